@@ -73,21 +73,23 @@ private:
 	append_int (int64_t elt, void *ud)
 	{
 		std::string *out = reinterpret_cast<std::string *>(ud);
-		auto nstr = std::to_string (elt);
+		char nbuf[UCL_NUMBER_BUF_SIZE];
+		auto len = ucl_itoa (elt, nbuf);
 
-		out->append (nstr);
+		out->append (nbuf, len);
 
-		return nstr.size ();
+		return len;
 	}
 	static int
 	append_double (double elt, void *ud)
 	{
 		std::string *out = reinterpret_cast<std::string *>(ud);
-		auto nstr = std::to_string (elt);
+		char nbuf[UCL_NUMBER_BUF_SIZE];
+		auto len = ucl_dtoa (elt, nbuf);
 
-		out->append (nstr);
+		out->append (nbuf, len);
 
-		return nstr.size ();
+		return len;
 	}
 
 	static struct ucl_emitter_functions default_emit_funcs()
@@ -137,6 +139,9 @@ private:
  		}
 
 		*replace = (unsigned char *)UCL_ALLOC (var_value.size ());
+		if (*replace == NULL) {
+			return false;
+		}
 		memcpy (*replace, var_value.data (), var_value.size ());
 
 		*replace_len = var_value.size ();
@@ -180,74 +185,221 @@ public:
 		void          *userdata;
 	};
 
-	class const_iterator {
+	class view_range;
+
+	// Non-owning view of an object, it is valid while the object is alive
+	class view {
 	private:
-		struct ucl_iter_deleter {
-			void operator() (ucl_object_iter_t it) {
-				ucl_object_iterate_free (it);
-			}
-		};
-		std::shared_ptr<void> it;
-		std::unique_ptr<Ucl> cur;
+		const ucl_object_t *obj;
 	public:
-		typedef std::forward_iterator_tag iterator_category;
+		view (const ucl_object_t *other = nullptr) noexcept : obj (other) {}
+
+		const ucl_object_t *get () const noexcept
+		{
+			return obj;
+		}
 
-		const_iterator(const Ucl &obj) {
-			it = std::shared_ptr<void>(ucl_object_iterate_new (obj.obj.get()),
-				ucl_iter_deleter());
-			cur.reset (new Ucl(ucl_object_iterate_safe (it.get(), true)));
-			if (!cur->obj) {
-				it.reset ();
-				cur.reset ();
+		ucl_type_t type () const
+		{
+			if (obj) {
+				return ucl_object_type (obj);
 			}
+			return UCL_NULL;
+		}
+
+		const char *key_data () const
+		{
+			return obj ? obj->key : nullptr;
+		}
+
+		size_t key_size () const
+		{
+			return obj ? obj->keylen : 0;
 		}
 
-		const_iterator() {}
-		const_iterator(const const_iterator &other) = delete;
-		const_iterator(const_iterator &&other) = default;
-		~const_iterator() {}
+		std::string key () const
+		{
+			std::string res;
+
+			if (obj && obj->key) {
+				res.assign (obj->key, obj->keylen);
+			}
 
-		const_iterator& operator=(const const_iterator &other) = delete;
-		const_iterator& operator=(const_iterator &&other) = default;
+			return res;
+		}
 
-		bool operator==(const const_iterator &other) const
+		double number_value (const double default_val = 0.0) const
 		{
-			if (cur && other.cur) {
-				return cur->obj.get() == other.cur->obj.get();
+			double res;
+
+			if (ucl_object_todouble_safe (obj, &res)) {
+				return res;
 			}
 
-			return !cur && !other.cur;
+			return default_val;
 		}
 
-		bool operator!=(const const_iterator &other) const
+		int64_t int_value (const int64_t default_val = 0) const
 		{
-			return !(*this == other);
+			int64_t res;
+
+			if (ucl_object_toint_safe (obj, &res)) {
+				return res;
+			}
+
+			return default_val;
 		}
 
-		const_iterator& operator++()
+		bool bool_value (const bool default_val = false) const
 		{
-			if (it) {
-				cur.reset (new Ucl(ucl_object_iterate_safe (it.get(), true)));
+			bool res;
+
+			if (ucl_object_toboolean_safe (obj, &res)) {
+				return res;
 			}
 
-			if (cur && !cur->obj) {
-				it.reset ();
-				cur.reset ();
+			return default_val;
+		}
+
+		const char *c_str (const char *default_val = nullptr) const
+		{
+			const char *res = nullptr;
+
+			if (ucl_object_tostring_safe (obj, &res)) {
+				return res;
+			}
+
+			return default_val;
+		}
+
+		std::string string_value (const std::string& default_val = "") const
+		{
+			const char *res = c_str ();
+
+			return res != nullptr ? std::string (res) : default_val;
+		}
+
+		size_t size () const
+		{
+			if (type () == UCL_ARRAY) {
+				return ucl_array_size (obj);
+			}
+
+			return 0;
+		}
+
+		view at (size_t i) const
+		{
+			if (type () == UCL_ARRAY) {
+				return view (ucl_array_find_index (obj, i));
+			}
+
+			return view ();
+		}
+
+		view lookup (const std::string &key) const
+		{
+			if (type () == UCL_OBJECT) {
+				return view (ucl_object_lookup_len (obj, key.data (),
+						key.size ()));
+			}
+
+			return view ();
+		}
+
+		inline view operator[] (size_t i) const
+		{
+			return at (i);
+		}
+
+		inline view operator[] (const std::string &key) const
+		{
+			return lookup (key);
+		}
+
+		// Get owning object that shares this one
+		Ucl ref () const
+		{
+			return Ucl (obj);
+		}
+
+		view_range views () const;
+
+		explicit operator bool () const
+		{
+			return obj != nullptr;
+		}
+	};
+
+	// Iterator that yields views and does not allocate memory
+	class view_iterator {
+	private:
+		struct ucl_object_stack_iter it;
+		view cur;
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef view value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const view* pointer;
+		typedef const view& reference;
+
+		view_iterator () noexcept : it (), cur () {}
+
+		explicit view_iterator (const ucl_object_t *obj) : it (), cur ()
+		{
+			if (obj) {
+				cur = view (ucl_object_iterate_safe (
+						ucl_object_iterate_init (&it, obj), true));
+			}
+		}
+
+		bool operator== (const view_iterator &other) const
+		{
+			return cur.get () == other.cur.get ();
+		}
+
+		bool operator!= (const view_iterator &other) const
+		{
+			return !(*this == other);
+		}
+
+		view_iterator& operator++ ()
+		{
+			if (cur) {
+				cur = view (ucl_object_iterate_safe (&it, true));
 			}
 
 			return *this;
 		}
 
-		const Ucl& operator*() const
+		const view& operator* () const
 		{
-			return *cur;
+			return cur;
 		}
-		const Ucl* operator->() const
+		const view* operator-> () const
 		{
-			return cur.get();
+			return &cur;
 		}
 	};
 
+	class view_range {
+	private:
+		const ucl_object_t *obj;
+	public:
+		explicit view_range (const ucl_object_t *other) noexcept : obj (other) {}
+
+		view_iterator begin () const
+		{
+			return view_iterator (obj);
+		}
+		view_iterator end () const
+		{
+			return view_iterator ();
+		}
+	};
+
+	class const_iterator;
+
 	struct variable_replacer {
 		virtual ~variable_replacer() {}
 
@@ -424,6 +576,37 @@ public:
 		return Ucl (nullptr);
 	}
 
+	// Lookup many keys at once, the result has the same order as keys
+	std::vector<Ucl> lookup_many (const std::vector<std::string> &keys) const
+	{
+		std::vector<Ucl> res;
+
+		res.reserve (keys.size ());
+
+		if (type () == UCL_OBJECT) {
+			std::vector<const char *> kptrs (keys.size ());
+			std::vector<size_t> klens (keys.size ());
+			std::vector<const ucl_object_t *> found (keys.size ());
+
+			for (size_t i = 0; i < keys.size (); i ++) {
+				kptrs[i] = keys[i].data ();
+				klens[i] = keys[i].size ();
+			}
+
+			ucl_object_lookup_many_len (obj.get (), kptrs.data (),
+					klens.data (), keys.size (), found.data ());
+
+			for (const auto *cur : found) {
+				res.emplace_back (Ucl (cur));
+			}
+		}
+		else {
+			res.resize (keys.size (), Ucl (nullptr));
+		}
+
+		return res;
+	}
+
 	inline Ucl operator[] (size_t i) const
 	{
 		return at(i);
@@ -718,22 +901,110 @@ public:
 		return true;
 	}
 
-	const_iterator begin() const
+	view as_view () const
 	{
-		return const_iterator(*this);
+		return view (obj.get ());
 	}
-	const_iterator cbegin() const
+
+	// Iterate over views of elements without allocations
+	view_range views () const
 	{
-		return const_iterator(*this);
+		return view_range (obj.get ());
+	}
+
+	const_iterator begin() const;
+	const_iterator cbegin() const;
+	const_iterator end() const;
+	const_iterator cend() const;
+};
+
+inline Ucl::view_range
+Ucl::view::views () const
+{
+	return view_range (obj);
+}
+
+// Defined out of line as it stores `Ucl` that is incomplete inside the class
+class Ucl::const_iterator {
+private:
+	struct ucl_object_stack_iter it;
+	Ucl cur;
+public:
+	typedef std::forward_iterator_tag iterator_category;
+
+	const_iterator(const Ucl &obj) : it (),
+			cur (static_cast<ucl_object_t *>(nullptr)) {
+		const ucl_object_t *next = ucl_object_iterate_safe (
+				ucl_object_iterate_init (&it, obj.obj.get()), true);
+
+		if (next) {
+			cur = Ucl (next);
+		}
 	}
-	const_iterator end() const
+
+	const_iterator() : it (), cur (static_cast<ucl_object_t *>(nullptr)) {}
+	const_iterator(const const_iterator &other) = delete;
+	const_iterator(const_iterator &&other) = default;
+	~const_iterator() {}
+
+	const_iterator& operator=(const const_iterator &other) = delete;
+	const_iterator& operator=(const_iterator &&other) = default;
+
+	bool operator==(const const_iterator &other) const
 	{
-		return const_iterator();
+		return cur.obj.get() == other.cur.obj.get();
 	}
-	const_iterator cend() const
+
+	bool operator!=(const const_iterator &other) const
 	{
-		return const_iterator();
+		return !(*this == other);
+	}
+
+	const_iterator& operator++()
+	{
+		const ucl_object_t *next = nullptr;
+
+		if (cur.obj) {
+			next = ucl_object_iterate_safe (&it, true);
+		}
+
+		cur = next ? Ucl (next) : Ucl (static_cast<ucl_object_t *>(nullptr));
+
+		return *this;
+	}
+
+	const Ucl& operator*() const
+	{
+		return cur;
+	}
+	const Ucl* operator->() const
+	{
+		return &cur;
 	}
 };
 
+inline Ucl::const_iterator
+Ucl::begin() const
+{
+	return const_iterator(*this);
+}
+
+inline Ucl::const_iterator
+Ucl::cbegin() const
+{
+	return const_iterator(*this);
+}
+
+inline Ucl::const_iterator
+Ucl::end() const
+{
+	return const_iterator();
+}
+
+inline Ucl::const_iterator
+Ucl::cend() const
+{
+	return const_iterator();
+}
+
 };
@@ -64,14 +64,18 @@ extern "C" {
 /*
  * Memory allocation utilities
  * UCL_ALLOC(size) - allocate memory for UCL
+ * UCL_REALLOC(ptr, size) - resize memory at ptr
  * UCL_FREE(size, ptr) - free memory of specified size at ptr
- * Default: malloc and free
+ * Default: allocator set by ucl_set_allocator (malloc and free by default)
  */
 #ifndef UCL_ALLOC
-#define UCL_ALLOC(size) malloc(size)
+#define UCL_ALLOC(size) ucl_malloc(size)
+#endif
+#ifndef UCL_REALLOC
+#define UCL_REALLOC(ptr, size) ucl_realloc((ptr), (size))
 #endif
 #ifndef UCL_FREE
-#define UCL_FREE(size, ptr) free(ptr)
+#define UCL_FREE(size, ptr) ucl_free_sized((ptr), (size))
 #endif
 
 #if    __GNUC__ > 3 || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4)
@@ -139,6 +143,8 @@ typedef enum ucl_emitter {
 	UCL_EMIT_CONFIG, /**< Emit human readable config format */
 	UCL_EMIT_YAML, /**< Emit embedded YAML format */
 	UCL_EMIT_MSGPACK, /**< Emit msgpack output */
+	UCL_EMIT_JSON_CANONICAL, /**< Emit canonical JSON similar to RFC 8785 */
+	UCL_EMIT_NDJSON, /**< Emit elements of a top array as compact JSON lines */
 	UCL_EMIT_MAX /**< Unsupported emitter type */
 } ucl_emitter_t;
 
@@ -156,7 +162,8 @@ typedef enum ucl_parser_flags {
 	UCL_PARSER_NO_IMPLICIT_ARRAYS = (1 << 3), /** Create explicit arrays instead of implicit ones */
 	UCL_PARSER_SAVE_COMMENTS = (1 << 4), /** Save comments in the parser context */
 	UCL_PARSER_DISABLE_MACRO = (1 << 5), /** Treat macros as comments */
-	UCL_PARSER_NO_FILEVARS = (1 << 6) /** Do not set file vars */
+	UCL_PARSER_NO_FILEVARS = (1 << 6), /** Do not set file vars */
+	UCL_PARSER_PACK_ARRAYS = (1 << 7) /** Pack homogeneous numeric arrays, see ucl_array_pack() */
 } ucl_parser_flags_t;
 
 /**
@@ -190,7 +197,9 @@ typedef enum ucl_object_flags {
 	UCL_OBJECT_MULTIVALUE = (1 << 5), /**< Object is a key with multiple values */
 	UCL_OBJECT_INHERITED = (1 << 6), /**< Object has been inherited from another */
 	UCL_OBJECT_BINARY = (1 << 7), /**< Object contains raw binary data */
-	UCL_OBJECT_SQUOTED = (1 << 8) /**< Object has been enclosed in single quotes */
+	UCL_OBJECT_SQUOTED = (1 << 8), /**< Object has been enclosed in single quotes */
+	UCL_OBJECT_FROZEN = (1 << 9), /**< Object belongs to an immutable (frozen) tree */
+	UCL_OBJECT_OWN_ALLOCATOR = (1 << 10) /**< Object remembers the thread allocator it has been created with */
 } ucl_object_flags_t;
 
 /**
@@ -247,6 +256,19 @@ typedef struct ucl_object_s {
 typedef void (*ucl_userdata_dtor)(void *ud);
 typedef const char* (*ucl_userdata_emitter)(void *ud);
 
+/**
+ * Memory allocator used for all libucl allocations
+ */
+struct ucl_allocator {
+	/** Allocate `size` bytes */
+	void* (*malloc_fn) (size_t size, void *ud);
+	/** Resize memory at `ptr` (may be NULL) to `size` bytes */
+	void* (*realloc_fn) (void *ptr, size_t size, void *ud);
+	/** Free memory at `ptr`, `size` is only a hint and is 0 if unknown */
+	void (*free_fn) (void *ptr, size_t size, void *ud);
+	void *ud; /**< Opaque data passed to all functions */
+};
+
 /** @} */
 
 /**
@@ -255,6 +277,60 @@ typedef const char* (*ucl_userdata_emitter)(void *ud);
  *
  * @{
  */
+/**
+ * Set the process wide allocator. It must be set before any libucl object is
+ * created, or after all of them are freed, as memory is always released with
+ * the allocator that is current at that time.
+ * @param allocator allocator to copy, NULL restores malloc and free
+ * @return false if some of allocator functions are missing
+ */
+UCL_EXTERN bool ucl_set_allocator (const struct ucl_allocator *allocator);
+
+/**
+ * Set allocator for the calling thread overriding the process wide one, e.g.
+ * to use per-thread or NUMA-local pools. Objects and containers created while
+ * it is current remember it, so they are modified and freed with it whatever
+ * allocator is current at that time, and trees may mix allocators. Other
+ * memory (parser state, emitted output) must be freed while the same
+ * allocator is current. On platforms without thread local storage this is
+ * the same as the process wide override.
+ * @param allocator allocator to use (must be alive while it is set and while
+ * objects created with it exist), NULL to fall back to the process wide
+ * allocator
+ * @return previous thread allocator (or NULL)
+ */
+UCL_EXTERN const struct ucl_allocator* ucl_set_thread_allocator (
+		const struct ucl_allocator *allocator);
+
+/**
+ * Allocate memory with the current allocator
+ * @param size number of bytes
+ * @return new memory or NULL
+ */
+UCL_EXTERN void* ucl_malloc (size_t size);
+
+/**
+ * Resize memory allocated with the current allocator
+ * @param ptr memory to resize (may be NULL)
+ * @param size new number of bytes
+ * @return resized memory or NULL
+ */
+UCL_EXTERN void* ucl_realloc (void *ptr, size_t size);
+
+/**
+ * Free memory allocated by libucl, such as buffers returned by
+ * `ucl_object_emit`, with the current allocator
+ * @param ptr memory to free (may be NULL)
+ */
+UCL_EXTERN void ucl_free (void *ptr);
+
+/**
+ * Free memory of a known size allocated with the current allocator
+ * @param ptr memory to free (may be NULL)
+ * @param size size hint passed to the allocator
+ */
+UCL_EXTERN void ucl_free_sized (void *ptr, size_t size);
+
 /**
  * Copy and return a key of an object, returned key is zero-terminated
  * @param obj CL object
@@ -569,6 +645,59 @@ UCL_EXTERN const ucl_object_t* ucl_array_find_index (const ucl_object_t *top,
 UCL_EXTERN unsigned int ucl_array_index_of (ucl_object_t *top,
 		ucl_object_t *elt);
 
+/**
+ * Enable or disable element-to-index map for the array `top`. When enabled,
+ * `ucl_array_delete` and `ucl_array_index_of` work in O(1) instead of a
+ * linear scan at the cost of a hash lookup on each array modification.
+ * The map is silently dropped if the same object is inserted into the array
+ * twice, and it is not preserved by `ucl_object_copy`.
+ * @param top array object (must be of type UCL_ARRAY and not frozen)
+ * @param enable true to build the map, false to drop it
+ * @return false if `top` is not a mutable array or it contains duplicate elements
+ */
+UCL_EXTERN bool ucl_array_enable_index (ucl_object_t *top, bool enable);
+
+/**
+ * Convert array `top` to a packed representation if all its elements are
+ * integers or all of them are floats: values are stored in a flat buffer
+ * instead of an object per element. Elements of packed arrays returned by
+ * `ucl_array_find_index`, `ucl_array_head`, `ucl_array_tail` and iterators
+ * are ephemeral views stored in a small ring of the calling thread, so reading
+ * a packed array never allocates memory: a view is valid until the array is
+ * modified or freed and until 32 more elements of packed arrays are read by
+ * the same thread. `ucl_object_ref` returns a copy of a view that can be
+ * kept. Any modification of a packed array converts it back to the object
+ * storage.
+ * @param top array object (must be of type UCL_ARRAY and not frozen)
+ * @return true if `top` is packed now
+ */
+UCL_EXTERN bool ucl_array_pack (ucl_object_t *top);
+
+/**
+ * Convert packed array `top` back to the object storage
+ * @param top array object (must be of type UCL_ARRAY and not frozen)
+ * @return true if `top` is not packed now
+ */
+UCL_EXTERN bool ucl_array_unpack (ucl_object_t *top);
+
+/**
+ * Return values of an integer packed array
+ * @param top array object
+ * @param len if not NULL, the number of values is stored here
+ * @return values buffer or NULL if `top` is not an integer packed array
+ */
+UCL_EXTERN const int64_t* ucl_array_packed_int (const ucl_object_t *top,
+		size_t *len);
+
+/**
+ * Return values of a float packed array
+ * @param top array object
+ * @param len if not NULL, the number of values is stored here
+ * @return values buffer or NULL if `top` is not a float packed array
+ */
+UCL_EXTERN const double* ucl_array_packed_float (const ucl_object_t *top,
+		size_t *len);
+
 /**
  * Replace an element in an array with a different element, returning the object
  * that was replaced. This object is not released, caller must unref the
@@ -652,7 +781,10 @@ UCL_EXTERN bool ucl_object_tostring_safe (const ucl_object_t *obj, const char **
 UCL_EXTERN const char* ucl_object_tostring (const ucl_object_t *obj);
 
 /**
- * Convert any object to a string in JSON notation if needed
+ * Convert any object to a string in JSON notation if needed. The string is
+ * owned by the object, except for elements of packed arrays (see
+ * `ucl_array_pack`): their string is valid until the next call in the same
+ * thread
  * @param obj CL object
  * @return string value
  */
@@ -711,6 +843,34 @@ UCL_EXTERN const ucl_object_t* ucl_object_lookup_len (const ucl_object_t *obj,
 		const char *key, size_t klen);
 #define ucl_object_find_keyl ucl_object_lookup_len
 
+/**
+ * Return objects identified by many keys in the specified object. This
+ * function is faster than calling `ucl_object_lookup` for each key, as hash
+ * probes for different keys are interleaved.
+ * @param obj object to get keys from (must be of type UCL_OBJECT)
+ * @param keys array of NULL terminated keys to search
+ * @param n number of keys
+ * @param out array of `n` elements that receives objects matching the
+ * corresponding keys or NULL for keys that were not found
+ * @return number of keys found
+ */
+UCL_EXTERN size_t ucl_object_lookup_many (const ucl_object_t *obj,
+		const char **keys, size_t n, const ucl_object_t **out);
+
+/**
+ * Return objects identified by many fixed size keys in the specified object
+ * @param obj object to get keys from (must be of type UCL_OBJECT)
+ * @param keys array of keys to search
+ * @param klens array of lengths of keys
+ * @param n number of keys
+ * @param out array of `n` elements that receives objects matching the
+ * corresponding keys or NULL for keys that were not found
+ * @return number of keys found
+ */
+UCL_EXTERN size_t ucl_object_lookup_many_len (const ucl_object_t *obj,
+		const char **keys, const size_t *klens, size_t n,
+		const ucl_object_t **out);
+
 /**
  * Return object identified by dot notation string
  * @param obj object to search in
@@ -732,6 +892,56 @@ UCL_EXTERN const ucl_object_t *ucl_object_lookup_path_char (const ucl_object_t *
 		const char *path, char sep);
 #define ucl_lookup_path_char ucl_object_lookup_path_char
 
+/**
+ * Opaque precompiled lookup path
+ */
+struct ucl_path;
+
+/**
+ * Flags for compiled paths
+ */
+enum ucl_path_flags {
+	UCL_PATH_DEFAULT = 0,
+	UCL_PATH_CACHE = (1 << 0) /**< Cache the last result for frozen trees */
+};
+
+/**
+ * Compile dot notation path for repeated lookups via `ucl_path_lookup`. The
+ * path is split to segments and hashes of all keys are calculated in advance.
+ * @param path dot.notation.path to compile. May use numeric .index on arrays
+ * @return new compiled path or NULL in case of error
+ */
+UCL_EXTERN struct ucl_path* ucl_path_compile (const char *path);
+
+/**
+ * Compile path using arbitrary delimiter and flags
+ * @param path path to compile
+ * @param sep the separator to use in place of .
+ * @param flags a combination of `ucl_path_flags`. If `UCL_PATH_CACHE` is set,
+ * then the last resolved object is remembered and returned without traversal
+ * while the same frozen tree is looked up, until that tree or a part of it is
+ * thawed; such a path must not be shared between threads
+ * @return new compiled path or NULL in case of error
+ */
+UCL_EXTERN struct ucl_path* ucl_path_compile_full (const char *path,
+		char sep, int flags);
+
+/**
+ * Return object identified by a compiled path. The result is the same as for
+ * `ucl_object_lookup_path_char` called with the source path.
+ * @param top object to search in
+ * @param path compiled path
+ * @return object matched the specified path or NULL if path is not found
+ */
+UCL_EXTERN const ucl_object_t* ucl_path_lookup (const ucl_object_t *top,
+		struct ucl_path *path);
+
+/**
+ * Free compiled path
+ * @param path path to free
+ */
+UCL_EXTERN void ucl_path_free (struct ucl_path *path);
+
 /**
  * Returns a key of an object as a NULL terminated string
  * @param obj CL object
@@ -766,6 +976,112 @@ UCL_DEPRECATED(UCL_EXTERN void ucl_object_free (ucl_object_t *obj));
  */
 UCL_EXTERN void ucl_object_unref (ucl_object_t *obj);
 
+/**
+ * Decrease reference count for an object, but if it drops to zero, do not
+ * free the tree and queue it for `ucl_object_reclaim` instead. This moves
+ * teardown of large trees out of latency sensitive code, e.g. a thread that
+ * swaps configurations under a lock.
+ * @param obj object to unref
+ */
+UCL_EXTERN void ucl_object_unref_deferred (ucl_object_t *obj);
+
+/**
+ * Free all trees queued by `ucl_object_unref_deferred`, typically from a
+ * background reclaimer thread. Objects are released with the allocators they
+ * have been created with.
+ * @return number of trees freed
+ */
+UCL_EXTERN unsigned int ucl_object_reclaim (void);
+
+/**
+ * Mark the whole tree starting from `top` as immutable. A frozen tree can be
+ * shared between threads without synchronisation: `ucl_object_ref` and
+ * `ucl_object_unref` become no-ops for its nodes (so no atomic operations are
+ * performed on read paths) and all mutating functions refuse to modify it.
+ * Its nodes cannot be inserted into other containers either, since that would
+ * relink them, so insert a copy made by `ucl_object_copy` instead.
+ * Reference counts are kept intact while frozen and resume from their previous
+ * values once the tree is thawed, so references obtained from a frozen tree
+ * must not be released after `ucl_object_thaw`. A frozen subtree of a mutable
+ * container is still owned by that container: it is released together with
+ * the container, so readers must not outlive it. Null terminated keys and
+ * values returned by `ucl_object_tostring_forced` are published atomically
+ * on first use, so concurrent readers never observe partial copies.
+ * @param top the root of a tree to freeze
+ * @return `top` or NULL if `top` is NULL
+ */
+UCL_EXTERN const ucl_object_t* ucl_object_freeze (ucl_object_t *top);
+
+/**
+ * Make a tree previously frozen by `ucl_object_freeze` mutable again. The
+ * caller must ensure that no other thread uses the tree at this point.
+ * @param top the root of a frozen tree
+ * @return `top` or NULL if `top` is NULL
+ */
+UCL_EXTERN ucl_object_t* ucl_object_thaw (const ucl_object_t *top);
+
+/**
+ * Check whether an object belongs to a frozen tree
+ * @param obj object to check
+ * @return true if `obj` is frozen
+ */
+UCL_EXTERN bool ucl_object_is_frozen (const ucl_object_t *obj);
+
+/**
+ * Structural fingerprint of an object
+ */
+struct ucl_fingerprint {
+	uint64_t h1;
+	uint64_t h2;
+};
+
+/**
+ * Get 128 bit structural fingerprint of an object. Equal objects have equal
+ * fingerprints regardless of keys order. Fingerprints of containers are
+ * cached and invalidated on modification made via UCL API, so repeated calls
+ * only validate nested containers, and for frozen trees they are O(1).
+ * Direct modification of object fields and appending values to an implicit
+ * array via `ucl_elt_append` after it has been inserted are not tracked.
+ * The cache is stored in the objects themselves, so concurrent calls on the
+ * same non-frozen tree are not thread safe; frozen trees can be
+ * fingerprinted concurrently.
+ * @param obj object
+ * @param fp output fingerprint
+ * @return true if fingerprint has been computed
+ */
+UCL_EXTERN bool ucl_object_fingerprint (const ucl_object_t *obj,
+		struct ucl_fingerprint *fp);
+
+/**
+ * Memory used by an object tree, in bytes requested from the allocator
+ */
+struct ucl_memory_stats {
+	size_t total; /**< Sum of all categories below */
+	size_t nodes; /**< Object nodes */
+	size_t keys; /**< Copied keys */
+	size_t strings; /**< Copied string values */
+	size_t hashes; /**< Hash tables of objects */
+	size_t elts; /**< Ordered element lists of objects */
+	size_t arrays; /**< Array storage (including packed values) */
+	size_t shared_bytes; /**< Part of `total` in shared subtrees */
+	unsigned int objects; /**< Number of nodes */
+	unsigned int shared; /**< Number of subtrees also referenced elsewhere */
+	unsigned int exclusive; /**< Number of exclusively owned containers */
+};
+
+/**
+ * Account memory used by an object and all its children. Nodes reachable
+ * by several paths are counted once; a node with extra references starts a
+ * shared subtree that is not freed together with `obj`, which makes it
+ * possible to tell exclusively owned memory (`total - shared_bytes`) from
+ * memory kept alive by other owners.
+ * @param obj object to account
+ * @param stats output statistics
+ * @return true if memory usage has been computed
+ */
+UCL_EXTERN bool ucl_object_memory_usage (const ucl_object_t *obj,
+		struct ucl_memory_stats *stats);
+
 /**
  * Compare objects `o1` and `o2`
  * @param o1 the first object
@@ -775,6 +1091,8 @@ UCL_EXTERN void ucl_object_unref (ucl_object_t *obj);
  * 1) Type of objects
  * 2) Size of objects
  * 3) Content of objects
+ * Numbers are compared exactly and values of implicit arrays are compared
+ * one by one, frozen and mutable objects are ordered in the same way
  */
 UCL_EXTERN int ucl_object_compare (const ucl_object_t *o1,
 		const ucl_object_t *o2);
@@ -800,6 +1118,33 @@ UCL_EXTERN int ucl_object_compare_qsort (const ucl_object_t **o1,
 UCL_EXTERN void ucl_object_array_sort (ucl_object_t *ar,
 		int (*cmp)(const ucl_object_t **o1, const ucl_object_t **o2));
 
+/**
+ * Compute structural difference between two objects as a JSON patch
+ * (RFC 6902) array. Unchanged subtrees are skipped without traversing them
+ * twice, arrays are compared after stripping common prefix and suffix and
+ * implicit arrays are replaced as a whole.
+ * @param o old object
+ * @param n new object
+ * @return array of patch operations (empty if objects are equal), must be
+ * unref'ed by a caller
+ */
+UCL_EXTERN ucl_object_t* ucl_object_diff (const ucl_object_t *o,
+		const ucl_object_t *n);
+
+/**
+ * Apply JSON patch (RFC 6902) to an object. Operations `add`, `remove`,
+ * `replace`, `move`, `copy` and `test` are supported. The top object (path
+ * "") is replaced in place, so `top` stays valid, unless it is frozen, an
+ * implicit array or userdata; it cannot be removed. `test` requires equal
+ * values, numbers are compared by value regardless of their type, so `1` is
+ * equal to `1.0` but not to `1.5`. Patch is not atomic: if some operation
+ * fails, the preceding operations remain applied.
+ * @param top object to modify
+ * @param patch array of patch operations
+ * @return true if all operations have been applied
+ */
+UCL_EXTERN bool ucl_object_patch (ucl_object_t *top, const ucl_object_t *patch);
+
 enum ucl_object_keys_sort_flags {
 	UCL_SORT_KEYS_DEFAULT = 0,
 	UCL_SORT_KEYS_ICASE = (1u << 0u),
@@ -855,6 +1200,28 @@ UCL_EXTERN const ucl_object_t* ucl_object_iterate_with_error (const ucl_object_t
  */
 UCL_EXTERN ucl_object_iter_t ucl_object_iterate_new (const ucl_object_t *obj)
 	UCL_WARN_UNUSED_RESULT;
+/**
+ * Storage for a safe iterator that can be placed on stack, its fields are
+ * private
+ */
+struct ucl_object_stack_iter {
+	char magic[4];
+	uint32_t flags;
+	const ucl_object_t *impl_it;
+	ucl_object_iter_t expl_it;
+};
+
+/**
+ * Initialize safe iterator in the caller provided storage, so iteration does
+ * not allocate memory. The result can be used with the safe iterators API
+ * and must not be passed to `ucl_object_iterate_free`.
+ * @param it iterator storage
+ * @param obj object to iterate
+ * @return iterator object pointing to `it`
+ */
+UCL_EXTERN ucl_object_iter_t ucl_object_iterate_init (
+		struct ucl_object_stack_iter *it, const ucl_object_t *obj);
+
 /**
  * Check safe iterator object after performing some operations on it
  * (such as ucl_object_iterate_safe()) to see if operation has encountered
@@ -954,6 +1321,18 @@ struct ucl_parser;
  */
 UCL_EXTERN struct ucl_parser* ucl_parser_new (int flags);
 
+/**
+ * Creates new parser object that allocates its own state and all objects
+ * it creates with `allocator`. Parsed objects remember the allocator, so they
+ * can be freed with any allocator current, see `ucl_set_thread_allocator`.
+ * @param flags parser flags
+ * @param allocator allocator to use (must be alive while the parser and
+ * objects created by it exist), NULL means the current one
+ * @return new parser object
+ */
+UCL_EXTERN struct ucl_parser* ucl_parser_new_full (int flags,
+		const struct ucl_allocator *allocator);
+
 /**
  * Sets the default priority for the parser applied to chunks that do not
  * specify priority explicitly
@@ -1002,7 +1381,7 @@ UCL_EXTERN bool ucl_parser_register_context_macro (struct ucl_parser *parser,
  * @param len length of variable
  * @param replace (out) replace value for variable
  * @param replace_len (out) replace length for variable
- * @param need_free (out) UCL will free `dest` after usage
+ * @param need_free (out) UCL will free `dest` with `ucl_free` after usage
  * @param ud opaque userdata
  * @return true if variable
  */
@@ -1328,6 +1707,13 @@ typedef bool (*ucl_parser_special_handler_t) (struct ucl_parser *parser,
 enum ucl_special_handler_flags {
 	UCL_SPECIAL_HANDLER_DEFAULT = 0,
 	UCL_SPECIAL_HANDLER_PREPROCESS_ALL = (1u << 0),
+	/**
+	 * Output of the handler is released as soon as its chunk is parsed unless
+	 * parser works in zero-copy mode (parsed objects never reference it then).
+	 * It only affects what is retained after parsing, the whole output still
+	 * exists while the chunk is parsed
+	 */
+	UCL_SPECIAL_HANDLER_RELEASE_PARSED = (1u << 1),
 };
 
 /**
@@ -1351,6 +1737,31 @@ struct ucl_parser_special_handler {
 UCL_EXTERN void ucl_parser_add_special_handler (struct ucl_parser *parser,
 		struct ucl_parser_special_handler *handler);
 
+/**
+ * Add special handlers that decompress chunks compressed by the supported
+ * codecs (see `ucl_object_emit_compressed_funcs`), chunks are recognized by
+ * the magic of their format. Msgpack chunks added with #UCL_PARSE_MSGPACK or
+ * #UCL_PARSE_AUTO are decompressed by windows as they are parsed; other chunks,
+ * chunks processed by further special handlers and all chunks of
+ * #UCL_PARSER_ZEROCOPY parsers are fully decompressed before parsing.
+ * Decompressed data is released once the chunk is parsed unless
+ * #UCL_PARSER_ZEROCOPY is used. Handlers are owned by the parser
+ * @param parser parser structure
+ * @return false if no codec is supported
+ */
+UCL_EXTERN bool ucl_parser_add_decompress_handlers (struct ucl_parser *parser);
+
+/**
+ * Limit the size of data produced by decompression handlers for a single
+ * chunk, larger chunks are rejected with a parser error. The default limit
+ * is 256 MiB
+ * @param parser parser structure
+ * @param limit maximum decompressed size in bytes, 0 restores the default
+ * @return true if the limit was set
+ */
+UCL_EXTERN bool ucl_parser_set_decompress_limit (struct ucl_parser *parser,
+		size_t limit);
+
 /**
  * Handler for include traces:
  * @param parser parser object
@@ -1447,7 +1858,7 @@ struct ucl_emitter_context {
  * @param obj object
  * @param emit_type if type is #UCL_EMIT_JSON then emit json, if type is
  * #UCL_EMIT_CONFIG then emit config like object
- * @return dump of an object (must be freed after using) or NULL in case of error
+ * @return dump of an object (must be freed with `ucl_free` after using) or NULL in case of error
  */
 UCL_EXTERN unsigned char *ucl_object_emit (const ucl_object_t *obj,
 		enum ucl_emitter emit_type);
@@ -1458,11 +1869,37 @@ UCL_EXTERN unsigned char *ucl_object_emit (const ucl_object_t *obj,
  * @param emit_type if type is #UCL_EMIT_JSON then emit json, if type is
  * #UCL_EMIT_CONFIG then emit config like object
  * @param len the resulting length
- * @return dump of an object (must be freed after using) or NULL in case of error
+ * @return dump of an object (must be freed with `ucl_free` after using) or NULL in case of error
  */
 UCL_EXTERN unsigned char *ucl_object_emit_len (const ucl_object_t *obj,
 		enum ucl_emitter emit_type, size_t *len);
 
+/**
+ * Calculate the exact length of an object's output without emitting it
+ * @param obj object
+ * @param emit_type emitter type
+ * @return length of the output not including the trailing zero or 0 in
+ * case of error
+ */
+UCL_EXTERN size_t ucl_object_emit_size (const ucl_object_t *obj,
+		enum ucl_emitter emit_type);
+
+/**
+ * Emit object to a caller provided buffer. The output is zero terminated
+ * when it fits
+ * @param obj object
+ * @param emit_type emitter type
+ * @param buf target buffer
+ * @param cap size of the buffer
+ * @param outlen length of the output not including the trailing zero, set
+ * even if the buffer is too small, so the buffer of `*outlen + 1` bytes is
+ * enough for the output
+ * @return true if the whole output has been written into the buffer
+ */
+UCL_EXTERN bool ucl_object_emit_into (const ucl_object_t *obj,
+		enum ucl_emitter emit_type, unsigned char *buf, size_t cap,
+		size_t *outlen);
+
 /**
  * Emit object to a string
  * @param obj object
@@ -1470,7 +1907,10 @@ UCL_EXTERN unsigned char *ucl_object_emit_len (const ucl_object_t *obj,
  * #UCL_EMIT_CONFIG then emit config like object
  * @param emitter a set of emitter functions
  * @param comments optional comments for the parser
- * @return dump of an object (must be freed after using) or NULL in case of error
+ * @return true if an object has been emitted and buffered output (if any)
+ * has been written successfully. Output is flushed by
+ * `ucl_object_emit_funcs_flush`, so the caller's `FILE` of
+ * `ucl_object_emit_file_funcs` is `fflush`ed as well
  */
 UCL_EXTERN bool ucl_object_emit_full (const ucl_object_t *obj,
 		enum ucl_emitter emit_type,
@@ -1478,7 +1918,60 @@ UCL_EXTERN bool ucl_object_emit_full (const ucl_object_t *obj,
 		const ucl_object_t *comments);
 
 /**
- * Start streamlined UCL object emitter
+ * Emit object using several threads. Arrays and objects with many elements
+ * are split into ranges of elements that are serialised to separate buffers
+ * concurrently and then written in order, so the output is the same as
+ * for `ucl_object_emit_full`. Only JSON, compact JSON and msgpack are
+ * emitted in parallel, other types are emitted by `ucl_object_emit_full`
+ * @param obj object
+ * @param emit_type type of emitter
+ * @param emitter emitter functions, they are called from the calling thread only;
+ * emitters of userdata objects are called from the calling thread only too, so
+ * ranges of elements containing userdata are not emitted by other threads
+ * @param nthreads number of threads, 0 to use all online processors; fewer
+ * threads are used for containers that are too small to split that much
+ * @return true if an object has been emitted and buffered output (if any)
+ * has been written successfully
+ */
+UCL_EXTERN bool ucl_object_emit_parallel (const ucl_object_t *obj,
+		enum ucl_emitter emit_type,
+		struct ucl_emitter_functions *emitter,
+		unsigned int nthreads);
+
+/**
+ * Emit object reusing output cached by previous calls. Output of large
+ * containers (arrays and objects) is stored in the containers, and it is
+ * reused by further calls with the same emitter type until a container in
+ * the subtree is modified, so after a small change only containers on the
+ * path to the modified one are emitted again. Cached output is freed with
+ * containers or by `ucl_object_emit_cache_clear`.
+ *
+ * Changes of scalar values made in place (rather than by replacing objects
+ * in containers) are not tracked. Cached emitting updates the emitted tree,
+ * so it must not be called concurrently for the same tree or together with
+ * its modification. Frozen containers are never cached, so they can still
+ * be shared between threads, and they are emitted as usual
+ * @param obj object
+ * @param emit_type type of emitter
+ * @param emitter emitter functions
+ * @param min_size minimum size of output to cache, 0 for the default
+ * @return true if an object has been emitted and buffered output (if any)
+ * has been written successfully
+ */
+UCL_EXTERN bool ucl_object_emit_cached (const ucl_object_t *obj,
+		enum ucl_emitter emit_type,
+		struct ucl_emitter_functions *emitter,
+		size_t min_size);
+
+/**
+ * Free output cached by `ucl_object_emit_cached` for a tree
+ * @param obj top of the tree
+ */
+UCL_EXTERN void ucl_object_emit_cache_clear (const ucl_object_t *obj);
+
+/**
+ * Start streamlined UCL object emitter. Keys are written in the order they
+ * are added, so #UCL_EMIT_JSON_CANONICAL is not supported
  * @param obj top UCL object
  * @param emit_type emit type
  * @param emitter a set of emitter functions
@@ -1516,23 +2009,154 @@ UCL_EXTERN void ucl_object_emit_streamline_end_container (
 UCL_EXTERN void ucl_object_emit_streamline_finish (
 		struct ucl_emitter_context *ctx);
 
+/**
+ * State of buffered streamlined output
+ */
+enum ucl_emitter_stream_status {
+	UCL_EMIT_STREAM_OK = 0, /**< output is flushed up to the high-water mark */
+	UCL_EMIT_STREAM_AGAIN, /**< flush callback would block, call `ucl_object_emit_streamline_flush` when it can write */
+	UCL_EMIT_STREAM_ERROR /**< flush callback has failed or buffer cannot grow, further output is discarded */
+};
+
+/**
+ * Flush callback of buffered streamlined output
+ * @param data buffered output
+ * @param len length of buffered output
+ * @param written should be set to the number of bytes written, writing
+ * less than `len` bytes means that the output would block
+ * @param ud opaque user data
+ * @return false in case of error
+ */
+typedef bool (*ucl_emitter_flush_func) (const unsigned char *data, size_t len,
+		size_t *written, void *ud);
+
+/**
+ * Start streamlined UCL object emitter that buffers output and passes it
+ * to `flush` once the buffer reaches `hwm` bytes. If `flush` writes less
+ * than it is given, the emitter keeps the rest and stops flushing until
+ * `ucl_object_emit_streamline_flush` is called, so nonblocking producers
+ * should check `ucl_object_emit_streamline_status` after adding objects.
+ * Msgpack containers are written with 32 bit headers that are patched when
+ * containers are finished, output after the header of an unfinished
+ * container is buffered unless its elements count is declared with
+ * `ucl_object_emit_streamline_set_count`. #UCL_EMIT_JSON_CANONICAL is not
+ * supported.
+ * @param obj top UCL object
+ * @param emit_type emit type
+ * @param flush flush callback
+ * @param ud opaque data for `flush`
+ * @param hwm high-water mark, 0 for the default (64 KiB)
+ * @return new streamlined context that should be freed by
+ * `ucl_object_emit_streamline_finish`
+ */
+UCL_EXTERN struct ucl_emitter_context* ucl_object_emit_streamline_buffered_new (
+		const ucl_object_t *obj, enum ucl_emitter emit_type,
+		ucl_emitter_flush_func flush, void *ud, size_t hwm);
+
+/**
+ * Declare the number of elements of the innermost started container,
+ * including elements of the container object itself that are emitted when
+ * it is started. Msgpack header of the container is written at once, so
+ * buffered output can be flushed before the container is finished; ending
+ * it with a different number of elements sets UCL_EMIT_STREAM_ERROR.
+ * Other formats do not need the count
+ * @param ctx streamlined context
+ * @param count number of elements
+ * @return false if there is no started container, the count is less than
+ * the number of elements already emitted or it has been declared before
+ */
+UCL_EXTERN bool ucl_object_emit_streamline_set_count (
+		struct ucl_emitter_context *ctx, size_t count);
+
+/**
+ * Get state of streamlined output after the last automatic flush
+ * @param ctx streamlined context
+ * @return state of output
+ */
+UCL_EXTERN enum ucl_emitter_stream_status ucl_object_emit_streamline_status (
+		struct ucl_emitter_context *ctx);
+
+/**
+ * Flush all buffered output of finished containers
+ * @param ctx streamlined context
+ * @return UCL_EMIT_STREAM_OK if everything is flushed
+ */
+UCL_EXTERN enum ucl_emitter_stream_status ucl_object_emit_streamline_flush (
+		struct ucl_emitter_context *ctx);
+
+/**
+ * Finish all containers and flush output without freeing the context,
+ * nonblocking producers should repeat `ucl_object_emit_streamline_flush`
+ * until it returns UCL_EMIT_STREAM_OK and then call
+ * `ucl_object_emit_streamline_finish`
+ * @param ctx streamlined context
+ * @return state of output
+ */
+UCL_EXTERN enum ucl_emitter_stream_status ucl_object_emit_streamline_close (
+		struct ucl_emitter_context *ctx);
+
+/**
+ * Opaque context of resumable emitting
+ */
+struct ucl_emitter_resumable;
+
+/**
+ * Start resumable emitting of UCL object. Output is produced into caller
+ * provided buffers by `ucl_object_emit_resumable`, that returns once
+ * a buffer is full and continues from the same position when it is called
+ * again. Output is the same as of `ucl_object_emit_full`. Objects must not
+ * be modified until the context is freed
+ * @param obj object to emit
+ * @param emit_type emit type
+ * @param comments optional comments for the config type
+ * @return new context that should be freed by `ucl_object_emit_resumable_free`
+ */
+UCL_EXTERN struct ucl_emitter_resumable* ucl_object_emit_resumable_new (
+		const ucl_object_t *obj, enum ucl_emitter emit_type,
+		const ucl_object_t *comments);
+
+/**
+ * Emit the next part of output. Memory is allocated only when an element
+ * or a nesting level is larger than any seen before
+ * @param rctx resumable context
+ * @param buf output buffer
+ * @param size size of `buf`
+ * @param written set to the number of bytes written to `buf`
+ * @return UCL_EMIT_STREAM_AGAIN if `buf` is full and there is more output,
+ * UCL_EMIT_STREAM_OK if output is finished and UCL_EMIT_STREAM_ERROR if
+ * memory cannot be allocated
+ */
+UCL_EXTERN enum ucl_emitter_stream_status ucl_object_emit_resumable (
+		struct ucl_emitter_resumable *rctx, unsigned char *buf, size_t size,
+		size_t *written);
+
+/**
+ * Free resumable context, output may be left unfinished
+ * @param rctx resumable context
+ */
+UCL_EXTERN void ucl_object_emit_resumable_free (
+		struct ucl_emitter_resumable *rctx);
+
 /**
  * Returns functions to emit object to memory
- * @param pmem target pointer (should be freed by caller)
+ * @param pmem target pointer (should be freed by caller with `ucl_free`)
  * @return emitter functions structure
  */
 UCL_EXTERN struct ucl_emitter_functions* ucl_object_emit_memory_funcs (
 		void **pmem);
 
 /**
- * Returns functions to emit object to FILE *
+ * Returns functions to emit object to FILE *. The file is not closed when
+ * functions are freed, but it is flushed by `ucl_object_emit_full`
  * @param fp FILE * object
  * @return emitter functions structure
  */
 UCL_EXTERN struct ucl_emitter_functions* ucl_object_emit_file_funcs (
 		FILE *fp);
 /**
- * Returns functions to emit object to a file descriptor
+ * Returns functions to emit object to a file descriptor. Output is buffered
+ * and written when the buffer is full, when the object has been emitted by
+ * `ucl_object_emit_full` or when functions are flushed or freed
  * @param fd file descriptor
  * @return emitter functions structure
  */
@@ -1540,11 +2164,228 @@ UCL_EXTERN struct ucl_emitter_functions* ucl_object_emit_fd_funcs (
 		int fd);
 
 /**
- * Free emitter functions
+ * Returns functions to emit object to a file descriptor using an output
+ * buffer of the specified size. Strings longer than half of the buffer are
+ * written directly together with the buffered data
+ * @param fd file descriptor
+ * @param bufsize size of the output buffer, 0 for the default size
+ * @return emitter functions structure
+ */
+UCL_EXTERN struct ucl_emitter_functions* ucl_object_emit_fd_funcs_full (
+		int fd, size_t bufsize);
+
+/**
+ * Compression codecs of compressed output
+ */
+enum ucl_compression {
+	UCL_COMPRESSION_GZIP = 0, /**< gzip format, requires zlib */
+	UCL_COMPRESSION_ZSTD, /**< zstd format, requires libzstd */
+	UCL_COMPRESSION_XZ /**< xz format, requires liblzma */
+};
+
+/**
+ * Returns functions to emit object to a file descriptor compressing output
+ * as it is produced. `ucl_object_emit_funcs_flush` writes everything emitted
+ * so far in a decompressible form, `ucl_object_emit_funcs_free` finishes
+ * the compressed stream
+ * @param fd file descriptor
+ * @param codec compression codec
+ * @param level compression level of the codec, 0 for its default
+ * @return emitter functions structure or NULL if the codec is not supported
+ */
+UCL_EXTERN struct ucl_emitter_functions* ucl_object_emit_compressed_funcs (
+		int fd, enum ucl_compression codec, int level);
+
+/**
+ * Write any output buffered by emitter functions: the buffers of fd,
+ * compressed and digest functions are written and the `FILE` of
+ * `ucl_object_emit_file_funcs` is flushed with `fflush`. Functions that are
+ * not created by libucl have nothing to flush
+ * @param f pointer to functions
+ * @return false if some output has not been written, `errno` is set to
+ * the first write error in this case
+ */
+UCL_EXTERN bool ucl_object_emit_funcs_flush (struct ucl_emitter_functions *f);
+
+/**
+ * Digest update callback, called with consecutive pieces of output
+ * @param data output data
+ * @param len length of data
+ * @param ud opaque userdata
+ */
+typedef void (*ucl_emitter_digest_update) (const unsigned char *data,
+		size_t len, void *ud);
+
+/**
+ * Returns functions that pass output to a digest (or any other consumer)
+ * in large pieces without keeping the whole output. Combined with
+ * #UCL_EMIT_JSON_CANONICAL this allows to hash objects by their content.
+ * Buffered output is passed to `update` when the object has been emitted by
+ * `ucl_object_emit_full` or when functions are flushed or freed
+ * @param update callback for output data
+ * @param ud userdata for `update`
+ * @return emitter functions structure
+ */
+UCL_EXTERN struct ucl_emitter_functions* ucl_object_emit_digest_funcs (
+		ucl_emitter_digest_update update, void *ud);
+
+struct iovec;
+
+/**
+ * Returns functions to emit object to a list of I/O vectors. Structural
+ * output is copied to internal chunks, while string values and keys of at
+ * least `min_ref` bytes that need no escaping are referenced in place, so
+ * the emitted object must not be modified or freed while the vectors are
+ * in use. Vectors are available after emitting via
+ * `ucl_object_emit_funcs_iovec` and stay valid until the functions are freed
+ * @param min_ref minimum length of a referenced string, 0 for the default
+ * @return emitter functions structure
+ */
+UCL_EXTERN struct ucl_emitter_functions* ucl_object_emit_iovec_funcs (
+		size_t min_ref);
+
+/**
+ * Get I/O vectors produced by functions from `ucl_object_emit_iovec_funcs`,
+ * the result is suitable for `writev` or `sendmsg` (mind `IOV_MAX`)
+ * @param f emitter functions
+ * @param cnt number of vectors is stored here if not NULL
+ * @param total total length of output is stored here if not NULL
+ * @return array of vectors or NULL if output is empty, functions are
+ * not iovec ones or memory allocation has failed
+ */
+UCL_EXTERN const struct iovec* ucl_object_emit_funcs_iovec (
+		const struct ucl_emitter_functions *f, size_t *cnt, size_t *total);
+
+/**
+ * Write output of functions from `ucl_object_emit_iovec_funcs` to a file
+ * descriptor, `writev` is called as few times as possible and partial
+ * writes are resumed
+ * @param f emitter functions
+ * @param fd file descriptor
+ * @return false if output has not been written, `errno` is set in this case
+ */
+UCL_EXTERN bool ucl_object_emit_funcs_writev (
+		const struct ucl_emitter_functions *f, int fd);
+
+/**
+ * Free emitter functions, buffered output is written before freeing
  * @param f pointer to functions
  */
 UCL_EXTERN void ucl_object_emit_funcs_free (struct ucl_emitter_functions *f);
 
+/**
+ * Size of a buffer large enough for `ucl_dtoa` and `ucl_itoa` output
+ */
+#define UCL_NUMBER_BUF_SIZE 32
+
+/**
+ * Format a double the way emitters do: in the shortest form that reads
+ * back to the same value, with `.0` appended to integral values so they
+ * are parsed as floats. The output does not depend on the current locale
+ * @param val value to format
+ * @param buf target buffer of at least UCL_NUMBER_BUF_SIZE bytes
+ * @return length of the zero terminated output
+ */
+UCL_EXTERN size_t ucl_dtoa (double val, char *buf);
+
+/**
+ * Format a signed integer in decimal
+ * @param val value to format
+ * @param buf target buffer of at least UCL_NUMBER_BUF_SIZE bytes
+ * @return length of the zero terminated output
+ */
+UCL_EXTERN size_t ucl_itoa (int64_t val, char *buf);
+
+/** @} */
+
+/**
+ * @defgroup query Query functions
+ * These functions are used to select objects using JSON pointers (RFC 6901)
+ * and JSONPath expressions (a subset of RFC 9535)
+ *
+ * @{
+ */
+
+/**
+ * Query compilation error
+ */
+struct ucl_query_error {
+	size_t pos;							/**< offset of an error in a query */
+	char msg[128];						/**< error message */
+};
+
+/**
+ * Opaque compiled query
+ */
+struct ucl_query;
+/**
+ * Opaque query results iterator
+ */
+struct ucl_query_iter;
+
+/**
+ * Compile query. Queries starting with `$` are treated as JSONPath expressions
+ * supporting `.name`, `['name']`, `*`, `..`, `[n]`, `[start:end:step]` and
+ * filters `[?(@.key > 1 && @.other == 'str')]`. Other queries are treated as
+ * JSON pointers, e.g. `/key/0/other`. Implicit arrays are handled just like
+ * UCL arrays.
+ * @param query query string
+ * @param err error pointer, filled if a query cannot be compiled (may be NULL)
+ * @return compiled query or NULL in case of error
+ */
+UCL_EXTERN struct ucl_query* ucl_query_compile (const char *query,
+		struct ucl_query_error *err);
+
+/**
+ * Free compiled query
+ * @param query query to free
+ */
+UCL_EXTERN void ucl_query_free (struct ucl_query *query);
+
+/**
+ * Create new iterator over query results. Results are produced lazily, so
+ * the tree must not be modified while an iterator is in use. A compiled query
+ * can be shared by any number of iterators.
+ * @param query compiled query
+ * @param top top object to apply query to
+ * @return new iterator or NULL
+ */
+UCL_EXTERN struct ucl_query_iter* ucl_query_iterate_new (
+		const struct ucl_query *query, const ucl_object_t *top);
+
+/**
+ * Get the next result of a query
+ * @param it iterator
+ * @return the next matching object or NULL if there are no more matches
+ */
+UCL_EXTERN const ucl_object_t* ucl_query_iterate_next (
+		struct ucl_query_iter *it);
+
+/**
+ * Restart iterator, possibly with another top object. This function reuses
+ * memory allocated by an iterator.
+ * @param it iterator
+ * @param top new top object
+ */
+UCL_EXTERN void ucl_query_iterate_reset (struct ucl_query_iter *it,
+		const ucl_object_t *top);
+
+/**
+ * Free query iterator
+ * @param it iterator to free
+ */
+UCL_EXTERN void ucl_query_iterate_free (struct ucl_query_iter *it);
+
+/**
+ * Get the first result of a query. JSON pointers and JSONPath expressions
+ * consisting of names and indexes only are evaluated without an iterator.
+ * @param query compiled query
+ * @param top top object
+ * @return the first matching object or NULL
+ */
+UCL_EXTERN const ucl_object_t* ucl_query_first (const struct ucl_query *query,
+		const ucl_object_t *top);
+
 /** @} */
 
 /**
@@ -52,18 +52,25 @@ e0:
 
 #include <stdlib.h>
 
+#ifndef kv_realloc
+#define kv_realloc(ptr, sz) realloc(ptr, sz)
+#endif
+#ifndef kv_release
+#define kv_release(ptr) free(ptr)
+#endif
+
 #define kv_roundup32(x) (--(x), (x)|=(x)>>1, (x)|=(x)>>2, (x)|=(x)>>4, (x)|=(x)>>8, (x)|=(x)>>16, ++(x))
 
 #define kvec_t(type) struct { size_t n, m; type *a; }
 #define kv_init(v) ((v).n = (v).m = 0, (v).a = 0)
-#define kv_destroy(v) free((v).a)
+#define kv_destroy(v) kv_release((v).a)
 #define kv_A(v, i) ((v).a[(i)])
 #define kv_pop(v) ((v).a[--(v).n])
 #define kv_size(v) ((v).n)
 #define kv_max(v) ((v).m)
 
 #define kv_resize_safe(type, v, s, el)  do { \
-		type *_tp = (type*)realloc((v).a, sizeof(type) * (s)); \
+		type *_tp = (type*)kv_realloc((v).a, sizeof(type) * (s)); \
 		if (_tp == NULL) { \
 			goto el; \
 		} else { \
@@ -75,7 +82,7 @@ e0:
 #define kv_grow_factor 1.5
 #define kv_grow_safe(type, v, el)  do { \
 		size_t _ts = ((v).m > 1 ? (v).m * kv_grow_factor : 2); \
-		type *_tp = (type*)realloc((v).a, sizeof(type) * _ts); \
+		type *_tp = (type*)kv_realloc((v).a, sizeof(type) * _ts); \
 		if (_tp == NULL) { \
 			goto el; \
 		} else { \
@@ -125,10 +132,10 @@ e0:
  * the new library code.
  */
 
-#define kv_resize(type, v, s)  ((v).m = (s), (v).a = (type*)realloc((v).a, sizeof(type) * (v).m))
+#define kv_resize(type, v, s)  ((v).m = (s), (v).a = (type*)kv_realloc((v).a, sizeof(type) * (v).m))
 
 #define kv_grow(type, v)  ((v).m = ((v).m > 1 ? (v).m * kv_grow_factor : 2), \
-		(v).a = (type*)realloc((v).a, sizeof(type) * (v).m))
+		(v).a = (type*)kv_realloc((v).a, sizeof(type) * (v).m))
 
 #define kv_copy(type, v1, v0) do {											\
 		if ((v1).m < (v0).n) kv_resize(type, v1, (v0).n);					\
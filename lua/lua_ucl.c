@@ -186,12 +186,13 @@ static int
 ucl_object_lua_push_array (lua_State *L, const ucl_object_t *obj, int flags)
 {
 	const ucl_object_t *cur;
+	struct ucl_object_stack_iter sit;
 	ucl_object_iter_t it;
 	int i = 1, nelt = 0;
 
 	if (obj->type == UCL_ARRAY) {
 		nelt = obj->len;
-		it = ucl_object_iterate_new (obj);
+		it = ucl_object_iterate_init (&sit, obj);
 		lua_createtable (L, nelt, 0);
 
 		while ((cur = ucl_object_iterate_safe (it, true))) {
@@ -202,8 +203,6 @@ ucl_object_lua_push_array (lua_State *L, const ucl_object_t *obj, int flags)
 
 		luaL_getmetatable (L, UCL_ARRAY_TYPE_META);
 		lua_setmetatable (L, -2);
-
-		ucl_object_iterate_free (it);
 	}
 	else {
 		/* Optimize allocation by preallocation of table */
@@ -635,7 +634,7 @@ lua_ucl_to_string (lua_State *L, const ucl_object_t *obj, enum ucl_emitter type)
 
 	if (result != NULL) {
 		lua_pushlstring (L, (const char *)result, outlen);
-		free (result);
+		ucl_free (result);
 	}
 	else {
 		lua_pushnil (L);
@@ -1092,6 +1091,12 @@ lua_ucl_str_to_emit_type (const char *strtype)
 	else if (strcasecmp (strtype, "json-compact") == 0) {
 		format = UCL_EMIT_JSON_COMPACT;
 	}
+	else if (strcasecmp (strtype, "json-canonical") == 0) {
+		format = UCL_EMIT_JSON_CANONICAL;
+	}
+	else if (strcasecmp (strtype, "ndjson") == 0) {
+		format = UCL_EMIT_NDJSON;
+	}
 	else if (strcasecmp (strtype, "yaml") == 0) {
 		format = UCL_EMIT_YAML;
 	}
@@ -1110,6 +1115,8 @@ lua_ucl_str_to_emit_type (const char *strtype)
  *
  * - `json` - fine printed json
  * - `json-compact` - compacted json
+ * - `json-canonical` - canonical json with sorted keys
+ * - `ndjson` - compacted json line per element of a top array
  * - `config` - fine printed configuration
  * - `ucl` - same as `config`
  * - `yaml` - embedded yaml
@@ -1412,6 +1419,8 @@ lua_ucl_to_config (lua_State *L)
  *
  * - `json` - fine printed json
  * - `json-compact` - compacted json
+ * - `json-canonical` - canonical json with sorted keys
+ * - `ndjson` - compacted json line per element of a top array
  * - `config` - fine printed configuration
  * - `ucl` - same as `config`
  * - `yaml` - embedded yaml
@@ -1464,6 +1473,12 @@ lua_ucl_to_format (lua_State *L)
 			else if (strcasecmp (strtype, "json-compact") == 0) {
 				format = UCL_EMIT_JSON_COMPACT;
 			}
+			else if (strcasecmp (strtype, "json-canonical") == 0) {
+				format = UCL_EMIT_JSON_CANONICAL;
+			}
+			else if (strcasecmp (strtype, "ndjson") == 0) {
+				format = UCL_EMIT_NDJSON;
+			}
 			else if (strcasecmp (strtype, "yaml") == 0) {
 				format = UCL_EMIT_YAML;
 			}
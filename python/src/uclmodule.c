@@ -246,7 +246,7 @@ ucl_dump (PyObject *self, PyObject *args)
 #else
 		ret = PyUnicode_FromString (buf);
 #endif
-		free(buf);
+		ucl_free (buf);
 
 		return ret;
 	}
@@ -303,6 +303,8 @@ init_macros(PyObject *mod)
 	PyModule_AddIntMacro(mod, UCL_EMIT_CONFIG);
 	PyModule_AddIntMacro(mod, UCL_EMIT_YAML);
 	PyModule_AddIntMacro(mod, UCL_EMIT_MSGPACK);
+	PyModule_AddIntMacro(mod, UCL_EMIT_JSON_CANONICAL);
+	PyModule_AddIntMacro(mod, UCL_EMIT_NDJSON);
 
 	SchemaError = PyErr_NewException("ucl.SchemaError", NULL, NULL);
 	Py_INCREF(SchemaError);
@@ -43,7 +43,7 @@ class DumpTest(unittest.TestCase):
 
     def test_float(self):
         data = { "a" : 1.1 }
-        valid = "a = 1.100000;\n"
+        valid = "a = 1.1;\n"
         self.assertEqual(ucl.dump(data), valid)
 
     def test_boolean(self):
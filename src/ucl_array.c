@@ -0,0 +1,1152 @@
+/* Copyright (c) 2026, Vsevolod Stakhov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *       * Redistributions of source code must retain the above copyright
+ *         notice, this list of conditions and the following disclaimer.
+ *       * Redistributions in binary form must reproduce the above copyright
+ *         notice, this list of conditions and the following disclaimer in the
+ *         documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Storage of arrays: a ring buffer (deque) of element pointers with an
+ * optional side index, or packed numeric values, see ucl_array_t
+ */
+
+#include "ucl.h"
+#include "ucl_internal.h"
+#include "kvec.h"
+#include "khash.h"
+
+#define ucl_array_ptr_hash_func(p) \
+	kh_int64_hash_func ((uint64_t)(uintptr_t)(p))
+
+KHASH_INIT (ucl_array_idx, const ucl_object_t *, int64_t, 1,
+		ucl_array_ptr_hash_func, kh_int64_hash_equal);
+
+/*
+ * Storage of an array is always allocated and freed with the allocator
+ * recorded by the array, arrays without an extension use the process wide one
+ */
+#define ucl_array_allocator_enter(vec) \
+	ucl_allocator_enter (UCL_ARRAY_ALLOCATOR (vec))
+
+ucl_array_t *
+ucl_array_new (void)
+{
+	const struct ucl_allocator *allocator = ucl_allocator_current ();
+	ucl_array_t *vec;
+
+	vec = UCL_ALLOC (sizeof (*vec));
+
+	if (vec == NULL) {
+		return NULL;
+	}
+
+	memset (vec, 0, sizeof (*vec));
+
+	if (allocator != NULL) {
+		/* Arrays of a thread allocator record it in the metadata */
+		vec->ext = UCL_ALLOC (sizeof (*vec->ext));
+
+		if (vec->ext == NULL) {
+			UCL_FREE (sizeof (*vec), vec);
+			return NULL;
+		}
+
+		memset (vec->ext, 0, sizeof (*vec->ext));
+		vec->ext->meta.allocator = allocator;
+	}
+
+	return vec;
+}
+
+struct ucl_array_ext *
+ucl_array_ext_get (ucl_array_t *vec)
+{
+	const struct ucl_allocator *prev;
+
+	if (vec->ext == NULL) {
+		prev = ucl_allocator_enter (NULL);
+		vec->ext = UCL_ALLOC (sizeof (*vec->ext));
+		ucl_allocator_leave (prev);
+
+		if (vec->ext != NULL) {
+			memset (vec->ext, 0, sizeof (*vec->ext));
+		}
+	}
+
+	return vec->ext;
+}
+
+static void
+ucl_array_packed_free (ucl_array_t *vec)
+{
+	const struct ucl_allocator *prev;
+
+	if (vec->ext != NULL) {
+		prev = ucl_array_allocator_enter (vec);
+		ucl_free (vec->ext->pv.ptr);
+		ucl_allocator_leave (prev);
+		vec->ext->pv.ptr = NULL;
+	}
+}
+
+void
+ucl_array_ext_free (ucl_array_t *vec)
+{
+	const struct ucl_allocator *prev;
+
+	if (vec->ext != NULL) {
+		ucl_array_index_drop (vec);
+		ucl_array_packed_free (vec);
+		prev = ucl_array_allocator_enter (vec);
+		ucl_emit_cache_free (vec->ext->meta.emit);
+		UCL_FREE (sizeof (*vec->ext), vec->ext);
+		ucl_allocator_leave (prev);
+		vec->ext = NULL;
+	}
+}
+
+void
+ucl_array_index_drop (ucl_array_t *vec)
+{
+	const struct ucl_allocator *prev;
+
+	if (vec->ext != NULL && vec->ext->index != NULL) {
+		prev = ucl_array_allocator_enter (vec);
+		kh_destroy (ucl_array_idx, vec->ext->index);
+		ucl_allocator_leave (prev);
+		vec->ext->index = NULL;
+	}
+}
+
+#define UCL_ARRAY_INDEX(vec) ((vec)->ext != NULL ? (vec)->ext->index : NULL)
+#define UCL_ARRAY_BASE(vec) ((vec)->ext != NULL ? (vec)->ext->base : 0)
+
+/* Moves the front of the array, sequence numbers matter with an index only */
+static inline void
+ucl_array_base_move (ucl_array_t *vec, int64_t delta)
+{
+	if (vec->ext != NULL) {
+		vec->ext->base += delta;
+	}
+}
+
+/*
+ * Sets sequence number of `elt` in the side map; if `fresh` is true then
+ * `elt` is a newly inserted element and a duplicate pointer makes the map
+ * ambiguous, so it is dropped
+ */
+static void
+ucl_array_index_set (ucl_array_t *vec, const ucl_object_t *elt, int64_t seq,
+		bool fresh)
+{
+	const struct ucl_allocator *prev;
+	khiter_t k;
+	int ret;
+
+	if (UCL_ARRAY_INDEX (vec) == NULL || elt == NULL) {
+		return;
+	}
+
+	prev = ucl_array_allocator_enter (vec);
+	k = kh_put (ucl_array_idx, vec->ext->index, elt, &ret);
+	ucl_allocator_leave (prev);
+
+	if (ret == -1 || (ret == 0 && fresh)) {
+		ucl_array_index_drop (vec);
+		return;
+	}
+
+	kh_value (vec->ext->index, k) = seq;
+}
+
+static void
+ucl_array_index_remove (ucl_array_t *vec, const ucl_object_t *elt)
+{
+	khiter_t k;
+
+	if (UCL_ARRAY_INDEX (vec) == NULL || elt == NULL) {
+		return;
+	}
+
+	k = kh_get (ucl_array_idx, vec->ext->index, elt);
+
+	if (k != kh_end (vec->ext->index)) {
+		kh_del (ucl_array_idx, vec->ext->index, k);
+	}
+}
+
+/* Renumbers logical range [start, end) in the side map */
+static void
+ucl_array_index_renumber (ucl_array_t *vec, size_t start, size_t end)
+{
+	size_t i;
+
+	for (i = start; i < end && UCL_ARRAY_INDEX (vec) != NULL; i ++) {
+		ucl_array_index_set (vec, UCL_ARRAY_A (vec, i),
+				vec->ext->base + (int64_t)i, false);
+	}
+}
+
+static bool
+ucl_array_index_build (ucl_array_t *vec)
+{
+	const struct ucl_allocator *prev;
+	size_t i;
+	int rc = 0;
+
+	if (ucl_array_ext_get (vec) == NULL) {
+		return false;
+	}
+
+	ucl_array_index_drop (vec);
+	prev = ucl_array_allocator_enter (vec);
+	vec->ext->index = kh_init (ucl_array_idx);
+
+	if (vec->ext->index != NULL && vec->n > 0) {
+		rc = kh_resize (ucl_array_idx, vec->ext->index, vec->n);
+	}
+
+	ucl_allocator_leave (prev);
+
+	if (vec->ext->index == NULL) {
+		return false;
+	}
+
+	if (rc < 0) {
+		ucl_array_index_drop (vec);
+		return false;
+	}
+
+	for (i = 0; i < vec->n && UCL_ARRAY_INDEX (vec) != NULL; i ++) {
+		ucl_array_index_set (vec, UCL_ARRAY_A (vec, i),
+				vec->ext->base + (int64_t)i, true);
+	}
+
+	return UCL_ARRAY_INDEX (vec) != NULL;
+}
+
+/*
+ * Changes capacity to `nm` elements keeping logical order; a wrapped front
+ * segment is moved to the end of the new buffer
+ */
+bool
+ucl_array_resize (ucl_array_t *vec, size_t nm)
+{
+	const struct ucl_allocator *prev;
+	ucl_object_t **na;
+	size_t front;
+
+	if (nm <= vec->m) {
+		return true;
+	}
+
+	prev = ucl_array_allocator_enter (vec);
+	na = UCL_REALLOC (vec->a, sizeof (ucl_object_t *) * nm);
+	ucl_allocator_leave (prev);
+
+	if (na == NULL) {
+		return false;
+	}
+
+	if (vec->head + vec->n > vec->m) {
+		front = vec->m - vec->head;
+		memmove (na + nm - front, na + vec->head,
+				sizeof (ucl_object_t *) * front);
+		vec->head = nm - front;
+	}
+
+	vec->a = na;
+	vec->m = nm;
+
+	return true;
+}
+
+static inline bool
+ucl_array_ensure (ucl_array_t *vec)
+{
+	if (vec->n < vec->m) {
+		return true;
+	}
+
+	return ucl_array_resize (vec, vec->m > 1 ? vec->m * kv_grow_factor : 2);
+}
+
+/* Moves elements to the beginning of the buffer so `a[0..n)` is contiguous */
+static bool
+ucl_array_linearize (ucl_array_t *vec)
+{
+	const struct ucl_allocator *prev;
+	ucl_object_t **na;
+	size_t i;
+
+	if (vec->head + vec->n <= vec->m) {
+		if (vec->head > 0) {
+			memmove (vec->a, vec->a + vec->head,
+					sizeof (ucl_object_t *) * vec->n);
+			vec->head = 0;
+		}
+
+		return true;
+	}
+
+	prev = ucl_array_allocator_enter (vec);
+	na = UCL_ALLOC (sizeof (ucl_object_t *) * vec->m);
+
+	if (na == NULL) {
+		ucl_allocator_leave (prev);
+		return false;
+	}
+
+	for (i = 0; i < vec->n; i ++) {
+		na[i] = UCL_ARRAY_A (vec, i);
+	}
+
+	ucl_free (vec->a);
+	ucl_allocator_leave (prev);
+	vec->a = na;
+	vec->head = 0;
+
+	return true;
+}
+
+static bool
+ucl_array_push_back (ucl_array_t *vec, ucl_object_t *elt)
+{
+	if (!ucl_array_ensure (vec)) {
+		return false;
+	}
+
+	UCL_ARRAY_A (vec, vec->n) = elt;
+	ucl_array_index_set (vec, elt, UCL_ARRAY_BASE (vec) + (int64_t)vec->n,
+			true);
+	vec->n ++;
+
+	return true;
+}
+
+static bool
+ucl_array_push_front (ucl_array_t *vec, ucl_object_t *elt)
+{
+	if (!ucl_array_ensure (vec)) {
+		return false;
+	}
+
+	vec->head = (vec->head == 0 ? vec->m : vec->head) - 1;
+	vec->a[vec->head] = elt;
+	vec->n ++;
+	ucl_array_base_move (vec, -1);
+	ucl_array_index_set (vec, elt, UCL_ARRAY_BASE (vec), true);
+
+	return true;
+}
+
+/* Inserts `elt` at logical position `i` shifting the shorter side */
+static bool
+ucl_array_insert_at (ucl_array_t *vec, ucl_object_t *elt, size_t i)
+{
+	size_t j;
+
+	if (i == 0) {
+		return ucl_array_push_front (vec, elt);
+	}
+	else if (i >= vec->n) {
+		return ucl_array_push_back (vec, elt);
+	}
+
+	if (!ucl_array_ensure (vec)) {
+		return false;
+	}
+
+	if (i < vec->n / 2) {
+		vec->head = (vec->head == 0 ? vec->m : vec->head) - 1;
+		ucl_array_base_move (vec, -1);
+
+		for (j = 0; j < i; j ++) {
+			UCL_ARRAY_A (vec, j) = UCL_ARRAY_A (vec, j + 1);
+		}
+
+		vec->n ++;
+		UCL_ARRAY_A (vec, i) = elt;
+		ucl_array_index_renumber (vec, 0, i);
+	}
+	else {
+		for (j = vec->n; j > i; j --) {
+			UCL_ARRAY_A (vec, j) = UCL_ARRAY_A (vec, j - 1);
+		}
+
+		vec->n ++;
+		UCL_ARRAY_A (vec, i) = elt;
+		ucl_array_index_renumber (vec, i + 1, vec->n);
+	}
+
+	ucl_array_index_set (vec, elt, UCL_ARRAY_BASE (vec) + (int64_t)i, true);
+
+	return true;
+}
+
+/* Removes element at logical position `i` shifting the shorter side */
+static ucl_object_t *
+ucl_array_remove_at (ucl_array_t *vec, size_t i)
+{
+	ucl_object_t *ret;
+	size_t j;
+
+	ret = UCL_ARRAY_A (vec, i);
+	ucl_array_index_remove (vec, ret);
+
+	if (i < vec->n / 2) {
+		for (j = i; j > 0; j --) {
+			UCL_ARRAY_A (vec, j) = UCL_ARRAY_A (vec, j - 1);
+		}
+
+		vec->head ++;
+
+		if (vec->head == vec->m) {
+			vec->head = 0;
+		}
+
+		ucl_array_base_move (vec, 1);
+		vec->n --;
+
+		if (i > 0) {
+			ucl_array_index_renumber (vec, 0, i);
+		}
+	}
+	else {
+		for (j = i; j + 1 < vec->n; j ++) {
+			UCL_ARRAY_A (vec, j) = UCL_ARRAY_A (vec, j + 1);
+		}
+
+		vec->n --;
+		ucl_array_index_renumber (vec, i, vec->n);
+	}
+
+	return ret;
+}
+
+/*
+ * Views of packed elements remember their source, so that they can be
+ * found in arrays
+ */
+struct ucl_array_view_slot {
+	ucl_object_t obj; /* Must be the first */
+	const ucl_array_t *vec;
+	size_t idx;
+};
+
+static UCL_THREAD_LOCAL struct ucl_array_view_slot
+		ucl_array_views[UCL_ARRAY_VIEW_SLOTS];
+static UCL_THREAD_LOCAL unsigned int ucl_array_views_next;
+
+/* Returns logical index of `elt` or -1 if it is not in array */
+static int64_t
+ucl_array_find_elt (const ucl_array_t *vec, const ucl_object_t *elt)
+{
+	const struct ucl_array_view_slot *slot;
+	khiter_t k;
+	size_t i;
+
+	if (UCL_ARRAY_IS_PACKED (vec)) {
+		/* Only views can be found in a packed array */
+		slot = (const struct ucl_array_view_slot *)elt;
+
+		if ((uintptr_t)slot >= (uintptr_t)ucl_array_views &&
+				(uintptr_t)slot < (uintptr_t)(ucl_array_views +
+						UCL_ARRAY_VIEW_SLOTS) &&
+				slot->vec == vec && slot->idx < vec->n) {
+			return (int64_t)slot->idx;
+		}
+
+		return -1;
+	}
+
+	if (UCL_ARRAY_INDEX (vec) != NULL && elt != NULL) {
+		k = kh_get (ucl_array_idx, vec->ext->index, elt);
+
+		if (k != kh_end (vec->ext->index)) {
+			return kh_value (vec->ext->index, k) - vec->ext->base;
+		}
+
+		return -1;
+	}
+
+	for (i = 0; i < vec->n; i ++) {
+		if (UCL_ARRAY_A (vec, i) == elt) {
+			return (int64_t)i;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * Returns ephemeral view of packed element `i`: views are written to the
+ * slots of the calling thread only, so frozen arrays are read concurrently
+ * without any allocations or writes to the array
+ */
+ucl_object_t *
+ucl_array_packed_view_at (const ucl_array_t *vec, size_t i)
+{
+	struct ucl_array_view_slot *slot;
+
+	slot = &ucl_array_views[ucl_array_views_next ++ % UCL_ARRAY_VIEW_SLOTS];
+	ucl_array_packed_view (vec, i, &slot->obj);
+	slot->vec = vec;
+	slot->idx = i;
+
+	return &slot->obj;
+}
+
+/* Converts packed array to the object storage */
+bool
+ucl_array_unpack_internal (ucl_array_t *vec, unsigned int priority)
+{
+	const struct ucl_allocator *prev;
+	ucl_object_t **na, *elt;
+	size_t i, nm;
+
+	if (!UCL_ARRAY_IS_PACKED (vec)) {
+		return true;
+	}
+
+	/* Elements are created with the allocator of the array too */
+	prev = ucl_array_allocator_enter (vec);
+	nm = vec->n > 8 ? vec->n : 8;
+	na = UCL_ALLOC (sizeof (ucl_object_t *) * nm);
+
+	if (na == NULL) {
+		ucl_allocator_leave (prev);
+		return false;
+	}
+
+	for (i = 0; i < vec->n; i ++) {
+		elt = ucl_object_new_full (vec->ext->storage == UCL_ARRAY_STORAGE_INT ?
+				UCL_INT : UCL_FLOAT, priority);
+
+		if (elt == NULL) {
+			while (i > 0) {
+				ucl_object_unref (na[--i]);
+			}
+
+			ucl_free (na);
+			ucl_allocator_leave (prev);
+
+			return false;
+		}
+
+		if (vec->ext->storage == UCL_ARRAY_STORAGE_INT) {
+			elt->value.iv = vec->ext->pv.iv[i];
+		}
+		else {
+			elt->value.dv = vec->ext->pv.dv[i];
+		}
+
+		na[i] = elt;
+	}
+
+	ucl_array_packed_free (vec);
+	ucl_allocator_leave (prev);
+	vec->a = na;
+	vec->m = nm;
+	vec->head = 0;
+	vec->ext->storage = UCL_ARRAY_STORAGE_OBJECTS;
+
+	return true;
+}
+
+bool
+ucl_array_append (ucl_object_t *top, ucl_object_t *elt)
+{
+	UCL_ARRAY_GET (vec, top);
+	const struct ucl_allocator *prev;
+
+	if (elt == NULL || top == NULL ||
+			((top->flags | elt->flags) & UCL_OBJECT_FROZEN)) {
+		return false;
+	}
+
+	if (vec == NULL) {
+		prev = ucl_object_allocator_enter (top);
+		vec = ucl_array_new ();
+		ucl_allocator_leave (prev);
+
+		if (vec == NULL) {
+			return false;
+		}
+
+		top->value.av = (void *)vec;
+	}
+	else if (!UCL_ARRAY_UNPACK (vec, top)) {
+		return false;
+	}
+
+	if (!ucl_array_push_back (vec, elt)) {
+		return false;
+	}
+
+	top->len ++;
+	ucl_container_modified (UCL_ARRAY_META (vec));
+
+	return true;
+}
+
+bool
+ucl_array_prepend (ucl_object_t *top, ucl_object_t *elt)
+{
+	UCL_ARRAY_GET (vec, top);
+	const struct ucl_allocator *prev;
+
+	if (elt == NULL || top == NULL ||
+			((top->flags | elt->flags) & UCL_OBJECT_FROZEN)) {
+		return false;
+	}
+
+	if (vec == NULL) {
+		prev = ucl_object_allocator_enter (top);
+		vec = ucl_array_new ();
+		ucl_allocator_leave (prev);
+
+		if (vec == NULL) {
+			return false;
+		}
+
+		top->value.av = (void *)vec;
+	}
+	else if (!UCL_ARRAY_UNPACK (vec, top)) {
+		return false;
+	}
+
+	if (!ucl_array_push_front (vec, elt)) {
+		return false;
+	}
+
+	top->len ++;
+	ucl_container_modified (UCL_ARRAY_META (vec));
+
+	return true;
+}
+
+bool
+ucl_array_merge (ucl_object_t *top, ucl_object_t *elt, bool copy)
+{
+	unsigned i, n;
+	ucl_object_t *cp = NULL;
+	ucl_object_t *obj, tmp;
+
+	if (elt == NULL || top == NULL || top->type != UCL_ARRAY || elt->type != UCL_ARRAY) {
+		return false;
+	}
+
+	if ((top->flags & UCL_OBJECT_FROZEN) ||
+			(!copy && (elt->flags & UCL_OBJECT_FROZEN))) {
+		return false;
+	}
+
+	if (copy) {
+		cp = ucl_object_copy (elt);
+	}
+	else {
+		cp = ucl_object_ref (elt);
+	}
+
+	UCL_ARRAY_GET (v1, top);
+	UCL_ARRAY_GET (v2, cp);
+
+	if (v1 && v2) {
+		n = v2->n;
+
+		if (!UCL_ARRAY_UNPACK (v1, top)) {
+			return false;
+		}
+
+		/* Reserve space first, so pushes below cannot fail */
+		if (!ucl_array_resize (v1, v1->n + n)) {
+			return false;
+		}
+
+		for (i = 0; i < n; i ++) {
+			if (UCL_ARRAY_IS_PACKED (v2)) {
+				/* Packed elements are ephemeral, so copy them */
+				obj = ucl_object_copy_internal (ucl_array_get (v2, i, &tmp),
+						false);
+			}
+			else {
+				obj = UCL_ARRAY_A (v2, i);
+			}
+
+			ucl_array_push_back (v1, obj);
+
+			if (obj != NULL) {
+				top->len ++;
+			}
+		}
+
+		ucl_container_modified (UCL_ARRAY_META (v1));
+	}
+
+	return true;
+}
+
+ucl_object_t *
+ucl_array_delete (ucl_object_t *top, ucl_object_t *elt)
+{
+	UCL_ARRAY_GET (vec, top);
+	ucl_object_t *ret = NULL;
+	int64_t idx;
+
+	if (vec == NULL || (top->flags & UCL_OBJECT_FROZEN)) {
+		return NULL;
+	}
+
+	idx = ucl_array_find_elt (vec, elt);
+
+	if (idx >= 0 && UCL_ARRAY_UNPACK (vec, top)) {
+		ret = ucl_array_remove_at (vec, idx);
+		top->len --;
+		ucl_container_modified (UCL_ARRAY_META (vec));
+	}
+
+	return ret;
+}
+
+const ucl_object_t *
+ucl_array_head (const ucl_object_t *top)
+{
+	UCL_ARRAY_GET (vec, top);
+
+	if (vec == NULL || top == NULL || top->type != UCL_ARRAY ||
+			top->value.av == NULL) {
+		return NULL;
+	}
+
+	if (UCL_ARRAY_IS_PACKED (vec)) {
+		return ucl_array_find_index (top, 0);
+	}
+
+	return (vec->n > 0 ? UCL_ARRAY_A (vec, 0) : NULL);
+}
+
+const ucl_object_t *
+ucl_array_tail (const ucl_object_t *top)
+{
+	UCL_ARRAY_GET (vec, top);
+
+	if (top == NULL || top->type != UCL_ARRAY || top->value.av == NULL) {
+		return NULL;
+	}
+
+	if (UCL_ARRAY_IS_PACKED (vec)) {
+		return ucl_array_find_index (top, vec->n - 1);
+	}
+
+	return (vec->n > 0 ? UCL_ARRAY_A (vec, vec->n - 1) : NULL);
+}
+
+ucl_object_t *
+ucl_array_pop_last (ucl_object_t *top)
+{
+	UCL_ARRAY_GET (vec, top);
+	ucl_object_t *ret = NULL;
+
+	if (vec != NULL && vec->n > 0 && !(top->flags & UCL_OBJECT_FROZEN) &&
+			UCL_ARRAY_UNPACK (vec, top)) {
+		ret = ucl_array_remove_at (vec, vec->n - 1);
+		top->len --;
+		ucl_container_modified (UCL_ARRAY_META (vec));
+	}
+
+	return ret;
+}
+
+ucl_object_t *
+ucl_array_pop_first (ucl_object_t *top)
+{
+	UCL_ARRAY_GET (vec, top);
+	ucl_object_t *ret = NULL;
+
+	if (vec != NULL && vec->n > 0 && !(top->flags & UCL_OBJECT_FROZEN) &&
+			UCL_ARRAY_UNPACK (vec, top)) {
+		ret = ucl_array_remove_at (vec, 0);
+		top->len --;
+		ucl_container_modified (UCL_ARRAY_META (vec));
+	}
+
+	return ret;
+}
+
+unsigned int
+ucl_array_size (const ucl_object_t *top)
+{
+	if (top == NULL || top->type != UCL_ARRAY) {
+		return 0;
+	}
+
+	UCL_ARRAY_GET (vec, top);
+
+	if (vec != NULL) {
+		return kv_size(*vec);
+	}
+
+	return 0;
+}
+
+const ucl_object_t *
+ucl_array_find_index (const ucl_object_t *top, unsigned int index)
+{
+	UCL_ARRAY_GET (vec, top);
+
+	if (vec != NULL && vec->n > 0 && index < vec->n) {
+		if (UCL_ARRAY_IS_PACKED (vec)) {
+			return ucl_array_packed_view_at (vec, index);
+		}
+
+		return UCL_ARRAY_A (vec, index);
+	}
+
+	return NULL;
+}
+
+unsigned int
+ucl_array_index_of (ucl_object_t *top, ucl_object_t *elt)
+{
+	UCL_ARRAY_GET (vec, top);
+	int64_t idx;
+
+	if (vec == NULL) {
+		return (unsigned int)(-1);
+	}
+
+	idx = ucl_array_find_elt (vec, elt);
+
+	if (idx >= 0) {
+		return (unsigned int)idx;
+	}
+
+	return (unsigned int)(-1);
+}
+
+bool
+ucl_array_enable_index (ucl_object_t *top, bool enable)
+{
+	UCL_ARRAY_GET (vec, top);
+
+	if (vec == NULL || top->type != UCL_ARRAY ||
+			(top->flags & UCL_OBJECT_FROZEN)) {
+		return false;
+	}
+
+	if (!enable) {
+		ucl_array_index_drop (vec);
+		return true;
+	}
+
+	if (UCL_ARRAY_INDEX (vec) != NULL) {
+		return true;
+	}
+
+	if (!UCL_ARRAY_UNPACK (vec, top)) {
+		return false;
+	}
+
+	return ucl_array_index_build (vec);
+}
+
+bool
+ucl_array_pack (ucl_object_t *top)
+{
+	UCL_ARRAY_GET (vec, top);
+	const struct ucl_allocator *prev;
+	const ucl_object_t *elt;
+	ucl_type_t type;
+	void *pv;
+	size_t i;
+
+	if (vec == NULL || top->type != UCL_ARRAY ||
+			(top->flags & UCL_OBJECT_FROZEN)) {
+		return false;
+	}
+
+	if (UCL_ARRAY_IS_PACKED (vec)) {
+		return true;
+	}
+
+	if (vec->n == 0 || UCL_ARRAY_A (vec, 0) == NULL) {
+		return false;
+	}
+
+	type = UCL_ARRAY_A (vec, 0)->type;
+
+	if ((type != UCL_INT && type != UCL_FLOAT) ||
+			ucl_array_ext_get (vec) == NULL) {
+		return false;
+	}
+
+	/* Elements referenced from elsewhere cannot be replaced with values */
+	for (i = 0; i < vec->n; i ++) {
+		elt = UCL_ARRAY_A (vec, i);
+
+		if (elt == NULL || elt->type != type || elt->next != NULL ||
+				elt->ref != 1 ||
+				(elt->flags & (UCL_OBJECT_FROZEN|UCL_OBJECT_EPHEMERAL))) {
+			return false;
+		}
+	}
+
+	prev = ucl_array_allocator_enter (vec);
+	pv = UCL_ALLOC ((type == UCL_INT ? sizeof (int64_t) : sizeof (double)) *
+			vec->n);
+	ucl_allocator_leave (prev);
+
+	if (pv == NULL) {
+		return false;
+	}
+
+	for (i = 0; i < vec->n; i ++) {
+		elt = UCL_ARRAY_A (vec, i);
+
+		if (type == UCL_INT) {
+			((int64_t *)pv)[i] = elt->value.iv;
+		}
+		else {
+			((double *)pv)[i] = elt->value.dv;
+		}
+
+		ucl_object_unref (UCL_ARRAY_A (vec, i));
+	}
+
+	ucl_array_index_drop (vec);
+	prev = ucl_array_allocator_enter (vec);
+	ucl_free (vec->a);
+	ucl_allocator_leave (prev);
+	vec->a = NULL;
+	vec->m = vec->n;
+	vec->head = 0;
+	vec->ext->base = 0;
+	vec->ext->pv.ptr = pv;
+	vec->ext->storage = type == UCL_INT ? UCL_ARRAY_STORAGE_INT :
+			UCL_ARRAY_STORAGE_FLOAT;
+
+	return true;
+}
+
+bool
+ucl_array_unpack (ucl_object_t *top)
+{
+	UCL_ARRAY_GET (vec, top);
+
+	if (vec == NULL || top->type != UCL_ARRAY ||
+			(top->flags & UCL_OBJECT_FROZEN)) {
+		return false;
+	}
+
+	return UCL_ARRAY_UNPACK (vec, top);
+}
+
+const int64_t *
+ucl_array_packed_int (const ucl_object_t *top, size_t *len)
+{
+	UCL_ARRAY_GET (vec, top);
+
+	if (vec == NULL || top->type != UCL_ARRAY ||
+			UCL_ARRAY_STORAGE (vec) != UCL_ARRAY_STORAGE_INT) {
+		return NULL;
+	}
+
+	if (len != NULL) {
+		*len = vec->n;
+	}
+
+	return vec->ext->pv.iv;
+}
+
+const double *
+ucl_array_packed_float (const ucl_object_t *top, size_t *len)
+{
+	UCL_ARRAY_GET (vec, top);
+
+	if (vec == NULL || top->type != UCL_ARRAY ||
+			UCL_ARRAY_STORAGE (vec) != UCL_ARRAY_STORAGE_FLOAT) {
+		return NULL;
+	}
+
+	if (len != NULL) {
+		*len = vec->n;
+	}
+
+	return vec->ext->pv.dv;
+}
+
+ucl_object_t *
+ucl_array_replace_index (ucl_object_t *top, ucl_object_t *elt,
+	unsigned int index)
+{
+	UCL_ARRAY_GET (vec, top);
+	ucl_object_t *ret = NULL;
+
+	if (vec != NULL && vec->n > 0 && index < vec->n &&
+			!(top->flags & UCL_OBJECT_FROZEN) &&
+			(elt == NULL || !(elt->flags & UCL_OBJECT_FROZEN)) &&
+			UCL_ARRAY_UNPACK (vec, top)) {
+		ret = UCL_ARRAY_A (vec, index);
+		UCL_ARRAY_A (vec, index) = elt;
+		ucl_array_index_remove (vec, ret);
+		ucl_array_index_set (vec, elt, UCL_ARRAY_BASE (vec) + (int64_t)index,
+				true);
+		ucl_container_modified (UCL_ARRAY_META (vec));
+	}
+
+	return ret;
+}
+
+bool
+ucl_array_insert_index (ucl_object_t *top, ucl_object_t *elt,
+		unsigned int index)
+{
+	UCL_ARRAY_GET (vec, top);
+
+	if (elt == NULL || top == NULL ||
+			((top->flags | elt->flags) & UCL_OBJECT_FROZEN)) {
+		return false;
+	}
+
+	if (vec == NULL || index == 0 || index >= vec->n) {
+		if (index > (vec != NULL ? vec->n : 0)) {
+			return false;
+		}
+
+		return index == 0 ? ucl_array_prepend (top, elt) :
+				ucl_array_append (top, elt);
+	}
+
+	if (!UCL_ARRAY_UNPACK (vec, top) ||
+			!ucl_array_insert_at (vec, elt, index)) {
+		return false;
+	}
+
+	top->len ++;
+	ucl_container_modified (UCL_ARRAY_META (vec));
+
+	return true;
+}
+
+ucl_object_t *
+ucl_array_delete_index (ucl_object_t *top, unsigned int index)
+{
+	UCL_ARRAY_GET (vec, top);
+	ucl_object_t *ret = NULL;
+
+	if (vec != NULL && index < vec->n && !(top->flags & UCL_OBJECT_FROZEN) &&
+			UCL_ARRAY_UNPACK (vec, top)) {
+		ret = ucl_array_remove_at (vec, index);
+		top->len --;
+		ucl_container_modified (UCL_ARRAY_META (vec));
+	}
+
+	return ret;
+}
+
+/* Copies packed values of `other` to `new`, returns false if not packed */
+bool
+ucl_array_copy_packed (ucl_object_t *new, const ucl_object_t *other)
+{
+	UCL_ARRAY_GET (src, other);
+	const struct ucl_allocator *prev;
+	ucl_array_t *vec;
+
+	if (!UCL_ARRAY_IS_PACKED (src)) {
+		return false;
+	}
+
+	prev = ucl_object_allocator_enter (new);
+	vec = ucl_array_new ();
+
+	if (vec == NULL) {
+		ucl_allocator_leave (prev);
+		return false;
+	}
+
+	if (ucl_array_ext_get (vec) == NULL ||
+			(vec->ext->pv.ptr = UCL_ALLOC (UCL_ARRAY_PACKED_ESIZE (src) *
+			src->n)) == NULL) {
+		ucl_array_ext_free (vec);
+		UCL_FREE (sizeof (*vec), vec);
+		ucl_allocator_leave (prev);
+		return false;
+	}
+
+	ucl_allocator_leave (prev);
+
+	memcpy (vec->ext->pv.ptr, src->ext->pv.ptr,
+			UCL_ARRAY_PACKED_ESIZE (src) * src->n);
+	vec->n = vec->m = src->n;
+	vec->ext->storage = src->ext->storage;
+	new->value.av = (void *)vec;
+
+	return true;
+}
+
+void
+ucl_array_memory_usage (const ucl_array_t *vec, struct ucl_memory_stats *st)
+{
+	st->arrays += sizeof (*vec);
+
+	if (vec->a != NULL) {
+		st->arrays += vec->m * sizeof (ucl_object_t *);
+	}
+
+	if (vec->ext != NULL) {
+		st->arrays += sizeof (*vec->ext);
+	}
+
+	if (UCL_ARRAY_INDEX (vec) != NULL) {
+		st->arrays += sizeof (*vec->ext->index) +
+				vec->ext->index->n_buckets * (sizeof (*vec->ext->index->keys) +
+				sizeof (*vec->ext->index->vals)) +
+				__ac_fsize (vec->ext->index->n_buckets) * sizeof (khint32_t);
+	}
+
+	if (UCL_ARRAY_IS_PACKED (vec)) {
+		st->arrays += UCL_ARRAY_PACKED_ESIZE (vec) * vec->n;
+	}
+}
+
+void
+ucl_object_array_sort (ucl_object_t *ar,
+		int (*cmp)(const ucl_object_t **o1, const ucl_object_t **o2))
+{
+	UCL_ARRAY_GET (vec, ar);
+
+	if (cmp == NULL || ar == NULL || ar->type != UCL_ARRAY || vec == NULL ||
+			(ar->flags & UCL_OBJECT_FROZEN)) {
+		return;
+	}
+
+	if (!UCL_ARRAY_UNPACK (vec, ar) || !ucl_array_linearize (vec)) {
+		return;
+	}
+
+	qsort (vec->a, vec->n, sizeof (ucl_object_t *),
+			(int (*)(const void *, const void *))cmp);
+
+	if (UCL_ARRAY_INDEX (vec) != NULL) {
+		ucl_array_index_renumber (vec, 0, vec->n);
+	}
+
+	ucl_container_modified (UCL_ARRAY_META (vec));
+}
@@ -0,0 +1,807 @@
+/* Copyright (c) 2026, Vsevolod Stakhov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *       * Redistributions of source code must retain the above copyright
+ *         notice, this list of conditions and the following disclaimer.
+ *       * Redistributions in binary form must reproduce the above copyright
+ *         notice, this list of conditions and the following disclaimer in the
+ *         documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Structural diff and patch of UCL trees using RFC 6902 (JSON patch) format.
+ *
+ * Changed subtrees are found by comparing cached container fingerprints:
+ * they are validated once for both trees and then used as is while the diff
+ * descends. Subtrees with equal fingerprints are compared in full before
+ * they are skipped. Implicit arrays are treated as atomic values: if they differ, the
+ * whole key is replaced.
+ */
+
+#include "ucl.h"
+#include "ucl_internal.h"
+#include "ucl_hash.h"
+#include "utlist.h"
+
+struct ucl_diff_ctx {
+	ucl_object_t *patch;
+	UT_string *path;
+};
+
+static bool ucl_diff_equal (const ucl_object_t *o1, const ucl_object_t *o2);
+
+/*
+ * Different fingerprints reject unequal values at once, equal ones are
+ * confirmed by a full comparison as fingerprints might collide
+ */
+static inline bool
+ucl_diff_same (const ucl_object_t *o, const ucl_object_t *n)
+{
+	struct ucl_fingerprint f1, f2;
+
+	if (o == NULL || n == NULL) {
+		return o == n;
+	}
+
+	ucl_object_fingerprint_values (o, false, &f1);
+	ucl_object_fingerprint_values (n, false, &f2);
+
+	if (f1.h1 != f2.h1 || f1.h2 != f2.h2) {
+		return false;
+	}
+
+	return ucl_diff_equal (o, n);
+}
+
+/*
+ * Copy a value, implicit arrays are either kept or converted to arrays
+ */
+static ucl_object_t *
+ucl_diff_copy_values (const ucl_object_t *obj, bool allow_implicit)
+{
+	ucl_object_t *res = NULL, *cp;
+	const ucl_object_t *cur;
+
+	if (obj == NULL) {
+		return ucl_object_typed_new (UCL_NULL);
+	}
+
+	if (obj->next == NULL) {
+		return ucl_object_copy_internal (obj, false);
+	}
+
+	if (!allow_implicit) {
+		res = ucl_object_typed_new (UCL_ARRAY);
+	}
+
+	LL_FOREACH (obj, cur) {
+		cp = ucl_object_copy_internal (cur, false);
+
+		if (cp == NULL) {
+			continue;
+		}
+
+		if (allow_implicit) {
+			DL_APPEND (res, cp);
+		}
+		else {
+			ucl_array_append (res, cp);
+		}
+	}
+
+	return res;
+}
+
+static void
+ucl_diff_path_push (struct ucl_diff_ctx *ctx, const char *key, size_t keylen)
+{
+	const char *p, *end = key + keylen, *c = key;
+
+	utstring_append_c (ctx->path, '/');
+
+	for (p = key; p < end; p ++) {
+		if (*p == '~' || *p == '/') {
+			utstring_append_len (ctx->path, c, (size_t)(p - c));
+			utstring_append_len (ctx->path, *p == '~' ? "~0" : "~1", 2);
+			c = p + 1;
+		}
+	}
+
+	utstring_append_len (ctx->path, c, (size_t)(end - c));
+}
+
+static void
+ucl_diff_path_push_index (struct ucl_diff_ctx *ctx, unsigned idx)
+{
+	utstring_printf (ctx->path, "/%u", idx);
+}
+
+static void
+ucl_diff_path_restore (struct ucl_diff_ctx *ctx, size_t len)
+{
+	ctx->path->i = len;
+	ctx->path->d[len] = '\0';
+}
+
+static void
+ucl_diff_emit_op (struct ucl_diff_ctx *ctx, const char *op,
+		const ucl_object_t *value, bool has_value)
+{
+	ucl_object_t *nop;
+
+	nop = ucl_object_typed_new (UCL_OBJECT);
+	ucl_object_insert_key (nop, ucl_object_fromstring (op), "op", 0, false);
+	ucl_object_insert_key (nop,
+			ucl_object_fromlstring (utstring_body (ctx->path),
+					utstring_len (ctx->path)),
+			"path", 0, false);
+
+	if (has_value) {
+		ucl_object_insert_key (nop, ucl_diff_copy_values (value, true),
+				"value", 0, false);
+	}
+
+	ucl_array_append (ctx->patch, nop);
+}
+
+static void ucl_diff_node (struct ucl_diff_ctx *ctx, const ucl_object_t *o,
+		const ucl_object_t *n);
+
+static void
+ucl_diff_objects (struct ucl_diff_ctx *ctx, const ucl_object_t *o,
+		const ucl_object_t *n)
+{
+	const ucl_object_t *cur, *found;
+	const void *cursor = NULL;
+	size_t plen = utstring_len (ctx->path);
+
+	while ((cur = ucl_hash_iterate_cursor (o->value.ov, &cursor))) {
+		found = ucl_object_lookup_len (n, cur->key, cur->keylen);
+		ucl_diff_path_push (ctx, cur->key, cur->keylen);
+
+		if (found == NULL) {
+			ucl_diff_emit_op (ctx, "remove", NULL, false);
+		}
+		else if (!ucl_diff_same (cur, found)) {
+			if (cur->next == NULL && found->next == NULL) {
+				ucl_diff_node (ctx, cur, found);
+			}
+			else {
+				ucl_diff_emit_op (ctx, "replace", found, true);
+			}
+		}
+
+		ucl_diff_path_restore (ctx, plen);
+	}
+
+	cursor = NULL;
+
+	while ((cur = ucl_hash_iterate_cursor (n->value.ov, &cursor))) {
+		if (ucl_object_lookup_len (o, cur->key, cur->keylen) == NULL) {
+			ucl_diff_path_push (ctx, cur->key, cur->keylen);
+			ucl_diff_emit_op (ctx, "add", cur, true);
+			ucl_diff_path_restore (ctx, plen);
+		}
+	}
+}
+
+static void
+ucl_diff_arrays (struct ucl_diff_ctx *ctx, const ucl_object_t *o,
+		const ucl_object_t *n)
+{
+	unsigned olen, nlen, pref = 0, suf = 0, i, omid, nmid;
+	size_t plen = utstring_len (ctx->path);
+
+	olen = ucl_array_size (o);
+	nlen = ucl_array_size (n);
+
+	/* Skip common prefix and suffix, so insertions and deletions are cheap */
+	while (pref < olen && pref < nlen &&
+			ucl_diff_same (ucl_array_find_index (o, pref),
+					ucl_array_find_index (n, pref))) {
+		pref ++;
+	}
+
+	while (suf < olen - pref && suf < nlen - pref &&
+			ucl_diff_same (ucl_array_find_index (o, olen - suf - 1),
+					ucl_array_find_index (n, nlen - suf - 1))) {
+		suf ++;
+	}
+
+	omid = olen - pref - suf;
+	nmid = nlen - pref - suf;
+
+	for (i = 0; i < omid && i < nmid; i ++) {
+		ucl_diff_path_push_index (ctx, pref + i);
+		ucl_diff_node (ctx, ucl_array_find_index (o, pref + i),
+				ucl_array_find_index (n, pref + i));
+		ucl_diff_path_restore (ctx, plen);
+	}
+
+	for (; i < nmid; i ++) {
+		if (suf == 0) {
+			utstring_append_len (ctx->path, "/-", 2);
+		}
+		else {
+			ucl_diff_path_push_index (ctx, pref + i);
+		}
+
+		ucl_diff_emit_op (ctx, "add", ucl_array_find_index (n, pref + i), true);
+		ucl_diff_path_restore (ctx, plen);
+	}
+
+	for (; i < omid; i ++) {
+		/* Elements are shifted after each removal */
+		ucl_diff_path_push_index (ctx, pref + nmid);
+		ucl_diff_emit_op (ctx, "remove", NULL, false);
+		ucl_diff_path_restore (ctx, plen);
+	}
+}
+
+static void
+ucl_diff_node (struct ucl_diff_ctx *ctx, const ucl_object_t *o,
+		const ucl_object_t *n)
+{
+	if (ucl_diff_same (o, n)) {
+		return;
+	}
+
+	if (o != NULL && n != NULL && o->type == n->type) {
+		if (o->type == UCL_OBJECT) {
+			ucl_diff_objects (ctx, o, n);
+			return;
+		}
+		else if (o->type == UCL_ARRAY) {
+			ucl_diff_arrays (ctx, o, n);
+			return;
+		}
+	}
+
+	ucl_diff_emit_op (ctx, "replace", n, true);
+}
+
+ucl_object_t *
+ucl_object_diff (const ucl_object_t *o, const ucl_object_t *n)
+{
+	struct ucl_diff_ctx ctx;
+	struct ucl_fingerprint f1, f2;
+
+	if (o == NULL || n == NULL) {
+		return NULL;
+	}
+
+	ctx.patch = ucl_object_typed_new (UCL_ARRAY);
+	utstring_new (ctx.path);
+
+	/* Validate cached fingerprints of all containers in both trees */
+	ucl_object_fingerprint_values (o, true, &f1);
+	ucl_object_fingerprint_values (n, true, &f2);
+
+	if (f1.h1 != f2.h1 || f1.h2 != f2.h2 || !ucl_diff_equal (o, n)) {
+		if (o->next == NULL && n->next == NULL) {
+			ucl_diff_node (&ctx, o, n);
+		}
+		else {
+			ucl_diff_emit_op (&ctx, "replace", n, true);
+		}
+	}
+
+	utstring_free (ctx.path);
+
+	return ctx.patch;
+}
+
+static inline bool
+ucl_diff_is_number (const ucl_object_t *obj)
+{
+	return obj->type == UCL_INT || obj->type == UCL_FLOAT ||
+			obj->type == UCL_TIME;
+}
+
+/*
+ * Numbers are equal if their values are (RFC 6902, 4.6), integers are
+ * compared with doubles without rounding them
+ */
+static bool
+ucl_diff_equal_number (const ucl_object_t *o1, const ucl_object_t *o2)
+{
+	const ucl_object_t *tmp;
+	double dv;
+
+	if (o1->type != UCL_INT && o2->type != UCL_INT) {
+		return o1->value.dv == o2->value.dv;
+	}
+
+	if (o2->type == UCL_INT) {
+		if (o1->type == UCL_INT) {
+			return o1->value.iv == o2->value.iv;
+		}
+
+		tmp = o1;
+		o1 = o2;
+		o2 = tmp;
+	}
+
+	/* o1 is an integer and o2 is a double */
+	dv = o2->value.dv;
+
+	if (dv != dv || dv < -9223372036854775808.0 ||
+			dv >= 9223372036854775808.0 || (double)(int64_t)dv != dv) {
+		return false;
+	}
+
+	return (int64_t)dv == o1->value.iv;
+}
+
+/*
+ * Exact equality of two values: `ucl_object_compare` is an ordering and
+ * must not decide the `test` operation
+ */
+static bool
+ucl_diff_equal_value (const ucl_object_t *o1, const ucl_object_t *o2)
+{
+	const ucl_object_t *it1, *it2;
+	ucl_object_iter_t iter = NULL;
+	unsigned int i;
+
+	if (ucl_diff_is_number (o1) && ucl_diff_is_number (o2)) {
+		return ucl_diff_equal_number (o1, o2);
+	}
+
+	if (o1->type != o2->type) {
+		return false;
+	}
+
+	switch (o1->type) {
+	case UCL_BOOLEAN:
+		return ucl_object_toboolean (o1) == ucl_object_toboolean (o2);
+	case UCL_STRING:
+		return o1->len == o2->len && (o1->len == 0 ||
+				memcmp (o1->value.sv, o2->value.sv, o1->len) == 0);
+	case UCL_USERDATA:
+		return o1->value.ud == o2->value.ud;
+	case UCL_ARRAY:
+		if (o1->len != o2->len) {
+			return false;
+		}
+
+		for (i = 0; i < o1->len; i ++) {
+			it1 = ucl_array_find_index (o1, i);
+			it2 = ucl_array_find_index (o2, i);
+
+			if (it1 == NULL || it2 == NULL) {
+				if (it1 != it2) {
+					return false;
+				}
+			}
+			else if (!ucl_diff_equal_value (it1, it2)) {
+				return false;
+			}
+		}
+
+		return true;
+	case UCL_OBJECT:
+		if (o1->len != o2->len) {
+			return false;
+		}
+
+		while ((it1 = ucl_object_iterate (o1, &iter, true)) != NULL) {
+			it2 = ucl_object_lookup_len (o2, it1->key, it1->keylen);
+
+			if (it2 == NULL || !ucl_diff_equal (it1, it2)) {
+				return false;
+			}
+		}
+
+		return true;
+	default:
+		return true;
+	}
+}
+
+/*
+ * Implicit arrays are equal if all their values are equal in order
+ */
+static bool
+ucl_diff_equal (const ucl_object_t *o1, const ucl_object_t *o2)
+{
+	while (o1 != NULL && o2 != NULL) {
+		if (!ucl_diff_equal_value (o1, o2)) {
+			return false;
+		}
+
+		o1 = o1->next;
+		o2 = o2->next;
+	}
+
+	return o1 == NULL && o2 == NULL;
+}
+
+/*
+ * JSON pointer resolution for patches
+ */
+struct ucl_patch_target {
+	ucl_object_t *parent;
+	ucl_object_t *node;
+	char *key;
+	size_t keylen;
+	/* Index in an array parent or -1 for `-` */
+	int64_t index;
+};
+
+static bool
+ucl_patch_parse_index (const char *tok, size_t len, int64_t *idx)
+{
+	size_t i;
+
+	if (len == 1 && *tok == '-') {
+		*idx = -1;
+		return true;
+	}
+
+	if (len == 0 || (len > 1 && *tok == '0')) {
+		return false;
+	}
+
+	*idx = 0;
+
+	for (i = 0; i < len; i ++) {
+		if (!isdigit ((unsigned char)tok[i]) || *idx > UINT_MAX / 10) {
+			return false;
+		}
+		*idx = *idx * 10 + (tok[i] - '0');
+	}
+
+	return true;
+}
+
+/* Returns an unescaped token from `*p`, advancing `*p` */
+static char *
+ucl_patch_next_token (const char **p, const char *end, size_t *len)
+{
+	const char *c = *p;
+	char *tok, *t;
+
+	while (*p < end && **p != '/') {
+		(*p) ++;
+	}
+
+	tok = UCL_ALLOC (*p - c + 1);
+
+	if (tok == NULL) {
+		return NULL;
+	}
+
+	for (t = tok; c < *p; c ++) {
+		if (*c == '~' && c + 1 < *p && (c[1] == '0' || c[1] == '1')) {
+			*t++ = c[1] == '0' ? '~' : '/';
+			c ++;
+		}
+		else if (*c == '~') {
+			ucl_free (tok);
+			return NULL;
+		}
+		else {
+			*t++ = *c;
+		}
+	}
+
+	*t = '\0';
+	*len = t - tok;
+
+	return tok;
+}
+
+static bool
+ucl_patch_resolve (ucl_object_t *top, const char *path, size_t pathlen,
+		struct ucl_patch_target *tgt)
+{
+	const char *p = path, *end = path + pathlen;
+	ucl_object_t *cur = top, *next = NULL;
+	int64_t idx;
+
+	memset (tgt, 0, sizeof (*tgt));
+	tgt->index = -1;
+
+	if (pathlen == 0) {
+		tgt->node = top;
+		return true;
+	}
+
+	if (*p != '/') {
+		return false;
+	}
+
+	while (p < end) {
+		/* Skip '/' */
+		p ++;
+
+		if (tgt->key != NULL) {
+			ucl_free (tgt->key);
+		}
+
+		tgt->key = ucl_patch_next_token (&p, end, &tgt->keylen);
+
+		if (tgt->key == NULL || cur == NULL) {
+			goto err;
+		}
+
+		if (cur->type == UCL_OBJECT) {
+			next = __DECONST (ucl_object_t *,
+					ucl_object_lookup_len (cur, tgt->key, tgt->keylen));
+			tgt->index = -1;
+		}
+		else if (cur->type == UCL_ARRAY) {
+			if (!ucl_patch_parse_index (tgt->key, tgt->keylen, &idx)) {
+				goto err;
+			}
+
+			if (idx >= 0) {
+				next = __DECONST (ucl_object_t *,
+						ucl_array_find_index (cur, idx));
+			}
+			else {
+				next = NULL;
+			}
+
+			tgt->index = idx;
+		}
+		else {
+			goto err;
+		}
+
+		tgt->parent = cur;
+		cur = next;
+	}
+
+	tgt->node = cur;
+
+	return true;
+err:
+	if (tgt->key != NULL) {
+		ucl_free (tgt->key);
+		tgt->key = NULL;
+	}
+
+	return false;
+}
+
+/*
+ * The top object is owned by a caller, so it is replaced in place: its value
+ * is swapped with the value of `elt` that is freed then
+ */
+static bool
+ucl_patch_replace_top (ucl_object_t *top, ucl_object_t *elt)
+{
+	const uint16_t vflags = UCL_OBJECT_ALLOCATED_VALUE|UCL_OBJECT_MULTILINE|
+			UCL_OBJECT_MULTIVALUE|UCL_OBJECT_BINARY|UCL_OBJECT_SQUOTED;
+	const struct ucl_allocator *prev;
+	ucl_object_t tmp, *cp;
+
+	if (top->next != NULL || elt->next != NULL ||
+			(top->flags & (UCL_OBJECT_FROZEN|UCL_OBJECT_EPHEMERAL)) ||
+			top->type == UCL_USERDATA || elt->type == UCL_USERDATA) {
+		ucl_object_unref (elt);
+		return false;
+	}
+
+	if (ucl_object_allocator (top) != ucl_object_allocator (elt)) {
+		/* Swapped strings are freed with the allocator of their new node */
+		prev = ucl_object_allocator_enter (top);
+		cp = ucl_object_copy (elt);
+		ucl_allocator_leave (prev);
+		ucl_object_unref (elt);
+
+		if (cp == NULL) {
+			return false;
+		}
+
+		elt = cp;
+	}
+
+	tmp = *top;
+	top->value = elt->value;
+	top->len = elt->len;
+	top->type = elt->type;
+	top->trash_stack[UCL_TRASH_VALUE] = elt->trash_stack[UCL_TRASH_VALUE];
+	top->flags = (top->flags & ~vflags) | (elt->flags & vflags);
+	elt->value = tmp.value;
+	elt->len = tmp.len;
+	elt->type = tmp.type;
+	elt->trash_stack[UCL_TRASH_VALUE] = tmp.trash_stack[UCL_TRASH_VALUE];
+	elt->flags = (elt->flags & ~vflags) | (tmp.flags & vflags);
+	ucl_object_unref (elt);
+
+	return true;
+}
+
+static bool
+ucl_patch_insert (struct ucl_patch_target *tgt, ucl_object_t *elt)
+{
+	bool ret = false;
+
+	if (tgt->parent == NULL) {
+		if (tgt->node == NULL || elt == NULL) {
+			ucl_object_unref (elt);
+			return false;
+		}
+
+		return ucl_patch_replace_top (tgt->node, elt);
+	}
+
+	if (tgt->parent->type == UCL_OBJECT) {
+		if (tgt->node != NULL) {
+			ret = ucl_object_replace_key (tgt->parent, elt, tgt->key,
+					tgt->keylen, true);
+		}
+		else {
+			ret = ucl_object_insert_key (tgt->parent, elt, tgt->key,
+					tgt->keylen, true);
+		}
+	}
+	else if (tgt->index < 0) {
+		ret = ucl_array_append (tgt->parent, elt);
+	}
+	else {
+		ret = ucl_array_insert_index (tgt->parent, elt, tgt->index);
+	}
+
+	if (!ret) {
+		ucl_object_unref (elt);
+	}
+
+	return ret;
+}
+
+static ucl_object_t *
+ucl_patch_detach (struct ucl_patch_target *tgt)
+{
+	if (tgt->parent == NULL || tgt->node == NULL) {
+		return NULL;
+	}
+
+	if (tgt->parent->type == UCL_OBJECT) {
+		return ucl_object_pop_keyl (tgt->parent, tgt->key, tgt->keylen);
+	}
+
+	return ucl_array_delete_index (tgt->parent, tgt->index);
+}
+
+static bool
+ucl_patch_apply_op (ucl_object_t *top, const ucl_object_t *op)
+{
+	const ucl_object_t *opname, *path, *from, *value;
+	struct ucl_patch_target tgt, src;
+	ucl_object_t *elt, *old;
+	const char *name;
+	bool ret = false;
+
+	opname = ucl_object_lookup (op, "op");
+	path = ucl_object_lookup (op, "path");
+	value = ucl_object_lookup (op, "value");
+	from = ucl_object_lookup (op, "from");
+
+	if (opname == NULL || opname->type != UCL_STRING || path == NULL ||
+			path->type != UCL_STRING) {
+		return false;
+	}
+
+	name = ucl_object_tostring (opname);
+	memset (&src, 0, sizeof (src));
+
+	if (!ucl_patch_resolve (top, path->value.sv, path->len, &tgt)) {
+		return false;
+	}
+
+	if (strcmp (name, "add") == 0) {
+		if (value != NULL && (tgt.parent == NULL ||
+				tgt.parent->type == UCL_OBJECT ||
+				tgt.index <= (int64_t)ucl_array_size (tgt.parent))) {
+			elt = ucl_diff_copy_values (value,
+					tgt.parent != NULL && tgt.parent->type == UCL_OBJECT);
+			ret = ucl_patch_insert (&tgt, elt);
+		}
+	}
+	else if (strcmp (name, "remove") == 0) {
+		if ((elt = ucl_patch_detach (&tgt)) != NULL) {
+			ucl_object_unref (elt);
+			ret = true;
+		}
+	}
+	else if (strcmp (name, "replace") == 0) {
+		if (value != NULL && tgt.node != NULL) {
+			elt = ucl_diff_copy_values (value,
+					tgt.parent != NULL && tgt.parent->type == UCL_OBJECT);
+
+			if (tgt.parent == NULL || tgt.parent->type == UCL_OBJECT) {
+				ret = ucl_patch_insert (&tgt, elt);
+			}
+			else {
+				old = ucl_array_replace_index (tgt.parent, elt, tgt.index);
+
+				if (old != NULL) {
+					ucl_object_unref (old);
+					ret = true;
+				}
+				else {
+					ucl_object_unref (elt);
+				}
+			}
+		}
+	}
+	else if (strcmp (name, "test") == 0) {
+		ret = value != NULL && tgt.node != NULL &&
+				ucl_diff_equal (tgt.node, value);
+	}
+	else if ((strcmp (name, "copy") == 0 || strcmp (name, "move") == 0) &&
+			from != NULL && from->type == UCL_STRING &&
+			ucl_patch_resolve (top, from->value.sv, from->len, &src) &&
+			src.node != NULL) {
+		if (name[0] == 'c') {
+			elt = ucl_diff_copy_values (src.node, tgt.parent != NULL &&
+					tgt.parent->type == UCL_OBJECT);
+			ret = ucl_patch_insert (&tgt, elt);
+		}
+		else if (from->len == path->len &&
+				memcmp (from->value.sv, path->value.sv, path->len) == 0) {
+			ret = true;
+		}
+		else if (!(path->len > from->len &&
+				memcmp (from->value.sv, path->value.sv, from->len) == 0 &&
+				path->value.sv[from->len] == '/')) {
+			/* Cannot move an object to its own child */
+			elt = ucl_patch_detach (&src);
+
+			if (elt != NULL) {
+				ucl_free (tgt.key);
+
+				/* Removal might have shifted array elements */
+				if (ucl_patch_resolve (top, path->value.sv, path->len,
+						&tgt)) {
+					ret = ucl_patch_insert (&tgt, elt);
+				}
+				else {
+					tgt.key = NULL;
+					ucl_object_unref (elt);
+				}
+			}
+		}
+	}
+
+	ucl_free (tgt.key);
+	ucl_free (src.key);
+
+	return ret;
+}
+
+bool
+ucl_object_patch (ucl_object_t *top, const ucl_object_t *patch)
+{
+	const ucl_object_t *op;
+	ucl_object_iter_t it = NULL;
+
+	if (top == NULL || patch == NULL || patch->type != UCL_ARRAY) {
+		return false;
+	}
+
+	while ((op = ucl_object_iterate (patch, &it, true)) != NULL) {
+		if (!ucl_patch_apply_op (top, op)) {
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,578 @@
+/* Copyright (c) 2014, Vsevolod Stakhov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *       * Redistributions of source code must retain the above copyright
+ *         notice, this list of conditions and the following disclaimer.
+ *       * Redistributions in binary form must reproduce the above copyright
+ *         notice, this list of conditions and the following disclaimer in the
+ *         documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Locale independent number formatting for emitters.
+ *
+ * Doubles are printed with the Grisu3 algorithm by Florian Loitsch
+ * ("Printing Floating-Point Numbers Quickly and Accurately with Integers",
+ * PLDI 2010): it either produces the shortest representation that reads
+ * back to the same double or detects that it cannot prove the result is the
+ * shortest. The latter happens for about 0.5% of inputs, they are printed by
+ * searching for the shortest correctly rounded `%.*e` output that reads back.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "ucl.h"
+#include "ucl_internal.h"
+
+struct ucl_diy_fp {
+	uint64_t f;
+	int e;
+};
+
+#define UCL_DBL_SIGNIFICAND_MASK 0x000FFFFFFFFFFFFFULL
+#define UCL_DBL_HIDDEN_BIT 0x0010000000000000ULL
+#define UCL_DBL_EXPONENT_MASK 0x7FF0000000000000ULL
+#define UCL_DBL_SIGNIFICAND_SIZE 52
+#define UCL_DBL_EXPONENT_BIAS (0x3FF + UCL_DBL_SIGNIFICAND_SIZE)
+
+/* Normalized powers of ten: 10^-348, 10^-340, ..., 10^340 */
+static const uint64_t ucl_cached_powers_f[] = {
+	0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+	0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+	0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+	0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+	0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+	0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+	0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+	0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+	0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+	0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+	0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+	0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+	0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+	0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+	0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+	0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+	0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+	0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+	0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+	0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+	0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+	0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+	0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+	0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+	0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+	0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+	0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+	0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+	0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL
+};
+
+static const int16_t ucl_cached_powers_e[] = {
+	-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954,
+	-927, -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635,
+	-608, -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316,
+	-289, -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30, 56,
+	83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348, 375, 402, 428, 455,
+	481, 508, 534, 561, 588, 614, 641, 667, 694, 720, 747, 774, 800, 827, 853,
+	880, 907, 933, 960, 986, 1013, 1039, 1066
+};
+
+static const uint64_t ucl_pow10[] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+	10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+	100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+	100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+	100000000000000000ULL, 1000000000000000000ULL,
+	10000000000000000000ULL
+};
+
+static const char ucl_digits_lut[200] =
+	"0001020304050607080910111213141516171819"
+	"2021222324252627282930313233343536373839"
+	"4041424344454647484950515253545556575859"
+	"6061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+static inline struct ucl_diy_fp
+ucl_diy_fp_mul (struct ucl_diy_fp x, struct ucl_diy_fp y)
+{
+	struct ucl_diy_fp r;
+	const uint64_t m32 = 0xFFFFFFFFULL;
+	uint64_t a = x.f >> 32, b = x.f & m32, c = y.f >> 32, d = y.f & m32;
+	uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+	uint64_t tmp = (bd >> 32) + (ad & m32) + (bc & m32);
+
+	/* Round the lower half */
+	tmp += 1ULL << 31;
+	r.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+	r.e = x.e + y.e + 64;
+
+	return r;
+}
+
+static inline struct ucl_diy_fp
+ucl_diy_fp_normalize (struct ucl_diy_fp x)
+{
+	while (!(x.f & (1ULL << 63))) {
+		x.f <<= 1;
+		x.e --;
+	}
+
+	return x;
+}
+
+/*
+ * Get the boundaries m- and m+ of the interval of reals that round to v,
+ * both sharing the exponent of normalized m+
+ */
+static void
+ucl_diy_fp_boundaries (struct ucl_diy_fp v, struct ucl_diy_fp *minus,
+		struct ucl_diy_fp *plus)
+{
+	struct ucl_diy_fp pl, mi;
+
+	pl.f = (v.f << 1) + 1;
+	pl.e = v.e - 1;
+
+	while (!(pl.f & (UCL_DBL_HIDDEN_BIT << 1))) {
+		pl.f <<= 1;
+		pl.e --;
+	}
+
+	pl.f <<= 64 - UCL_DBL_SIGNIFICAND_SIZE - 2;
+	pl.e -= 64 - UCL_DBL_SIGNIFICAND_SIZE - 2;
+
+	if (v.f == UCL_DBL_HIDDEN_BIT) {
+		/* The lower boundary is closer for powers of two */
+		mi.f = (v.f << 2) - 1;
+		mi.e = v.e - 2;
+	}
+	else {
+		mi.f = (v.f << 1) - 1;
+		mi.e = v.e - 1;
+	}
+
+	mi.f <<= mi.e - pl.e;
+	mi.e = pl.e;
+
+	*minus = mi;
+	*plus = pl;
+}
+
+/*
+ * Select a cached power c = 10^-K, so that the product of c and a number
+ * with binary exponent `e` has an exponent in [-60, -32]
+ */
+static struct ucl_diy_fp
+ucl_cached_power (int e, int *K)
+{
+	struct ucl_diy_fp r;
+	double dk = (-61 - e) * 0.30102999566398114 + 347;
+	int k = (int)dk;
+	unsigned idx;
+
+	if (dk - k > 0.0) {
+		k ++;
+	}
+
+	idx = (unsigned)((k >> 3) + 1);
+	*K = -(-348 + (int)(idx << 3));
+	r.f = ucl_cached_powers_f[idx];
+	r.e = ucl_cached_powers_e[idx];
+
+	return r;
+}
+
+/*
+ * Move the last digit down while it gets closer to w, `rest` is the distance
+ * from the digits to too_high; returns false if the result is not known to
+ * be inside of the safe interval or to be the closest to w
+ */
+static bool
+ucl_grisu_round_weed (char *buf, int len, uint64_t dist_high_w,
+		uint64_t unsafe, uint64_t rest, uint64_t ten_kappa, uint64_t unit)
+{
+	const uint64_t small_dist = dist_high_w - unit;
+	const uint64_t big_dist = dist_high_w + unit;
+
+	while (rest < small_dist && unsafe - rest >= ten_kappa &&
+			(rest + ten_kappa < small_dist ||
+			small_dist - rest >= rest + ten_kappa - small_dist)) {
+		buf[len - 1] --;
+		rest += ten_kappa;
+	}
+
+	/* Another digit may be closer to the real w */
+	if (rest < big_dist && unsafe - rest >= ten_kappa &&
+			(rest + ten_kappa < big_dist ||
+			big_dist - rest > rest + ten_kappa - big_dist)) {
+		return false;
+	}
+
+	return 2 * unit <= rest && rest <= unsafe - 4 * unit;
+}
+
+static unsigned
+ucl_count_digits32 (uint32_t n)
+{
+	unsigned i;
+
+	for (i = 1; i < 10; i ++) {
+		if (n < ucl_pow10[i]) {
+			return i;
+		}
+	}
+
+	return 10;
+}
+
+/*
+ * Generate the shortest digits in the unsafe interval (low - 1, high + 1)
+ * of scaled boundaries, all sharing the exponent of w in [-60, -32]
+ */
+static bool
+ucl_grisu_digits (struct ucl_diy_fp low, struct ucl_diy_fp w,
+		struct ucl_diy_fp high, char *buf, int *len, int *kappa)
+{
+	const int shift = -w.e;
+	const uint64_t one = 1ULL << shift;
+	const uint64_t too_high = high.f + 1;
+	uint64_t unit = 1, unsafe = too_high - (low.f - 1);
+	/* Integral part is not zero as high is normalized */
+	uint32_t integrals = (uint32_t)(too_high >> shift), divisor, d;
+	uint64_t fractionals = too_high & (one - 1), rest;
+
+	*kappa = (int)ucl_count_digits32 (integrals);
+	divisor = (uint32_t)ucl_pow10[*kappa - 1];
+	*len = 0;
+
+	while (*kappa > 0) {
+		d = integrals / divisor;
+		buf[(*len) ++] = (char)('0' + d);
+		integrals %= divisor;
+		(*kappa) --;
+		rest = ((uint64_t)integrals << shift) + fractionals;
+
+		if (rest < unsafe) {
+			return ucl_grisu_round_weed (buf, *len, too_high - w.f, unsafe,
+					rest, (uint64_t)divisor << shift, unit);
+		}
+
+		divisor /= 10;
+	}
+
+	for (;;) {
+		fractionals *= 10;
+		unit *= 10;
+		unsafe *= 10;
+		d = (uint32_t)(fractionals >> shift);
+		buf[(*len) ++] = (char)('0' + d);
+		fractionals &= one - 1;
+		(*kappa) --;
+
+		if (fractionals < unsafe) {
+			return ucl_grisu_round_weed (buf, *len, (too_high - w.f) * unit,
+					unsafe, fractionals, one, unit);
+		}
+	}
+}
+
+/*
+ * Produce the shortest digit string `buf` (not terminated) of a positive
+ * finite double, so that value = buf * 10^K; returns 0 if that cannot be
+ * proven
+ */
+static int
+ucl_grisu3 (uint64_t bits, char *buf, int *K)
+{
+	struct ucl_diy_fp v, w, mi, pl, c;
+	int biased = (int)((bits & UCL_DBL_EXPONENT_MASK) >>
+			UCL_DBL_SIGNIFICAND_SIZE);
+	int len, kappa;
+
+	v.f = bits & UCL_DBL_SIGNIFICAND_MASK;
+
+	if (biased != 0) {
+		v.f += UCL_DBL_HIDDEN_BIT;
+		v.e = biased - UCL_DBL_EXPONENT_BIAS;
+	}
+	else {
+		v.e = 1 - UCL_DBL_EXPONENT_BIAS;
+	}
+
+	/* Normalized v and m+ share the exponent */
+	ucl_diy_fp_boundaries (v, &mi, &pl);
+	c = ucl_cached_power (pl.e, K);
+	w = ucl_diy_fp_mul (ucl_diy_fp_normalize (v), c);
+	pl = ucl_diy_fp_mul (pl, c);
+	mi = ucl_diy_fp_mul (mi, c);
+
+	if (!ucl_grisu_digits (mi, w, pl, buf, &len, &kappa)) {
+		return 0;
+	}
+
+	*K += kappa;
+
+	return len;
+}
+
+/*
+ * Slow path for values rejected by Grisu3: the shortest correctly rounded
+ * output of printf that reads back to the same value
+ */
+static int
+ucl_dtoa_slow (uint64_t bits, char *buf, int *K)
+{
+	char tmp[40];
+	const char *p;
+	double val;
+	int prec, len = 0, exp;
+
+	bits &= ~(1ULL << 63);
+	memcpy (&val, &bits, sizeof (val));
+
+	for (prec = 0; ; prec ++) {
+		snprintf (tmp, sizeof (tmp), "%.*e", prec, val);
+
+		if (prec >= 16 || strtod (tmp, NULL) == val) {
+			break;
+		}
+	}
+
+	/* Decimal point depends on the locale, so take only digits */
+	for (p = tmp; *p != 'e' && *p != '\0'; p ++) {
+		if (*p >= '0' && *p <= '9') {
+			buf[len ++] = *p;
+		}
+	}
+
+	exp = *p == 'e' ? (int)strtol (p + 1, NULL, 10) : 0;
+
+	while (len > 1 && buf[len - 1] == '0') {
+		len --;
+	}
+
+	*K = exp - len + 1;
+
+	return len;
+}
+
+static int
+ucl_dtoa_digits (uint64_t bits, char *buf, int *K)
+{
+	int len = ucl_grisu3 (bits, buf, K);
+
+	if (len == 0) {
+		len = ucl_dtoa_slow (bits, buf, K);
+	}
+
+	return len;
+}
+
+static char *
+ucl_write_exponent (int k, char *p, bool plus)
+{
+	if (k < 0) {
+		*p ++ = '-';
+		k = -k;
+	}
+	else if (plus) {
+		*p ++ = '+';
+	}
+
+	if (k >= 100) {
+		*p ++ = (char)('0' + k / 100);
+		k %= 100;
+		memcpy (p, &ucl_digits_lut[k * 2], 2);
+		p += 2;
+	}
+	else if (k >= 10) {
+		memcpy (p, &ucl_digits_lut[k * 2], 2);
+		p += 2;
+	}
+	else {
+		*p ++ = (char)('0' + k);
+	}
+
+	return p;
+}
+
+/*
+ * Place the decimal point: plain notation for numbers in [1e-6, 1e21),
+ * exponent notation otherwise. Integral values keep `.0`, so they are
+ * read back as floats, unless canonical (ECMAScript) form is requested
+ */
+static size_t
+ucl_dtoa_prettify (char *buf, int len, int k, bool canonical)
+{
+	const int kk = len + k;
+	int i;
+
+	if (k >= 0 && kk <= 21) {
+		/* 1234e7 -> 12340000000.0 */
+		for (i = len; i < kk; i ++) {
+			buf[i] = '0';
+		}
+
+		if (canonical) {
+			return kk;
+		}
+
+		buf[kk] = '.';
+		buf[kk + 1] = '0';
+
+		return kk + 2;
+	}
+	else if (kk > 0 && kk <= 21) {
+		/* 1234e-2 -> 12.34 */
+		memmove (&buf[kk + 1], &buf[kk], len - kk);
+		buf[kk] = '.';
+
+		return len + 1;
+	}
+	else if (kk > -6 && kk <= 0) {
+		/* 1234e-6 -> 0.001234 */
+		const int offset = 2 - kk;
+
+		memmove (&buf[offset], &buf[0], len);
+		buf[0] = '0';
+		buf[1] = '.';
+
+		for (i = 2; i < offset; i ++) {
+			buf[i] = '0';
+		}
+
+		return len + offset;
+	}
+	else if (len == 1) {
+		/* 1e30 */
+		buf[1] = 'e';
+
+		return ucl_write_exponent (kk - 1, &buf[2], canonical) - buf;
+	}
+
+	/* 1234e30 -> 1.234e33 */
+	memmove (&buf[2], &buf[1], len - 1);
+	buf[1] = '.';
+	buf[len + 1] = 'e';
+
+	return ucl_write_exponent (kk - 1, &buf[len + 2], canonical) - buf;
+}
+
+size_t
+ucl_dtoa (double val, char *buf)
+{
+	uint64_t bits;
+	char *p = buf;
+	int len, k;
+
+	memcpy (&bits, &val, sizeof (bits));
+
+	if (bits >> 63) {
+		*p ++ = '-';
+	}
+
+	if ((bits & UCL_DBL_EXPONENT_MASK) == UCL_DBL_EXPONENT_MASK) {
+		if (bits & UCL_DBL_SIGNIFICAND_MASK) {
+			/* No sign for NaN */
+			memcpy (buf, "nan", 4);
+			return 3;
+		}
+
+		memcpy (p, "inf", 4);
+		return p - buf + 3;
+	}
+
+	if ((bits & ~(1ULL << 63)) == 0) {
+		memcpy (p, "0.0", 4);
+		return p - buf + 3;
+	}
+
+	len = ucl_dtoa_digits (bits, p, &k);
+	len = (int)ucl_dtoa_prettify (p, len, k, false);
+	p[len] = '\0';
+
+	return p - buf + len;
+}
+
+size_t
+ucl_dtoa_canonical (double val, char *buf)
+{
+	uint64_t bits;
+	char *p = buf;
+	int len, k;
+
+	memcpy (&bits, &val, sizeof (bits));
+
+	if ((bits & UCL_DBL_EXPONENT_MASK) == UCL_DBL_EXPONENT_MASK) {
+		buf[0] = '\0';
+		return 0;
+	}
+
+	/* Negative zero is written as zero */
+	if ((bits & ~(1ULL << 63)) == 0) {
+		memcpy (buf, "0", 2);
+		return 1;
+	}
+
+	if (bits >> 63) {
+		*p ++ = '-';
+	}
+
+	len = ucl_dtoa_digits (bits, p, &k);
+	len = (int)ucl_dtoa_prettify (p, len, k, true);
+	p[len] = '\0';
+
+	return p - buf + len;
+}
+
+size_t
+ucl_itoa (int64_t val, char *buf)
+{
+	char tmp[24], *p = tmp + sizeof (tmp);
+	uint64_t u = val < 0 ? -(uint64_t)val : (uint64_t)val;
+	size_t len;
+	unsigned idx;
+
+	while (u >= 100) {
+		idx = (unsigned)(u % 100) * 2;
+		u /= 100;
+		*--p = ucl_digits_lut[idx + 1];
+		*--p = ucl_digits_lut[idx];
+	}
+
+	if (u >= 10) {
+		idx = (unsigned)u * 2;
+		*--p = ucl_digits_lut[idx + 1];
+		*--p = ucl_digits_lut[idx];
+	}
+	else {
+		*--p = (char)('0' + u);
+	}
+
+	if (val < 0) {
+		*--p = '-';
+	}
+
+	len = tmp + sizeof (tmp) - p;
+	memcpy (buf, p, len);
+	buf[len] = '\0';
+
+	return len;
+}
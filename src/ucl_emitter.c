@@ -34,6 +34,9 @@
 #ifdef HAVE_MATH_H
 #include <math.h>
 #endif
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 /**
  * @file ucl_emitter.c
@@ -42,6 +45,10 @@
 
 static void ucl_emitter_common_elt (struct ucl_emitter_context *ctx,
 		const ucl_object_t *obj, bool first, bool print_key, bool compact);
+static bool ucl_emitter_parallel_elts (struct ucl_emitter_context *ctx,
+		const ucl_object_t *obj);
+static bool ucl_emitter_cached_elt (struct ucl_emitter_context *ctx,
+		const ucl_object_t *obj, bool first, bool print_key);
 
 #define UCL_EMIT_TYPE_OPS(type)		\
 	static void ucl_emit_ ## type ## _elt (struct ucl_emitter_context *ctx,	\
@@ -63,6 +70,8 @@ UCL_EMIT_TYPE_OPS(json_compact);
 UCL_EMIT_TYPE_OPS(config);
 UCL_EMIT_TYPE_OPS(yaml);
 UCL_EMIT_TYPE_OPS(msgpack);
+UCL_EMIT_TYPE_OPS(json_canonical);
+UCL_EMIT_TYPE_OPS(ndjson);
 
 #define UCL_EMIT_TYPE_CONTENT(type) {	\
 	.ucl_emitter_write_elt = ucl_emit_ ## type ## _elt,	\
@@ -77,14 +86,71 @@ const struct ucl_emitter_operations ucl_standartd_emitter_ops[] = {
 	[UCL_EMIT_JSON_COMPACT] = UCL_EMIT_TYPE_CONTENT(json_compact),
 	[UCL_EMIT_CONFIG] = UCL_EMIT_TYPE_CONTENT(config),
 	[UCL_EMIT_YAML] = UCL_EMIT_TYPE_CONTENT(yaml),
+	[UCL_EMIT_MSGPACK] = UCL_EMIT_TYPE_CONTENT(msgpack),
+	[UCL_EMIT_JSON_CANONICAL] = UCL_EMIT_TYPE_CONTENT(json_canonical),
+	[UCL_EMIT_NDJSON] = UCL_EMIT_TYPE_CONTENT(ndjson)
+};
+
+/*
+ * The same operations, distinct addresses mark contexts of parallel emitting
+ */
+static const struct ucl_emitter_operations ucl_parallel_emitter_ops[] = {
+	[UCL_EMIT_JSON] = UCL_EMIT_TYPE_CONTENT(json),
+	[UCL_EMIT_JSON_COMPACT] = UCL_EMIT_TYPE_CONTENT(json_compact),
 	[UCL_EMIT_MSGPACK] = UCL_EMIT_TYPE_CONTENT(msgpack)
 };
 
+#define UCL_EMIT_IS_PARALLEL(ctx) ((ctx)->id >= 0 && \
+		(ctx)->id <= UCL_EMIT_MSGPACK && \
+		(ctx)->ops == &ucl_parallel_emitter_ops[(ctx)->id])
+
+/* Containers with fewer elements are not worth splitting */
+#define UCL_EMIT_PARALLEL_MIN_ELTS 1024
+/* Ranges are never smaller, so threads are not started for a few elements */
+#define UCL_EMIT_PARALLEL_MIN_RANGE 256
+#define UCL_EMIT_PARALLEL_MAX_THREADS 64
+
+/*
+ * Contexts of cached emitting use these operations
+ */
+static const struct ucl_emitter_operations ucl_cached_emitter_ops[] = {
+	[UCL_EMIT_JSON] = UCL_EMIT_TYPE_CONTENT(json),
+	[UCL_EMIT_JSON_COMPACT] = UCL_EMIT_TYPE_CONTENT(json_compact),
+	[UCL_EMIT_CONFIG] = UCL_EMIT_TYPE_CONTENT(config),
+	[UCL_EMIT_YAML] = UCL_EMIT_TYPE_CONTENT(yaml),
+	[UCL_EMIT_MSGPACK] = UCL_EMIT_TYPE_CONTENT(msgpack),
+	[UCL_EMIT_JSON_CANONICAL] = UCL_EMIT_TYPE_CONTENT(json_canonical),
+	[UCL_EMIT_NDJSON] = UCL_EMIT_TYPE_CONTENT(ndjson)
+};
+
+#define UCL_EMIT_IS_CACHED(ctx) ((ctx)->id >= 0 && \
+		(ctx)->id < UCL_EMIT_MAX && \
+		(ctx)->ops == &ucl_cached_emitter_ops[(ctx)->id])
+
+/* Smaller containers are emitted directly */
+#define UCL_EMIT_CACHE_MIN_ELTS 16
+#define UCL_EMIT_CACHE_MIN_SIZE 4096
+
+struct ucl_emitter_context_cached {
+	struct ucl_emitter_context ctx;
+	size_t min_size;
+	/* Epoch of the current emitting */
+	unsigned long pass;
+	/* Container that is being emitted to a cache buffer */
+	const ucl_object_t *skip;
+};
+
+struct ucl_emitter_context_parallel {
+	struct ucl_emitter_context ctx;
+	unsigned int nthreads;
+};
+
 /*
  * Utility to check whether we need a top object
  */
 #define UCL_EMIT_IDENT_TOP_OBJ(ctx, obj) ((ctx)->top != (obj) || \
-		((ctx)->id == UCL_EMIT_JSON_COMPACT || (ctx)->id == UCL_EMIT_JSON))
+		((ctx)->id == UCL_EMIT_JSON_COMPACT || (ctx)->id == UCL_EMIT_JSON || \
+		(ctx)->id == UCL_EMIT_JSON_CANONICAL || (ctx)->id == UCL_EMIT_NDJSON))
 
 
 /**
@@ -144,6 +210,10 @@ ucl_emitter_print_key (bool print_key, struct ucl_emitter_context *ctx,
 
 		func->ucl_emitter_append_len (": ", 2, func->ud);
 	}
+	else if (ctx->id == UCL_EMIT_JSON_CANONICAL) {
+		ucl_elt_string_write_canonical (obj->key, obj->keylen, ctx, true);
+		func->ucl_emitter_append_character (':', 1, func->ud);
+	}
 	else {
 		if (obj->keylen > 0) {
 			ucl_elt_string_write_json (obj->key, obj->keylen, ctx);
@@ -241,19 +311,59 @@ ucl_emitter_common_end_array (struct ucl_emitter_context *ctx,
 }
 
 /**
- * Start emit standard UCL array
+ * Emit elements of a packed array directly from its values buffer reusing a
+ * single view object instead of materializing element objects
+ * @param ctx emitter context
+ * @param obj array to write
+ * @param compact compact flag
+ * @return false if `obj` is not packed
+ */
+static bool
+ucl_emitter_common_packed_elts (struct ucl_emitter_context *ctx,
+		const ucl_object_t *obj, bool compact)
+{
+	const int64_t *iv;
+	const double *dv = NULL;
+	ucl_object_t view;
+	size_t i, n;
+
+	iv = ucl_array_packed_int (obj, &n);
+
+	if (iv == NULL && (dv = ucl_array_packed_float (obj, &n)) == NULL) {
+		return false;
+	}
+
+	memset (&view, 0, sizeof (view));
+	view.ref = 1;
+	view.prev = &view;
+	view.flags = UCL_OBJECT_EPHEMERAL;
+	view.type = iv != NULL ? UCL_INT : UCL_FLOAT;
+
+	for (i = 0; i < n; i ++) {
+		if (iv != NULL) {
+			view.value.iv = iv[i];
+		}
+		else {
+			view.value.dv = dv[i];
+		}
+
+		ucl_emitter_common_elt (ctx, &view, i == 0, false, compact);
+	}
+
+	return true;
+}
+
+/**
+ * Emit the opening of standard UCL array: separator, key and bracket
  * @param ctx emitter context
  * @param obj object to write
  * @param compact compact flag
  */
 static void
-ucl_emitter_common_start_array (struct ucl_emitter_context *ctx,
+ucl_emitter_common_open_array (struct ucl_emitter_context *ctx,
 		const ucl_object_t *obj, bool first, bool print_key, bool compact)
 {
-	const ucl_object_t *cur;
-	ucl_object_iter_t iter = NULL;
 	const struct ucl_emitter_functions *func = ctx->func;
-	bool first_key = true;
 
 	if (ctx->id != UCL_EMIT_CONFIG && !first) {
 		if (compact) {
@@ -279,9 +389,34 @@ ucl_emitter_common_start_array (struct ucl_emitter_context *ctx,
 	}
 
 	ctx->indent ++;
+}
+
+/**
+ * Start emit standard UCL array
+ * @param ctx emitter context
+ * @param obj object to write
+ * @param compact compact flag
+ */
+static void
+ucl_emitter_common_start_array (struct ucl_emitter_context *ctx,
+		const ucl_object_t *obj, bool first, bool print_key, bool compact)
+{
+	const ucl_object_t *cur;
+	ucl_object_iter_t iter = NULL;
+	bool first_key = true;
+
+	ucl_emitter_common_open_array (ctx, obj, first, print_key, compact);
 
 	if (obj->type == UCL_ARRAY) {
 		/* explicit array */
+		if (ucl_emitter_common_packed_elts (ctx, obj, compact)) {
+			return;
+		}
+
+		if (ucl_emitter_parallel_elts (ctx, obj)) {
+			return;
+		}
+
 		while ((cur = ucl_object_iterate (obj, &iter, true)) != NULL) {
 			ucl_emitter_common_elt (ctx, cur, first_key, false, compact);
 			first_key = false;
@@ -301,19 +436,127 @@ ucl_emitter_common_start_array (struct ucl_emitter_context *ctx,
 }
 
 /**
- * Start emit standard UCL object
+ * Emit all values of a single key of UCL object
+ * @param ctx emitter context
+ * @param cur the first value of a key
+ * @param first_key flag to mark the first key
+ * @param compact compact flag
+ */
+static void
+ucl_emitter_common_obj_elt (struct ucl_emitter_context *ctx,
+		const ucl_object_t *cur, bool first_key, bool compact)
+{
+	const ucl_object_t *elt;
+	const struct ucl_emitter_functions *func = ctx->func;
+
+	if (ctx->id == UCL_EMIT_CONFIG) {
+		LL_FOREACH (cur, elt) {
+			ucl_emitter_common_elt (ctx, elt, first_key, true, compact);
+		}
+	}
+	else {
+		/* Expand implicit arrays */
+		if (cur->next != NULL) {
+			/* The separator and indent of a next key are added by start_array */
+			if (first_key) {
+				ucl_add_tabs (func, ctx->indent, compact);
+			}
+			ucl_emitter_common_start_array (ctx, cur, first_key, true, compact);
+			ucl_emitter_common_end_array (ctx, cur, compact);
+		}
+		else {
+			ucl_emitter_common_elt (ctx, cur, first_key, true, compact);
+		}
+	}
+}
+
+static int
+ucl_emitter_canonical_key_cmp (const void *a, const void *b)
+{
+	const ucl_object_t *o1 = *(const ucl_object_t **)a,
+			*o2 = *(const ucl_object_t **)b;
+	size_t len = o1->keylen < o2->keylen ? o1->keylen : o2->keylen;
+	int ret = memcmp (o1->key, o2->key, len);
+
+	if (ret == 0) {
+		ret = (o1->keylen > o2->keylen) - (o1->keylen < o2->keylen);
+	}
+
+	return ret;
+}
+
+/**
+ * Emit elements of an object ordered by keys. Keys are compared bytewise,
+ * which is the order of code points for UTF-8. The object is not modified
+ * @param ctx emitter context
+ * @param obj object to write
+ */
+static void
+ucl_emitter_canonical_obj_elts (struct ucl_emitter_context *ctx,
+		const ucl_object_t *obj)
+{
+	const ucl_object_t *stack_elts[64], **elts = stack_elts, *cur, *next,
+			*last = NULL;
+	ucl_hash_iter_t it = NULL;
+	size_t n = 0, nelts = obj->len, i;
+
+	if (nelts > sizeof (stack_elts) / sizeof (stack_elts[0])) {
+		elts = UCL_ALLOC (nelts * sizeof (*elts));
+	}
+
+	if (elts != NULL) {
+		while ((cur = ucl_hash_iterate (obj->value.ov, &it)) != NULL &&
+				n < nelts) {
+			elts[n ++] = cur;
+		}
+
+		qsort (elts, n, sizeof (*elts), ucl_emitter_canonical_key_cmp);
+
+		for (i = 0; i < n; i ++) {
+			ucl_emitter_common_obj_elt (ctx, elts[i], i == 0, true);
+		}
+
+		if (elts != stack_elts) {
+			UCL_FREE (nelts * sizeof (*elts), elts);
+		}
+
+		return;
+	}
+
+	/* No memory to sort, select the next key on each pass */
+	for (i = 0; i < nelts; i ++) {
+		next = NULL;
+		it = NULL;
+
+		while ((cur = ucl_hash_iterate (obj->value.ov, &it)) != NULL) {
+			if ((last == NULL ||
+					ucl_emitter_canonical_key_cmp (&cur, &last) > 0) &&
+					(next == NULL ||
+					ucl_emitter_canonical_key_cmp (&cur, &next) < 0)) {
+				next = cur;
+			}
+		}
+
+		if (next == NULL) {
+			break;
+		}
+
+		ucl_emitter_common_obj_elt (ctx, next, i == 0, true);
+		last = next;
+	}
+}
+
+/**
+ * Emit the opening of standard UCL object: separator, key and brace
  * @param ctx emitter context
  * @param obj object to write
  * @param compact compact flag
  */
 static void
-ucl_emitter_common_start_object (struct ucl_emitter_context *ctx,
+ucl_emitter_common_open_object (struct ucl_emitter_context *ctx,
 		const ucl_object_t *obj, bool first, bool print_key, bool compact)
 {
-	ucl_hash_iter_t it = NULL;
-	const ucl_object_t *cur, *elt;
 	const struct ucl_emitter_functions *func = ctx->func;
-	bool first_key = true;
 
 	if (ctx->id != UCL_EMIT_CONFIG && !first) {
 		if (compact) {
@@ -343,55 +586,53 @@ ucl_emitter_common_start_object (struct ucl_emitter_context *ctx,
 		}
 		ctx->indent ++;
 	}
+}
 
-	while ((cur = ucl_hash_iterate (obj->value.ov, &it))) {
+/**
+ * Start emit standard UCL object
+ * @param ctx emitter context
+ * @param obj object to write
+ * @param compact compact flag
+ */
+static void
+ucl_emitter_common_start_object (struct ucl_emitter_context *ctx,
+		const ucl_object_t *obj, bool first, bool print_key, bool compact)
+{
+	ucl_hash_iter_t it = NULL;
+	const ucl_object_t *cur;
+	bool first_key = true;
 
-		if (ctx->id == UCL_EMIT_CONFIG) {
-			LL_FOREACH (cur, elt) {
-				ucl_emitter_common_elt (ctx, elt, first_key, true, compact);
-			}
-		}
-		else {
-			/* Expand implicit arrays */
-			if (cur->next != NULL) {
-				if (!first_key) {
-					if (compact) {
-						func->ucl_emitter_append_character (',', 1, func->ud);
-					}
-					else {
-						func->ucl_emitter_append_len (",\n", 2, func->ud);
-					}
-				}
-				ucl_add_tabs (func, ctx->indent, compact);
-				ucl_emitter_common_start_array (ctx, cur, first_key, true, compact);
-				ucl_emitter_common_end_array (ctx, cur, compact);
-			}
-			else {
-				ucl_emitter_common_elt (ctx, cur, first_key, true, compact);
-			}
-		}
+	ucl_emitter_common_open_object (ctx, obj, first, print_key, compact);
+
+	if (ucl_emitter_parallel_elts (ctx, obj)) {
+		return;
+	}
 
+	if (ctx->id == UCL_EMIT_JSON_CANONICAL) {
+		ucl_emitter_canonical_obj_elts (ctx, obj);
+		return;
+	}
+
+	while ((cur = ucl_hash_iterate (obj->value.ov, &it))) {
+		ucl_emitter_common_obj_elt (ctx, cur, first_key, compact);
 		first_key = false;
 	}
 }
 
 /**
- * Common choice of object emitting
+ * Emit separator, indentation and leading comments of an element
  * @param ctx emitter context
  * @param obj object to print
  * @param first flag to mark the first element
- * @param print_key print key of an object
  * @param compact compact output
+ * @return comments to emit after the element
  */
-static void
-ucl_emitter_common_elt (struct ucl_emitter_context *ctx,
-		const ucl_object_t *obj, bool first, bool print_key, bool compact)
+static const ucl_object_t *
+ucl_emitter_common_elt_prefix (struct ucl_emitter_context *ctx,
+		const ucl_object_t *obj, bool first, bool compact)
 {
 	const struct ucl_emitter_functions *func = ctx->func;
-	bool flag;
-	struct ucl_object_userdata *ud;
 	const ucl_object_t *comment = NULL, *cur_comment;
-	const char *ud_out = "";
 
 	if (ctx->id != UCL_EMIT_CONFIG && !first) {
 		if (compact) {
@@ -427,6 +668,60 @@ ucl_emitter_common_elt (struct ucl_emitter_context *ctx,
 		}
 	}
 
+	return comment;
+}
+
+/**
+ * Emit comments that follow an element
+ * @param ctx emitter context
+ * @param comment comments returned by `ucl_emitter_common_elt_prefix`
+ * @param compact compact output
+ */
+static void
+ucl_emitter_common_elt_comments (struct ucl_emitter_context *ctx,
+		const ucl_object_t *comment, bool compact)
+{
+	const struct ucl_emitter_functions *func = ctx->func;
+	const ucl_object_t *cur_comment;
+
+	DL_FOREACH (comment, cur_comment) {
+		func->ucl_emitter_append_len (cur_comment->value.sv,
+				cur_comment->len,
+				func->ud);
+		func->ucl_emitter_append_character ('\n', 1, func->ud);
+
+		if (cur_comment->next) {
+			ucl_add_tabs (func, ctx->indent, compact);
+		}
+	}
+}
+
+/**
+ * Common choice of object emitting
+ * @param ctx emitter context
+ * @param obj object to print
+ * @param first flag to mark the first element
+ * @param print_key print key of an object
+ * @param compact compact output
+ */
+static void
+ucl_emitter_common_elt (struct ucl_emitter_context *ctx,
+		const ucl_object_t *obj, bool first, bool print_key, bool compact)
+{
+	const struct ucl_emitter_functions *func = ctx->func;
+	bool flag;
+	struct ucl_object_userdata *ud;
+	const ucl_object_t *comment;
+	const char *ud_out = "";
+	char nbuf[UCL_NUMBER_BUF_SIZE];
+	size_t nlen;
+
+	if (ucl_emitter_cached_elt (ctx, obj, first, print_key)) {
+		return;
+	}
+
+	comment = ucl_emitter_common_elt_prefix (ctx, obj, first, compact);
+
 	switch (obj->type) {
 	case UCL_INT:
 		ucl_emitter_print_key (print_key, ctx, obj, compact);
@@ -436,7 +731,21 @@ ucl_emitter_common_elt (struct ucl_emitter_context *ctx,
 	case UCL_FLOAT:
 	case UCL_TIME:
 		ucl_emitter_print_key (print_key, ctx, obj, compact);
-		func->ucl_emitter_append_double (ucl_object_todouble (obj), func->ud);
+		if (ctx->id == UCL_EMIT_JSON_CANONICAL) {
+			nlen = ucl_dtoa_canonical (ucl_object_todouble (obj), nbuf);
+
+			if (nlen > 0) {
+				func->ucl_emitter_append_len (nbuf, nlen, func->ud);
+			}
+			else {
+				/* No infinities and NaNs in JSON */
+				func->ucl_emitter_append_len ("null", 4, func->ud);
+			}
+		}
+		else {
+			func->ucl_emitter_append_double (ucl_object_todouble (obj),
+					func->ud);
+		}
 		ucl_emitter_finish_object (ctx, obj, compact, !print_key);
 		break;
 	case UCL_BOOLEAN:
@@ -463,6 +772,9 @@ ucl_emitter_common_elt (struct ucl_emitter_context *ctx,
 				}
 			}
 		}
+		else if (ctx->id == UCL_EMIT_JSON_CANONICAL) {
+			ucl_elt_string_write_canonical (obj->value.sv, obj->len, ctx, true);
+		}
 		else {
 			ucl_elt_string_write_json (obj->value.sv, obj->len, ctx);
 		}
@@ -490,63 +802,439 @@ ucl_emitter_common_elt (struct ucl_emitter_context *ctx,
 				ud_out = "null";
 			}
 		}
-		ucl_elt_string_write_json (ud_out, strlen (ud_out), ctx);
+		if (ctx->id == UCL_EMIT_JSON_CANONICAL) {
+			ucl_elt_string_write_canonical (ud_out, strlen (ud_out), ctx, false);
+		}
+		else {
+			ucl_elt_string_write_json_full (ud_out, strlen (ud_out), ctx, false);
+		}
 		ucl_emitter_finish_object (ctx, obj, compact, !print_key);
 		break;
 	}
 
 	if (comment) {
-		DL_FOREACH (comment, cur_comment) {
-			func->ucl_emitter_append_len (cur_comment->value.sv,
-					cur_comment->len,
-					func->ud);
-			func->ucl_emitter_append_character ('\n', 1, func->ud);
-
-			if (cur_comment->next) {
-				ucl_add_tabs (func, ctx->indent, compact);
-			}
-		}
+		ucl_emitter_common_elt_comments (ctx, comment, compact);
 	}
 }
 
 /*
- * Specific standard implementations of the emitter functions
+ * Cached emitting: output of large containers is stored in their metadata.
+ * Containers have no links to their parents, so modifications are ordered
+ * by a global epoch instead: each cached emitting starts a new epoch, and
+ * a modified container records the next one. Output cached during some
+ * epoch is valid while no container of its subtree has been modified after
+ * it; the latest modification of a subtree is computed once per emitting.
+ * Output includes the key of a container, as the same container may be
+ * moved to another key, so the key is a part of an entry identity and it
+ * is stored after the output.
+ * Frozen containers are shared between threads, so they are never cached.
  */
-#define UCL_EMIT_TYPE_IMPL(type, compact)		\
-	static void ucl_emit_ ## type ## _elt (struct ucl_emitter_context *ctx,	\
-		const ucl_object_t *obj, bool first, bool print_key) {	\
-		ucl_emitter_common_elt (ctx, obj, first, print_key, (compact));	\
-	}	\
-	static void ucl_emit_ ## type ## _start_obj (struct ucl_emitter_context *ctx,	\
-		const ucl_object_t *obj, bool first, bool print_key) {	\
-		ucl_emitter_common_start_object (ctx, obj, first, print_key, (compact));	\
-	}	\
-	static void ucl_emit_ ## type## _start_array (struct ucl_emitter_context *ctx,	\
-		const ucl_object_t *obj, bool first, bool print_key) {	\
-		ucl_emitter_common_start_array (ctx, obj, first, print_key, (compact));	\
-	}	\
-	static void ucl_emit_ ##type## _end_object (struct ucl_emitter_context *ctx,	\
-		const ucl_object_t *obj) {	\
-		ucl_emitter_common_end_object (ctx, obj, (compact));	\
-	}	\
-	static void ucl_emit_ ##type## _end_array (struct ucl_emitter_context *ctx,	\
-		const ucl_object_t *obj) {	\
-		ucl_emitter_common_end_array (ctx, obj, (compact));	\
-	}
+struct ucl_emit_cache_entry {
+	struct ucl_emit_cache_entry *next;
+	unsigned long epoch;
+	unsigned int indent;
+	int id;
+	unsigned int flags;
+	unsigned int keylen;
+	size_t len;
+	unsigned char data[];
+};
 
-UCL_EMIT_TYPE_IMPL(json, false)
-UCL_EMIT_TYPE_IMPL(json_compact, true)
-UCL_EMIT_TYPE_IMPL(config, false)
-UCL_EMIT_TYPE_IMPL(yaml, false)
+struct ucl_emit_cache {
+	/* Epoch of the last modification */
+	unsigned long mod_epoch;
+	/* The latest modification in the subtree and when it was computed */
+	unsigned long tree_epoch;
+	unsigned long tree_checked;
+	struct ucl_emit_cache_entry *entries;
+};
 
-static void
-ucl_emit_msgpack_elt (struct ucl_emitter_context *ctx,
-		const ucl_object_t *obj, bool _first, bool print_key)
+static unsigned long ucl_emit_cache_epoch = 0;
+
+#define UCL_EMIT_CACHE_FIRST (1u << 0)
+#define UCL_EMIT_CACHE_KEY (1u << 1)
+#define UCL_EMIT_CACHE_TOP (1u << 2)
+
+void
+ucl_emit_cache_modified (struct ucl_emit_cache *cache)
+{
+#ifdef HAVE_ATOMIC_BUILTINS
+	cache->mod_epoch = __sync_fetch_and_add (&ucl_emit_cache_epoch, 0) + 1;
+#else
+	cache->mod_epoch = ucl_emit_cache_epoch + 1;
+#endif
+}
+
+static void
+ucl_emit_cache_entry_free (struct ucl_emit_cache_entry *entry)
+{
+	UCL_FREE (sizeof (*entry) + entry->len + entry->keylen, entry);
+}
+
+void
+ucl_emit_cache_free (struct ucl_emit_cache *cache)
+{
+	struct ucl_emit_cache_entry *entry, *tmp;
+
+	if (cache != NULL) {
+		LL_FOREACH_SAFE (cache->entries, entry, tmp) {
+			ucl_emit_cache_entry_free (entry);
+		}
+
+		UCL_FREE (sizeof (*cache), cache);
+	}
+}
+
+static inline bool
+ucl_emitter_is_packed (const ucl_object_t *obj)
+{
+	size_t n;
+
+	return obj->type == UCL_ARRAY && (ucl_array_packed_int (obj, &n) != NULL ||
+			ucl_array_packed_float (obj, &n) != NULL);
+}
+
+/* Cached output is released with a container, so it uses its allocator */
+static const struct ucl_allocator *
+ucl_emit_cache_allocator_enter (const ucl_object_t *obj)
+{
+	struct ucl_container_meta *meta = ucl_object_container_meta (obj);
+
+	return ucl_allocator_enter (meta != NULL ? meta->allocator : NULL);
+}
+
+/*
+ * Get cache of a container, a new cache treats a container as modified
+ * in the current epoch as its earlier modifications are unknown
+ */
+static struct ucl_emit_cache *
+ucl_emit_cache_get (const ucl_object_t *obj, unsigned long pass)
+{
+	struct ucl_container_meta *meta = ucl_object_container_meta_new (obj);
+	struct ucl_emit_cache *cache;
+	const struct ucl_allocator *prev;
+
+	if (meta == NULL) {
+		return NULL;
+	}
+
+	if (meta->emit == NULL) {
+		prev = ucl_allocator_enter (meta->allocator);
+		cache = UCL_ALLOC (sizeof (*cache));
+		ucl_allocator_leave (prev);
+
+		if (cache == NULL) {
+			return NULL;
+		}
+
+		cache->mod_epoch = pass;
+		cache->tree_epoch = pass;
+		cache->tree_checked = 0;
+		cache->entries = NULL;
+		meta->emit = cache;
+	}
+
+	return meta->emit;
+}
+
+/*
+ * Epoch of the latest modification of any container in a subtree
+ */
+static unsigned long
+ucl_emit_cache_tree_epoch (const ucl_object_t *obj, unsigned long pass)
+{
+	struct ucl_emit_cache *cache;
+	const ucl_object_t *cur, *elt;
+	ucl_object_iter_t it = NULL;
+	unsigned long epoch, nested;
+
+	if (obj->flags & UCL_OBJECT_FROZEN) {
+		/* Not tracked, may be thawed and modified between emittings */
+		return ULONG_MAX;
+	}
+
+	cache = ucl_emit_cache_get (obj, pass);
+
+	if (cache == NULL) {
+		/* Containers with no storage are empty */
+		return obj->value.av == NULL ? 0 : ULONG_MAX;
+	}
+
+	if (cache->tree_checked == pass) {
+		return cache->tree_epoch;
+	}
+
+	epoch = cache->mod_epoch;
+
+	/* Scalars are never modified in place, packed arrays hold only scalars */
+	while (!ucl_emitter_is_packed (obj) &&
+			(cur = ucl_object_iterate (obj, &it, true)) != NULL) {
+		LL_FOREACH (cur, elt) {
+			if (elt->type == UCL_OBJECT || elt->type == UCL_ARRAY) {
+				nested = ucl_emit_cache_tree_epoch (elt, pass);
+
+				if (nested > epoch) {
+					epoch = nested;
+				}
+			}
+
+			if (obj->type == UCL_ARRAY) {
+				break;
+			}
+		}
+	}
+
+	cache->tree_epoch = epoch;
+	cache->tree_checked = pass;
+
+	return epoch;
+}
+
+/**
+ * Emit a container using its cached output, emitting and caching it when
+ * the cached output is missing or stale
+ * @return false if `obj` should be emitted as usual
+ */
+static bool
+ucl_emitter_cached_elt (struct ucl_emitter_context *ctx,
+		const ucl_object_t *obj, bool first, bool print_key)
+{
+	struct ucl_emitter_context_cached *cctx, sub;
+	struct ucl_emit_cache *cache;
+	struct ucl_emit_cache_entry *entry, **pentry;
+	struct ucl_emitter_functions bfunc;
+	struct ucl_emitter_buf out;
+	const struct ucl_emitter_functions *func = ctx->func;
+	const struct ucl_allocator *prev;
+	const ucl_object_t *skip;
+	unsigned int flags, keylen;
+
+	if (!UCL_EMIT_IS_CACHED (ctx) ||
+			(obj->type != UCL_OBJECT && obj->type != UCL_ARRAY) ||
+			(obj->flags & UCL_OBJECT_FROZEN)) {
+		return false;
+	}
+
+	cctx = (struct ucl_emitter_context_cached *)ctx;
+
+	if (obj == cctx->skip) {
+		return false;
+	}
+
+	cache = ucl_emit_cache_get (obj, cctx->pass);
+
+	if (cache == NULL) {
+		return false;
+	}
+
+	flags = (first ? UCL_EMIT_CACHE_FIRST : 0) |
+			(print_key ? UCL_EMIT_CACHE_KEY : 0) |
+			(obj == ctx->top ? UCL_EMIT_CACHE_TOP : 0);
+	keylen = (print_key && obj->key != NULL) ? obj->keylen : 0;
+
+	for (pentry = &cache->entries; (entry = *pentry) != NULL;
+			pentry = &entry->next) {
+		if (entry->id == ctx->id && entry->flags == flags &&
+				entry->indent == ctx->indent && entry->keylen == keylen &&
+				(keylen == 0 ||
+				memcmp (entry->data + entry->len, obj->key, keylen) == 0)) {
+			break;
+		}
+	}
+
+	if (entry != NULL &&
+			ucl_emit_cache_tree_epoch (obj, cctx->pass) <= entry->epoch) {
+		func->ucl_emitter_append_len (entry->data, entry->len, func->ud);
+		return true;
+	}
+
+	if (entry == NULL && obj->len < UCL_EMIT_CACHE_MIN_ELTS) {
+		return false;
+	}
+
+	/* Nested containers still use their own cached output */
+	memcpy (&sub, cctx, sizeof (sub));
+	memset (&out, 0, sizeof (out));
+	ucl_emitter_buf_funcs (&bfunc, &out);
+	out.grow = true;
+	sub.ctx.func = &bfunc;
+	sub.skip = obj;
+	ctx->ops->ucl_emitter_write_elt (&sub.ctx, obj, first, print_key);
+
+	if (out.len > out.cap) {
+		/* Not enough memory for a buffer, emit directly */
+		skip = cctx->skip;
+		cctx->skip = obj;
+		ctx->ops->ucl_emitter_write_elt (ctx, obj, first, print_key);
+		cctx->skip = skip;
+	}
+	else if (out.len > 0) {
+		func->ucl_emitter_append_len (out.buf, out.len, func->ud);
+	}
+
+	prev = ucl_emit_cache_allocator_enter (obj);
+
+	if (entry != NULL) {
+		*pentry = entry->next;
+		ucl_emit_cache_entry_free (entry);
+	}
+
+	/* Subtrees with frozen containers are always emitted again */
+	if (out.len <= out.cap && out.len >= cctx->min_size &&
+			ucl_emit_cache_tree_epoch (obj, cctx->pass) != ULONG_MAX) {
+		entry = UCL_ALLOC (sizeof (*entry) + out.len + keylen);
+
+		if (entry != NULL) {
+			entry->epoch = cctx->pass;
+			entry->indent = ctx->indent;
+			entry->id = ctx->id;
+			entry->flags = flags;
+			entry->keylen = keylen;
+			entry->len = out.len;
+			memcpy (entry->data, out.buf, out.len);
+			if (keylen > 0) {
+				memcpy (entry->data + out.len, obj->key, keylen);
+			}
+			LL_PREPEND (cache->entries, entry);
+		}
+	}
+
+	ucl_allocator_leave (prev);
+
+	if (out.buf != NULL) {
+		UCL_FREE (out.cap, out.buf);
+	}
+
+	return true;
+}
+
+/*
+ * Specific standard implementations of the emitter functions
+ */
+#define UCL_EMIT_TYPE_IMPL(type, compact)		\
+	static void ucl_emit_ ## type ## _elt (struct ucl_emitter_context *ctx,	\
+		const ucl_object_t *obj, bool first, bool print_key) {	\
+		ucl_emitter_common_elt (ctx, obj, first, print_key, (compact));	\
+	}	\
+	static void ucl_emit_ ## type ## _start_obj (struct ucl_emitter_context *ctx,	\
+		const ucl_object_t *obj, bool first, bool print_key) {	\
+		ucl_emitter_common_start_object (ctx, obj, first, print_key, (compact));	\
+	}	\
+	static void ucl_emit_ ## type## _start_array (struct ucl_emitter_context *ctx,	\
+		const ucl_object_t *obj, bool first, bool print_key) {	\
+		ucl_emitter_common_start_array (ctx, obj, first, print_key, (compact));	\
+	}	\
+	static void ucl_emit_ ##type## _end_object (struct ucl_emitter_context *ctx,	\
+		const ucl_object_t *obj) {	\
+		ucl_emitter_common_end_object (ctx, obj, (compact));	\
+	}	\
+	static void ucl_emit_ ##type## _end_array (struct ucl_emitter_context *ctx,	\
+		const ucl_object_t *obj) {	\
+		ucl_emitter_common_end_array (ctx, obj, (compact));	\
+	}
+
+UCL_EMIT_TYPE_IMPL(json, false)
+UCL_EMIT_TYPE_IMPL(json_compact, true)
+UCL_EMIT_TYPE_IMPL(json_canonical, true)
+UCL_EMIT_TYPE_IMPL(config, false)
+UCL_EMIT_TYPE_IMPL(yaml, false)
+
+/*
+ * NDJSON: elements of a top level array are emitted as compact JSON lines,
+ * the top level is the one with no indentation
+ */
+static void
+ucl_emit_ndjson_line (struct ucl_emitter_context *ctx, const ucl_object_t *obj)
+{
+	ucl_emitter_common_elt (ctx, obj, true, false, true);
+	ctx->func->ucl_emitter_append_character ('\n', 1, ctx->func->ud);
+}
+
+static void
+ucl_emit_ndjson_elt (struct ucl_emitter_context *ctx,
+		const ucl_object_t *obj, bool first, bool print_key)
+{
+	if (ctx->indent > 0 || (UCL_EMIT_IS_CACHED (ctx) &&
+			((struct ucl_emitter_context_cached *)ctx)->skip == obj)) {
+		/* Nested element or a line emitted to the output cache */
+		ucl_emitter_common_elt (ctx, obj, first, print_key, true);
+	}
+	else if (obj == ctx->top && obj->type == UCL_ARRAY) {
+		ucl_emit_ndjson_start_array (ctx, obj, true, false);
+	}
+	else {
+		ucl_emit_ndjson_line (ctx, obj);
+	}
+}
+
+static void
+ucl_emit_ndjson_start_obj (struct ucl_emitter_context *ctx,
+		const ucl_object_t *obj, bool first, bool print_key)
+{
+	/* Containers at the top level start new lines */
+	ucl_emitter_common_start_object (ctx, obj, first || ctx->indent == 0,
+			print_key, true);
+}
+
+static void
+ucl_emit_ndjson_start_array (struct ucl_emitter_context *ctx,
+		const ucl_object_t *obj, bool first, bool print_key)
+{
+	const ucl_object_t *cur;
+	ucl_object_iter_t it = NULL;
+
+	if (obj != ctx->top || ctx->indent > 0) {
+		ucl_emitter_common_start_array (ctx, obj, first || ctx->indent == 0,
+				print_key, true);
+		return;
+	}
+
+	while ((cur = ucl_object_iterate (obj, &it, true)) != NULL) {
+		ucl_emit_ndjson_line (ctx, cur);
+	}
+}
+
+static void
+ucl_emit_ndjson_end_object (struct ucl_emitter_context *ctx,
+		const ucl_object_t *obj)
+{
+	ucl_emitter_common_end_object (ctx, obj, true);
+
+	if (ctx->indent == 0) {
+		ctx->func->ucl_emitter_append_character ('\n', 1, ctx->func->ud);
+	}
+}
+
+static void
+ucl_emit_ndjson_end_array (struct ucl_emitter_context *ctx,
+		const ucl_object_t *obj)
+{
+	if (obj == ctx->top && ctx->indent == 0) {
+		return;
+	}
+
+	ucl_emitter_common_end_array (ctx, obj, true);
+
+	if (ctx->indent == 0) {
+		ctx->func->ucl_emitter_append_character ('\n', 1, ctx->func->ud);
+	}
+}
+
+static void
+ucl_emit_msgpack_elt (struct ucl_emitter_context *ctx,
+		const ucl_object_t *obj, bool _first, bool print_key)
 {
 	ucl_object_iter_t it;
 	struct ucl_object_userdata *ud;
 	const char *ud_out;
 	const ucl_object_t *cur, *celt;
+	const int64_t *iv;
+	const double *dv;
+	size_t i, n;
+
+	if (ucl_emitter_cached_elt (ctx, obj, _first, print_key)) {
+		return;
+	}
 
 	switch (obj->type) {
 	case UCL_INT:
@@ -585,6 +1273,11 @@ ucl_emit_msgpack_elt (struct ucl_emitter_context *ctx,
 	case UCL_OBJECT:
 		ucl_emitter_print_key_msgpack (print_key, ctx, obj);
 		ucl_emit_msgpack_start_obj (ctx, obj, false, print_key);
+
+		if (ucl_emitter_parallel_elts (ctx, obj)) {
+			break;
+		}
+
 		it = NULL;
 
 		while ((cur = ucl_object_iterate (obj, &it, true)) != NULL) {
@@ -604,6 +1297,26 @@ ucl_emit_msgpack_elt (struct ucl_emitter_context *ctx,
 	case UCL_ARRAY:
 		ucl_emitter_print_key_msgpack (print_key, ctx, obj);
 		ucl_emit_msgpack_start_array (ctx, obj, false, print_key);
+
+		if ((iv = ucl_array_packed_int (obj, &n)) != NULL) {
+			for (i = 0; i < n; i ++) {
+				ucl_emitter_print_int_msgpack (ctx, iv[i]);
+			}
+
+			break;
+		}
+		else if ((dv = ucl_array_packed_float (obj, &n)) != NULL) {
+			for (i = 0; i < n; i ++) {
+				ucl_emitter_print_double_msgpack (ctx, dv[i]);
+			}
+
+			break;
+		}
+
+		if (ucl_emitter_parallel_elts (ctx, obj)) {
+			break;
+		}
+
 		it = NULL;
 
 		while ((cur = ucl_object_iterate (obj, &it, true)) != NULL) {
@@ -655,60 +1368,952 @@ ucl_emit_msgpack_end_array (struct ucl_emitter_context *ctx,
 
 }
 
-unsigned char *
-ucl_object_emit (const ucl_object_t *obj, enum ucl_emitter emit_type)
+/*
+ * Parallel emitting: elements of a large container are split into ranges,
+ * each range is serialised to its own buffer by a worker thread and the
+ * buffers are appended in order. Workers emit nested containers
+ * sequentially. Userdata emitters (e.g. of the Lua binding) are not thread
+ * safe, so a worker that finds userdata in its range leaves the range to
+ * the calling thread.
+ */
+struct ucl_emit_range {
+	struct ucl_emitter_context ctx;
+	struct ucl_emitter_functions func;
+	struct ucl_emitter_buf out;
+	const ucl_object_t **elts;
+	size_t lo, hi;
+	bool is_object;
+	const struct ucl_allocator *allocator;
+#ifdef HAVE_PTHREAD
+	pthread_t thread;
+	bool started;
+	bool has_userdata;
+#endif
+};
+
+static void
+ucl_emit_range_elts (struct ucl_emitter_context *ctx,
+		const ucl_object_t **elts, size_t lo, size_t hi, bool is_object)
 {
-	return ucl_object_emit_len (obj, emit_type, NULL);
+	bool compact = ctx->id == UCL_EMIT_JSON_COMPACT;
+	size_t i;
+
+	for (i = lo; i < hi; i ++) {
+		if (ctx->id == UCL_EMIT_MSGPACK) {
+			ucl_emit_msgpack_elt (ctx, elts[i], false, is_object);
+		}
+		else if (is_object) {
+			ucl_emitter_common_obj_elt (ctx, elts[i], i == 0, compact);
+		}
+		else {
+			ucl_emitter_common_elt (ctx, elts[i], i == 0, false, compact);
+		}
+	}
 }
 
-unsigned char *
-ucl_object_emit_len (const ucl_object_t *obj, enum ucl_emitter emit_type,
-		size_t *outlen)
+#ifdef HAVE_PTHREAD
+static bool
+ucl_emitter_has_userdata (const ucl_object_t *obj)
 {
-	unsigned char *res = NULL;
-	struct ucl_emitter_functions *func;
-	UT_string *s;
+	const ucl_object_t *cur, *elt;
+	ucl_object_iter_t it = NULL;
 
-	if (obj == NULL) {
-		return NULL;
+	if (obj->type == UCL_USERDATA) {
+		return true;
 	}
 
-	func = ucl_object_emit_memory_funcs ((void **)&res);
+	if ((obj->type != UCL_OBJECT && obj->type != UCL_ARRAY) ||
+			ucl_emitter_is_packed (obj)) {
+		return false;
+	}
 
-	if (func != NULL) {
-		s = func->ud;
-		ucl_object_emit_full (obj, emit_type, func, NULL);
+	while ((cur = ucl_object_iterate (obj, &it, true)) != NULL) {
+		LL_FOREACH (cur, elt) {
+			if (ucl_emitter_has_userdata (elt)) {
+				return true;
+			}
 
-		if (outlen != NULL) {
-			*outlen = s->i;
+			if (obj->type == UCL_ARRAY) {
+				break;
+			}
 		}
+	}
 
-		ucl_object_emit_funcs_free (func);
+	return false;
+}
+
+static void *
+ucl_emit_range_thread (void *arg)
+{
+	struct ucl_emit_range *r = arg;
+	const ucl_object_t *elt;
+	size_t i;
+
+	for (i = r->lo; i < r->hi; i ++) {
+		LL_FOREACH (r->elts[i], elt) {
+			if (ucl_emitter_has_userdata (elt)) {
+				r->has_userdata = true;
+				return NULL;
+			}
+
+			if (!r->is_object) {
+				break;
+			}
+		}
 	}
 
-	return res;
+	ucl_allocator_enter (r->allocator);
+	ucl_emit_range_elts (&r->ctx, r->elts, r->lo, r->hi, r->is_object);
+
+	return NULL;
 }
+#endif
 
-bool
-ucl_object_emit_full (const ucl_object_t *obj, enum ucl_emitter emit_type,
-		struct ucl_emitter_functions *emitter,
-		const ucl_object_t *comments)
+/**
+ * Emit elements of a large container in parallel
+ * @param ctx emitter context
+ * @param obj array or object to write
+ * @return false if `obj` has not been written
+ */
+static bool
+ucl_emitter_parallel_elts (struct ucl_emitter_context *ctx,
+		const ucl_object_t *obj)
 {
-	const struct ucl_emitter_context *ctx;
-	struct ucl_emitter_context my_ctx;
-	bool res = false;
+	struct ucl_emitter_context_parallel *pctx;
+	struct ucl_emitter_context seq;
+	struct ucl_emit_range *ranges, *r;
+	const struct ucl_emitter_functions *func = ctx->func;
+	const struct ucl_allocator *allocator;
+	const ucl_object_t **elts, *cur;
+	ucl_object_iter_t it = NULL;
+	unsigned int nranges, i;
+	bool is_object = obj->type == UCL_OBJECT;
+	size_t n = 0, step;
+
+	if (!UCL_EMIT_IS_PARALLEL (ctx)) {
+		return false;
+	}
 
-	ctx = ucl_emit_get_standard_context (emit_type);
-	if (ctx != NULL) {
-		memcpy (&my_ctx, ctx, sizeof (my_ctx));
-		my_ctx.func = emitter;
-		my_ctx.indent = 0;
-		my_ctx.top = obj;
-		my_ctx.comments = comments;
+	pctx = (struct ucl_emitter_context_parallel *)ctx;
+	nranges = pctx->nthreads;
 
-		my_ctx.ops->ucl_emitter_write_elt (&my_ctx, obj, true, false);
-		res = true;
+	if (nranges > obj->len / UCL_EMIT_PARALLEL_MIN_RANGE) {
+		nranges = obj->len / UCL_EMIT_PARALLEL_MIN_RANGE;
 	}
 
-	return res;
+	if (nranges < 2 || obj->len < UCL_EMIT_PARALLEL_MIN_ELTS) {
+		return false;
+	}
+
+	elts = UCL_ALLOC (obj->len * sizeof (*elts));
+
+	if (elts == NULL) {
+		return false;
+	}
+
+	ranges = ucl_calloc (nranges, sizeof (*ranges));
+
+	if (ranges == NULL) {
+		UCL_FREE (obj->len * sizeof (*elts), elts);
+		return false;
+	}
+
+	if (is_object) {
+		while ((cur = ucl_hash_iterate (obj->value.ov, &it)) != NULL &&
+				n < obj->len) {
+			elts[n ++] = cur;
+		}
+	}
+	else {
+		while ((cur = ucl_object_iterate (obj, &it, true)) != NULL &&
+				n < obj->len) {
+			elts[n ++] = cur;
+		}
+	}
+
+	/* Workers allocate with the same allocator as the caller */
+	allocator = ucl_allocator_current ();
+
+	memcpy (&seq, ctx, sizeof (seq));
+	seq.ops = &ucl_standartd_emitter_ops[ctx->id];
+	step = (n + nranges - 1) / nranges;
+
+	for (i = 0; i < nranges; i ++) {
+		r = &ranges[i];
+		memcpy (&r->ctx, &seq, sizeof (seq));
+		ucl_emitter_buf_funcs (&r->func, &r->out);
+		r->out.grow = true;
+		r->ctx.func = &r->func;
+		r->elts = elts;
+		r->lo = i * step < n ? i * step : n;
+		r->hi = r->lo + step < n ? r->lo + step : n;
+		r->is_object = is_object;
+		r->allocator = allocator;
+#ifdef HAVE_PTHREAD
+		if (i > 0 && r->lo < r->hi) {
+			r->started = pthread_create (&r->thread, NULL,
+					ucl_emit_range_thread, r) == 0;
+		}
+#endif
+	}
+
+	/* The first range goes directly to the output */
+	ucl_emit_range_elts (&seq, elts, ranges[0].lo, ranges[0].hi, is_object);
+
+	for (i = 1; i < nranges; i ++) {
+		r = &ranges[i];
+
+#ifdef HAVE_PTHREAD
+		if (r->started) {
+			pthread_join (r->thread, NULL);
+		}
+
+		if (!r->started || r->has_userdata)
+#endif
+		{
+			ucl_emit_range_elts (&r->ctx, elts, r->lo, r->hi, is_object);
+		}
+
+		if (r->out.len <= r->out.cap) {
+			if (r->out.len > 0) {
+				func->ucl_emitter_append_len (r->out.buf, r->out.len,
+						func->ud);
+			}
+		}
+		else {
+			/* Not enough memory for a buffer, emit the range again */
+			ucl_emit_range_elts (&seq, elts, r->lo, r->hi, is_object);
+		}
+
+		if (r->out.buf != NULL) {
+			UCL_FREE (r->out.cap, r->out.buf);
+		}
+	}
+
+	UCL_FREE (nranges * sizeof (*ranges), ranges);
+	UCL_FREE (obj->len * sizeof (*elts), elts);
+
+	return true;
+}
+
+unsigned char *
+ucl_object_emit (const ucl_object_t *obj, enum ucl_emitter emit_type)
+{
+	return ucl_object_emit_len (obj, emit_type, NULL);
+}
+
+unsigned char *
+ucl_object_emit_len (const ucl_object_t *obj, enum ucl_emitter emit_type,
+		size_t *outlen)
+{
+	struct ucl_emitter_functions func;
+	struct ucl_emitter_buf ebuf;
+	size_t len;
+
+	if (obj == NULL) {
+		return NULL;
+	}
+
+	memset (&ebuf, 0, sizeof (ebuf));
+	ebuf.grow = true;
+
+	/*
+	 * Size the output first, so it is usually allocated exactly once.
+	 * Userdata emitters may return another output on the second pass, so
+	 * the buffer still grows if needed. Sizing msgpack costs more than
+	 * growing a buffer for it.
+	 */
+	if (emit_type != UCL_EMIT_MSGPACK) {
+		len = ucl_object_emit_size (obj, emit_type);
+
+		if (len == 0 && ucl_emit_get_standard_context (emit_type) == NULL) {
+			return NULL;
+		}
+
+		ebuf.buf = UCL_ALLOC (len + 1);
+
+		if (ebuf.buf == NULL) {
+			return NULL;
+		}
+
+		ebuf.cap = len + 1;
+	}
+
+	ucl_emitter_buf_funcs (&func, &ebuf);
+
+	if (!ucl_object_emit_full (obj, emit_type, &func, NULL)) {
+		UCL_FREE (ebuf.cap, ebuf.buf);
+		return NULL;
+	}
+
+	func.ucl_emitter_append_character ('\0', 1, func.ud);
+
+	if (ebuf.len > ebuf.cap) {
+		/* Not enough memory to grow */
+		UCL_FREE (ebuf.cap, ebuf.buf);
+		return NULL;
+	}
+
+	if (outlen != NULL) {
+		*outlen = ebuf.len - 1;
+	}
+
+	return ebuf.buf;
+}
+
+size_t
+ucl_object_emit_size (const ucl_object_t *obj, enum ucl_emitter emit_type)
+{
+	size_t len = 0;
+
+	ucl_object_emit_into (obj, emit_type, NULL, 0, &len);
+
+	return len;
+}
+
+bool
+ucl_object_emit_into (const ucl_object_t *obj, enum ucl_emitter emit_type,
+		unsigned char *buf, size_t cap, size_t *outlen)
+{
+	struct ucl_emitter_functions func;
+	struct ucl_emitter_buf ebuf;
+
+	if (obj == NULL || (buf == NULL && cap > 0)) {
+		return false;
+	}
+
+	ebuf.buf = buf;
+	ebuf.cap = cap;
+	ebuf.len = 0;
+	ebuf.grow = false;
+	ucl_emitter_buf_funcs (&func, &ebuf);
+
+	if (!ucl_object_emit_full (obj, emit_type, &func, NULL)) {
+		return false;
+	}
+
+	if (outlen != NULL) {
+		*outlen = ebuf.len;
+	}
+
+	if (ebuf.len >= cap) {
+		return false;
+	}
+
+	buf[ebuf.len] = '\0';
+
+	return true;
+}
+
+bool
+ucl_object_emit_parallel (const ucl_object_t *obj, enum ucl_emitter emit_type,
+		struct ucl_emitter_functions *emitter, unsigned int nthreads)
+{
+	const struct ucl_emitter_context *ctx;
+	struct ucl_emitter_context_parallel pctx;
+
+	if (emit_type != UCL_EMIT_JSON && emit_type != UCL_EMIT_JSON_COMPACT &&
+			emit_type != UCL_EMIT_MSGPACK) {
+		return ucl_object_emit_full (obj, emit_type, emitter, NULL);
+	}
+
+#ifdef HAVE_PTHREAD
+	if (nthreads == 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+		long ncpu = sysconf (_SC_NPROCESSORS_ONLN);
+
+		nthreads = ncpu > 0 ? (unsigned int)ncpu : 1;
+#else
+		nthreads = 1;
+#endif
+	}
+#else
+	nthreads = 1;
+#endif
+
+	if (nthreads > UCL_EMIT_PARALLEL_MAX_THREADS) {
+		nthreads = UCL_EMIT_PARALLEL_MAX_THREADS;
+	}
+
+	ctx = ucl_emit_get_standard_context (emit_type);
+	memcpy (&pctx.ctx, ctx, sizeof (pctx.ctx));
+	pctx.ctx.ops = &ucl_parallel_emitter_ops[emit_type];
+	pctx.ctx.func = emitter;
+	pctx.ctx.indent = 0;
+	pctx.ctx.top = obj;
+	pctx.ctx.comments = NULL;
+	pctx.nthreads = nthreads;
+
+	pctx.ctx.ops->ucl_emitter_write_elt (&pctx.ctx, obj, true, false);
+
+	return ucl_object_emit_funcs_flush (emitter);
+}
+
+bool
+ucl_object_emit_cached (const ucl_object_t *obj, enum ucl_emitter emit_type,
+		struct ucl_emitter_functions *emitter, size_t min_size)
+{
+	const struct ucl_emitter_context *ctx;
+	struct ucl_emitter_context_cached cctx;
+
+	ctx = ucl_emit_get_standard_context (emit_type);
+
+	if (ctx == NULL || obj == NULL) {
+		return false;
+	}
+
+	memcpy (&cctx.ctx, ctx, sizeof (cctx.ctx));
+	cctx.ctx.ops = &ucl_cached_emitter_ops[emit_type];
+	cctx.ctx.func = emitter;
+	cctx.ctx.indent = 0;
+	cctx.ctx.top = obj;
+	cctx.ctx.comments = NULL;
+	cctx.min_size = min_size > 0 ? min_size : UCL_EMIT_CACHE_MIN_SIZE;
+	cctx.skip = NULL;
+#ifdef HAVE_ATOMIC_BUILTINS
+	cctx.pass = __sync_add_and_fetch (&ucl_emit_cache_epoch, 1);
+#else
+	cctx.pass = ++ ucl_emit_cache_epoch;
+#endif
+
+	cctx.ctx.ops->ucl_emitter_write_elt (&cctx.ctx, obj, true, false);
+
+	return ucl_object_emit_funcs_flush (emitter);
+}
+
+void
+ucl_object_emit_cache_clear (const ucl_object_t *obj)
+{
+	struct ucl_container_meta *meta;
+	const struct ucl_allocator *prev;
+	const ucl_object_t *cur, *elt;
+	ucl_object_iter_t it = NULL;
+
+	if (obj == NULL || (obj->flags & UCL_OBJECT_FROZEN)) {
+		return;
+	}
+
+	meta = ucl_object_container_meta (obj);
+
+	/* Containers without a cache are treated as modified later */
+	if (meta != NULL) {
+		prev = ucl_allocator_enter (meta->allocator);
+		ucl_emit_cache_free (meta->emit);
+		ucl_allocator_leave (prev);
+		meta->emit = NULL;
+	}
+
+	while (!ucl_emitter_is_packed (obj) &&
+			(cur = ucl_object_iterate (obj, &it, true)) != NULL) {
+		LL_FOREACH (cur, elt) {
+			if (elt->type == UCL_OBJECT || elt->type == UCL_ARRAY) {
+				ucl_object_emit_cache_clear (elt);
+			}
+
+			if (obj->type == UCL_ARRAY) {
+				break;
+			}
+		}
+	}
+}
+
+bool
+ucl_object_emit_full (const ucl_object_t *obj, enum ucl_emitter emit_type,
+		struct ucl_emitter_functions *emitter,
+		const ucl_object_t *comments)
+{
+	const struct ucl_emitter_context *ctx;
+	struct ucl_emitter_context my_ctx;
+	bool res = false;
+
+	ctx = ucl_emit_get_standard_context (emit_type);
+	if (ctx != NULL) {
+		memcpy (&my_ctx, ctx, sizeof (my_ctx));
+		my_ctx.func = emitter;
+		my_ctx.indent = 0;
+		my_ctx.top = obj;
+		my_ctx.comments = comments;
+
+		my_ctx.ops->ucl_emitter_write_elt (&my_ctx, obj, true, false);
+		res = ucl_object_emit_funcs_flush (emitter);
+	}
+
+	return res;
+}
+
+/*
+ * Resumable emitting: the traversal is kept in an explicit stack of frames,
+ * so it can be suspended whenever the output buffer is full. Each step
+ * emits a single scalar element or the opening or the closing of
+ * a container to the staging buffer, that is copied to caller buffers
+ */
+enum ucl_emit_frame_kind {
+	UCL_EMIT_FRAME_OBJECT = 0,
+	UCL_EMIT_FRAME_ARRAY,
+	/* Values of an implicit array */
+	UCL_EMIT_FRAME_IMPLICIT,
+	/* Elements of the top level NDJSON array */
+	UCL_EMIT_FRAME_LINES
+};
+
+struct ucl_emit_frame {
+	enum ucl_emit_frame_kind kind;
+	bool first;
+	/* NDJSON line ends after this container */
+	bool line;
+	const ucl_object_t *obj;
+	/* The next value of an implicit array or of a multi-value key */
+	const ucl_object_t *chain;
+	/* Comments to emit after this container */
+	const ucl_object_t *comment;
+	ucl_object_iter_t it;
+	/* Packed values */
+	const int64_t *iv;
+	const double *dv;
+	/* Keys in canonical order */
+	const ucl_object_t **sorted;
+	const ucl_object_t *last;
+	size_t idx;
+	size_t n;
+};
+
+#define UCL_EMIT_RESUMABLE_FRAMES 16
+
+struct ucl_emitter_resumable {
+	struct ucl_emitter_context ctx;
+	bool compact;
+	bool started;
+	bool done;
+	struct ucl_emitter_functions bfunc;
+	struct ucl_emitter_buf out;
+	/* Offset of the pending output in the staging buffer */
+	size_t pos;
+	struct ucl_emit_frame *frames;
+	size_t nframes;
+	size_t maxframes;
+	/* Element of a packed array */
+	ucl_object_t view;
+};
+
+static struct ucl_emit_frame *
+ucl_emit_resumable_push (struct ucl_emitter_resumable *rctx,
+		enum ucl_emit_frame_kind kind, const ucl_object_t *obj)
+{
+	struct ucl_emit_frame *frame;
+	size_t nmax;
+
+	if (rctx->nframes == rctx->maxframes) {
+		nmax = rctx->maxframes * 2;
+		frame = UCL_REALLOC (rctx->frames, nmax * sizeof (*frame));
+
+		if (frame == NULL) {
+			return NULL;
+		}
+
+		rctx->frames = frame;
+		rctx->maxframes = nmax;
+	}
+
+	frame = &rctx->frames[rctx->nframes ++];
+	memset (frame, 0, sizeof (*frame));
+	frame->kind = kind;
+	frame->obj = obj;
+	frame->first = true;
+
+	if (kind == UCL_EMIT_FRAME_ARRAY && obj->type == UCL_ARRAY) {
+		frame->iv = ucl_array_packed_int (obj, &frame->n);
+
+		if (frame->iv == NULL) {
+			frame->dv = ucl_array_packed_float (obj, &frame->n);
+		}
+	}
+	else if (kind == UCL_EMIT_FRAME_IMPLICIT) {
+		frame->chain = obj;
+	}
+
+	return frame;
+}
+
+/*
+ * Emit an element, containers are opened and their frames are pushed
+ */
+static bool
+ucl_emit_resumable_elt (struct ucl_emitter_resumable *rctx,
+		const ucl_object_t *obj, bool first, bool print_key, bool line)
+{
+	struct ucl_emitter_context *ctx = &rctx->ctx;
+	struct ucl_emit_frame *frame;
+	const ucl_object_t *comment;
+	bool is_array = obj->type == UCL_ARRAY;
+
+	if (obj->type != UCL_OBJECT && !is_array) {
+		if (ctx->id == UCL_EMIT_MSGPACK) {
+			ucl_emit_msgpack_elt (ctx, obj, first, print_key);
+		}
+		else {
+			/* NDJSON lines are ended by the caller */
+			ucl_emitter_common_elt (ctx, obj, first, print_key, rctx->compact);
+		}
+
+		if (line) {
+			ctx->func->ucl_emitter_append_character ('\n', 1, ctx->func->ud);
+		}
+
+		return true;
+	}
+
+	frame = ucl_emit_resumable_push (rctx,
+			is_array ? UCL_EMIT_FRAME_ARRAY : UCL_EMIT_FRAME_OBJECT, obj);
+
+	if (frame == NULL) {
+		return false;
+	}
+
+	if (ctx->id == UCL_EMIT_MSGPACK) {
+		ucl_emitter_print_key_msgpack (print_key, ctx, obj);
+
+		if (is_array) {
+			ucl_emit_msgpack_start_array (ctx, obj, false, print_key);
+		}
+		else {
+			ucl_emit_msgpack_start_obj (ctx, obj, false, print_key);
+		}
+
+		return true;
+	}
+
+	comment = ucl_emitter_common_elt_prefix (ctx, obj, first, rctx->compact);
+	frame->comment = comment;
+	frame->line = line;
+
+	if (is_array) {
+		ucl_emitter_common_open_array (ctx, obj, true, print_key, rctx->compact);
+	}
+	else {
+		ucl_emitter_common_open_object (ctx, obj, true, print_key,
+				rctx->compact);
+	}
+
+	return true;
+}
+
+/*
+ * Select the next key of an object being emitted
+ */
+static const ucl_object_t *
+ucl_emit_resumable_next_key (struct ucl_emitter_resumable *rctx,
+		struct ucl_emit_frame *frame)
+{
+	const ucl_object_t *cur, *next = NULL;
+	ucl_hash_iter_t it = NULL;
+
+	if (rctx->ctx.id != UCL_EMIT_JSON_CANONICAL) {
+		return ucl_object_iterate (frame->obj, &frame->it, true);
+	}
+
+	if (frame->first && frame->obj->len > 0) {
+		frame->sorted = UCL_ALLOC (frame->obj->len * sizeof (*frame->sorted));
+
+		if (frame->sorted != NULL) {
+			while ((cur = ucl_hash_iterate (frame->obj->value.ov, &it)) != NULL &&
+					frame->n < frame->obj->len) {
+				frame->sorted[frame->n ++] = cur;
+			}
+
+			qsort (frame->sorted, frame->n, sizeof (*frame->sorted),
+					ucl_emitter_canonical_key_cmp);
+		}
+	}
+
+	if (frame->sorted != NULL) {
+		return frame->idx < frame->n ? frame->sorted[frame->idx ++] : NULL;
+	}
+
+	/* No memory to sort, select the next key on each step */
+	while ((cur = ucl_hash_iterate (frame->obj->value.ov, &it)) != NULL) {
+		if ((frame->last == NULL ||
+				ucl_emitter_canonical_key_cmp (&cur, &frame->last) > 0) &&
+				(next == NULL ||
+				ucl_emitter_canonical_key_cmp (&cur, &next) < 0)) {
+			next = cur;
+		}
+	}
+
+	frame->last = next;
+
+	return next;
+}
+
+static void
+ucl_emit_resumable_close (struct ucl_emitter_resumable *rctx,
+		struct ucl_emit_frame *frame)
+{
+	struct ucl_emitter_context *ctx = &rctx->ctx;
+
+	if (frame->sorted != NULL) {
+		UCL_FREE (frame->obj->len * sizeof (*frame->sorted), frame->sorted);
+	}
+
+	if (ctx->id == UCL_EMIT_MSGPACK || frame->kind == UCL_EMIT_FRAME_LINES) {
+		return;
+	}
+
+	if (frame->kind == UCL_EMIT_FRAME_OBJECT) {
+		ucl_emitter_common_end_object (ctx, frame->obj, rctx->compact);
+	}
+	else {
+		ucl_emitter_common_end_array (ctx, frame->obj, rctx->compact);
+	}
+
+	if (frame->comment) {
+		ucl_emitter_common_elt_comments (ctx, frame->comment, rctx->compact);
+	}
+
+	if (frame->line) {
+		ctx->func->ucl_emitter_append_character ('\n', 1, ctx->func->ud);
+	}
+}
+
+/*
+ * Emit the next element of the current container or close it
+ */
+static bool
+ucl_emit_resumable_step (struct ucl_emitter_resumable *rctx)
+{
+	struct ucl_emitter_context *ctx = &rctx->ctx;
+	struct ucl_emit_frame *frame;
+	const ucl_object_t *cur, *top = ctx->top;
+	bool first, msgpack = ctx->id == UCL_EMIT_MSGPACK;
+
+	if (!rctx->started) {
+		rctx->started = true;
+
+		if (ctx->id == UCL_EMIT_NDJSON && top->type == UCL_ARRAY) {
+			/* Top level array has no brackets, its elements are lines */
+			return ucl_emit_resumable_push (rctx, UCL_EMIT_FRAME_LINES,
+					top) != NULL;
+		}
+
+		return ucl_emit_resumable_elt (rctx, top, true, false,
+				ctx->id == UCL_EMIT_NDJSON);
+	}
+
+	if (rctx->nframes == 0) {
+		rctx->done = true;
+		return true;
+	}
+
+	frame = &rctx->frames[rctx->nframes - 1];
+	first = frame->first;
+
+	if (frame->chain != NULL) {
+		/* Values of a multi-value key or elements of an implicit array */
+		cur = frame->chain;
+		frame->chain = cur->next;
+
+		if (frame->kind == UCL_EMIT_FRAME_IMPLICIT) {
+			frame->first = false;
+			return ucl_emit_resumable_elt (rctx, cur, first, false, false);
+		}
+
+		/* Separators are not used by this format, so `first` is irrelevant */
+		return ucl_emit_resumable_elt (rctx, cur, false, true, false);
+	}
+
+	switch (frame->kind) {
+	case UCL_EMIT_FRAME_OBJECT:
+		cur = ucl_emit_resumable_next_key (rctx, frame);
+
+		if (cur == NULL) {
+			break;
+		}
+
+		frame->first = false;
+
+		if (msgpack) {
+			/* Only the first value of a key is written */
+			return ucl_emit_resumable_elt (rctx, cur, false, true, false);
+		}
+		if (ctx->id == UCL_EMIT_CONFIG) {
+			/* Values of a key are emitted one by one */
+			frame->chain = cur->next;
+			return ucl_emit_resumable_elt (rctx, cur, first, true, false);
+		}
+		if (cur->next != NULL) {
+			/* Implicit array, see ucl_emitter_common_obj_elt */
+			if (first) {
+				ucl_add_tabs (ctx->func, ctx->indent, rctx->compact);
+			}
+
+			ucl_emitter_common_open_array (ctx, cur, first, true, rctx->compact);
+
+			return ucl_emit_resumable_push (rctx, cur->type == UCL_ARRAY ?
+					UCL_EMIT_FRAME_ARRAY : UCL_EMIT_FRAME_IMPLICIT, cur) != NULL;
+		}
+
+		return ucl_emit_resumable_elt (rctx, cur, first, true, false);
+	case UCL_EMIT_FRAME_ARRAY:
+	case UCL_EMIT_FRAME_LINES:
+		frame->first = false;
+
+		if (frame->iv != NULL || frame->dv != NULL) {
+			if (frame->idx >= frame->n) {
+				break;
+			}
+
+			if (msgpack && frame->iv != NULL) {
+				ucl_emitter_print_int_msgpack (ctx, frame->iv[frame->idx ++]);
+				return true;
+			}
+			if (msgpack) {
+				ucl_emitter_print_double_msgpack (ctx, frame->dv[frame->idx ++]);
+				return true;
+			}
+
+			if (frame->iv != NULL) {
+				rctx->view.type = UCL_INT;
+				rctx->view.value.iv = frame->iv[frame->idx ++];
+			}
+			else {
+				rctx->view.type = UCL_FLOAT;
+				rctx->view.value.dv = frame->dv[frame->idx ++];
+			}
+
+			return ucl_emit_resumable_elt (rctx, &rctx->view, first, false,
+					false);
+		}
+
+		cur = ucl_object_iterate (frame->obj, &frame->it, true);
+
+		if (cur == NULL) {
+			break;
+		}
+
+		if (frame->kind == UCL_EMIT_FRAME_LINES) {
+			return ucl_emit_resumable_elt (rctx, cur, true, false, true);
+		}
+
+		return ucl_emit_resumable_elt (rctx, cur, first, false, false);
+	case UCL_EMIT_FRAME_IMPLICIT:
+		break;
+	}
+
+	/* The container is finished */
+	ucl_emit_resumable_close (rctx, frame);
+	rctx->nframes --;
+
+	return true;
+}
+
+struct ucl_emitter_resumable*
+ucl_object_emit_resumable_new (const ucl_object_t *obj,
+		enum ucl_emitter emit_type, const ucl_object_t *comments)
+{
+	const struct ucl_emitter_context *ctx;
+	struct ucl_emitter_resumable *rctx;
+
+	ctx = ucl_emit_get_standard_context (emit_type);
+	if (ctx == NULL || obj == NULL) {
+		return NULL;
+	}
+
+	rctx = ucl_calloc (1, sizeof (*rctx));
+	if (rctx == NULL) {
+		return NULL;
+	}
+
+	memcpy (&rctx->ctx, ctx, sizeof (*ctx));
+	rctx->ctx.top = obj;
+	rctx->ctx.comments = comments;
+	rctx->compact = emit_type == UCL_EMIT_JSON_COMPACT ||
+			emit_type == UCL_EMIT_JSON_CANONICAL || emit_type == UCL_EMIT_NDJSON;
+	rctx->out.grow = true;
+	ucl_emitter_buf_funcs (&rctx->bfunc, &rctx->out);
+	rctx->ctx.func = &rctx->bfunc;
+	rctx->view.ref = 1;
+	rctx->view.prev = &rctx->view;
+	rctx->view.flags = UCL_OBJECT_EPHEMERAL;
+	rctx->maxframes = UCL_EMIT_RESUMABLE_FRAMES;
+	rctx->frames = UCL_ALLOC (rctx->maxframes * sizeof (*rctx->frames));
+
+	if (rctx->frames == NULL) {
+		ucl_free (rctx);
+		return NULL;
+	}
+
+	return rctx;
+}
+
+enum ucl_emitter_stream_status
+ucl_object_emit_resumable (struct ucl_emitter_resumable *rctx,
+		unsigned char *buf, size_t size, size_t *written)
+{
+	size_t len, total = 0;
+
+	for (;;) {
+		if (rctx->out.len > rctx->out.cap) {
+			/* Staging buffer has failed to grow */
+			*written = total;
+			return UCL_EMIT_STREAM_ERROR;
+		}
+
+		if (rctx->pos < rctx->out.len) {
+			len = rctx->out.len - rctx->pos;
+
+			if (len > size - total) {
+				len = size - total;
+			}
+
+			memcpy (buf + total, rctx->out.buf + rctx->pos, len);
+			total += len;
+			rctx->pos += len;
+
+			if (rctx->pos < rctx->out.len) {
+				/* Caller buffer is full */
+				*written = total;
+				return UCL_EMIT_STREAM_AGAIN;
+			}
+		}
+
+		rctx->out.len = 0;
+		rctx->pos = 0;
+
+		if (rctx->done) {
+			break;
+		}
+
+		if (!ucl_emit_resumable_step (rctx)) {
+			*written = total;
+			return UCL_EMIT_STREAM_ERROR;
+		}
+	}
+
+	*written = total;
+
+	return UCL_EMIT_STREAM_OK;
+}
+
+void
+ucl_object_emit_resumable_free (struct ucl_emitter_resumable *rctx)
+{
+	size_t i;
+
+	if (rctx == NULL) {
+		return;
+	}
+
+	for (i = 0; i < rctx->nframes; i ++) {
+		if (rctx->frames[i].sorted != NULL) {
+			UCL_FREE (rctx->frames[i].obj->len * sizeof (*rctx->frames[i].sorted),
+					rctx->frames[i].sorted);
+		}
+	}
+
+	UCL_FREE (rctx->maxframes * sizeof (*rctx->frames), rctx->frames);
+
+	if (rctx->out.buf != NULL) {
+		UCL_FREE (rctx->out.cap, rctx->out.buf);
+	}
+
+	ucl_free (rctx);
 }
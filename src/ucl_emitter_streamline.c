@@ -33,9 +33,17 @@ struct ucl_emitter_streamline_stack {
 	bool is_array;
 	bool empty;
 	const ucl_object_t *obj;
+	/* Elements count and offset of msgpack header to patch */
+	size_t count;
+	size_t hdr;
+	/* Elements count declared by the caller */
+	size_t expected;
 	struct ucl_emitter_streamline_stack *next;
 };
 
+#define UCL_STREAMLINE_NO_HDR ((size_t)-1)
+#define UCL_STREAMLINE_DEFAULT_HWM 65536
+
 struct ucl_emitter_context_streamline {
 	/* Inherited from the main context */
 	/** Name of emitter (e.g. json, compact_json) */
@@ -55,9 +63,97 @@ struct ucl_emitter_context_streamline {
 
 	/* Streamline specific fields */
 	struct ucl_emitter_streamline_stack *containers;
+
+	/* Buffered output */
+	ucl_emitter_flush_func flush;
+	void *flush_ud;
+	struct ucl_emitter_functions bfunc;
+	struct ucl_emitter_buf out;
+	/* High-water mark and amount of output passed to the flush callback */
+	size_t hwm;
+	size_t flushed;
+	enum ucl_emitter_stream_status status;
 };
 
 #define TO_STREAMLINE(ctx) (struct ucl_emitter_context_streamline *)(ctx)
+#define STREAMLINE_BUFFERED(sctx) ((sctx)->flush != NULL)
+#define STREAMLINE_PATCHED(sctx) (STREAMLINE_BUFFERED (sctx) && \
+	(sctx)->id == UCL_EMIT_MSGPACK)
+
+/*
+ * Pass buffered output to the flush callback, output after the first
+ * msgpack header that is not yet patched is kept in the buffer
+ */
+static enum ucl_emitter_stream_status
+ucl_streamline_flush_buf (struct ucl_emitter_context_streamline *sctx)
+{
+	struct ucl_emitter_streamline_stack *st;
+	size_t len, written;
+
+	if (sctx->status == UCL_EMIT_STREAM_ERROR) {
+		return sctx->status;
+	}
+
+	if (sctx->out.len > sctx->out.cap) {
+		/* Buffer has failed to grow */
+		sctx->status = UCL_EMIT_STREAM_ERROR;
+		sctx->out.len = 0;
+
+		return sctx->status;
+	}
+
+	len = sctx->out.len;
+
+	LL_FOREACH (sctx->containers, st) {
+		if (st->hdr != UCL_STREAMLINE_NO_HDR && st->hdr - sctx->flushed < len) {
+			len = st->hdr - sctx->flushed;
+		}
+	}
+
+	sctx->status = UCL_EMIT_STREAM_OK;
+
+	while (len > 0) {
+		written = 0;
+
+		if (!sctx->flush (sctx->out.buf, len, &written, sctx->flush_ud)) {
+			sctx->status = UCL_EMIT_STREAM_ERROR;
+			sctx->out.len = 0;
+
+			return sctx->status;
+		}
+
+		if (written > len) {
+			written = len;
+		}
+
+		if (written > 0) {
+			memmove (sctx->out.buf, sctx->out.buf + written,
+					sctx->out.len - written);
+			sctx->out.len -= written;
+			sctx->flushed += written;
+			len -= written;
+		}
+		else {
+			sctx->status = UCL_EMIT_STREAM_AGAIN;
+			break;
+		}
+	}
+
+	return sctx->status;
+}
+
+/*
+ * Flush buffered output once it reaches the high-water mark, unless
+ * the flush callback has asked to wait
+ */
+static void
+ucl_streamline_maybe_flush (struct ucl_emitter_context_streamline *sctx)
+{
+	if (STREAMLINE_BUFFERED (sctx) && sctx->status == UCL_EMIT_STREAM_OK &&
+			sctx->out.len >= sctx->hwm) {
+		ucl_streamline_flush_buf (sctx);
+	}
+}
 
 struct ucl_emitter_context*
 ucl_object_emit_streamline_new (const ucl_object_t *obj,
@@ -67,12 +163,17 @@ ucl_object_emit_streamline_new (const ucl_object_t *obj,
 	const struct ucl_emitter_context *ctx;
 	struct ucl_emitter_context_streamline *sctx;
 
+	/* Keys are written in the order they are added and cannot be sorted */
+	if (emit_type == UCL_EMIT_JSON_CANONICAL) {
+		return NULL;
+	}
+
 	ctx = ucl_emit_get_standard_context (emit_type);
 	if (ctx == NULL) {
 		return NULL;
 	}
 
-	sctx = calloc (1, sizeof (*sctx));
+	sctx = ucl_calloc (1, sizeof (*sctx));
 	if (sctx == NULL) {
 		return NULL;
 	}
@@ -87,13 +188,54 @@ ucl_object_emit_streamline_new (const ucl_object_t *obj,
 	return (struct ucl_emitter_context *)sctx;
 }
 
+struct ucl_emitter_context*
+ucl_object_emit_streamline_buffered_new (const ucl_object_t *obj,
+		enum ucl_emitter emit_type,
+		ucl_emitter_flush_func flush,
+		void *ud,
+		size_t hwm)
+{
+	const struct ucl_emitter_context *ctx;
+	struct ucl_emitter_context_streamline *sctx;
+
+	if (emit_type == UCL_EMIT_JSON_CANONICAL) {
+		return NULL;
+	}
+
+	ctx = ucl_emit_get_standard_context (emit_type);
+	if (ctx == NULL || flush == NULL) {
+		return NULL;
+	}
+
+	sctx = ucl_calloc (1, sizeof (*sctx));
+	if (sctx == NULL) {
+		return NULL;
+	}
+
+	memcpy (sctx, ctx, sizeof (*ctx));
+	sctx->flush = flush;
+	sctx->flush_ud = ud;
+	sctx->hwm = hwm > 0 ? hwm : UCL_STREAMLINE_DEFAULT_HWM;
+	sctx->out.grow = true;
+	ucl_emitter_buf_funcs (&sctx->bfunc, &sctx->out);
+	sctx->func = &sctx->bfunc;
+	sctx->top = obj;
+
+	ucl_object_emit_streamline_start_container ((struct ucl_emitter_context *)sctx,
+			obj);
+
+	return (struct ucl_emitter_context *)sctx;
+}
+
 bool
 ucl_object_emit_streamline_start_container (struct ucl_emitter_context *ctx,
 		const ucl_object_t *obj)
 {
 	struct ucl_emitter_context_streamline *sctx = TO_STREAMLINE(ctx);
 	struct ucl_emitter_streamline_stack *st, *top;
-	bool print_key = false;
+	const ucl_object_t *cur;
+	ucl_object_iter_t it = NULL;
+	bool print_key = false, first;
 
 	/* Check top object presence */
 	if (sctx->top == NULL) {
@@ -101,29 +243,64 @@ ucl_object_emit_streamline_start_container (struct ucl_emitter_context *ctx,
 	}
 
 	top = sctx->containers;
-	st = malloc (sizeof (*st));
+	st = UCL_ALLOC (sizeof (*st));
 	if (st != NULL) {
-		st->empty = true;
+		st->count = 0;
+		st->hdr = UCL_STREAMLINE_NO_HDR;
+		st->expected = UCL_STREAMLINE_NO_HDR;
 		if (top && !top->is_array) {
 			print_key = true;
 		}
 
+		if (obj == NULL ||
+				(obj->type != UCL_ARRAY && obj->type != UCL_OBJECT)) {
+			/* API MISUSE */
+			ucl_free (st);
+
+			return false;
+		}
+
 		st->obj = obj;
-		if (obj != NULL && obj->type == UCL_ARRAY) {
-			st->is_array = true;
-			sctx->ops->ucl_emitter_start_array (ctx, obj, top == NULL, print_key);
+		st->is_array = obj->type == UCL_ARRAY;
+		/* Elements of a container are emitted when it is started */
+		st->empty = obj->len == 0;
+		first = true;
+
+		if (top != NULL) {
+			first = top->empty;
+			top->empty = false;
+			top->count ++;
 		}
-		else if (obj != NULL && obj->type == UCL_OBJECT) {
-			st->is_array = false;
-			sctx->ops->ucl_emitter_start_object (ctx, obj, top == NULL, print_key);
+
+		if (sctx->id == UCL_EMIT_MSGPACK) {
+			ucl_emitter_print_key_msgpack (print_key, ctx, obj);
 		}
-		else {
-			/* API MISUSE */
-			free (st);
 
-			return false;
+		if (STREAMLINE_PATCHED (sctx)) {
+			/*
+			 * Length of a streamed container is unknown, so its header
+			 * uses the widest form and is patched when it is finished
+			 */
+			unsigned char hdr[5] = {st->is_array ? 0xdd : 0xdf, 0, 0, 0, 0};
+
+			st->hdr = sctx->flushed + sctx->out.len;
+			sctx->func->ucl_emitter_append_len (hdr, sizeof (hdr),
+					sctx->func->ud);
+
+			while ((cur = ucl_object_iterate (obj, &it, true)) != NULL) {
+				sctx->ops->ucl_emitter_write_elt (ctx, cur, false,
+						!st->is_array);
+				st->count ++;
+			}
+		}
+		else if (st->is_array) {
+			sctx->ops->ucl_emitter_start_array (ctx, obj, first, print_key);
+		}
+		else {
+			sctx->ops->ucl_emitter_start_object (ctx, obj, first, print_key);
 		}
 		LL_PREPEND (sctx->containers, st);
+		ucl_streamline_maybe_flush (sctx);
 	}
 
 	return true;
@@ -144,9 +321,54 @@ ucl_object_emit_streamline_add_object (
 			is_first = true;
 			sctx->containers->empty = false;
 		}
+		sctx->containers->count ++;
 	}
 
 	sctx->ops->ucl_emitter_write_elt (ctx, obj, is_first, !is_array);
+	ucl_streamline_maybe_flush (sctx);
+}
+
+/* Writes elements count to the msgpack header of a container */
+static void
+ucl_streamline_patch_hdr (struct ucl_emitter_context_streamline *sctx,
+		struct ucl_emitter_streamline_stack *st, size_t count)
+{
+	unsigned char *hdr;
+
+	if (st->hdr >= sctx->flushed &&
+			st->hdr - sctx->flushed + 5 <= sctx->out.len &&
+			sctx->out.len <= sctx->out.cap) {
+		hdr = sctx->out.buf + (st->hdr - sctx->flushed);
+		hdr[1] = (count >> 24) & 0xff;
+		hdr[2] = (count >> 16) & 0xff;
+		hdr[3] = (count >> 8) & 0xff;
+		hdr[4] = count & 0xff;
+	}
+
+	st->hdr = UCL_STREAMLINE_NO_HDR;
+}
+
+bool
+ucl_object_emit_streamline_set_count (struct ucl_emitter_context *ctx,
+		size_t count)
+{
+	struct ucl_emitter_context_streamline *sctx = TO_STREAMLINE(ctx);
+	struct ucl_emitter_streamline_stack *st = sctx->containers;
+
+	if (st == NULL || count < st->count || count > UINT32_MAX ||
+			st->expected != UCL_STREAMLINE_NO_HDR) {
+		return false;
+	}
+
+	st->expected = count;
+
+	if (STREAMLINE_PATCHED (sctx)) {
+		/* Output up to the next unfinished container can be flushed now */
+		ucl_streamline_patch_hdr (sctx, st, count);
+		ucl_streamline_maybe_flush (sctx);
+	}
+
+	return true;
 }
 
 void
@@ -158,19 +380,51 @@ ucl_object_emit_streamline_end_container (struct ucl_emitter_context *ctx)
 	if (sctx->containers != NULL) {
 		st = sctx->containers;
 
-		if (st->is_array) {
+		if (STREAMLINE_PATCHED (sctx)) {
+			if (st->hdr != UCL_STREAMLINE_NO_HDR) {
+				ucl_streamline_patch_hdr (sctx, st, st->count);
+			}
+			else if (st->expected != st->count) {
+				/* Declared count has been written already */
+				sctx->status = UCL_EMIT_STREAM_ERROR;
+			}
+		}
+		else if (st->is_array) {
 			sctx->ops->ucl_emitter_end_array (ctx, st->obj);
 		}
 		else {
 			sctx->ops->ucl_emitter_end_object (ctx, st->obj);
 		}
 		sctx->containers = st->next;
-		free (st);
+		ucl_free (st);
+		ucl_streamline_maybe_flush (sctx);
 	}
 }
 
-void
-ucl_object_emit_streamline_finish (struct ucl_emitter_context *ctx)
+enum ucl_emitter_stream_status
+ucl_object_emit_streamline_status (struct ucl_emitter_context *ctx)
+{
+	struct ucl_emitter_context_streamline *sctx = TO_STREAMLINE(ctx);
+
+	return sctx->status;
+}
+
+enum ucl_emitter_stream_status
+ucl_object_emit_streamline_flush (struct ucl_emitter_context *ctx)
+{
+	struct ucl_emitter_context_streamline *sctx = TO_STREAMLINE(ctx);
+
+	if (!STREAMLINE_BUFFERED (sctx)) {
+		return ucl_object_emit_funcs_flush (
+				(struct ucl_emitter_functions *)ctx->func) ?
+				UCL_EMIT_STREAM_OK : UCL_EMIT_STREAM_ERROR;
+	}
+
+	return ucl_streamline_flush_buf (sctx);
+}
+
+enum ucl_emitter_stream_status
+ucl_object_emit_streamline_close (struct ucl_emitter_context *ctx)
 {
 	struct ucl_emitter_context_streamline *sctx = TO_STREAMLINE(ctx);
 
@@ -178,5 +432,19 @@ ucl_object_emit_streamline_finish (struct ucl_emitter_context *ctx)
 		ucl_object_emit_streamline_end_container (ctx);
 	}
 
-	free (sctx);
+	return ucl_object_emit_streamline_flush (ctx);
+}
+
+void
+ucl_object_emit_streamline_finish (struct ucl_emitter_context *ctx)
+{
+	struct ucl_emitter_context_streamline *sctx = TO_STREAMLINE(ctx);
+
+	ucl_object_emit_streamline_close (ctx);
+
+	if (sctx->out.buf != NULL) {
+		UCL_FREE (sctx->out.cap, sctx->out.buf);
+	}
+
+	ucl_free (sctx);
 }
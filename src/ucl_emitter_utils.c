@@ -29,11 +29,20 @@
 #include "ucl_internal.h"
 #include "ucl_chartable.h"
 
-#ifdef HAVE_FLOAT_H
-#include <float.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
 #endif
-#ifdef HAVE_MATH_H
-#include <math.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
 #endif
 
 extern const struct ucl_emitter_operations ucl_standartd_emitter_ops[];
@@ -68,6 +77,18 @@ static const struct ucl_emitter_context ucl_standard_emitters[] = {
 		.id = UCL_EMIT_MSGPACK,
 		.func = NULL,
 		.ops = &ucl_standartd_emitter_ops[UCL_EMIT_MSGPACK]
+	},
+	[UCL_EMIT_JSON_CANONICAL] = {
+		.name = "json_canonical",
+		.id = UCL_EMIT_JSON_CANONICAL,
+		.func = NULL,
+		.ops = &ucl_standartd_emitter_ops[UCL_EMIT_JSON_CANONICAL]
+	},
+	[UCL_EMIT_NDJSON] = {
+		.name = "ndjson",
+		.id = UCL_EMIT_NDJSON,
+		.func = NULL,
+		.ops = &ucl_standartd_emitter_ops[UCL_EMIT_NDJSON]
 	}
 };
 
@@ -75,7 +96,7 @@ static inline void
 _ucl_emitter_free(void *p)
 {
 
-    free(p);
+    ucl_free (p);
 }
 
 /**
@@ -93,6 +114,181 @@ ucl_emit_get_standard_context (enum ucl_emitter emit_type)
 	return NULL;
 }
 
+/*
+ * Byte class scanners used by the string writers.
+ *
+ * A class is described by an inclusive upper bound for control characters
+ * plus a few explicit byte values. A class may be wider than the set of
+ * characters a caller cares for, in which case the caller confirms each
+ * candidate with `ucl_test_character`.
+ */
+struct ucl_byte_class {
+	unsigned char ctl;
+	unsigned char nchars;
+	unsigned char chars[8];
+};
+
+/* Characters that cannot appear in a JSON string literal as is */
+static const struct ucl_byte_class ucl_json_unsafe_class = {
+	.ctl = 0x1f,
+	.nchars = 3,
+	.chars = {'"', '\\', 0x7f}
+};
+
+/* Canonical JSON escapes nothing but these */
+static const struct ucl_byte_class ucl_canonical_unsafe_class = {
+	.ctl = 0x1f,
+	.nchars = 2,
+	.chars = {'"', '\\'}
+};
+
+/* Superset of UCL_CHARACTER_UCL_UNSAFE */
+static const struct ucl_byte_class ucl_key_unsafe_class = {
+	.ctl = '\r',
+	.nchars = 8,
+	.chars = {' ', '"', '+', ':', '=', '[', '\\', '{'}
+};
+
+static inline bool
+ucl_byte_class_has (const struct ucl_byte_class *cls, unsigned char c)
+{
+	unsigned i;
+
+	if (c <= cls->ctl) {
+		return true;
+	}
+
+	for (i = 0; i < cls->nchars; i ++) {
+		if (c == cls->chars[i]) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+#define UCL_SWAR_ONES (~(uint64_t)0 / 255)
+#define UCL_SWAR_HIGHS (UCL_SWAR_ONES * 0x80)
+
+/*
+ * Find the first byte of [p, end) that belongs to a class. Clean runs are
+ * skipped a vector (or a machine word when no vector unit is available)
+ * at a time.
+ */
+static const char *
+ucl_byte_class_scan (const struct ucl_byte_class *cls,
+		const char *p, const char *end)
+{
+	unsigned i;
+
+#if defined(__AVX2__) && defined(__GNUC__)
+	while (end - p >= 32) {
+		__m256i v = _mm256_loadu_si256 ((const __m256i *)p);
+		/* Unsigned v <= ctl iff min(v, ctl) == v */
+		__m256i m = _mm256_cmpeq_epi8 (
+				_mm256_min_epu8 (v, _mm256_set1_epi8 ((char)cls->ctl)), v);
+		unsigned mask;
+
+		for (i = 0; i < cls->nchars; i ++) {
+			m = _mm256_or_si256 (m, _mm256_cmpeq_epi8 (v,
+					_mm256_set1_epi8 ((char)cls->chars[i])));
+		}
+
+		mask = (unsigned)_mm256_movemask_epi8 (m);
+
+		if (mask != 0) {
+			return p + __builtin_ctz (mask);
+		}
+
+		p += 32;
+	}
+#endif
+#if defined(__SSE2__) && defined(__GNUC__)
+	while (end - p >= 16) {
+		__m128i v = _mm_loadu_si128 ((const __m128i *)p);
+		__m128i m = _mm_cmpeq_epi8 (
+				_mm_min_epu8 (v, _mm_set1_epi8 ((char)cls->ctl)), v);
+		unsigned mask;
+
+		for (i = 0; i < cls->nchars; i ++) {
+			m = _mm_or_si128 (m, _mm_cmpeq_epi8 (v,
+					_mm_set1_epi8 ((char)cls->chars[i])));
+		}
+
+		mask = (unsigned)_mm_movemask_epi8 (m);
+
+		if (mask != 0) {
+			return p + __builtin_ctz (mask);
+		}
+
+		p += 16;
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	while (end - p >= 16) {
+		uint8x16_t v = vld1q_u8 ((const uint8_t *)p);
+		uint8x16_t m = vcleq_u8 (v, vdupq_n_u8 (cls->ctl));
+
+		for (i = 0; i < cls->nchars; i ++) {
+			m = vorrq_u8 (m, vceqq_u8 (v, vdupq_n_u8 (cls->chars[i])));
+		}
+
+		if (vmaxvq_u8 (m) != 0) {
+			break;
+		}
+
+		p += 16;
+	}
+#else
+	while (end - p >= 8) {
+		uint64_t v, m;
+
+		memcpy (&v, p, sizeof (v));
+		/* Word has a byte below ctl + 1 */
+		m = (v - UCL_SWAR_ONES * ((uint64_t)cls->ctl + 1)) & ~v;
+
+		for (i = 0; i < cls->nchars; i ++) {
+			uint64_t x = v ^ (UCL_SWAR_ONES * cls->chars[i]);
+			/* Word has a byte equal to chars[i] */
+			m |= (x - UCL_SWAR_ONES) & ~x;
+		}
+
+		if (m & UCL_SWAR_HIGHS) {
+			break;
+		}
+
+		p += 8;
+	}
+#endif
+
+	while (p < end && !ucl_byte_class_has (cls, *p)) {
+		p ++;
+	}
+
+	return p;
+}
+
+size_t
+ucl_json_safe_span (const char *str, size_t size)
+{
+	return ucl_byte_class_scan (&ucl_json_unsafe_class, str, str + size) - str;
+}
+
+bool
+ucl_key_need_escape (const char *key, size_t keylen)
+{
+	const char *p = key, *end = key + keylen;
+
+	while ((p = ucl_byte_class_scan (&ucl_key_unsafe_class, p, end)) < end) {
+		if (ucl_test_character (*p, UCL_CHARACTER_UCL_UNSAFE)) {
+			return true;
+		}
+
+		p ++;
+	}
+
+	return false;
+}
+
 /**
  * Serialise string
  * @param str string to emit
@@ -102,64 +298,168 @@ void
 ucl_elt_string_write_json (const char *str, size_t size,
 		struct ucl_emitter_context *ctx)
 {
-	const char *p = str, *c = str;
-	size_t len = 0;
+	ucl_elt_string_write_json_full (str, size, ctx, true);
+}
+
+void
+ucl_elt_string_write_json_full (const char *str, size_t size,
+		struct ucl_emitter_context *ctx, bool borrow)
+{
+	const char *p = str, *end = str + size, *esc;
+	/* Adjacent escapes are collected here and flushed at once */
+	char ebuf[64];
+	size_t elen = 0, slen;
 	const struct ucl_emitter_functions *func = ctx->func;
 
 	func->ucl_emitter_append_character ('"', 1, func->ud);
 
-	while (size) {
-		if (ucl_test_character (*p, (UCL_CHARACTER_JSON_UNSAFE|
-				UCL_CHARACTER_DENIED|
-				UCL_CHARACTER_WHITESPACE_UNSAFE))) {
-			if (len > 0) {
-				func->ucl_emitter_append_len (c, len, func->ud);
+	while (p < end) {
+		slen = ucl_json_safe_span (p, end - p);
+
+		if (slen > 0) {
+			if (elen > 0) {
+				func->ucl_emitter_append_len (ebuf, elen, func->ud);
+				elen = 0;
 			}
-			switch (*p) {
-			case '\n':
-				func->ucl_emitter_append_len ("\\n", 2, func->ud);
-				break;
-			case '\r':
-				func->ucl_emitter_append_len ("\\r", 2, func->ud);
-				break;
-			case '\b':
-				func->ucl_emitter_append_len ("\\b", 2, func->ud);
-				break;
-			case '\t':
-				func->ucl_emitter_append_len ("\\t", 2, func->ud);
-				break;
-			case '\f':
-				func->ucl_emitter_append_len ("\\f", 2, func->ud);
-				break;
-			case '\v':
-				func->ucl_emitter_append_len ("\\u000B", 6, func->ud);
-				break;
-			case '\\':
-				func->ucl_emitter_append_len ("\\\\", 2, func->ud);
-				break;
-			case ' ':
-				func->ucl_emitter_append_character (' ', 1, func->ud);
-				break;
-			case '"':
-				func->ucl_emitter_append_len ("\\\"", 2, func->ud);
+
+			if (borrow) {
+				ucl_emitter_append_ref (p, slen, func);
+			}
+			else {
+				func->ucl_emitter_append_len (p, slen, func->ud);
+			}
+			p += slen;
+
+			if (p == end) {
 				break;
-			default:
-				/* Emit unicode unknown character */
-				func->ucl_emitter_append_len ("\\uFFFD", 6, func->ud);
+			}
+		}
+
+		switch (*p) {
+		case '\n':
+			esc = "\\n";
+			break;
+		case '\r':
+			esc = "\\r";
+			break;
+		case '\b':
+			esc = "\\b";
+			break;
+		case '\t':
+			esc = "\\t";
+			break;
+		case '\f':
+			esc = "\\f";
+			break;
+		case '\v':
+			esc = "\\u000B";
+			break;
+		case '\\':
+			esc = "\\\\";
+			break;
+		case '"':
+			esc = "\\\"";
+			break;
+		default:
+			/* Emit unicode unknown character */
+			esc = "\\uFFFD";
+			break;
+		}
+
+		slen = strlen (esc);
+
+		if (elen + slen > sizeof (ebuf)) {
+			func->ucl_emitter_append_len (ebuf, elen, func->ud);
+			elen = 0;
+		}
+
+		memcpy (ebuf + elen, esc, slen);
+		elen += slen;
+		p ++;
+	}
+
+	if (elen > 0) {
+		func->ucl_emitter_append_len (ebuf, elen, func->ud);
+	}
+
+	func->ucl_emitter_append_character ('"', 1, func->ud);
+}
+
+void
+ucl_elt_string_write_canonical (const char *str, size_t size,
+		struct ucl_emitter_context *ctx, bool borrow)
+{
+	static const char hexdigits[] = "0123456789abcdef";
+	const char *p = str, *end = str + size, *q;
+	const struct ucl_emitter_functions *func = ctx->func;
+	char ebuf[64];
+	size_t elen = 0;
+
+	func->ucl_emitter_append_character ('"', 1, func->ud);
+
+	while (p < end) {
+		q = ucl_byte_class_scan (&ucl_canonical_unsafe_class, p, end);
+
+		if (q > p) {
+			if (elen > 0) {
+				func->ucl_emitter_append_len (ebuf, elen, func->ud);
+				elen = 0;
+			}
+
+			if (borrow) {
+				ucl_emitter_append_ref (p, q - p, func);
+			}
+			else {
+				func->ucl_emitter_append_len (p, q - p, func->ud);
+			}
+
+			p = q;
+
+			if (p == end) {
 				break;
 			}
-			len = 0;
-			c = ++p;
 		}
-		else {
-			p ++;
-			len ++;
+
+		if (elen + 6 > sizeof (ebuf)) {
+			func->ucl_emitter_append_len (ebuf, elen, func->ud);
+			elen = 0;
+		}
+
+		ebuf[elen ++] = '\\';
+
+		switch (*p) {
+		case '\b':
+			ebuf[elen ++] = 'b';
+			break;
+		case '\t':
+			ebuf[elen ++] = 't';
+			break;
+		case '\n':
+			ebuf[elen ++] = 'n';
+			break;
+		case '\f':
+			ebuf[elen ++] = 'f';
+			break;
+		case '\r':
+			ebuf[elen ++] = 'r';
+			break;
+		case '"':
+		case '\\':
+			ebuf[elen ++] = *p;
+			break;
+		default:
+			memcpy (ebuf + elen, "u00", 3);
+			ebuf[elen + 3] = hexdigits[(*p >> 4) & 0xf];
+			ebuf[elen + 4] = hexdigits[*p & 0xf];
+			elen += 5;
+			break;
 		}
-		size --;
+
+		p ++;
 	}
 
-	if (len > 0) {
-		func->ucl_emitter_append_len (c, len, func->ud);
+	if (elen > 0) {
+		func->ucl_emitter_append_len (ebuf, elen, func->ud);
 	}
 
 	func->ucl_emitter_append_character ('"', 1, func->ud);
@@ -169,31 +469,23 @@ void
 ucl_elt_string_write_squoted (const char *str, size_t size,
 		struct ucl_emitter_context *ctx)
 {
-	const char *p = str, *c = str;
-	size_t len = 0;
+	const char *p = str, *end = str + size, *q;
 	const struct ucl_emitter_functions *func = ctx->func;
 
 	func->ucl_emitter_append_character ('\'', 1, func->ud);
 
-	while (size) {
-		if (*p == '\'') {
-			if (len > 0) {
-				func->ucl_emitter_append_len (c, len, func->ud);
-			}
-
-			len = 0;
-			c = ++p;
-			func->ucl_emitter_append_len ("\\\'", 2, func->ud);
+	/* A single byte to look for, so libc memchr is as fast as it gets */
+	while (p < end && (q = memchr (p, '\'', end - p)) != NULL) {
+		if (q > p) {
+			ucl_emitter_append_ref (p, q - p, func);
 		}
-		else {
-			p ++;
-			len ++;
-		}
-		size --;
+
+		func->ucl_emitter_append_len ("\\\'", 2, func->ud);
+		p = q + 1;
 	}
 
-	if (len > 0) {
-		func->ucl_emitter_append_len (c, len, func->ud);
+	if (p < end) {
+		ucl_emitter_append_ref (p, end - p, func);
 	}
 
 	func->ucl_emitter_append_character ('\'', 1, func->ud);
@@ -206,7 +498,7 @@ ucl_elt_string_write_multiline (const char *str, size_t size,
 	const struct ucl_emitter_functions *func = ctx->func;
 
 	func->ucl_emitter_append_len ("<<EOD\n", sizeof ("<<EOD\n") - 1, func->ud);
-	func->ucl_emitter_append_len (str, size, func->ud);
+	ucl_emitter_append_ref (str, size, func);
 	func->ucl_emitter_append_len ("\nEOD", sizeof ("\nEOD") - 1, func->ud);
 }
 
@@ -245,8 +537,9 @@ static int
 ucl_utstring_append_int (int64_t val, void *ud)
 {
 	UT_string *buf = ud;
+	char nbuf[UCL_NUMBER_BUF_SIZE];
 
-	utstring_printf (buf, "%jd", (intmax_t)val);
+	utstring_bincpy (buf, nbuf, ucl_itoa (val, nbuf));
 	return 0;
 }
 
@@ -254,188 +547,1077 @@ static int
 ucl_utstring_append_double (double val, void *ud)
 {
 	UT_string *buf = ud;
-	const double delta = 0.0000001;
+	char nbuf[UCL_NUMBER_BUF_SIZE];
+
+	utstring_bincpy (buf, nbuf, ucl_dtoa (val, nbuf));
+	return 0;
+}
+
+/*
+ * Fixed or growable buffer output
+ */
+static void
+ucl_emitter_buf_grow (struct ucl_emitter_buf *ebuf, size_t len)
+{
+	size_t ncap = ebuf->cap > 0 ? ebuf->cap * 2 : 4096;
+	unsigned char *nbuf;
 
-	if (val == (double)(int)val) {
-		utstring_printf (buf, "%.1lf", val);
+	while (ncap - ebuf->len < len) {
+		ncap *= 2;
 	}
-	else if (fabs (val - (double)(int)val) < delta) {
-		/* Write at maximum precision */
-		utstring_printf (buf, "%.*lg", DBL_DIG, val);
+
+	nbuf = UCL_REALLOC (ebuf->buf, ncap);
+
+	if (nbuf == NULL) {
+		ebuf->grow = false;
+		return;
 	}
-	else {
-		utstring_printf (buf, "%lf", val);
+
+	ebuf->buf = nbuf;
+	ebuf->cap = ncap;
+}
+
+static inline void
+ucl_emitter_buf_put (struct ucl_emitter_buf *ebuf, const void *str, size_t len)
+{
+	size_t avail;
+
+	/* Empty strings may come with a NULL pointer */
+	if (len == 0) {
+		return;
 	}
 
-	return 0;
+	if (ebuf->grow && ebuf->cap - ebuf->len < len) {
+		ucl_emitter_buf_grow (ebuf, len);
+	}
+
+	if (ebuf->len < ebuf->cap) {
+		avail = ebuf->cap - ebuf->len;
+		memcpy (ebuf->buf + ebuf->len, str, len < avail ? len : avail);
+	}
+
+	ebuf->len += len;
 }
 
-/*
- * Generic file output
- */
 static int
-ucl_file_append_character (unsigned char c, size_t len, void *ud)
+ucl_buf_append_character (unsigned char c, size_t len, void *ud)
 {
-	FILE *fp = ud;
+	struct ucl_emitter_buf *ebuf = ud;
+	size_t avail;
 
-	while (len --) {
-		fputc (c, fp);
+	if (ebuf->grow && ebuf->cap - ebuf->len < len) {
+		ucl_emitter_buf_grow (ebuf, len);
 	}
 
+	if (ebuf->len < ebuf->cap) {
+		avail = ebuf->cap - ebuf->len;
+		memset (ebuf->buf + ebuf->len, c, len < avail ? len : avail);
+	}
+
+	ebuf->len += len;
+
 	return 0;
 }
 
 static int
-ucl_file_append_len (const unsigned char *str, size_t len, void *ud)
+ucl_buf_append_len (const unsigned char *str, size_t len, void *ud)
 {
-	FILE *fp = ud;
-
-	fwrite (str, len, 1, fp);
+	ucl_emitter_buf_put (ud, str, len);
 
 	return 0;
 }
 
 static int
-ucl_file_append_int (int64_t val, void *ud)
+ucl_buf_append_int (int64_t val, void *ud)
 {
-	FILE *fp = ud;
+	char nbuf[UCL_NUMBER_BUF_SIZE];
 
-	fprintf (fp, "%jd", (intmax_t)val);
+	ucl_emitter_buf_put (ud, nbuf, ucl_itoa (val, nbuf));
 
 	return 0;
 }
 
 static int
-ucl_file_append_double (double val, void *ud)
+ucl_buf_append_double (double val, void *ud)
 {
-	FILE *fp = ud;
-	const double delta = 0.0000001;
+	char nbuf[UCL_NUMBER_BUF_SIZE];
 
-	if (val == (double)(int)val) {
-		fprintf (fp, "%.1lf", val);
-	}
-	else if (fabs (val - (double)(int)val) < delta) {
-		/* Write at maximum precision */
-		fprintf (fp, "%.*lg", DBL_DIG, val);
-	}
-	else {
-		fprintf (fp, "%lf", val);
-	}
+	ucl_emitter_buf_put (ud, nbuf, ucl_dtoa (val, nbuf));
 
 	return 0;
 }
 
+void
+ucl_emitter_buf_funcs (struct ucl_emitter_functions *func,
+		struct ucl_emitter_buf *ebuf)
+{
+	memset (func, 0, sizeof (*func));
+	func->ucl_emitter_append_character = ucl_buf_append_character;
+	func->ucl_emitter_append_len = ucl_buf_append_len;
+	func->ucl_emitter_append_int = ucl_buf_append_int;
+	func->ucl_emitter_append_double = ucl_buf_append_double;
+	func->ud = ebuf;
+}
+
+/*
+ * Sinks that buffer output start with this header, so that their output is
+ * written by ucl_object_emit_funcs_flush whatever the sink is
+ */
+struct ucl_emitter_sink {
+	/* Write buffered output, false with errno set on errors */
+	bool (*flush) (void *ud);
+	/* Write buffered output and free the sink */
+	void (*release) (void *ud);
+	/* Reference a string owned by the emitted object, NULL to copy it */
+	bool (*append_ref) (const unsigned char *str, size_t len, void *ud);
+	/* Collected output vectors, NULL if output is written immediately */
+	bool (*iovec) (void *ud, const struct iovec **iov, size_t *cnt,
+			size_t *total);
+};
+
+static void
+ucl_emitter_sink_free (void *ud)
+{
+	struct ucl_emitter_sink *sink = ud;
+
+	sink->release (ud);
+}
+
 /*
- * Generic file descriptor writing functions
+ * Generic file output
  */
+struct ucl_file_sink {
+	struct ucl_emitter_sink h;
+	FILE *fp;
+};
+
 static int
-ucl_fd_append_character (unsigned char c, size_t len, void *ud)
+ucl_file_append_character (unsigned char c, size_t len, void *ud)
 {
-	int fd = *(int *)ud;
-	unsigned char *buf;
+	FILE *fp = ((struct ucl_file_sink *)ud)->fp;
 
-	if (len == 1) {
-		return write (fd, &c, 1);
-	}
-	else {
-		buf = malloc (len);
-		if (buf == NULL) {
-			/* Fallback */
-			while (len --) {
-				if (write (fd, &c, 1) == -1) {
-					return -1;
-				}
-			}
-		}
-		else {
-			memset (buf, c, len);
-			if (write (fd, buf, len) == -1) {
-				free(buf);
-				return -1;
-			}
-			free (buf);
-		}
+	while (len --) {
+		fputc (c, fp);
 	}
 
 	return 0;
 }
 
 static int
-ucl_fd_append_len (const unsigned char *str, size_t len, void *ud)
+ucl_file_append_len (const unsigned char *str, size_t len, void *ud)
 {
-	int fd = *(int *)ud;
+	FILE *fp = ((struct ucl_file_sink *)ud)->fp;
+
+	fwrite (str, len, 1, fp);
 
-	return write (fd, str, len);
+	return 0;
 }
 
 static int
-ucl_fd_append_int (int64_t val, void *ud)
+ucl_file_append_int (int64_t val, void *ud)
 {
-	int fd = *(int *)ud;
-	char intbuf[64];
+	FILE *fp = ((struct ucl_file_sink *)ud)->fp;
+	char nbuf[UCL_NUMBER_BUF_SIZE];
 
-	snprintf (intbuf, sizeof (intbuf), "%jd", (intmax_t)val);
-	return write (fd, intbuf, strlen (intbuf));
+	fwrite (nbuf, ucl_itoa (val, nbuf), 1, fp);
+
+	return 0;
 }
 
 static int
-ucl_fd_append_double (double val, void *ud)
+ucl_file_append_double (double val, void *ud)
 {
-	int fd = *(int *)ud;
-	const double delta = 0.0000001;
-	char nbuf[64];
+	FILE *fp = ((struct ucl_file_sink *)ud)->fp;
+	char nbuf[UCL_NUMBER_BUF_SIZE];
 
-	if (val == (double)(int)val) {
-		snprintf (nbuf, sizeof (nbuf), "%.1lf", val);
-	}
-	else if (fabs (val - (double)(int)val) < delta) {
-		/* Write at maximum precision */
-		snprintf (nbuf, sizeof (nbuf), "%.*lg", DBL_DIG, val);
-	}
-	else {
-		snprintf (nbuf, sizeof (nbuf), "%lf", val);
-	}
+	fwrite (nbuf, ucl_dtoa (val, nbuf), 1, fp);
 
-	return write (fd, nbuf, strlen (nbuf));
+	return 0;
 }
 
-struct ucl_emitter_functions*
-ucl_object_emit_memory_funcs (void **pmem)
+static bool
+ucl_file_sink_flush (void *ud)
 {
-	struct ucl_emitter_functions *f;
-	UT_string *s;
+	struct ucl_file_sink *sink = ud;
 
-	f = calloc (1, sizeof (*f));
+	return fflush (sink->fp) == 0;
+}
 
-	if (f != NULL) {
-		f->ucl_emitter_append_character = ucl_utstring_append_character;
-		f->ucl_emitter_append_double = ucl_utstring_append_double;
-		f->ucl_emitter_append_int = ucl_utstring_append_int;
-		f->ucl_emitter_append_len = ucl_utstring_append_len;
-		f->ucl_emitter_free_func = _ucl_emitter_free;
-		utstring_new (s);
-		f->ud = s;
-		*pmem = s->d;
-		s->pd = pmem;
-	}
+static void
+ucl_file_sink_free (void *ud)
+{
+	struct ucl_file_sink *sink = ud;
 
-	return f;
+	/* The file itself is owned by a caller */
+	UCL_FREE (sizeof (*sink), sink);
 }
 
-struct ucl_emitter_functions*
+/*
+ * Buffered file descriptor output
+ */
+#define UCL_FD_BUFFER_SIZE 65536
+
+struct ucl_fd_sink {
+	struct ucl_emitter_sink h;
+	int fd;
+	/* The first errno seen, output stops after an error */
+	int err;
+	size_t len;
+	size_t size;
+	unsigned char *buf;
+};
+
+#ifndef HAVE_SYS_UIO_H
+struct iovec {
+	void *iov_base;
+	size_t iov_len;
+};
+#endif
+
+/* Vectors passed to a single writev call */
+#if defined(IOV_MAX) && IOV_MAX < 1024
+#define UCL_IOV_BATCH IOV_MAX
+#else
+#define UCL_IOV_BATCH 1024
+#endif
+
+/*
+ * Write all vectors, restarting after partial writes; `iov` is modified
+ * @return 0 or errno of a failed write
+ */
+static int
+ucl_writev_full (int fd, struct iovec *iov, size_t cnt)
+{
+	ssize_t r;
+
+	while (cnt > 0) {
+#ifdef HAVE_SYS_UIO_H
+		r = writev (fd, iov, cnt > UCL_IOV_BATCH ? UCL_IOV_BATCH : (int)cnt);
+#else
+		r = write (fd, iov->iov_base, iov->iov_len);
+#endif
+
+		if (r == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			return errno;
+		}
+
+		/* Skip fully written vectors and adjust a partially written one */
+		while (cnt > 0 && (size_t)r >= iov->iov_len) {
+			r -= iov->iov_len;
+			iov ++;
+			cnt --;
+		}
+		if (cnt > 0) {
+			iov->iov_base = (unsigned char *)iov->iov_base + r;
+			iov->iov_len -= r;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Write buffered data followed by `str` and empty the buffer
+ */
+static bool
+ucl_fd_sink_write (struct ucl_fd_sink *sink, const unsigned char *str,
+		size_t len)
+{
+	struct iovec iov[2];
+	size_t cnt = 0;
+
+	if (sink->len > 0) {
+		iov[cnt].iov_base = sink->buf;
+		iov[cnt].iov_len = sink->len;
+		cnt ++;
+	}
+	if (len > 0) {
+		iov[cnt].iov_base = (void *)str;
+		iov[cnt].iov_len = len;
+		cnt ++;
+	}
+
+	sink->err = ucl_writev_full (sink->fd, iov, cnt);
+
+	if (sink->err != 0) {
+		return false;
+	}
+
+	sink->len = 0;
+
+	return true;
+}
+
+static int
+ucl_fd_append_len (const unsigned char *str, size_t len, void *ud)
+{
+	struct ucl_fd_sink *sink = ud;
+
+	if (sink->err != 0) {
+		return -1;
+	}
+
+	if (len > sink->size - sink->len) {
+		if (len >= sink->size / 2) {
+			/* Large chunks are written along with the buffer in one call */
+			return ucl_fd_sink_write (sink, str, len) ? 0 : -1;
+		}
+
+		if (!ucl_fd_sink_write (sink, NULL, 0)) {
+			return -1;
+		}
+	}
+
+	memcpy (sink->buf + sink->len, str, len);
+	sink->len += len;
+
+	return 0;
+}
+
+static int
+ucl_fd_append_character (unsigned char c, size_t len, void *ud)
+{
+	struct ucl_fd_sink *sink = ud;
+	size_t chunk;
+
+	if (sink->err != 0) {
+		return -1;
+	}
+
+	while (len > 0) {
+		if (sink->len == sink->size && !ucl_fd_sink_write (sink, NULL, 0)) {
+			return -1;
+		}
+
+		chunk = sink->size - sink->len;
+		if (chunk > len) {
+			chunk = len;
+		}
+		memset (sink->buf + sink->len, c, chunk);
+		sink->len += chunk;
+		len -= chunk;
+	}
+
+	return 0;
+}
+
+static int
+ucl_fd_append_int (int64_t val, void *ud)
+{
+	char nbuf[UCL_NUMBER_BUF_SIZE];
+	size_t len = ucl_itoa (val, nbuf);
+
+	return ucl_fd_append_len ((unsigned char *)nbuf, len, ud);
+}
+
+static int
+ucl_fd_append_double (double val, void *ud)
+{
+	char nbuf[UCL_NUMBER_BUF_SIZE];
+	size_t len = ucl_dtoa (val, nbuf);
+
+	return ucl_fd_append_len ((unsigned char *)nbuf, len, ud);
+}
+
+static bool
+ucl_fd_sink_flush (void *ud)
+{
+	struct ucl_fd_sink *sink = ud;
+
+	if (sink->err != 0) {
+		errno = sink->err;
+		return false;
+	}
+
+	return sink->len == 0 || ucl_fd_sink_write (sink, NULL, 0);
+}
+
+static void
+ucl_fd_sink_free (void *ud)
+{
+	struct ucl_fd_sink *sink = ud;
+
+	if (sink->err == 0 && sink->len > 0) {
+		ucl_fd_sink_write (sink, NULL, 0);
+	}
+
+	UCL_FREE (sink->size, sink->buf);
+	UCL_FREE (sizeof (*sink), sink);
+}
+
+/*
+ * Compressed file descriptor output: emitted bytes are collected in the
+ * input buffer and compressed by buffer sized pieces
+ */
+#define UCL_COMPRESS_IN_SIZE 65536
+#define UCL_COMPRESS_OUT_SIZE 65536
+
+enum ucl_compress_mode {
+	UCL_COMPRESS_RUN = 0,
+	UCL_COMPRESS_FLUSH,
+	UCL_COMPRESS_END
+};
+
+struct ucl_compress_sink {
+	struct ucl_emitter_sink h;
+	int fd;
+	/* The first errno seen, output stops after an error */
+	int err;
+	enum ucl_compression codec;
+	size_t len;
+	unsigned char *in;
+	unsigned char *out;
+#ifdef HAVE_ZLIB
+	z_stream zs;
+#endif
+#ifdef HAVE_ZSTD
+	ZSTD_CCtx *zc;
+#endif
+#ifdef HAVE_LZMA
+	lzma_stream xz;
+#endif
+};
+
+static bool
+ucl_compress_sink_out (struct ucl_compress_sink *sink, size_t len)
+{
+	struct iovec iov;
+
+	if (len > 0) {
+		iov.iov_base = sink->out;
+		iov.iov_len = len;
+		sink->err = ucl_writev_full (sink->fd, &iov, 1);
+	}
+
+	return sink->err == 0;
+}
+
+/*
+ * Compress `data` writing all produced output
+ */
+static bool
+ucl_compress_sink_run (struct ucl_compress_sink *sink,
+		const unsigned char *data, size_t len, enum ucl_compress_mode mode)
+{
+	if (sink->err != 0) {
+		return false;
+	}
+
+#ifdef HAVE_ZLIB
+	if (sink->codec == UCL_COMPRESSION_GZIP) {
+		int flush, ret;
+		uInt chunk;
+
+		/* zlib counts input in uInt, so it is passed in pieces */
+		do {
+			chunk = len > UINT_MAX ? UINT_MAX : (uInt)len;
+			len -= chunk;
+			flush = len > 0 ? Z_NO_FLUSH : (mode == UCL_COMPRESS_END ?
+					Z_FINISH : (mode == UCL_COMPRESS_FLUSH ?
+					Z_SYNC_FLUSH : Z_NO_FLUSH));
+			sink->zs.next_in = (unsigned char *)data;
+			sink->zs.avail_in = chunk;
+			data += chunk;
+
+			do {
+				sink->zs.next_out = sink->out;
+				sink->zs.avail_out = UCL_COMPRESS_OUT_SIZE;
+				ret = deflate (&sink->zs, flush);
+
+				if (ret == Z_STREAM_ERROR) {
+					sink->err = EINVAL;
+					return false;
+				}
+				if (!ucl_compress_sink_out (sink,
+						UCL_COMPRESS_OUT_SIZE - sink->zs.avail_out)) {
+					return false;
+				}
+			} while (sink->zs.avail_out == 0 ||
+					(flush == Z_FINISH && ret != Z_STREAM_END));
+		} while (len > 0);
+
+		return true;
+	}
+#endif
+#ifdef HAVE_ZSTD
+	if (sink->codec == UCL_COMPRESSION_ZSTD) {
+		ZSTD_EndDirective op = mode == UCL_COMPRESS_END ? ZSTD_e_end :
+				(mode == UCL_COMPRESS_FLUSH ? ZSTD_e_flush : ZSTD_e_continue);
+		ZSTD_inBuffer in = {data, len, 0};
+		ZSTD_outBuffer out;
+		size_t rem;
+
+		do {
+			out.dst = sink->out;
+			out.size = UCL_COMPRESS_OUT_SIZE;
+			out.pos = 0;
+			rem = ZSTD_compressStream2 (sink->zc, &out, &in, op);
+
+			if (ZSTD_isError (rem)) {
+				sink->err = EINVAL;
+				return false;
+			}
+			if (!ucl_compress_sink_out (sink, out.pos)) {
+				return false;
+			}
+		} while (op == ZSTD_e_continue ? in.pos < in.size : rem != 0);
+
+		return true;
+	}
+#endif
+#ifdef HAVE_LZMA
+	if (sink->codec == UCL_COMPRESSION_XZ) {
+		lzma_action action = mode == UCL_COMPRESS_END ? LZMA_FINISH :
+				(mode == UCL_COMPRESS_FLUSH ? LZMA_FULL_FLUSH : LZMA_RUN);
+		lzma_ret ret;
+
+		sink->xz.next_in = data;
+		sink->xz.avail_in = len;
+
+		do {
+			sink->xz.next_out = sink->out;
+			sink->xz.avail_out = UCL_COMPRESS_OUT_SIZE;
+			ret = lzma_code (&sink->xz, action);
+
+			if (ret != LZMA_OK && ret != LZMA_STREAM_END) {
+				sink->err = ret == LZMA_MEM_ERROR ? ENOMEM : EINVAL;
+				return false;
+			}
+			if (!ucl_compress_sink_out (sink,
+					UCL_COMPRESS_OUT_SIZE - sink->xz.avail_out)) {
+				return false;
+			}
+		} while (action == LZMA_RUN ?
+				sink->xz.avail_in > 0 || sink->xz.avail_out == 0 :
+				ret != LZMA_STREAM_END);
+
+		return true;
+	}
+#endif
+
+	sink->err = EINVAL;
+
+	return false;
+}
+
+static int
+ucl_compress_append_len (const unsigned char *str, size_t len, void *ud)
+{
+	struct ucl_compress_sink *sink = ud;
+
+	if (sink->err != 0) {
+		return -1;
+	}
+
+	if (len > UCL_COMPRESS_IN_SIZE - sink->len) {
+		if (!ucl_compress_sink_run (sink, sink->in, sink->len,
+				UCL_COMPRESS_RUN)) {
+			return -1;
+		}
+		sink->len = 0;
+
+		if (len >= UCL_COMPRESS_IN_SIZE / 2) {
+			/* Large chunks are compressed in place */
+			return ucl_compress_sink_run (sink, str, len,
+					UCL_COMPRESS_RUN) ? 0 : -1;
+		}
+	}
+
+	memcpy (sink->in + sink->len, str, len);
+	sink->len += len;
+
+	return 0;
+}
+
+static int
+ucl_compress_append_character (unsigned char c, size_t len, void *ud)
+{
+	struct ucl_compress_sink *sink = ud;
+	size_t chunk;
+
+	if (sink->err != 0) {
+		return -1;
+	}
+
+	while (len > 0) {
+		if (sink->len == UCL_COMPRESS_IN_SIZE) {
+			if (!ucl_compress_sink_run (sink, sink->in, sink->len,
+					UCL_COMPRESS_RUN)) {
+				return -1;
+			}
+			sink->len = 0;
+		}
+
+		chunk = UCL_COMPRESS_IN_SIZE - sink->len;
+		if (chunk > len) {
+			chunk = len;
+		}
+		memset (sink->in + sink->len, c, chunk);
+		sink->len += chunk;
+		len -= chunk;
+	}
+
+	return 0;
+}
+
+static int
+ucl_compress_append_int (int64_t val, void *ud)
+{
+	char nbuf[UCL_NUMBER_BUF_SIZE];
+	size_t len = ucl_itoa (val, nbuf);
+
+	return ucl_compress_append_len ((unsigned char *)nbuf, len, ud);
+}
+
+static int
+ucl_compress_append_double (double val, void *ud)
+{
+	char nbuf[UCL_NUMBER_BUF_SIZE];
+	size_t len = ucl_dtoa (val, nbuf);
+
+	return ucl_compress_append_len ((unsigned char *)nbuf, len, ud);
+}
+
+static bool
+ucl_compress_sink_flush (struct ucl_compress_sink *sink,
+		enum ucl_compress_mode mode)
+{
+	if (!ucl_compress_sink_run (sink, sink->in, sink->len, mode)) {
+		return false;
+	}
+
+	sink->len = 0;
+
+	return true;
+}
+
+static bool
+ucl_compress_sink_flush_hook (void *ud)
+{
+	struct ucl_compress_sink *sink = ud;
+
+	if (!ucl_compress_sink_flush (sink, UCL_COMPRESS_FLUSH)) {
+		errno = sink->err;
+		return false;
+	}
+
+	return true;
+}
+
+static void
+ucl_compress_sink_free (void *ud)
+{
+	struct ucl_compress_sink *sink = ud;
+
+	/* Finish the stream so that its output is complete */
+	ucl_compress_sink_flush (sink, UCL_COMPRESS_END);
+
+#ifdef HAVE_ZLIB
+	if (sink->codec == UCL_COMPRESSION_GZIP) {
+		deflateEnd (&sink->zs);
+	}
+#endif
+#ifdef HAVE_ZSTD
+	if (sink->zc != NULL) {
+		ZSTD_freeCCtx (sink->zc);
+	}
+#endif
+#ifdef HAVE_LZMA
+	/* Safe for a stream that has not been initialized */
+	lzma_end (&sink->xz);
+#endif
+
+	UCL_FREE (UCL_COMPRESS_IN_SIZE, sink->in);
+	UCL_FREE (UCL_COMPRESS_OUT_SIZE, sink->out);
+	UCL_FREE (sizeof (*sink), sink);
+}
+
+/*
+ * Iovec output: structural bytes and short strings are copied to chunks,
+ * long strings are referenced in place
+ */
+#define UCL_IOV_CHUNK_SIZE 4096
+#define UCL_IOV_MIN_REF 512
+
+struct ucl_iov_chunk {
+	struct ucl_iov_chunk *next;
+	size_t len;
+	unsigned char data[UCL_IOV_CHUNK_SIZE];
+};
+
+struct ucl_iov_sink {
+	struct ucl_emitter_sink h;
+	struct iovec *iov;
+	size_t niov;
+	size_t iovcap;
+	size_t total;
+	size_t min_ref;
+	/* The current chunk is the head of the list */
+	struct ucl_iov_chunk *chunks;
+	bool err;
+};
+
+static bool
+ucl_iov_push (struct ucl_iov_sink *sink, const void *base, size_t len)
+{
+	struct iovec *niov;
+	size_t ncap;
+
+	if (sink->niov == sink->iovcap) {
+		ncap = sink->iovcap > 0 ? sink->iovcap * 2 : 64;
+		niov = UCL_REALLOC (sink->iov, ncap * sizeof (*niov));
+
+		if (niov == NULL) {
+			sink->err = true;
+			return false;
+		}
+
+		sink->iov = niov;
+		sink->iovcap = ncap;
+	}
+
+	sink->iov[sink->niov].iov_base = (void *)base;
+	sink->iov[sink->niov].iov_len = len;
+	sink->niov ++;
+	sink->total += len;
+
+	return true;
+}
+
+/*
+ * Reserve space in the current chunk, a chunk tail reserved just after
+ * the previous one extends the last vector
+ */
+static unsigned char *
+ucl_iov_reserve (struct ucl_iov_sink *sink, size_t *len)
+{
+	struct ucl_iov_chunk *chunk = sink->chunks;
+	struct iovec *last;
+	unsigned char *p;
+
+	if (chunk == NULL || chunk->len == UCL_IOV_CHUNK_SIZE) {
+		chunk = UCL_ALLOC (sizeof (*chunk));
+
+		if (chunk == NULL) {
+			sink->err = true;
+			return NULL;
+		}
+
+		chunk->len = 0;
+		chunk->next = sink->chunks;
+		sink->chunks = chunk;
+	}
+
+	p = chunk->data + chunk->len;
+
+	if (*len > UCL_IOV_CHUNK_SIZE - chunk->len) {
+		*len = UCL_IOV_CHUNK_SIZE - chunk->len;
+	}
+
+	last = sink->niov > 0 ? &sink->iov[sink->niov - 1] : NULL;
+
+	if (last != NULL && (unsigned char *)last->iov_base + last->iov_len == p &&
+			chunk->len > 0) {
+		last->iov_len += *len;
+		sink->total += *len;
+	}
+	else if (!ucl_iov_push (sink, p, *len)) {
+		return NULL;
+	}
+
+	chunk->len += *len;
+
+	return p;
+}
+
+static int
+ucl_iov_append_len (const unsigned char *str, size_t len, void *ud)
+{
+	struct ucl_iov_sink *sink = ud;
+	unsigned char *p;
+	size_t chunk;
+
+	while (len > 0 && !sink->err) {
+		chunk = len;
+		p = ucl_iov_reserve (sink, &chunk);
+
+		if (p == NULL) {
+			break;
+		}
+
+		memcpy (p, str, chunk);
+		str += chunk;
+		len -= chunk;
+	}
+
+	return sink->err ? -1 : 0;
+}
+
+static int
+ucl_iov_append_character (unsigned char c, size_t len, void *ud)
+{
+	struct ucl_iov_sink *sink = ud;
+	unsigned char *p;
+	size_t chunk;
+
+	while (len > 0 && !sink->err) {
+		chunk = len;
+		p = ucl_iov_reserve (sink, &chunk);
+
+		if (p == NULL) {
+			break;
+		}
+
+		memset (p, c, chunk);
+		len -= chunk;
+	}
+
+	return sink->err ? -1 : 0;
+}
+
+static int
+ucl_iov_append_int (int64_t val, void *ud)
+{
+	char nbuf[UCL_NUMBER_BUF_SIZE];
+	size_t len = ucl_itoa (val, nbuf);
+
+	return ucl_iov_append_len ((unsigned char *)nbuf, len, ud);
+}
+
+static int
+ucl_iov_append_double (double val, void *ud)
+{
+	char nbuf[UCL_NUMBER_BUF_SIZE];
+	size_t len = ucl_dtoa (val, nbuf);
+
+	return ucl_iov_append_len ((unsigned char *)nbuf, len, ud);
+}
+
+static void
+ucl_iov_sink_free (void *ud)
+{
+	struct ucl_iov_sink *sink = ud;
+	struct ucl_iov_chunk *chunk, *tmp;
+
+	LL_FOREACH_SAFE (sink->chunks, chunk, tmp) {
+		UCL_FREE (sizeof (*chunk), chunk);
+	}
+
+	if (sink->iov != NULL) {
+		UCL_FREE (sink->iovcap * sizeof (*sink->iov), sink->iov);
+	}
+
+	UCL_FREE (sizeof (*sink), sink);
+}
+
+static bool
+ucl_iov_sink_flush (void *ud)
+{
+	/* Output is written by ucl_object_emit_funcs_writev */
+	return true;
+}
+
+static bool
+ucl_iov_append_ref (const unsigned char *str, size_t len, void *ud)
+{
+	struct ucl_iov_sink *sink = ud;
+
+	if (len < sink->min_ref || sink->err) {
+		return false;
+	}
+
+	return ucl_iov_push (sink, str, len);
+}
+
+static bool
+ucl_iov_sink_iovec (void *ud, const struct iovec **iov, size_t *cnt,
+		size_t *total)
+{
+	struct ucl_iov_sink *sink = ud;
+
+	if (sink->err) {
+		return false;
+	}
+
+	*iov = sink->iov;
+	*cnt = sink->niov;
+	*total = sink->total;
+
+	return true;
+}
+
+/*
+ * Digest output: data is passed to a callback in pieces of the buffer size
+ */
+#define UCL_DIGEST_BUFFER_SIZE 4096
+
+struct ucl_digest_sink {
+	struct ucl_emitter_sink h;
+	ucl_emitter_digest_update update;
+	void *ud;
+	size_t len;
+	unsigned char buf[UCL_DIGEST_BUFFER_SIZE];
+};
+
+static void
+ucl_digest_sink_flush (struct ucl_digest_sink *sink)
+{
+	if (sink->len > 0) {
+		sink->update (sink->buf, sink->len, sink->ud);
+		sink->len = 0;
+	}
+}
+
+static bool
+ucl_digest_sink_flush_hook (void *ud)
+{
+	ucl_digest_sink_flush (ud);
+
+	return true;
+}
+
+static int
+ucl_digest_append_len (const unsigned char *str, size_t len, void *ud)
+{
+	struct ucl_digest_sink *sink = ud;
+
+	if (len > sizeof (sink->buf) - sink->len) {
+		ucl_digest_sink_flush (sink);
+
+		if (len >= sizeof (sink->buf) / 2) {
+			/* Pass large chunks as is */
+			sink->update (str, len, sink->ud);
+			return 0;
+		}
+	}
+
+	memcpy (sink->buf + sink->len, str, len);
+	sink->len += len;
+
+	return 0;
+}
+
+static int
+ucl_digest_append_character (unsigned char c, size_t len, void *ud)
+{
+	struct ucl_digest_sink *sink = ud;
+	size_t chunk;
+
+	while (len > 0) {
+		if (sink->len == sizeof (sink->buf)) {
+			ucl_digest_sink_flush (sink);
+		}
+
+		chunk = sizeof (sink->buf) - sink->len;
+		if (chunk > len) {
+			chunk = len;
+		}
+		memset (sink->buf + sink->len, c, chunk);
+		sink->len += chunk;
+		len -= chunk;
+	}
+
+	return 0;
+}
+
+static int
+ucl_digest_append_int (int64_t val, void *ud)
+{
+	char nbuf[UCL_NUMBER_BUF_SIZE];
+	size_t len = ucl_itoa (val, nbuf);
+
+	return ucl_digest_append_len ((unsigned char *)nbuf, len, ud);
+}
+
+static int
+ucl_digest_append_double (double val, void *ud)
+{
+	char nbuf[UCL_NUMBER_BUF_SIZE];
+	size_t len = ucl_dtoa (val, nbuf);
+
+	return ucl_digest_append_len ((unsigned char *)nbuf, len, ud);
+}
+
+static void
+ucl_digest_sink_free (void *ud)
+{
+	struct ucl_digest_sink *sink = ud;
+
+	ucl_digest_sink_flush (sink);
+	UCL_FREE (sizeof (*sink), sink);
+}
+
+void
+ucl_emitter_append_ref (const unsigned char *str, size_t len,
+		const struct ucl_emitter_functions *func)
+{
+	struct ucl_emitter_sink *sink;
+
+	if (func->ucl_emitter_free_func == ucl_emitter_sink_free) {
+		sink = func->ud;
+
+		if (sink->append_ref != NULL &&
+				sink->append_ref (str, len, func->ud)) {
+			return;
+		}
+	}
+
+	func->ucl_emitter_append_len (str, len, func->ud);
+}
+
+struct ucl_emitter_functions*
+ucl_object_emit_memory_funcs (void **pmem)
+{
+	struct ucl_emitter_functions *f;
+	UT_string *s;
+
+	f = ucl_calloc (1, sizeof (*f));
+
+	if (f != NULL) {
+		f->ucl_emitter_append_character = ucl_utstring_append_character;
+		f->ucl_emitter_append_double = ucl_utstring_append_double;
+		f->ucl_emitter_append_int = ucl_utstring_append_int;
+		f->ucl_emitter_append_len = ucl_utstring_append_len;
+		f->ucl_emitter_free_func = _ucl_emitter_free;
+		utstring_new (s);
+		f->ud = s;
+		*pmem = s->d;
+		s->pd = pmem;
+	}
+
+	return f;
+}
+
+struct ucl_emitter_functions*
 ucl_object_emit_file_funcs (FILE *fp)
 {
 	struct ucl_emitter_functions *f;
+	struct ucl_file_sink *sink;
 
-	f = calloc (1, sizeof (*f));
+	f = ucl_calloc (1, sizeof (*f));
 
 	if (f != NULL) {
+		sink = UCL_ALLOC (sizeof (*sink));
+		if (sink == NULL) {
+			ucl_free (f);
+			return NULL;
+		}
+
+		sink->h.flush = ucl_file_sink_flush;
+		sink->h.release = ucl_file_sink_free;
+		sink->h.append_ref = NULL;
+		sink->h.iovec = NULL;
+		sink->fp = fp;
 		f->ucl_emitter_append_character = ucl_file_append_character;
 		f->ucl_emitter_append_double = ucl_file_append_double;
 		f->ucl_emitter_append_int = ucl_file_append_int;
 		f->ucl_emitter_append_len = ucl_file_append_len;
-		f->ucl_emitter_free_func = NULL;
-		f->ud = fp;
+		f->ucl_emitter_free_func = ucl_emitter_sink_free;
+		f->ud = sink;
 	}
 
 	return f;
@@ -443,31 +1625,301 @@ ucl_object_emit_file_funcs (FILE *fp)
 
 struct ucl_emitter_functions*
 ucl_object_emit_fd_funcs (int fd)
+{
+	return ucl_object_emit_fd_funcs_full (fd, 0);
+}
+
+struct ucl_emitter_functions*
+ucl_object_emit_fd_funcs_full (int fd, size_t bufsize)
 {
 	struct ucl_emitter_functions *f;
-	int *ip;
+	struct ucl_fd_sink *sink;
 
-	f = calloc (1, sizeof (*f));
+	if (bufsize == 0) {
+		bufsize = UCL_FD_BUFFER_SIZE;
+	}
+
+	f = ucl_calloc (1, sizeof (*f));
 
 	if (f != NULL) {
-		ip = malloc (sizeof (fd));
-		if (ip == NULL) {
-			free (f);
+		sink = ucl_calloc (1, sizeof (*sink));
+		if (sink == NULL) {
+			ucl_free (f);
+			return NULL;
+		}
+
+		sink->buf = UCL_ALLOC (bufsize);
+		if (sink->buf == NULL) {
+			ucl_free (sink);
+			ucl_free (f);
 			return NULL;
 		}
 
-		memcpy (ip, &fd, sizeof (fd));
+		sink->h.flush = ucl_fd_sink_flush;
+		sink->h.release = ucl_fd_sink_free;
+		sink->fd = fd;
+		sink->size = bufsize;
 		f->ucl_emitter_append_character = ucl_fd_append_character;
 		f->ucl_emitter_append_double = ucl_fd_append_double;
 		f->ucl_emitter_append_int = ucl_fd_append_int;
 		f->ucl_emitter_append_len = ucl_fd_append_len;
-		f->ucl_emitter_free_func = _ucl_emitter_free;
-		f->ud = ip;
+		f->ucl_emitter_free_func = ucl_emitter_sink_free;
+		f->ud = sink;
+	}
+
+	return f;
+}
+
+struct ucl_emitter_functions*
+ucl_object_emit_compressed_funcs (int fd, enum ucl_compression codec, int level)
+{
+	struct ucl_emitter_functions *f;
+	struct ucl_compress_sink *sink;
+	bool inited = false;
+
+	sink = ucl_calloc (1, sizeof (*sink));
+	if (sink == NULL) {
+		return NULL;
+	}
+
+	sink->h.flush = ucl_compress_sink_flush_hook;
+	sink->h.release = ucl_compress_sink_free;
+	sink->fd = fd;
+	sink->codec = codec;
+
+#ifdef HAVE_ZLIB
+	if (codec == UCL_COMPRESSION_GZIP) {
+		/* Window bits above 15 select the gzip wrapper */
+		inited = deflateInit2 (&sink->zs,
+				level == 0 ? Z_DEFAULT_COMPRESSION : level,
+				Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+	}
+#endif
+#ifdef HAVE_ZSTD
+	if (codec == UCL_COMPRESSION_ZSTD) {
+		sink->zc = ZSTD_createCCtx ();
+
+		if (sink->zc != NULL) {
+			inited = !ZSTD_isError (ZSTD_CCtx_setParameter (sink->zc,
+					ZSTD_c_compressionLevel, level));
+
+			if (!inited) {
+				ZSTD_freeCCtx (sink->zc);
+			}
+		}
+	}
+#endif
+#ifdef HAVE_LZMA
+	if (codec == UCL_COMPRESSION_XZ) {
+		inited = lzma_easy_encoder (&sink->xz,
+				level == 0 ? LZMA_PRESET_DEFAULT : (uint32_t)level,
+				LZMA_CHECK_CRC64) == LZMA_OK;
+	}
+#endif
+
+	if (!inited) {
+		/* Codec is not supported */
+		UCL_FREE (sizeof (*sink), sink);
+		return NULL;
+	}
+
+	sink->in = UCL_ALLOC (UCL_COMPRESS_IN_SIZE);
+	sink->out = UCL_ALLOC (UCL_COMPRESS_OUT_SIZE);
+	f = ucl_calloc (1, sizeof (*f));
+
+	if (sink->in == NULL || sink->out == NULL || f == NULL) {
+		if (f != NULL) {
+			ucl_free (f);
+		}
+		/* Nothing has been written, so the sink is freed silently */
+		sink->err = ENOMEM;
+		ucl_compress_sink_free (sink);
+
+		return NULL;
+	}
+
+	f->ucl_emitter_append_character = ucl_compress_append_character;
+	f->ucl_emitter_append_double = ucl_compress_append_double;
+	f->ucl_emitter_append_int = ucl_compress_append_int;
+	f->ucl_emitter_append_len = ucl_compress_append_len;
+	f->ucl_emitter_free_func = ucl_emitter_sink_free;
+	f->ud = sink;
+
+	return f;
+}
+
+struct ucl_emitter_functions*
+ucl_object_emit_digest_funcs (ucl_emitter_digest_update update, void *ud)
+{
+	struct ucl_emitter_functions *f;
+	struct ucl_digest_sink *sink;
+
+	if (update == NULL) {
+		return NULL;
+	}
+
+	f = ucl_calloc (1, sizeof (*f));
+
+	if (f != NULL) {
+		sink = UCL_ALLOC (sizeof (*sink));
+		if (sink == NULL) {
+			ucl_free (f);
+			return NULL;
+		}
+
+		sink->h.flush = ucl_digest_sink_flush_hook;
+		sink->h.release = ucl_digest_sink_free;
+		sink->h.append_ref = NULL;
+		sink->h.iovec = NULL;
+		sink->update = update;
+		sink->ud = ud;
+		sink->len = 0;
+		f->ucl_emitter_append_character = ucl_digest_append_character;
+		f->ucl_emitter_append_double = ucl_digest_append_double;
+		f->ucl_emitter_append_int = ucl_digest_append_int;
+		f->ucl_emitter_append_len = ucl_digest_append_len;
+		f->ucl_emitter_free_func = ucl_emitter_sink_free;
+		f->ud = sink;
 	}
 
 	return f;
 }
 
+struct ucl_emitter_functions*
+ucl_object_emit_iovec_funcs (size_t min_ref)
+{
+	struct ucl_emitter_functions *f;
+	struct ucl_iov_sink *sink;
+
+	f = ucl_calloc (1, sizeof (*f));
+
+	if (f != NULL) {
+		sink = ucl_calloc (1, sizeof (*sink));
+		if (sink == NULL) {
+			ucl_free (f);
+			return NULL;
+		}
+
+		sink->h.flush = ucl_iov_sink_flush;
+		sink->h.release = ucl_iov_sink_free;
+		sink->h.append_ref = ucl_iov_append_ref;
+		sink->h.iovec = ucl_iov_sink_iovec;
+		sink->min_ref = min_ref > 0 ? min_ref : UCL_IOV_MIN_REF;
+		f->ucl_emitter_append_character = ucl_iov_append_character;
+		f->ucl_emitter_append_double = ucl_iov_append_double;
+		f->ucl_emitter_append_int = ucl_iov_append_int;
+		f->ucl_emitter_append_len = ucl_iov_append_len;
+		f->ucl_emitter_free_func = ucl_emitter_sink_free;
+		f->ud = sink;
+	}
+
+	return f;
+}
+
+/*
+ * Sinks that collect output vectors, NULL for any other output
+ */
+static struct ucl_emitter_sink *
+ucl_emitter_iovec_sink (const struct ucl_emitter_functions *f)
+{
+	struct ucl_emitter_sink *sink;
+
+	if (f == NULL || f->ucl_emitter_free_func != ucl_emitter_sink_free) {
+		return NULL;
+	}
+
+	sink = f->ud;
+
+	return sink->iovec != NULL ? sink : NULL;
+}
+
+const struct iovec *
+ucl_object_emit_funcs_iovec (const struct ucl_emitter_functions *f,
+		size_t *cnt, size_t *total)
+{
+	struct ucl_emitter_sink *sink;
+	const struct iovec *iov;
+	size_t niov, ntotal;
+
+	sink = ucl_emitter_iovec_sink (f);
+
+	if (sink == NULL || !sink->iovec (sink, &iov, &niov, &ntotal)) {
+		return NULL;
+	}
+
+	if (cnt != NULL) {
+		*cnt = niov;
+	}
+	if (total != NULL) {
+		*total = ntotal;
+	}
+
+	return iov;
+}
+
+bool
+ucl_object_emit_funcs_writev (const struct ucl_emitter_functions *f, int fd)
+{
+	struct ucl_emitter_sink *sink;
+	const struct iovec *iov;
+	struct iovec *copy;
+	size_t cnt, total;
+	int err;
+
+	sink = ucl_emitter_iovec_sink (f);
+
+	if (sink == NULL) {
+		errno = EINVAL;
+		return false;
+	}
+
+	if (!sink->iovec (sink, &iov, &cnt, &total)) {
+		errno = ENOMEM;
+		return false;
+	}
+	if (cnt == 0) {
+		return true;
+	}
+
+	/* Vectors are adjusted by partial writes, so the output can be reused */
+	copy = UCL_ALLOC (cnt * sizeof (*copy));
+
+	if (copy == NULL) {
+		errno = ENOMEM;
+		return false;
+	}
+
+	memcpy (copy, iov, cnt * sizeof (*copy));
+	err = ucl_writev_full (fd, copy, cnt);
+	UCL_FREE (cnt * sizeof (*copy), copy);
+
+	if (err != 0) {
+		errno = err;
+		return false;
+	}
+
+	return true;
+}
+
+bool
+ucl_object_emit_funcs_flush (struct ucl_emitter_functions *f)
+{
+	struct ucl_emitter_sink *sink;
+
+	if (f == NULL) {
+		return false;
+	}
+
+	if (f->ucl_emitter_free_func == ucl_emitter_sink_free) {
+		sink = f->ud;
+
+		return sink->flush (sink);
+	}
+
+	/* Other output is not buffered */
+	return true;
+}
+
 void
 ucl_object_emit_funcs_free (struct ucl_emitter_functions *f)
 {
@@ -475,7 +1927,7 @@ ucl_object_emit_funcs_free (struct ucl_emitter_functions *f)
 		if (f->ucl_emitter_free_func != NULL) {
 			f->ucl_emitter_free_func (f->ud);
 		}
-		free (f);
+		ucl_free (f);
 	}
 }
 
@@ -526,7 +1978,7 @@ ucl_object_emit_single_json (const ucl_object_t *obj)
 			break;
 		}
 		res = utstring_body (buf);
-		free (buf);
+		ucl_free (buf);
 	}
 
 	return res;
@@ -30,6 +30,15 @@
 #include <time.h>
 #include <limits.h>
 
+#if defined(__GNUC__) || defined(__clang__)
+#define UCL_PREFETCH(p) __builtin_prefetch ((p))
+#else
+#define UCL_PREFETCH(p) (void)(p)
+#endif
+
+/* Number of keys that are probed simultaneously by ucl_hash_search_many */
+#define UCL_HASH_BATCH 16
+
 struct ucl_hash_elt {
 	const ucl_object_t *obj;
 	struct ucl_hash_elt *prev, *next;
@@ -39,6 +48,7 @@ struct ucl_hash_struct {
 	void *hash;
 	struct ucl_hash_elt *head;
 	bool caseless;
+	struct ucl_container_meta *meta; /* Allocated on the first use */
 };
 
 static uint64_t
@@ -104,6 +114,30 @@ ucl_hash_func (const ucl_object_t *o)
 {
 	return mum_hash (o->key, o->keylen, ucl_hash_seed ());
 }
+
+/*
+ * The same as kh_get but uses the hash value calculated by a caller
+ */
+#define UCL_HASH_GET_HASHED(name, __hash_equal)							\
+static inline khint_t													\
+kh_get_hashed_##name (const khash_t(name) *h, const ucl_object_t *key,	\
+		khint_t k)														\
+{																		\
+	if (h->n_buckets) {													\
+		khint_t i, last, mask, step = 0;								\
+		mask = h->n_buckets - 1;										\
+		i = k & mask;													\
+		last = i;														\
+		while (!__ac_isempty(h->flags, i) && (__ac_isdel(h->flags, i) ||	\
+				!__hash_equal(h->keys[i], key))) {						\
+			i = (i + (++step)) & mask;									\
+			if (i == last) return h->n_buckets;							\
+		}																\
+		return __ac_iseither(h->flags, i) ? h->n_buckets : i;			\
+	}																	\
+	return 0;															\
+}
+
 static inline int
 ucl_hash_equal (const ucl_object_t *k1, const ucl_object_t *k2)
 {
@@ -116,14 +150,15 @@ ucl_hash_equal (const ucl_object_t *k1, const ucl_object_t *k2)
 
 KHASH_INIT (ucl_hash_node, const ucl_object_t *, struct ucl_hash_elt *, 1,
 		ucl_hash_func, ucl_hash_equal)
+UCL_HASH_GET_HASHED (ucl_hash_node, ucl_hash_equal)
 
 static inline uint32_t
-ucl_hash_caseless_func (const ucl_object_t *o)
+ucl_hash_caseless_str (const char *key, unsigned keylen)
 {
-	unsigned len = o->keylen;
-	unsigned leftover = o->keylen % 8;
+	unsigned len = keylen;
+	unsigned leftover = keylen % 8;
 	unsigned fp, i;
-	const uint8_t* s = (const uint8_t*)o->key;
+	const uint8_t* s = (const uint8_t*)key;
 	union {
 		struct {
 			unsigned char c1, c2, c3, c4, c5, c6, c7, c8;
@@ -178,6 +213,12 @@ ucl_hash_caseless_func (const ucl_object_t *o)
 	return mum_hash_finish (r);
 }
 
+static inline uint32_t
+ucl_hash_caseless_func (const ucl_object_t *o)
+{
+	return ucl_hash_caseless_str (o->key, o->keylen);
+}
+
 static inline int
 ucl_hash_caseless_equal (const ucl_object_t *k1, const ucl_object_t *k2)
 {
@@ -228,10 +269,16 @@ ucl_hash_caseless_equal (const ucl_object_t *k1, const ucl_object_t *k2)
 
 KHASH_INIT (ucl_hash_caseless_node, const ucl_object_t *, struct ucl_hash_elt *, 1,
 		ucl_hash_caseless_func, ucl_hash_caseless_equal)
+UCL_HASH_GET_HASHED (ucl_hash_caseless_node, ucl_hash_caseless_equal)
+
+/* Makes the allocator of a hash current, see ucl_hash_create */
+#define ucl_hash_allocator_enter(hashlin) ucl_allocator_enter ( \
+	(hashlin)->meta != NULL ? (hashlin)->meta->allocator : NULL)
 
 ucl_hash_t*
 ucl_hash_create (bool ignore_case)
 {
+	const struct ucl_allocator *allocator = ucl_allocator_current ();
 	ucl_hash_t *new;
 
 	new = UCL_ALLOC (sizeof (ucl_hash_t));
@@ -239,6 +286,21 @@ ucl_hash_create (bool ignore_case)
 		void *h;
 		new->head = NULL;
 		new->caseless = ignore_case;
+		new->meta = NULL;
+
+		if (allocator != NULL) {
+			/* Hashes of a thread allocator record it in the metadata */
+			new->meta = UCL_ALLOC (sizeof (*new->meta));
+
+			if (new->meta == NULL) {
+				UCL_FREE (sizeof (ucl_hash_t), new);
+				return NULL;
+			}
+
+			memset (new->meta, 0, sizeof (*new->meta));
+			new->meta->allocator = allocator;
+		}
+
 		if (ignore_case) {
 			h = (void *)kh_init (ucl_hash_caseless_node);
 		}
@@ -246,6 +308,9 @@ ucl_hash_create (bool ignore_case)
 			h = (void *)kh_init (ucl_hash_node);
 		}
 		if (h == NULL) {
+			if (new->meta != NULL) {
+				UCL_FREE (sizeof (*new->meta), new->meta);
+			}
 			UCL_FREE (sizeof (ucl_hash_t), new);
 			return NULL;
 		}
@@ -256,6 +321,7 @@ ucl_hash_create (bool ignore_case)
 
 void ucl_hash_destroy (ucl_hash_t* hashlin, ucl_hash_free_func func)
 {
+	const struct ucl_allocator *prev;
 
 	if (hashlin == NULL) {
 		return;
@@ -280,6 +346,8 @@ void ucl_hash_destroy (ucl_hash_t* hashlin, ucl_hash_free_func func)
 		}
 	}
 
+	prev = ucl_hash_allocator_enter (hashlin);
+
 	if (hashlin->caseless) {
 		khash_t(ucl_hash_caseless_node) *h = (khash_t(ucl_hash_caseless_node) *)
 			hashlin->hash;
@@ -297,13 +365,20 @@ void ucl_hash_destroy (ucl_hash_t* hashlin, ucl_hash_free_func func)
 		UCL_FREE(sizeof(*cur), cur);
 	}
 
+	if (hashlin->meta != NULL) {
+		ucl_emit_cache_free (hashlin->meta->emit);
+		UCL_FREE (sizeof (*hashlin->meta), hashlin->meta);
+	}
+
 	UCL_FREE (sizeof (*hashlin), hashlin);
+	ucl_allocator_leave (prev);
 }
 
 bool
 ucl_hash_insert (ucl_hash_t* hashlin, const ucl_object_t *obj,
 		const char *key, unsigned keylen)
 {
+	const struct ucl_allocator *prev;
 	khiter_t k;
 	int ret;
 	struct ucl_hash_elt **pelt, *elt;
@@ -312,6 +387,8 @@ ucl_hash_insert (ucl_hash_t* hashlin, const ucl_object_t *obj,
 		return false;
 	}
 
+	prev = ucl_hash_allocator_enter (hashlin);
+
 	if (hashlin->caseless) {
 		khash_t(ucl_hash_caseless_node) *h = (khash_t(ucl_hash_caseless_node) *)
 				hashlin->hash;
@@ -341,14 +418,18 @@ ucl_hash_insert (ucl_hash_t* hashlin, const ucl_object_t *obj,
 			goto e0;
 		}
 	}
+	ucl_allocator_leave (prev);
+	ucl_container_modified (hashlin->meta);
 	return true;
 e0:
+	ucl_allocator_leave (prev);
 	return false;
 }
 
 void ucl_hash_replace (ucl_hash_t* hashlin, const ucl_object_t *old,
 		const ucl_object_t *new)
 {
+	const struct ucl_allocator *prev;
 	khiter_t k;
 	int ret;
 	struct ucl_hash_elt *elt, *nelt;
@@ -357,6 +438,9 @@ void ucl_hash_replace (ucl_hash_t* hashlin, const ucl_object_t *old,
 		return;
 	}
 
+	ucl_container_modified (hashlin->meta);
+	prev = ucl_hash_allocator_enter (hashlin);
+
 	if (hashlin->caseless) {
 		khash_t(ucl_hash_caseless_node) *h = (khash_t(ucl_hash_caseless_node) *)
 				hashlin->hash;
@@ -387,58 +471,79 @@ void ucl_hash_replace (ucl_hash_t* hashlin, const ucl_object_t *old,
 			UCL_FREE(sizeof(*elt), elt);
 		}
 	}
-}
 
-struct ucl_hash_real_iter {
-	const struct ucl_hash_elt *cur;
-};
+	ucl_allocator_leave (prev);
+}
 
 #define UHI_SETERR(ep, ern) {if (ep != NULL) *ep = (ern);}
 
+/*
+ * Iterator points to the next element, so the returned one may be removed
+ * while iterating; the hash itself is used as the end marker, so no memory
+ * is allocated
+ */
 const void*
 ucl_hash_iterate2 (ucl_hash_t *hashlin, ucl_hash_iter_t *iter, int *ep)
 {
-	struct ucl_hash_real_iter *it = (struct ucl_hash_real_iter *)(*iter);
-	const ucl_object_t *ret = NULL;
+	const struct ucl_hash_elt *elt;
 
 	if (hashlin == NULL) {
 		UHI_SETERR(ep, EINVAL);
 		return NULL;
 	}
 
-	if (it == NULL) {
-		it = UCL_ALLOC (sizeof (*it));
+	UHI_SETERR(ep, 0);
 
-		if (it == NULL) {
-			UHI_SETERR(ep, ENOMEM);
-			return NULL;
-		}
+	if (*iter == NULL) {
+		elt = hashlin->head;
+	}
+	else if (*iter == (ucl_hash_iter_t)hashlin) {
+		elt = NULL;
+	}
+	else {
+		elt = (const struct ucl_hash_elt *)*iter;
+	}
 
-		it->cur = hashlin->head;
+	if (elt == NULL) {
+		*iter = NULL;
+		return NULL;
 	}
 
-	UHI_SETERR(ep, 0);
-	if (it->cur) {
-		ret = it->cur->obj;
-		it->cur = it->cur->next;
+	*iter = elt->next != NULL ? (ucl_hash_iter_t)elt->next :
+			(ucl_hash_iter_t)hashlin;
+
+	return elt->obj;
+}
+
+const ucl_object_t*
+ucl_hash_iterate_cursor (ucl_hash_t *hashlin, const void **cursor)
+{
+	const struct ucl_hash_elt *elt;
+
+	if (hashlin == NULL) {
+		return NULL;
+	}
+
+	if (*cursor == NULL) {
+		elt = hashlin->head;
 	}
 	else {
-		UCL_FREE (sizeof (*it), it);
-		*iter = NULL;
+		elt = ((const struct ucl_hash_elt *)*cursor)->next;
+	}
+
+	if (elt == NULL) {
 		return NULL;
 	}
 
-	*iter = it;
+	*cursor = elt;
 
-	return ret;
+	return elt->obj;
 }
 
 bool
 ucl_hash_iter_has_next (ucl_hash_t *hashlin, ucl_hash_iter_t iter)
 {
-	struct ucl_hash_real_iter *it = (struct ucl_hash_real_iter *)(iter);
-
-	return it->cur != NULL;
+	return iter != NULL && iter != (ucl_hash_iter_t)hashlin;
 }
 
 
@@ -480,9 +585,148 @@ ucl_hash_search (ucl_hash_t* hashlin, const char *key, unsigned keylen)
 	return ret;
 }
 
+void
+ucl_hash_key_hashes (const char *key, unsigned keylen, uint32_t *hv,
+		uint32_t *hv_caseless)
+{
+	*hv = mum_hash (key, keylen, ucl_hash_seed ());
+	*hv_caseless = ucl_hash_caseless_str (key, keylen);
+}
+
+const ucl_object_t*
+ucl_hash_search_hashed (ucl_hash_t* hashlin, const char *key, unsigned keylen,
+		uint32_t hv, uint32_t hv_caseless)
+{
+	khiter_t k;
+	const ucl_object_t *ret = NULL;
+	ucl_object_t search;
+	struct ucl_hash_elt *elt;
+
+	search.key = key;
+	search.keylen = keylen;
+
+	if (hashlin == NULL) {
+		return NULL;
+	}
+
+	if (hashlin->caseless) {
+		khash_t(ucl_hash_caseless_node) *h = (khash_t(ucl_hash_caseless_node) *)
+						hashlin->hash;
+
+		k = kh_get_hashed_ucl_hash_caseless_node (h, &search, hv_caseless);
+		if (k != kh_end (h)) {
+			elt = kh_value (h, k);
+			ret = elt->obj;
+		}
+	}
+	else {
+		khash_t(ucl_hash_node) *h = (khash_t(ucl_hash_node) *)
+						hashlin->hash;
+		k = kh_get_hashed_ucl_hash_node (h, &search, hv);
+		if (k != kh_end (h)) {
+			elt = kh_value (h, k);
+			ret = elt->obj;
+		}
+	}
+
+	return ret;
+}
+
+size_t
+ucl_hash_search_many (ucl_hash_t* hashlin, const char **keys,
+		const size_t *keylens, size_t n, const ucl_object_t **out)
+{
+	ucl_object_t search[UCL_HASH_BATCH];
+	khint_t hv[UCL_HASH_BATCH], mask, b;
+	size_t i, j, batch, nfound = 0;
+	khiter_t k;
+	/* Both kinds of hashes share the same layout */
+	khash_t(ucl_hash_node) *h;
+
+	if (hashlin == NULL) {
+		for (i = 0; i < n; i ++) {
+			out[i] = NULL;
+		}
+
+		return 0;
+	}
+
+	h = (khash_t(ucl_hash_node) *)hashlin->hash;
+	mask = h->n_buckets > 0 ? h->n_buckets - 1 : 0;
+
+	for (i = 0; i < n; i += batch) {
+		batch = n - i > UCL_HASH_BATCH ? UCL_HASH_BATCH : n - i;
+
+		/* Hash all keys and prefetch their buckets */
+		for (j = 0; j < batch; j ++) {
+			search[j].key = keys[i + j];
+
+			if (search[j].key == NULL) {
+				continue;
+			}
+
+			search[j].keylen = keylens != NULL ? keylens[i + j] :
+					strlen (search[j].key);
+
+			if (hashlin->caseless) {
+				hv[j] = ucl_hash_caseless_str (search[j].key, search[j].keylen);
+			}
+			else {
+				hv[j] = mum_hash (search[j].key, search[j].keylen,
+						ucl_hash_seed ());
+			}
+
+			if (h->n_buckets > 0) {
+				b = hv[j] & mask;
+				UCL_PREFETCH (&h->flags[b >> 4]);
+				UCL_PREFETCH (&h->keys[b]);
+				UCL_PREFETCH (&h->vals[b]);
+			}
+		}
+
+		/* Prefetch the objects stored in the first probed buckets */
+		if (h->n_buckets > 0) {
+			for (j = 0; j < batch; j ++) {
+				if (search[j].key != NULL) {
+					b = hv[j] & mask;
+
+					if (!__ac_iseither (h->flags, b)) {
+						UCL_PREFETCH (h->keys[b]);
+					}
+				}
+			}
+		}
+
+		/* Now do the real probes */
+		for (j = 0; j < batch; j ++) {
+			out[i + j] = NULL;
+
+			if (search[j].key == NULL) {
+				continue;
+			}
+
+			if (hashlin->caseless) {
+				k = kh_get_hashed_ucl_hash_caseless_node (
+						(khash_t(ucl_hash_caseless_node) *)h, &search[j], hv[j]);
+			}
+			else {
+				k = kh_get_hashed_ucl_hash_node (h, &search[j], hv[j]);
+			}
+
+			if (k != kh_end (h)) {
+				out[i + j] = kh_value (h, k)->obj;
+				nfound ++;
+			}
+		}
+	}
+
+	return nfound;
+}
+
 void
 ucl_hash_delete (ucl_hash_t* hashlin, const ucl_object_t *obj)
 {
+	const struct ucl_allocator *prev;
 	khiter_t k;
 	struct ucl_hash_elt *elt;
 
@@ -490,6 +734,9 @@ ucl_hash_delete (ucl_hash_t* hashlin, const ucl_object_t *obj)
 		return;
 	}
 
+	ucl_container_modified (hashlin->meta);
+	prev = ucl_hash_allocator_enter (hashlin);
+
 	if (hashlin->caseless) {
 		khash_t(ucl_hash_caseless_node) *h = (khash_t(ucl_hash_caseless_node) *)
 			hashlin->hash;
@@ -513,15 +760,21 @@ ucl_hash_delete (ucl_hash_t* hashlin, const ucl_object_t *obj)
 			UCL_FREE(sizeof(*elt), elt);
 		}
 	}
+
+	ucl_allocator_leave (prev);
 }
 
 bool ucl_hash_reserve (ucl_hash_t *hashlin, size_t sz)
 {
+	const struct ucl_allocator *prev;
+
 	if (hashlin == NULL) {
 		return false;
 	}
 
 	if (sz > kh_size((khash_t(ucl_hash_node) *)hashlin->hash)) {
+		prev = ucl_hash_allocator_enter (hashlin);
+
 		if (hashlin->caseless) {
 			khash_t(ucl_hash_caseless_node) *h = (khash_t(
 					ucl_hash_caseless_node) *)
@@ -532,6 +785,7 @@ bool ucl_hash_reserve (ucl_hash_t *hashlin, size_t sz)
 					hashlin->hash;
 			kh_resize (ucl_hash_node, h, sz * 2);
 		}
+		ucl_allocator_leave (prev);
 	}
 	return true;
 }
@@ -609,6 +863,7 @@ ucl_hash_cmp_case_sens (const void *a, const void *b)
 void
 ucl_hash_sort (ucl_hash_t *hashlin, enum ucl_object_keys_sort_flags fl)
 {
+	ucl_container_modified (hashlin->meta);
 
 	if (fl & UCL_SORT_KEYS_ICASE) {
 		DL_SORT(hashlin->head, ucl_hash_cmp_icase);
@@ -627,3 +882,67 @@ ucl_hash_sort (ucl_hash_t *hashlin, enum ucl_object_keys_sort_flags fl)
 		}
 	}
 }
+
+struct ucl_container_meta*
+ucl_hash_meta (ucl_hash_t *hashlin)
+{
+	if (hashlin == NULL) {
+		return NULL;
+	}
+
+	return hashlin->meta;
+}
+
+struct ucl_container_meta*
+ucl_hash_meta_new (ucl_hash_t *hashlin)
+{
+	const struct ucl_allocator *prev;
+
+	if (hashlin == NULL) {
+		return NULL;
+	}
+
+	if (hashlin->meta == NULL) {
+		/* Hashes without metadata use the process wide allocator */
+		prev = ucl_allocator_enter (NULL);
+		hashlin->meta = UCL_ALLOC (sizeof (*hashlin->meta));
+		ucl_allocator_leave (prev);
+
+		if (hashlin->meta != NULL) {
+			memset (hashlin->meta, 0, sizeof (*hashlin->meta));
+		}
+	}
+
+	return hashlin->meta;
+}
+
+void
+ucl_hash_memory_usage (ucl_hash_t *hashlin, size_t *table, size_t *elts)
+{
+	khash_t(ucl_hash_node) *h;
+	struct ucl_hash_elt *elt;
+	size_t nelts = 0;
+
+	if (hashlin == NULL) {
+		return;
+	}
+
+	/* Both key variants share the same layout */
+	h = (khash_t(ucl_hash_node) *)hashlin->hash;
+	*table += sizeof (*hashlin) + sizeof (*h);
+
+	if (hashlin->meta != NULL) {
+		*table += sizeof (*hashlin->meta);
+	}
+
+	if (h->n_buckets > 0) {
+		*table += h->n_buckets * (sizeof (*h->keys) + sizeof (*h->vals)) +
+				__ac_fsize (h->n_buckets) * sizeof (khint32_t);
+	}
+
+	DL_FOREACH (hashlin->head, elt) {
+		nelts ++;
+	}
+
+	*elts += nelts * sizeof (struct ucl_hash_elt);
+}
@@ -42,6 +42,46 @@ typedef void* ucl_hash_iter_t;
 struct ucl_hash_struct;
 typedef struct ucl_hash_struct ucl_hash_t;
 
+struct ucl_emit_cache;
+
+/**
+ * Metadata attached to containers (objects and arrays), it is allocated only
+ * when fingerprints, cached output or freeze epochs are used and for all
+ * containers created with a thread allocator
+ */
+struct ucl_container_meta {
+	unsigned int version; /* Incremented on each modification */
+	unsigned int fp_version; /* Version of a container when fp was computed */
+	bool fp_valid;
+	uint64_t fp[2]; /* Cached fingerprint */
+	struct ucl_emit_cache *emit; /* Cached output, see ucl_object_emit_cached */
+	unsigned int frozen_epoch; /* Non zero for roots of frozen trees */
+	/* Allocator of the container, NULL for the process wide allocator */
+	const struct ucl_allocator *allocator;
+};
+
+/**
+ * Record modification of a container with cached output
+ */
+void ucl_emit_cache_modified (struct ucl_emit_cache *cache);
+
+/**
+ * Free cached output of a container
+ */
+void ucl_emit_cache_free (struct ucl_emit_cache *cache);
+
+static inline void
+ucl_container_modified (struct ucl_container_meta *meta)
+{
+	if (meta != NULL) {
+		meta->version ++;
+
+		if (meta->emit != NULL) {
+			ucl_emit_cache_modified (meta->emit);
+		}
+	}
+}
+
 
 /**
  * Initializes the hashtable.
@@ -77,12 +117,40 @@ void ucl_hash_delete (ucl_hash_t* hashlin, const ucl_object_t *obj);
 const ucl_object_t* ucl_hash_search (ucl_hash_t* hashlin, const char *key,
 		unsigned keylen);
 
+/**
+ * Calculate hash values of a key for `ucl_hash_search_hashed`
+ * @param key key to hash
+ * @param keylen length of the key
+ * @param hv hash value for case sensitive hashes
+ * @param hv_caseless hash value for case insensitive hashes
+ */
+void ucl_hash_key_hashes (const char *key, unsigned keylen, uint32_t *hv,
+		uint32_t *hv_caseless);
+
+/**
+ * Searches an element in the hashtable using precalculated hash values
+ */
+const ucl_object_t* ucl_hash_search_hashed (ucl_hash_t* hashlin,
+		const char *key, unsigned keylen, uint32_t hv, uint32_t hv_caseless);
+
+/**
+ * Searches many elements in the hashtable at once. All keys are hashed first
+ * and then probes are performed with prefetching of the buckets.
+ * @param keys array of keys (NULL keys are allowed and are never found)
+ * @param keylens array of key lengths or NULL if keys are NULL terminated
+ * @param n number of keys
+ * @param out array of `n` elements to store results (NULL if not found)
+ * @return number of keys found
+ */
+size_t ucl_hash_search_many (ucl_hash_t* hashlin, const char **keys,
+		const size_t *keylens, size_t n, const ucl_object_t **out);
 
 /**
  * Iterate over hash table
  * @param hashlin hash
- * @param iter iterator (must be NULL on first iteration)
- * @param ep pointer record exception (such as ENOMEM), could be NULL
+ * @param iter iterator (must be NULL on first iteration), it does not own any
+ * memory and the returned element may be removed while iterating
+ * @param ep pointer record exception (such as EINVAL), could be NULL
  * @return the next object
  */
 const void* ucl_hash_iterate2 (ucl_hash_t *hashlin, ucl_hash_iter_t *iter, int *ep);
@@ -92,6 +160,16 @@ const void* ucl_hash_iterate2 (ucl_hash_t *hashlin, ucl_hash_iter_t *iter, int *
  */
 #define ucl_hash_iterate(hl, ip) ucl_hash_iterate2((hl), (ip), NULL)
 
+/**
+ * Iterate over hash table without allocations
+ * @param hashlin hash
+ * @param cursor opaque cursor that points to the last returned element (must
+ * be NULL on the first iteration)
+ * @return the next object or NULL if there are no more elements
+ */
+const ucl_object_t* ucl_hash_iterate_cursor (ucl_hash_t *hashlin,
+		const void **cursor);
+
 /**
  * Check whether an iterator has next element
  */
@@ -104,6 +182,28 @@ bool ucl_hash_iter_has_next (ucl_hash_t *hashlin, ucl_hash_iter_t iter);
  */
 bool ucl_hash_reserve (ucl_hash_t *hashlin, size_t sz);
 
+/**
+ * Returns metadata of a hash
+ * @param hashlin
+ * @return metadata or NULL if hashlin is NULL or has no metadata yet
+ */
+struct ucl_container_meta* ucl_hash_meta (ucl_hash_t *hashlin);
+
+/**
+ * Returns metadata of a hash allocating it on the first call
+ * @param hashlin
+ * @return metadata or NULL if hashlin is NULL or on allocation failure
+ */
+struct ucl_container_meta* ucl_hash_meta_new (ucl_hash_t *hashlin);
+
 void ucl_hash_sort (ucl_hash_t *hashlin, enum ucl_object_keys_sort_flags fl);
 
+/**
+ * Adds memory used by a hash to the counters
+ * @param hashlin hash
+ * @param table incremented by the size of the hash table itself
+ * @param elts incremented by the size of the elements list
+ */
+void ucl_hash_memory_usage (ucl_hash_t *hashlin, size_t *table, size_t *elts);
+
 #endif
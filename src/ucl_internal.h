@@ -47,6 +47,7 @@
 #define HAVE_STDARG_H
 #ifndef _WIN32
 # define HAVE_REGEX_H
+# define HAVE_SYS_UIO_H
 #endif
 #endif
 
@@ -67,6 +68,11 @@
 # include <sys/param.h>
 # endif
 #endif
+#ifdef HAVE_SYS_UIO_H
+# ifndef _WIN32
+# include <sys/uio.h>
+# endif
+#endif
 
 #ifdef HAVE_LIMITS_H
 #include <limits.h>
@@ -121,10 +127,23 @@ typedef SSIZE_T ssize_t;
 
 #endif
 
+/* Route allocations of the bundled containers through the ucl allocator */
+#define uthash_malloc(sz) ucl_malloc (sz)
+#define uthash_free(ptr, sz) ucl_free_sized ((ptr), (sz))
+#define utstring_malloc(sz) ucl_malloc (sz)
+#define utstring_realloc(ptr, sz) ucl_realloc ((ptr), (sz))
+#define utstring_release(ptr) ucl_free (ptr)
+#define kmalloc(sz) ucl_malloc (sz)
+#define kcalloc(n, sz) ucl_calloc ((n), (sz))
+#define krealloc(ptr, sz) ucl_realloc ((ptr), (sz))
+#define kfree(ptr) ucl_free (ptr)
+#define kv_realloc(ptr, sz) ucl_realloc ((ptr), (sz))
+#define kv_release(ptr) ucl_free (ptr)
+
+#include "ucl.h"
 #include "utlist.h"
 #include "utstring.h"
 #include "uthash.h"
-#include "ucl.h"
 #include "ucl_hash.h"
 
 #ifdef HAVE_OPENSSL
@@ -135,6 +154,14 @@ typedef SSIZE_T ssize_t;
 #define __DECONST(type, var)    ((type)(uintptr_t)(const void *)(var))
 #endif
 
+#if defined(_MSC_VER)
+#define UCL_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#define UCL_THREAD_LOCAL __thread
+#else
+#define UCL_THREAD_LOCAL
+#endif
+
 /**
  * @file rcl_internal.h
  * Internal structures and functions of UCL library
@@ -225,6 +252,8 @@ struct ucl_chunk {
 	enum ucl_duplicate_strategy strategy;
 	enum ucl_parse_type parse_type;
 	struct ucl_parser_special_handler_chain *special_handlers;
+	/* Decompression stream if the chunk is parsed by windows */
+	struct ucl_decompress_stream *stream;
 	struct ucl_chunk *next;
 };
 
@@ -254,6 +283,7 @@ struct ucl_parser {
 	int flags;
 	unsigned default_priority;
 	int err_code;
+	size_t decompress_limit;
 	ucl_object_t *top_obj;
 	ucl_object_t *cur_obj;
 	ucl_object_t *trash_objs;
@@ -272,6 +302,7 @@ struct ucl_parser {
 	ucl_object_t *comments;
 	ucl_object_t *last_comment;
 	UT_string *err;
+	const struct ucl_allocator *allocator;
 };
 
 struct ucl_object_userdata {
@@ -280,6 +311,238 @@ struct ucl_object_userdata {
 	ucl_userdata_emitter emitter;
 };
 
+/*
+ * Arrays are stored as a ring buffer (deque) of pointers: the logical
+ * element `i` lives at `a[(head + i) % m]`, so both ends can be grown and
+ * shrunk in O(1). Field names are kept compatible with kvec.
+ *
+ * Rarely used state lives in an extension `ext` allocated on demand, so that
+ * plain arrays stay small:
+ *
+ * An optional side map from element pointer to a sequence number makes
+ * `ucl_array_delete` and `ucl_array_index_of` O(1): the logical index of
+ * an element is `seq - base`, and `base` moves with the front of the array.
+ *
+ * Homogeneous numeric arrays can be packed: values are stored in a flat
+ * `int64_t` or `double` buffer `pv` (`a` is NULL then), and element objects
+ * are ephemeral views materialized on demand in a thread local ring, so that
+ * reading an array neither allocates memory nor writes to it. Any
+ * modification through the object API converts an array back to the object
+ * storage.
+ */
+enum ucl_array_storage {
+	UCL_ARRAY_STORAGE_OBJECTS = 0,
+	UCL_ARRAY_STORAGE_INT,
+	UCL_ARRAY_STORAGE_FLOAT
+};
+
+struct kh_ucl_array_idx_s;
+
+struct ucl_array_ext {
+	int64_t base;
+	struct kh_ucl_array_idx_s *index;
+	enum ucl_array_storage storage;
+	union {
+		int64_t *iv;
+		double *dv;
+		void *ptr;
+	} pv;
+	struct ucl_container_meta meta;
+};
+
+typedef struct ucl_array_s {
+	size_t n, m;
+	ucl_object_t **a;
+	size_t head;
+	struct ucl_array_ext *ext;
+} ucl_array_t;
+
+/* Number of views of packed elements that are valid at once in a thread */
+#define UCL_ARRAY_VIEW_SLOTS 32
+
+#define UCL_ARRAY_GET(ar, obj) ucl_array_t *ar = \
+	(ucl_array_t *)((obj) != NULL ? (obj)->value.av : NULL)
+
+#define UCL_ARRAY_STORAGE(vec) ((vec)->ext != NULL ? \
+	(vec)->ext->storage : UCL_ARRAY_STORAGE_OBJECTS)
+#define UCL_ARRAY_IS_PACKED(vec) ((vec) != NULL && \
+	UCL_ARRAY_STORAGE (vec) != UCL_ARRAY_STORAGE_OBJECTS)
+#define UCL_ARRAY_PACKED_ESIZE(vec) \
+	((vec)->ext->storage == UCL_ARRAY_STORAGE_INT ? \
+	sizeof (int64_t) : sizeof (double))
+#define UCL_ARRAY_META(vec) ((vec)->ext != NULL ? &(vec)->ext->meta : NULL)
+#define UCL_ARRAY_ALLOCATOR(vec) ((vec)->ext != NULL ? \
+	(vec)->ext->meta.allocator : NULL)
+
+static inline ucl_object_t **
+ucl_array_slot (const ucl_array_t *vec, size_t i)
+{
+	size_t pos = vec->head + i;
+
+	if (pos >= vec->m) {
+		pos -= vec->m;
+	}
+
+	return &vec->a[pos];
+}
+
+#define UCL_ARRAY_A(vec, i) (*ucl_array_slot ((vec), (i)))
+
+static inline void
+ucl_array_packed_view (const ucl_array_t *vec, size_t i, ucl_object_t *view)
+{
+	memset (view, 0, sizeof (*view));
+	view->ref = 1;
+	view->prev = view;
+	view->flags = UCL_OBJECT_EPHEMERAL;
+
+	if (vec->ext->storage == UCL_ARRAY_STORAGE_INT) {
+		view->type = UCL_INT;
+		view->value.iv = vec->ext->pv.iv[i];
+	}
+	else {
+		view->type = UCL_FLOAT;
+		view->value.dv = vec->ext->pv.dv[i];
+	}
+}
+
+/* Returns element `i` using `tmp` as a storage for packed elements */
+static inline const ucl_object_t *
+ucl_array_get (const ucl_array_t *vec, size_t i, ucl_object_t *tmp)
+{
+	if (!UCL_ARRAY_IS_PACKED (vec)) {
+		return UCL_ARRAY_A (vec, i);
+	}
+
+	ucl_array_packed_view (vec, i, tmp);
+
+	return tmp;
+}
+
+/**
+ * Create an empty array, arrays created with a thread allocator record it
+ * @return new array or NULL on allocation failure
+ */
+ucl_array_t* ucl_array_new (void);
+
+/**
+ * Change capacity of an array to `nm` elements keeping the logical order
+ * @param vec array
+ * @param nm new capacity, smaller values are ignored
+ * @return false on allocation failure
+ */
+bool ucl_array_resize (ucl_array_t *vec, size_t nm);
+
+/**
+ * Destroy the side index of an array
+ * @param vec array
+ */
+void ucl_array_index_drop (ucl_array_t *vec);
+
+/**
+ * Get the extension of an array allocating it on the first call
+ * @param vec array
+ * @return extension or NULL on allocation failure
+ */
+struct ucl_array_ext* ucl_array_ext_get (ucl_array_t *vec);
+
+/**
+ * Free the extension of an array with its index, packed values and metadata
+ * @param vec array
+ */
+void ucl_array_ext_free (ucl_array_t *vec);
+
+/**
+ * Get an ephemeral view of a packed element, views are taken from a thread
+ * local ring and are valid until `UCL_ARRAY_VIEW_SLOTS` more views are taken
+ * by the same thread
+ * @param vec packed array
+ * @param i index of an element
+ * @return view
+ */
+ucl_object_t* ucl_array_packed_view_at (const ucl_array_t *vec, size_t i);
+
+/**
+ * Convert packed array to the object storage
+ * @param vec array
+ * @param priority priority of created element objects
+ * @return false on allocation failure
+ */
+bool ucl_array_unpack_internal (ucl_array_t *vec, unsigned int priority);
+
+/* Prepares array of `top` for modification through the object API */
+#define UCL_ARRAY_UNPACK(vec, top) \
+	ucl_array_unpack_internal ((vec), ucl_object_get_priority (top))
+
+/**
+ * Copy packed values of an array
+ * @param new array object to store a copy in
+ * @param other array to copy
+ * @return false if `other` is not packed or on allocation failure
+ */
+bool ucl_array_copy_packed (ucl_object_t *new, const ucl_object_t *other);
+
+/**
+ * Add memory used by an array storage (but not by its elements) to `st->arrays`
+ * @param vec array
+ * @param st statistics to update
+ */
+void ucl_array_memory_usage (const ucl_array_t *vec,
+		struct ucl_memory_stats *st);
+
+/**
+ * Allocate zeroed memory with the current allocator
+ */
+void* ucl_calloc (size_t nmemb, size_t size);
+
+/**
+ * Duplicate a string with the current allocator
+ */
+char* ucl_strdup (const char *s);
+
+/**
+ * Make allocator of the parser current for the calling thread
+ * @return previous thread allocator to be passed to `ucl_parser_allocator_leave`
+ */
+const struct ucl_allocator* ucl_parser_allocator_enter (
+		struct ucl_parser *parser);
+
+/**
+ * Restore thread allocator after `ucl_parser_allocator_enter`
+ */
+void ucl_parser_allocator_leave (struct ucl_parser *parser,
+		const struct ucl_allocator *prev);
+
+/**
+ * Get the allocator recorded for new objects and containers
+ * @return current thread allocator or NULL for the process wide one
+ */
+const struct ucl_allocator* ucl_allocator_current (void);
+
+/**
+ * Make an allocator current for the calling thread
+ * @param allocator allocator recorded by an object or a container, NULL for
+ * the process wide one
+ * @return previous thread allocator to be passed to `ucl_allocator_leave`
+ */
+const struct ucl_allocator* ucl_allocator_enter (
+		const struct ucl_allocator *allocator);
+
+/**
+ * Restore thread allocator after `ucl_allocator_enter`
+ */
+void ucl_allocator_leave (const struct ucl_allocator *prev);
+
+/**
+ * Get the allocator an object has been created with
+ * @param obj object
+ * @return allocator or NULL for the process wide one
+ */
+const struct ucl_allocator* ucl_object_allocator (const ucl_object_t *obj);
+
+#define ucl_object_allocator_enter(obj) \
+	ucl_allocator_enter (ucl_object_allocator (obj))
+
 /**
  * Unescape json string inplace
  * @param str
@@ -509,6 +772,37 @@ ucl_emit_get_standard_context (enum ucl_emitter emit_type);
 void ucl_elt_string_write_json (const char *str, size_t size,
 		struct ucl_emitter_context *ctx);
 
+/**
+ * Serialize string as canonical JSON string: only quotes, backslashes and
+ * control characters are escaped
+ * @param str string to emit
+ * @param size length of the string
+ * @param ctx emitter context
+ * @param borrow true if `str` outlives the output
+ */
+void ucl_elt_string_write_canonical (const char *str, size_t size,
+		struct ucl_emitter_context *ctx, bool borrow);
+
+/**
+ * Format a finite double as ECMAScript does: integral values have no
+ * fractional part, exponents are signed and negative zero is `0`
+ * @param val value to format
+ * @param buf target buffer of at least UCL_NUMBER_BUF_SIZE bytes
+ * @return length of the output or 0 if `val` is not finite
+ */
+size_t ucl_dtoa_canonical (double val, char *buf);
+
+/**
+ * Serialize string as JSON string
+ * @param str string to emit
+ * @param size length of the string
+ * @param ctx emitter context
+ * @param borrow true if `str` outlives the output and may be referenced
+ * by it instead of copied (see `ucl_emitter_append_ref`)
+ */
+void ucl_elt_string_write_json_full (const char *str, size_t size,
+		struct ucl_emitter_context *ctx, bool borrow);
+
 
 /**
  * Serialize string as single quoted string
@@ -519,6 +813,24 @@ void
 ucl_elt_string_write_squoted (const char *str, size_t size,
 		struct ucl_emitter_context *ctx);
 
+/**
+ * Return the length of the longest prefix of a string that can be emitted
+ * inside a JSON string literal without escaping
+ * @param str string to scan
+ * @param size length of the string
+ * @return number of leading bytes that need no escaping
+ */
+size_t ucl_json_safe_span (const char *str, size_t size);
+
+/**
+ * Check whether a key contains characters that are unsafe in UCL keys
+ * and thus must be escaped on emitting
+ * @param key key to check
+ * @param keylen length of the key
+ * @return true if a key needs escaping
+ */
+bool ucl_key_need_escape (const char *key, size_t keylen);
+
 /**
  * Write multiline string using `EOD` as string terminator
  * @param str
@@ -528,6 +840,37 @@ ucl_elt_string_write_squoted (const char *str, size_t size,
 void ucl_elt_string_write_multiline (const char *str, size_t size,
 		struct ucl_emitter_context *ctx);
 
+/**
+ * Output into a memory region. Output that does not fit is counted but not
+ * stored, so a NULL buffer gives the exact length of an output. Growable
+ * buffers are reallocated instead (and stop growing on allocation failure)
+ */
+struct ucl_emitter_buf {
+	unsigned char *buf;
+	size_t cap;
+	size_t len;
+	bool grow;
+};
+
+/**
+ * Initialize emitter functions writing into a fixed buffer
+ * @param func functions to initialize
+ * @param ebuf target buffer
+ */
+void ucl_emitter_buf_funcs (struct ucl_emitter_functions *func,
+		struct ucl_emitter_buf *ebuf);
+
+/**
+ * Append a string that belongs to an emitted object. Unlike
+ * `ucl_emitter_append_len`, iovec output may reference such a string
+ * instead of copying it, so temporary buffers must not be passed here
+ * @param str string owned by an object
+ * @param len length of the string
+ * @param func emitter functions
+ */
+void ucl_emitter_append_ref (const unsigned char *str, size_t len,
+		const struct ucl_emitter_functions *func);
+
 /**
  * Emit a single object to string
  * @param obj
@@ -658,10 +1001,95 @@ bool ucl_parse_msgpack (struct ucl_parser *parser);
 
 bool ucl_parse_csexp (struct ucl_parser *parser);
 
+/**
+ * Deep copy of an object
+ * @param other object to copy
+ * @param allow_array if true, then all values of an implicit array are copied
+ * @return new object
+ */
+ucl_object_t *ucl_object_copy_internal (const ucl_object_t *other,
+		bool allow_array);
+
+/**
+ * Get metadata of a container
+ * @param obj object or array
+ * @return metadata or NULL if `obj` is not a container or has no metadata
+ */
+struct ucl_container_meta *ucl_object_container_meta (const ucl_object_t *obj);
+
+/**
+ * Get metadata of a container allocating it on the first call
+ * @param obj object or array
+ * @return metadata or NULL if `obj` is not a container, has no storage or on
+ * allocation failure
+ */
+struct ucl_container_meta *ucl_object_container_meta_new (const ucl_object_t *obj);
+
+/**
+ * Get fingerprint of all values of an implicit array (or of a single value)
+ * @param obj head of an implicit array
+ * @param update if false, then cached fingerprints of containers are used
+ * without validation (so they must be updated by a previous call)
+ * @param fp output fingerprint
+ */
+void ucl_object_fingerprint_values (const ucl_object_t *obj, bool update,
+		struct ucl_fingerprint *fp);
+
+/**
+ * Insert element to an array at the specified position shifting the tail
+ * @param top array
+ * @param elt element to insert
+ * @param index position, must not be greater than the array size
+ * @return true if an element has been inserted
+ */
+bool ucl_array_insert_index (ucl_object_t *top, ucl_object_t *elt,
+		unsigned int index);
+
+/**
+ * Remove element at the specified position from an array
+ * @param top array
+ * @param index position
+ * @return removed element (must be unref'ed by a caller) or NULL
+ */
+ucl_object_t *ucl_array_delete_index (ucl_object_t *top, unsigned int index);
+
 /**
  * Free ucl chunk
  * @param chunk
  */
 void ucl_chunk_free (struct ucl_chunk *chunk);
 
+/**
+ * Start decompressing a chunk by windows instead of as a whole
+ * @param parser parser
+ * @param chunk chunk to set the first window to
+ * @param handler matched special handler
+ * @param data compressed data
+ * @param len length of data
+ * @return true if the first window is read, false if `handler` is not a
+ * decompression handler or the data cannot be decompressed by windows
+ */
+bool ucl_chunk_decompress_open (struct ucl_parser *parser,
+		struct ucl_chunk *chunk,
+		const struct ucl_parser_special_handler *handler,
+		const unsigned char *data, size_t len);
+
+/**
+ * Ensure that at least `need` bytes are available after chunk->pos unless
+ * the end of data is reached; data before `keep` can be discarded
+ * @param parser parser
+ * @param chunk chunk being parsed
+ * @param keep the first byte that must be kept in the window
+ * @param need number of bytes required
+ * @return true on success, false on a decompression error
+ */
+bool ucl_chunk_refill (struct ucl_parser *parser, struct ucl_chunk *chunk,
+		const unsigned char *keep, size_t need);
+
+/**
+ * Free a decompression stream of a chunk
+ * @param st stream
+ */
+void ucl_decompress_stream_free (struct ucl_decompress_stream *st);
+
 #endif /* UCL_INTERNAL_H_ */
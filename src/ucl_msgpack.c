@@ -244,7 +244,7 @@ ucl_emitter_print_string_msgpack (struct ucl_emitter_context *ctx,
 	}
 
 	func->ucl_emitter_append_len (buf, blen, func->ud);
-	func->ucl_emitter_append_len (s, len, func->ud);
+	ucl_emitter_append_ref (s, len, func);
 }
 
 void
@@ -277,7 +277,7 @@ ucl_emitter_print_binary_string_msgpack (struct ucl_emitter_context *ctx,
 	}
 
 	func->ucl_emitter_append_len (buf, blen, func->ud);
-	func->ucl_emitter_append_len (s, len, func->ud);
+	ucl_emitter_append_ref (s, len, func);
 }
 
 void
@@ -771,7 +771,7 @@ ucl_msgpack_get_container (struct ucl_parser *parser,
 		 * Insert new container to the stack
 		 */
 		if (parser->stack == NULL) {
-			parser->stack = calloc (1, sizeof (struct ucl_stack));
+			parser->stack = ucl_calloc (1, sizeof (struct ucl_stack));
 
 			if (parser->stack == NULL) {
 				ucl_create_err (&parser->err, "no memory");
@@ -781,7 +781,7 @@ ucl_msgpack_get_container (struct ucl_parser *parser,
 			parser->stack->chunk = parser->chunks;
 		}
 		else {
-			stack = calloc (1, sizeof (struct ucl_stack));
+			stack = ucl_calloc (1, sizeof (struct ucl_stack));
 
 			if (stack == NULL) {
 				ucl_create_err (&parser->err, "no memory");
@@ -893,7 +893,13 @@ ucl_msgpack_get_next_container (struct ucl_parser *parser)
 		/* We need to switch to the previous container */
 		parser->stack = cur->next;
 		parser->cur_obj = cur->obj;
-		free (cur);
+
+		if (cur->obj->type == UCL_ARRAY &&
+				(parser->flags & UCL_PARSER_PACK_ARRAYS)) {
+			ucl_array_pack (cur->obj);
+		}
+
+		ucl_free (cur);
 
 #ifdef MSGPACK_DEBUG_PARSER
 		cur = parser->stack;
@@ -917,6 +923,52 @@ ucl_msgpack_get_next_container (struct ucl_parser *parser)
 	return cur;
 }
 
+/*
+ * Decompressed chunks are parsed by windows: make `need` bytes available
+ * after `p` keeping the current key in the window
+ */
+static bool
+ucl_msgpack_refill (struct ucl_parser *parser, const unsigned char **p,
+		const unsigned char **key, uint64_t need)
+{
+	struct ucl_chunk *chunk = parser->chunks;
+	const unsigned char *keep;
+	size_t koff = 0, poff;
+
+	keep = (*key != NULL && *key < *p) ? *key : *p;
+	poff = *p - keep;
+
+	if (*key != NULL) {
+		koff = *key - keep;
+	}
+
+	chunk->pos = *p;
+
+	if (!ucl_chunk_refill (parser, chunk, keep,
+			need < SIZE_MAX ? (size_t)need : SIZE_MAX)) {
+		return false;
+	}
+
+	/* Kept data might be moved to the window start */
+	*p = chunk->pos;
+
+	if (*key != NULL) {
+		*key = chunk->pos - poff + koff;
+	}
+
+	return true;
+}
+
+#define MSGPACK_NEED(n) do {								\
+	if (parser->chunks->stream != NULL && (uint64_t)remain < (n)) {		\
+		if (!ucl_msgpack_refill (parser, &p, &key, (n))) {	\
+			return false;									\
+		}													\
+		end = parser->chunks->end;							\
+		remain = end - p;									\
+	}														\
+} while (0)
+
 #define CONSUME_RET do {									\
 	if (ret != -1) {										\
 		p += ret;											\
@@ -973,12 +1025,21 @@ ucl_msgpack_consume (struct ucl_parser *parser)
 	end = p + remain;
 
 
-	while (p < end) {
+	for (;;) {
+		if (p >= end) {
+			MSGPACK_NEED (1);
+
+			if (p >= end) {
+				break;
+			}
+		}
 #ifdef MSGPACK_DEBUG_PARSER
 		hist[i++ % 256] = state;
 #endif
 		switch (state) {
 		case read_type:
+			/* Type byte and up to 8 bytes of length */
+			MSGPACK_NEED (9);
 			obj_parser = ucl_msgpack_get_parser_from_type (*p);
 
 			if (obj_parser == NULL) {
@@ -1116,6 +1177,8 @@ ucl_msgpack_consume (struct ucl_parser *parser)
 			ret = obj_parser->func (parser, container, len, obj_parser->fmt,
 								p, remain);
 			CONSUME_RET;
+			key = NULL;
+			keylen = 0;
 
 			if (len > 0) {
 				state = read_type;
@@ -1140,6 +1203,8 @@ ucl_msgpack_consume (struct ucl_parser *parser)
 				return false;
 			}
 
+			/* Ext values have the type byte after the length */
+			MSGPACK_NEED (len + 1);
 			ret = obj_parser->func (parser, container, len, obj_parser->fmt,
 					p, remain);
 			CONSUME_RET;
@@ -1178,6 +1243,7 @@ ucl_msgpack_consume (struct ucl_parser *parser)
 				return false;
 			}
 
+			MSGPACK_NEED (len);
 			key = p;
 			keylen = len;
 
@@ -1206,6 +1272,7 @@ ucl_msgpack_consume (struct ucl_parser *parser)
 				return false;
 			}
 
+			MSGPACK_NEED (len + 1);
 			ret = obj_parser->func (parser, container, len, obj_parser->fmt,
 					p, remain);
 			CONSUME_RET;
@@ -1373,6 +1440,17 @@ ucl_parse_msgpack (struct ucl_parser *parser)
 	if (ret && parser->top_obj == NULL) {
 		parser->top_obj = parser->cur_obj;
 	}
+	else if (!ret && parser->top_obj == NULL && parser->stack != NULL) {
+		/* Partially read top level container is not owned by anything */
+		struct ucl_stack *bottom = parser->stack;
+
+		while (bottom->next != NULL) {
+			bottom = bottom->next;
+		}
+
+		ucl_object_unref (bottom->obj);
+		bottom->obj = NULL;
+	}
 
 	return ret;
 }
@@ -1417,16 +1495,8 @@ ucl_msgpack_parse_string (struct ucl_parser *parser,
 	}
 
 	if (!(parser->flags & UCL_PARSER_ZEROCOPY)) {
-		if (obj->flags & UCL_OBJECT_BINARY) {
-			obj->trash_stack[UCL_TRASH_VALUE] = malloc (len);
-
-			if (obj->trash_stack[UCL_TRASH_VALUE] != NULL) {
-				memcpy (obj->trash_stack[UCL_TRASH_VALUE], pos, len);
-			}
-		}
-		else {
-			ucl_copy_value_trash (obj);
-		}
+		/* Value must not point to the chunk that is released after parsing */
+		ucl_copy_value_trash (obj);
 	}
 
 	parser->cur_obj = obj;
@@ -352,7 +352,7 @@ ucl_check_variable_safe (struct ucl_parser *parser, const char *ptr, size_t rema
 			*out_len = dstlen;
 
 			if (need_free) {
-				free (dst);
+				ucl_free (dst);
 			}
 			return (ptr + remain);
 		}
@@ -481,7 +481,7 @@ ucl_expand_single_variable (struct ucl_parser *parser, const char *ptr,
 				if (dstlen > out_len) {
 					/* We do not have enough space! */
 					if (need_free) {
-						free (dst);
+						ucl_free (dst);
 					}
 				}
 				else {
@@ -491,7 +491,7 @@ ucl_expand_single_variable (struct ucl_parser *parser, const char *ptr,
 					found = true;
 
 					if (need_free) {
-						free(dst);
+						ucl_free (dst);
 					}
 				}
 			}
@@ -1217,6 +1217,7 @@ ucl_parser_append_elt (struct ucl_parser *parser, ucl_hash_t *cont,
 		top->flags |= UCL_OBJECT_MULTIVALUE;
 		DL_APPEND (top, elt);
 		parser->stack->obj->len ++;
+		ucl_container_modified (ucl_hash_meta (cont));
 	}
 	else {
 		if ((top->flags & UCL_OBJECT_MULTIVALUE) != 0) {
@@ -2060,12 +2061,21 @@ ucl_parse_after_value (struct ucl_parser *parser, struct ucl_chunk *chunk)
 					}
 
 					parser->stack = st->next;
-					UCL_FREE (sizeof (struct ucl_stack), st);
 
 					if (parser->cur_obj) {
 						ucl_attach_comment (parser, parser->cur_obj, true);
 					}
 
+					/* Comments are keyed by element pointers, so skip them */
+					if (*p == ']' && (parser->flags & UCL_PARSER_PACK_ARRAYS) &&
+							!(parser->flags & UCL_PARSER_SAVE_COMMENTS) &&
+							ucl_array_pack (st->obj)) {
+						/* The last element does not exist anymore */
+						parser->cur_obj = st->obj;
+					}
+
+					UCL_FREE (sizeof (struct ucl_stack), st);
+
 					while (parser->stack != NULL) {
 						st = parser->stack;
 
@@ -2812,6 +2822,32 @@ e0:
 	return NULL;
 }
 
+struct ucl_parser*
+ucl_parser_new_full (int flags, const struct ucl_allocator *allocator)
+{
+	struct ucl_parser *parser;
+	const struct ucl_allocator *prev;
+
+	if (allocator == NULL) {
+		return ucl_parser_new (flags);
+	}
+
+	if (allocator->malloc_fn == NULL || allocator->realloc_fn == NULL ||
+			allocator->free_fn == NULL) {
+		return NULL;
+	}
+
+	prev = ucl_allocator_enter (allocator);
+	parser = ucl_parser_new (flags);
+	ucl_allocator_leave (prev);
+
+	if (parser != NULL) {
+		parser->allocator = allocator;
+	}
+
+	return parser;
+}
+
 bool
 ucl_parser_set_default_priority (struct ucl_parser *parser, unsigned prio)
 {
@@ -2834,8 +2870,8 @@ ucl_parser_get_default_priority (struct ucl_parser *parser)
 	return parser->default_priority;
 }
 
-bool
-ucl_parser_register_macro (struct ucl_parser *parser, const char *macro,
+static bool
+ucl_parser_register_macro_internal (struct ucl_parser *parser, const char *macro,
 		ucl_macro_handler handler, void* ud)
 {
 	struct ucl_macro *new;
@@ -2851,7 +2887,7 @@ ucl_parser_register_macro (struct ucl_parser *parser, const char *macro,
 
 	memset (new, 0, sizeof (struct ucl_macro));
 	new->h.handler = handler;
-	new->name = strdup (macro);
+	new->name = ucl_strdup (macro);
 	if (new->name == NULL) {
 		UCL_FREE (sizeof (struct ucl_macro), new);
 		return false;
@@ -2862,7 +2898,21 @@ ucl_parser_register_macro (struct ucl_parser *parser, const char *macro,
 }
 
 bool
-ucl_parser_register_context_macro (struct ucl_parser *parser, const char *macro,
+ucl_parser_register_macro (struct ucl_parser *parser, const char *macro,
+		ucl_macro_handler handler, void* ud)
+{
+	const struct ucl_allocator *prev;
+	bool ret;
+
+	prev = ucl_parser_allocator_enter (parser);
+	ret = ucl_parser_register_macro_internal (parser, macro, handler, ud);
+	ucl_parser_allocator_leave (parser, prev);
+
+	return ret;
+}
+
+static bool
+ucl_parser_register_context_macro_internal (struct ucl_parser *parser, const char *macro,
 		ucl_context_macro_handler handler, void* ud)
 {
 	struct ucl_macro *new;
@@ -2878,7 +2928,7 @@ ucl_parser_register_context_macro (struct ucl_parser *parser, const char *macro,
 
 	memset (new, 0, sizeof (struct ucl_macro));
 	new->h.context_handler = handler;
-	new->name = strdup (macro);
+	new->name = ucl_strdup (macro);
 	if (new->name == NULL) {
 		UCL_FREE (sizeof (struct ucl_macro), new);
 		return false;
@@ -2889,8 +2939,22 @@ ucl_parser_register_context_macro (struct ucl_parser *parser, const char *macro,
 	return true;
 }
 
-void
-ucl_parser_register_variable (struct ucl_parser *parser, const char *var,
+bool
+ucl_parser_register_context_macro (struct ucl_parser *parser,
+		const char *macro, ucl_context_macro_handler handler, void* ud)
+{
+	const struct ucl_allocator *prev;
+	bool ret;
+
+	prev = ucl_parser_allocator_enter (parser);
+	ret = ucl_parser_register_context_macro_internal (parser, macro, handler, ud);
+	ucl_parser_allocator_leave (parser, prev);
+
+	return ret;
+}
+
+static void
+ucl_parser_register_variable_internal (struct ucl_parser *parser, const char *var,
 		const char *value)
 {
 	struct ucl_variable *new = NULL, *cur;
@@ -2912,8 +2976,8 @@ ucl_parser_register_variable (struct ucl_parser *parser, const char *var,
 		if (new != NULL) {
 			/* Remove variable */
 			DL_DELETE (parser->variables, new);
-			free (new->var);
-			free (new->value);
+			ucl_free (new->var);
+			ucl_free (new->value);
 			UCL_FREE (sizeof (struct ucl_variable), new);
 		}
 		else {
@@ -2928,21 +2992,32 @@ ucl_parser_register_variable (struct ucl_parser *parser, const char *var,
 				return;
 			}
 			memset (new, 0, sizeof (struct ucl_variable));
-			new->var = strdup (var);
+			new->var = ucl_strdup (var);
 			new->var_len = strlen (var);
-			new->value = strdup (value);
+			new->value = ucl_strdup (value);
 			new->value_len = strlen (value);
 
 			DL_APPEND (parser->variables, new);
 		}
 		else {
-			free (new->value);
-			new->value = strdup (value);
+			ucl_free (new->value);
+			new->value = ucl_strdup (value);
 			new->value_len = strlen (value);
 		}
 	}
 }
 
+void
+ucl_parser_register_variable (struct ucl_parser *parser, const char *var,
+		const char *value)
+{
+	const struct ucl_allocator *prev;
+
+	prev = ucl_parser_allocator_enter (parser);
+	ucl_parser_register_variable_internal (parser, var, value);
+	ucl_parser_allocator_leave (parser, prev);
+}
+
 void
 ucl_parser_set_variables_handler (struct ucl_parser *parser,
 		ucl_variable_handler handler, void *ud)
@@ -2951,8 +3026,101 @@ ucl_parser_set_variables_handler (struct ucl_parser *parser,
 	parser->var_data = ud;
 }
 
-bool
-ucl_parser_add_chunk_full (struct ucl_parser *parser, const unsigned char *data,
+/*
+ * Free outputs of special handlers that are no longer needed once the chunk
+ * is parsed: without zero-copy all parsed data is copied to objects
+ */
+static void
+ucl_chunk_release_parsed (struct ucl_parser *parser, struct ucl_chunk *chunk)
+{
+	struct ucl_parser_special_handler_chain *chain, *tmp;
+	bool released = false;
+
+	if (chunk->stream) {
+		ucl_decompress_stream_free (chunk->stream);
+		chunk->stream = NULL;
+		released = true;
+	}
+
+	if (parser->flags & UCL_PARSER_ZEROCOPY && !released) {
+		return;
+	}
+
+	LL_FOREACH_SAFE (chunk->special_handlers, chain, tmp) {
+		if (chain->special_handler->flags & UCL_SPECIAL_HANDLER_RELEASE_PARSED) {
+			if (chain->special_handler->free_function) {
+				chain->special_handler->free_function (
+						chain->begin,
+						chain->len,
+						chain->special_handler->user_data);
+			} else {
+				UCL_FREE (chain->len, chain->begin);
+			}
+
+			LL_DELETE (chunk->special_handlers, chain);
+			UCL_FREE (sizeof (*chain), chain);
+			released = true;
+		}
+	}
+
+	if (released) {
+		/* Chunk data might be the released output */
+		chunk->begin = NULL;
+		chunk->pos = NULL;
+		chunk->end = NULL;
+		chunk->remain = 0;
+	}
+}
+
+/*
+ * Compressed msgpack is fed to the lexer by windows of decompressed data when
+ * nothing else has to see the whole output: the UCL text lexer and further
+ * handlers get a fully decompressed chunk
+ */
+static bool
+ucl_chunk_try_windowed (struct ucl_parser *parser, struct ucl_chunk *chunk,
+		struct ucl_parser_special_handler *special_handler,
+		const unsigned char *data, size_t len,
+		enum ucl_parse_type parse_type)
+{
+	struct ucl_parser_special_handler *next;
+
+	if ((parser->flags & UCL_PARSER_ZEROCOPY) ||
+			(parse_type != UCL_PARSE_AUTO && parse_type != UCL_PARSE_MSGPACK)) {
+		return false;
+	}
+
+	if (!ucl_chunk_decompress_open (parser, chunk, special_handler, data, len)) {
+		return false;
+	}
+
+	if (chunk->remain > 0 && (parse_type == UCL_PARSE_MSGPACK ||
+			(*chunk->begin & 0x80) == 0x80)) {
+		LL_FOREACH (special_handler->next, next) {
+			if ((next->flags & UCL_SPECIAL_HANDLER_PREPROCESS_ALL) ||
+					(chunk->remain >= next->magic_len &&
+					 memcmp (chunk->begin, next->magic, next->magic_len) == 0)) {
+				break;
+			}
+		}
+
+		if (next == NULL) {
+			return true;
+		}
+	}
+
+	ucl_decompress_stream_free (chunk->stream);
+	chunk->stream = NULL;
+	chunk->begin = NULL;
+	chunk->pos = NULL;
+	chunk->end = NULL;
+	chunk->remain = 0;
+
+	return false;
+}
+
+static bool
+ucl_parser_add_chunk_full_internal (struct ucl_parser *parser, const unsigned char *data,
 		size_t len, unsigned priority, enum ucl_duplicate_strategy strat,
 		enum ucl_parse_type parse_type)
 {
@@ -2985,6 +3153,13 @@ ucl_parser_add_chunk_full (struct ucl_parser *parser, const unsigned char *data,
 				unsigned char *ndata = NULL;
 				size_t nlen = 0;
 
+				if (ucl_chunk_try_windowed (parser, chunk, special_handler,
+						data, len, parse_type)) {
+					data = chunk->begin;
+					len = chunk->remain;
+					break;
+				}
+
 				if (!special_handler->handler (parser, data, len, &ndata, &nlen,
 						special_handler->user_data)) {
 					UCL_FREE(sizeof (struct ucl_chunk), chunk);
@@ -3031,7 +3206,7 @@ ucl_parser_add_chunk_full (struct ucl_parser *parser, const unsigned char *data,
 		chunk->parse_type = parse_type;
 
 		if (parser->cur_file) {
-			chunk->fname = strdup (parser->cur_file);
+			chunk->fname = ucl_strdup (parser->cur_file);
 		}
 
 		LL_PREPEND (parser->chunks, chunk);
@@ -3044,16 +3219,25 @@ ucl_parser_add_chunk_full (struct ucl_parser *parser, const unsigned char *data,
 		}
 
 		if (len > 0) {
+			bool ret;
+
 			/* Need to parse something */
 			switch (parse_type) {
 			default:
 			case UCL_PARSE_UCL:
-				return ucl_state_machine (parser);
+				ret = ucl_state_machine (parser);
+				break;
 			case UCL_PARSE_MSGPACK:
-				return ucl_parse_msgpack (parser);
+				ret = ucl_parse_msgpack (parser);
+				break;
 			case UCL_PARSE_CSEXP:
-				return ucl_parse_csexp (parser);
+				ret = ucl_parse_csexp (parser);
+				break;
 			}
+
+			ucl_chunk_release_parsed (parser, chunk);
+
+			return ret;
 		}
 		else {
 			/* Just add empty chunk and go forward */
@@ -3074,6 +3258,22 @@ ucl_parser_add_chunk_full (struct ucl_parser *parser, const unsigned char *data,
 	return false;
 }
 
+bool
+ucl_parser_add_chunk_full (struct ucl_parser *parser, const unsigned char *data,
+		size_t len, unsigned priority, enum ucl_duplicate_strategy strat,
+		enum ucl_parse_type parse_type)
+{
+	const struct ucl_allocator *prev;
+	bool ret;
+
+	prev = ucl_parser_allocator_enter (parser);
+	ret = ucl_parser_add_chunk_full_internal (parser, data, len, priority, strat,
+			parse_type);
+	ucl_parser_allocator_leave (parser, prev);
+
+	return ret;
+}
+
 bool
 ucl_parser_add_chunk_priority (struct ucl_parser *parser,
 		const unsigned char *data, size_t len, unsigned priority)
@@ -3099,8 +3299,8 @@ ucl_parser_add_chunk (struct ucl_parser *parser, const unsigned char *data,
 			parser->default_priority, UCL_DUPLICATE_APPEND, UCL_PARSE_UCL);
 }
 
-bool
-ucl_parser_insert_chunk (struct ucl_parser *parser, const unsigned char *data,
+static bool
+ucl_parser_insert_chunk_internal (struct ucl_parser *parser, const unsigned char *data,
 		size_t len)
 {
 	if (parser == NULL || parser->top_obj == NULL) {
@@ -3134,12 +3334,30 @@ ucl_parser_insert_chunk (struct ucl_parser *parser, const unsigned char *data,
 	return res;
 }
 
+bool
+ucl_parser_insert_chunk (struct ucl_parser *parser, const unsigned char *data,
+		size_t len)
+{
+	const struct ucl_allocator *prev;
+	bool ret;
+
+	prev = ucl_parser_allocator_enter (parser);
+	ret = ucl_parser_insert_chunk_internal (parser, data, len);
+	ucl_parser_allocator_leave (parser, prev);
+
+	return ret;
+}
+
 bool
 ucl_parser_add_string_priority (struct ucl_parser *parser, const char *data,
 		size_t len, unsigned priority)
 {
+	const struct ucl_allocator *prev;
+
 	if (data == NULL) {
+		prev = ucl_parser_allocator_enter (parser);
 		ucl_create_err (&parser->err, "invalid string added");
+		ucl_parser_allocator_leave (parser, prev);
 		return false;
 	}
 	if (len == 0) {
@@ -3162,8 +3380,8 @@ ucl_parser_add_string (struct ucl_parser *parser, const char *data,
 			(const unsigned char *)data, len, parser->default_priority);
 }
 
-bool
-ucl_set_include_path (struct ucl_parser *parser, ucl_object_t *paths)
+static bool
+ucl_set_include_path_internal (struct ucl_parser *parser, ucl_object_t *paths)
 {
 	if (parser == NULL || paths == NULL) {
 		return false;
@@ -3184,6 +3402,19 @@ ucl_set_include_path (struct ucl_parser *parser, ucl_object_t *paths)
 	return true;
 }
 
+bool
+ucl_set_include_path (struct ucl_parser *parser, ucl_object_t *paths)
+{
+	const struct ucl_allocator *prev;
+	bool ret;
+
+	prev = ucl_parser_allocator_enter (parser);
+	ret = ucl_set_include_path_internal (parser, paths);
+	ucl_parser_allocator_leave (parser, prev);
+
+	return ret;
+}
+
 unsigned char ucl_parser_chunk_peek (struct ucl_parser *parser)
 {
 	if (parser == NULL || parser->chunks == NULL || parser->chunks->pos == NULL || parser->chunks->end == NULL ||
@@ -0,0 +1,1574 @@
+/* Copyright (c) 2026, Vsevolod Stakhov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *       * Redistributions of source code must retain the above copyright
+ *         notice, this list of conditions and the following disclaimer.
+ *       * Redistributions in binary form must reproduce the above copyright
+ *         notice, this list of conditions and the following disclaimer in the
+ *         documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Query engine: RFC 6901 JSON pointers and a subset of JSONPath.
+ *
+ * A query is compiled to a plan, that is a sequence of steps (selectors).
+ * Execution is performed by an iterator that keeps an explicit stack of
+ * frames, each frame applies a single step to a single node and yields
+ * candidates one by one, so no intermediate results are ever collected.
+ *
+ * Implicit arrays (multiple values of the same key) are treated as arrays,
+ * just like they are represented in JSON output.
+ */
+
+#include "ucl.h"
+#include "ucl_internal.h"
+#include "ucl_hash.h"
+#include "utlist.h"
+#include "kvec.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+enum ucl_query_step_type {
+	UCL_QUERY_STEP_MEMBER = 0,
+	UCL_QUERY_STEP_INDEX,
+	UCL_QUERY_STEP_WILDCARD,
+	UCL_QUERY_STEP_SLICE,
+	UCL_QUERY_STEP_FILTER
+};
+
+struct ucl_query_key {
+	char *key;
+	size_t keylen;
+	/* Array index for JSON pointer tokens, -1 if a token is not an index */
+	int64_t index;
+	uint32_t hv;
+	uint32_t hv_caseless;
+};
+
+enum ucl_query_op {
+	UCL_QUERY_OP_EXISTS = 0,
+	UCL_QUERY_OP_EQ,
+	UCL_QUERY_OP_NE,
+	UCL_QUERY_OP_LT,
+	UCL_QUERY_OP_LE,
+	UCL_QUERY_OP_GT,
+	UCL_QUERY_OP_GE,
+	UCL_QUERY_OP_AND,
+	UCL_QUERY_OP_OR,
+	UCL_QUERY_OP_NOT
+};
+
+struct ucl_query_rel {
+	bool is_index;
+	int64_t index;
+	struct ucl_query_key key;
+};
+
+struct ucl_query_operand {
+	/* Either a literal value or a path relative to the current node */
+	ucl_object_t *literal;
+	struct ucl_query_rel *path;
+	unsigned npath;
+};
+
+struct ucl_query_expr {
+	enum ucl_query_op op;
+	struct ucl_query_expr *left;
+	struct ucl_query_expr *right;
+	struct ucl_query_operand lhs;
+	struct ucl_query_operand rhs;
+};
+
+struct ucl_query_step {
+	enum ucl_query_step_type type;
+	bool descendant;
+	bool has_start;
+	bool has_end;
+	struct ucl_query_key key;
+	int64_t index;
+	int64_t start;
+	int64_t end;
+	int64_t step;
+	struct ucl_query_expr *filter;
+};
+
+struct ucl_query {
+	kvec_t(struct ucl_query_step) steps;
+	/* Query selects at most one node */
+	bool singular;
+};
+
+enum ucl_query_frame_kind {
+	UCL_QUERY_FRAME_APPLY = 0,
+	UCL_QUERY_FRAME_DESCEND
+};
+
+struct ucl_query_frame {
+	const ucl_object_t *node;
+	unsigned step;
+	unsigned char kind;
+	/* Node is a single value of an implicit array */
+	bool expanded;
+	bool started;
+	size_t idx;
+	int64_t pos;
+	const void *cursor;
+};
+
+struct ucl_query_iter {
+	const struct ucl_query *query;
+	const ucl_object_t *top;
+	kvec_t(struct ucl_query_frame) stack;
+};
+
+struct ucl_query_parser {
+	const char *start;
+	const char *p;
+	const char *end;
+	struct ucl_query_error *err;
+};
+
+static void
+ucl_query_set_err (struct ucl_query_parser *qp, const char *msg)
+{
+	if (qp->err != NULL && qp->err->msg[0] == '\0') {
+		qp->err->pos = qp->p - qp->start;
+		snprintf (qp->err->msg, sizeof (qp->err->msg), "%s", msg);
+	}
+}
+
+static void
+ucl_query_skip_spaces (struct ucl_query_parser *qp)
+{
+	while (qp->p < qp->end && isspace ((unsigned char)*qp->p)) {
+		qp->p ++;
+	}
+}
+
+static bool
+ucl_query_key_init (struct ucl_query_key *k, const char *key, size_t keylen)
+{
+	k->key = UCL_ALLOC (keylen + 1);
+
+	if (k->key == NULL) {
+		return false;
+	}
+
+	memcpy (k->key, key, keylen);
+	k->key[keylen] = '\0';
+	k->keylen = keylen;
+	k->index = -1;
+	ucl_hash_key_hashes (k->key, keylen, &k->hv, &k->hv_caseless);
+
+	return true;
+}
+
+static void
+ucl_query_key_free (struct ucl_query_key *k)
+{
+	if (k->key != NULL) {
+		UCL_FREE (k->keylen + 1, k->key);
+		k->key = NULL;
+	}
+}
+
+static void
+ucl_query_expr_free (struct ucl_query_expr *expr)
+{
+	unsigned i;
+
+	if (expr == NULL) {
+		return;
+	}
+
+	ucl_query_expr_free (expr->left);
+	ucl_query_expr_free (expr->right);
+
+	if (expr->lhs.literal) {
+		ucl_object_unref (expr->lhs.literal);
+	}
+	if (expr->rhs.literal) {
+		ucl_object_unref (expr->rhs.literal);
+	}
+
+	for (i = 0; i < expr->lhs.npath; i ++) {
+		ucl_query_key_free (&expr->lhs.path[i].key);
+	}
+	for (i = 0; i < expr->rhs.npath; i ++) {
+		ucl_query_key_free (&expr->rhs.path[i].key);
+	}
+	if (expr->lhs.path) {
+		UCL_FREE (expr->lhs.npath * sizeof (struct ucl_query_rel),
+				expr->lhs.path);
+	}
+	if (expr->rhs.path) {
+		UCL_FREE (expr->rhs.npath * sizeof (struct ucl_query_rel),
+				expr->rhs.path);
+	}
+
+	UCL_FREE (sizeof (*expr), expr);
+}
+
+void
+ucl_query_free (struct ucl_query *query)
+{
+	unsigned i;
+	struct ucl_query_step *st;
+
+	if (query == NULL) {
+		return;
+	}
+
+	for (i = 0; i < kv_size (query->steps); i ++) {
+		st = &kv_A (query->steps, i);
+		ucl_query_key_free (&st->key);
+		ucl_query_expr_free (st->filter);
+	}
+
+	kv_destroy (query->steps);
+	UCL_FREE (sizeof (*query), query);
+}
+
+/*
+ * Parse quoted string with either single or double quotes and unescape it
+ */
+static char *
+ucl_query_parse_quoted (struct ucl_query_parser *qp, size_t *len)
+{
+	char quote = *qp->p, *res;
+	const char *c;
+	bool need_unescape = false;
+
+	c = ++qp->p;
+
+	while (qp->p < qp->end && *qp->p != quote) {
+		if (*qp->p == '\\') {
+			need_unescape = true;
+			qp->p ++;
+		}
+		qp->p ++;
+	}
+
+	if (qp->p >= qp->end) {
+		ucl_query_set_err (qp, "unterminated string");
+		return NULL;
+	}
+
+	*len = qp->p - c;
+	res = UCL_ALLOC (*len + 1);
+
+	if (res == NULL) {
+		ucl_query_set_err (qp, "cannot allocate memory");
+		return NULL;
+	}
+
+	memcpy (res, c, *len);
+	res[*len] = '\0';
+
+	if (need_unescape) {
+		if (quote == '"') {
+			*len = ucl_unescape_json_string (res, *len);
+		}
+		else {
+			*len = ucl_unescape_squoted_string (res, *len);
+		}
+	}
+
+	/* Skip closing quote */
+	qp->p ++;
+
+	return res;
+}
+
+static bool
+ucl_query_parse_int (struct ucl_query_parser *qp, int64_t *res)
+{
+	const char *c = qp->p;
+	bool neg = false;
+	int64_t val = 0;
+
+	if (qp->p < qp->end && *qp->p == '-') {
+		neg = true;
+		qp->p ++;
+	}
+
+	if (qp->p >= qp->end || !isdigit ((unsigned char)*qp->p)) {
+		qp->p = c;
+		ucl_query_set_err (qp, "integer expected");
+		return false;
+	}
+
+	while (qp->p < qp->end && isdigit ((unsigned char)*qp->p)) {
+		if (val > (INT64_MAX - 9) / 10) {
+			ucl_query_set_err (qp, "integer is too large");
+			return false;
+		}
+		val = val * 10 + (*qp->p - '0');
+		qp->p ++;
+	}
+
+	*res = neg ? -val : val;
+
+	return true;
+}
+
+static bool
+ucl_query_is_name_char (unsigned char c, bool in_filter)
+{
+	if (in_filter) {
+		return isalnum (c) || c == '_' || c == '-' || c >= 0x80;
+	}
+
+	return c != '.' && c != '[';
+}
+
+static const char *
+ucl_query_parse_name (struct ucl_query_parser *qp, size_t *len, bool in_filter)
+{
+	const char *c = qp->p;
+
+	while (qp->p < qp->end &&
+			ucl_query_is_name_char ((unsigned char)*qp->p, in_filter)) {
+		qp->p ++;
+	}
+
+	*len = qp->p - c;
+
+	if (*len == 0) {
+		ucl_query_set_err (qp, "member name expected");
+		return NULL;
+	}
+
+	return c;
+}
+
+static struct ucl_query_expr *ucl_query_parse_or (struct ucl_query_parser *qp);
+
+static bool
+ucl_query_parse_operand (struct ucl_query_parser *qp,
+		struct ucl_query_operand *op)
+{
+	kvec_t(struct ucl_query_rel) path;
+	struct ucl_query_rel rel;
+	const char *name, *c;
+	char *str, *endptr;
+	size_t len;
+	bool is_float = false;
+
+	memset (op, 0, sizeof (*op));
+	ucl_query_skip_spaces (qp);
+
+	if (qp->p >= qp->end) {
+		ucl_query_set_err (qp, "operand expected");
+		return false;
+	}
+
+	if (*qp->p == '@') {
+		kv_init (path);
+		qp->p ++;
+
+		for (;;) {
+			memset (&rel, 0, sizeof (rel));
+
+			if (qp->p < qp->end && *qp->p == '.') {
+				qp->p ++;
+				name = ucl_query_parse_name (qp, &len, true);
+
+				if (name == NULL ||
+						!ucl_query_key_init (&rel.key, name, len)) {
+					goto err;
+				}
+			}
+			else if (qp->p < qp->end && *qp->p == '[') {
+				qp->p ++;
+				ucl_query_skip_spaces (qp);
+
+				if (qp->p < qp->end && (*qp->p == '\'' || *qp->p == '"')) {
+					str = ucl_query_parse_quoted (qp, &len);
+
+					if (str == NULL) {
+						goto err;
+					}
+
+					rel.key.key = str;
+					rel.key.keylen = len;
+					rel.key.index = -1;
+					ucl_hash_key_hashes (str, len, &rel.key.hv,
+							&rel.key.hv_caseless);
+				}
+				else {
+					if (!ucl_query_parse_int (qp, &rel.index)) {
+						goto err;
+					}
+					rel.is_index = true;
+				}
+
+				ucl_query_skip_spaces (qp);
+
+				if (qp->p >= qp->end || *qp->p != ']') {
+					ucl_query_key_free (&rel.key);
+					ucl_query_set_err (qp, "']' expected");
+					goto err;
+				}
+
+				qp->p ++;
+			}
+			else {
+				break;
+			}
+
+			kv_push_safe (struct ucl_query_rel, path, rel, enomem);
+		}
+
+		op->path = path.a;
+		op->npath = path.n;
+
+		return true;
+enomem:
+		ucl_query_key_free (&rel.key);
+		ucl_query_set_err (qp, "cannot allocate memory");
+err:
+		for (len = 0; len < path.n; len ++) {
+			ucl_query_key_free (&kv_A (path, len).key);
+		}
+		kv_destroy (path);
+
+		return false;
+	}
+	else if (*qp->p == '\'' || *qp->p == '"') {
+		str = ucl_query_parse_quoted (qp, &len);
+
+		if (str == NULL) {
+			return false;
+		}
+
+		op->literal = ucl_object_fromlstring (str, len);
+		UCL_FREE (len + 1, str);
+	}
+	else if (*qp->p == '-' || isdigit ((unsigned char)*qp->p)) {
+		c = qp->p;
+
+		if (*qp->p == '-') {
+			qp->p ++;
+		}
+
+		while (qp->p < qp->end && (isdigit ((unsigned char)*qp->p) ||
+				*qp->p == '.' || *qp->p == 'e' || *qp->p == 'E' ||
+				((*qp->p == '-' || *qp->p == '+') &&
+				(qp->p[-1] == 'e' || qp->p[-1] == 'E')))) {
+			if (!isdigit ((unsigned char)*qp->p)) {
+				is_float = true;
+			}
+			qp->p ++;
+		}
+
+		len = qp->p - c;
+		str = UCL_ALLOC (len + 1);
+
+		if (str == NULL) {
+			ucl_query_set_err (qp, "cannot allocate memory");
+			return false;
+		}
+
+		memcpy (str, c, len);
+		str[len] = '\0';
+
+		if (is_float) {
+			op->literal = ucl_object_fromdouble (strtod (str, &endptr));
+		}
+		else {
+			op->literal = ucl_object_fromint (strtoll (str, &endptr, 10));
+		}
+
+		if (*endptr != '\0') {
+			qp->p = c;
+			ucl_query_set_err (qp, "invalid number");
+			ucl_object_unref (op->literal);
+			op->literal = NULL;
+			UCL_FREE (len + 1, str);
+
+			return false;
+		}
+
+		UCL_FREE (len + 1, str);
+	}
+	else if (qp->end - qp->p >= 4 && memcmp (qp->p, "true", 4) == 0) {
+		op->literal = ucl_object_frombool (true);
+		qp->p += 4;
+	}
+	else if (qp->end - qp->p >= 5 && memcmp (qp->p, "false", 5) == 0) {
+		op->literal = ucl_object_frombool (false);
+		qp->p += 5;
+	}
+	else if (qp->end - qp->p >= 4 && memcmp (qp->p, "null", 4) == 0) {
+		op->literal = ucl_object_typed_new (UCL_NULL);
+		qp->p += 4;
+	}
+	else {
+		ucl_query_set_err (qp, "invalid operand");
+		return false;
+	}
+
+	if (op->literal == NULL) {
+		ucl_query_set_err (qp, "cannot allocate memory");
+		return false;
+	}
+
+	return true;
+}
+
+static struct ucl_query_expr *
+ucl_query_expr_new (struct ucl_query_parser *qp, enum ucl_query_op op)
+{
+	struct ucl_query_expr *expr;
+
+	expr = UCL_ALLOC (sizeof (*expr));
+
+	if (expr == NULL) {
+		ucl_query_set_err (qp, "cannot allocate memory");
+		return NULL;
+	}
+
+	memset (expr, 0, sizeof (*expr));
+	expr->op = op;
+
+	return expr;
+}
+
+static struct ucl_query_expr *
+ucl_query_parse_unary (struct ucl_query_parser *qp)
+{
+	struct ucl_query_expr *expr, *sub;
+	static const struct {
+		const char *str;
+		size_t len;
+		enum ucl_query_op op;
+	} ops[] = {
+		{"==", 2, UCL_QUERY_OP_EQ},
+		{"!=", 2, UCL_QUERY_OP_NE},
+		{"<=", 2, UCL_QUERY_OP_LE},
+		{">=", 2, UCL_QUERY_OP_GE},
+		{"<", 1, UCL_QUERY_OP_LT},
+		{">", 1, UCL_QUERY_OP_GT},
+	};
+	unsigned i;
+
+	ucl_query_skip_spaces (qp);
+
+	if (qp->p < qp->end && *qp->p == '!' &&
+			(qp->p + 1 >= qp->end || qp->p[1] != '=')) {
+		qp->p ++;
+		sub = ucl_query_parse_unary (qp);
+
+		if (sub == NULL) {
+			return NULL;
+		}
+
+		expr = ucl_query_expr_new (qp, UCL_QUERY_OP_NOT);
+
+		if (expr == NULL) {
+			ucl_query_expr_free (sub);
+			return NULL;
+		}
+
+		expr->left = sub;
+
+		return expr;
+	}
+
+	if (qp->p < qp->end && *qp->p == '(') {
+		qp->p ++;
+		expr = ucl_query_parse_or (qp);
+
+		if (expr == NULL) {
+			return NULL;
+		}
+
+		ucl_query_skip_spaces (qp);
+
+		if (qp->p >= qp->end || *qp->p != ')') {
+			ucl_query_set_err (qp, "')' expected");
+			ucl_query_expr_free (expr);
+			return NULL;
+		}
+
+		qp->p ++;
+
+		return expr;
+	}
+
+	expr = ucl_query_expr_new (qp, UCL_QUERY_OP_EXISTS);
+
+	if (expr == NULL) {
+		return NULL;
+	}
+
+	if (!ucl_query_parse_operand (qp, &expr->lhs)) {
+		ucl_query_expr_free (expr);
+		return NULL;
+	}
+
+	ucl_query_skip_spaces (qp);
+
+	for (i = 0; i < sizeof (ops) / sizeof (ops[0]); i ++) {
+		if (qp->end - qp->p >= (ptrdiff_t)ops[i].len &&
+				memcmp (qp->p, ops[i].str, ops[i].len) == 0) {
+			qp->p += ops[i].len;
+			expr->op = ops[i].op;
+
+			if (!ucl_query_parse_operand (qp, &expr->rhs)) {
+				ucl_query_expr_free (expr);
+				return NULL;
+			}
+
+			return expr;
+		}
+	}
+
+	if (expr->lhs.literal != NULL) {
+		ucl_query_set_err (qp, "comparison operator expected");
+		ucl_query_expr_free (expr);
+		return NULL;
+	}
+
+	return expr;
+}
+
+static struct ucl_query_expr *
+ucl_query_parse_binary (struct ucl_query_parser *qp, enum ucl_query_op op)
+{
+	struct ucl_query_expr *left, *right, *expr;
+	const char *opstr = op == UCL_QUERY_OP_OR ? "||" : "&&";
+
+	if (op == UCL_QUERY_OP_OR) {
+		left = ucl_query_parse_binary (qp, UCL_QUERY_OP_AND);
+	}
+	else {
+		left = ucl_query_parse_unary (qp);
+	}
+
+	if (left == NULL) {
+		return NULL;
+	}
+
+	for (;;) {
+		ucl_query_skip_spaces (qp);
+
+		if (qp->end - qp->p < 2 || memcmp (qp->p, opstr, 2) != 0) {
+			break;
+		}
+
+		qp->p += 2;
+
+		if (op == UCL_QUERY_OP_OR) {
+			right = ucl_query_parse_binary (qp, UCL_QUERY_OP_AND);
+		}
+		else {
+			right = ucl_query_parse_unary (qp);
+		}
+
+		if (right == NULL) {
+			ucl_query_expr_free (left);
+			return NULL;
+		}
+
+		expr = ucl_query_expr_new (qp, op);
+
+		if (expr == NULL) {
+			ucl_query_expr_free (left);
+			ucl_query_expr_free (right);
+			return NULL;
+		}
+
+		expr->left = left;
+		expr->right = right;
+		left = expr;
+	}
+
+	return left;
+}
+
+static struct ucl_query_expr *
+ucl_query_parse_or (struct ucl_query_parser *qp)
+{
+	return ucl_query_parse_binary (qp, UCL_QUERY_OP_OR);
+}
+
+static bool
+ucl_query_parse_bracket (struct ucl_query_parser *qp,
+		struct ucl_query_step *st)
+{
+	char *str;
+	size_t len;
+
+	/* Skip '[' */
+	qp->p ++;
+	ucl_query_skip_spaces (qp);
+
+	if (qp->p >= qp->end) {
+		ucl_query_set_err (qp, "unterminated selector");
+		return false;
+	}
+
+	if (*qp->p == '*') {
+		st->type = UCL_QUERY_STEP_WILDCARD;
+		qp->p ++;
+	}
+	else if (*qp->p == '\'' || *qp->p == '"') {
+		str = ucl_query_parse_quoted (qp, &len);
+
+		if (str == NULL) {
+			return false;
+		}
+
+		st->type = UCL_QUERY_STEP_MEMBER;
+		st->key.key = str;
+		st->key.keylen = len;
+		st->key.index = -1;
+		ucl_hash_key_hashes (str, len, &st->key.hv, &st->key.hv_caseless);
+	}
+	else if (*qp->p == '?') {
+		qp->p ++;
+		st->type = UCL_QUERY_STEP_FILTER;
+		st->filter = ucl_query_parse_or (qp);
+
+		if (st->filter == NULL) {
+			return false;
+		}
+	}
+	else {
+		/* Index or slice */
+		if (*qp->p != ':') {
+			if (!ucl_query_parse_int (qp, &st->start)) {
+				return false;
+			}
+			st->has_start = true;
+			ucl_query_skip_spaces (qp);
+		}
+
+		if (qp->p < qp->end && *qp->p == ':') {
+			st->type = UCL_QUERY_STEP_SLICE;
+			st->step = 1;
+			qp->p ++;
+			ucl_query_skip_spaces (qp);
+
+			if (qp->p < qp->end && *qp->p != ':' && *qp->p != ']') {
+				if (!ucl_query_parse_int (qp, &st->end)) {
+					return false;
+				}
+				st->has_end = true;
+				ucl_query_skip_spaces (qp);
+			}
+
+			if (qp->p < qp->end && *qp->p == ':') {
+				qp->p ++;
+				ucl_query_skip_spaces (qp);
+
+				if (qp->p < qp->end && *qp->p != ']') {
+					if (!ucl_query_parse_int (qp, &st->step)) {
+						return false;
+					}
+				}
+			}
+		}
+		else {
+			st->type = UCL_QUERY_STEP_INDEX;
+			st->index = st->start;
+		}
+	}
+
+	ucl_query_skip_spaces (qp);
+
+	if (qp->p >= qp->end || *qp->p != ']') {
+		ucl_query_set_err (qp, "']' expected");
+		return false;
+	}
+
+	qp->p ++;
+
+	return true;
+}
+
+static bool
+ucl_query_parse_jsonpath (struct ucl_query_parser *qp, struct ucl_query *q)
+{
+	struct ucl_query_step st;
+	const char *name;
+	size_t len;
+
+	/* Skip '$' */
+	qp->p ++;
+
+	while (qp->p < qp->end) {
+		memset (&st, 0, sizeof (st));
+
+		if (*qp->p == '.') {
+			qp->p ++;
+
+			if (qp->p < qp->end && *qp->p == '.') {
+				st.descendant = true;
+				qp->p ++;
+			}
+
+			if (qp->p < qp->end && *qp->p == '[' && st.descendant) {
+				if (!ucl_query_parse_bracket (qp, &st)) {
+					goto err;
+				}
+			}
+			else if (qp->p < qp->end && *qp->p == '*') {
+				st.type = UCL_QUERY_STEP_WILDCARD;
+				qp->p ++;
+			}
+			else {
+				name = ucl_query_parse_name (qp, &len, false);
+
+				if (name == NULL) {
+					goto err;
+				}
+
+				st.type = UCL_QUERY_STEP_MEMBER;
+
+				if (!ucl_query_key_init (&st.key, name, len)) {
+					ucl_query_set_err (qp, "cannot allocate memory");
+					goto err;
+				}
+			}
+		}
+		else if (*qp->p == '[') {
+			if (!ucl_query_parse_bracket (qp, &st)) {
+				goto err;
+			}
+		}
+		else {
+			ucl_query_set_err (qp, "'.' or '[' expected");
+			return false;
+		}
+
+		if (st.type != UCL_QUERY_STEP_MEMBER &&
+				st.type != UCL_QUERY_STEP_INDEX) {
+			q->singular = false;
+		}
+		if (st.descendant) {
+			q->singular = false;
+		}
+
+		kv_push_safe (struct ucl_query_step, q->steps, st, enomem);
+	}
+
+	return true;
+
+enomem:
+	ucl_query_set_err (qp, "cannot allocate memory");
+err:
+	ucl_query_key_free (&st.key);
+	ucl_query_expr_free (st.filter);
+
+	return false;
+}
+
+static bool
+ucl_query_parse_pointer (struct ucl_query_parser *qp, struct ucl_query *q)
+{
+	struct ucl_query_step st;
+	const char *c;
+	char *t;
+	size_t i;
+
+	while (qp->p < qp->end) {
+		/* Skip '/' */
+		qp->p ++;
+		c = qp->p;
+
+		while (qp->p < qp->end && *qp->p != '/') {
+			qp->p ++;
+		}
+
+		memset (&st, 0, sizeof (st));
+		st.type = UCL_QUERY_STEP_MEMBER;
+
+		if (!ucl_query_key_init (&st.key, c, qp->p - c)) {
+			ucl_query_set_err (qp, "cannot allocate memory");
+			return false;
+		}
+
+		/* Unescape ~0 and ~1 */
+		for (i = 0, t = st.key.key; i < st.key.keylen; i ++) {
+			if (st.key.key[i] == '~') {
+				if (i + 1 < st.key.keylen && st.key.key[i + 1] == '0') {
+					*t++ = '~';
+				}
+				else if (i + 1 < st.key.keylen && st.key.key[i + 1] == '1') {
+					*t++ = '/';
+				}
+				else {
+					qp->p = c + i;
+					ucl_query_set_err (qp, "invalid escape sequence");
+					ucl_query_key_free (&st.key);
+
+					return false;
+				}
+				i ++;
+			}
+			else {
+				*t++ = st.key.key[i];
+			}
+		}
+
+		if (t - st.key.key != (ptrdiff_t)st.key.keylen) {
+			*t = '\0';
+			st.key.keylen = t - st.key.key;
+			ucl_hash_key_hashes (st.key.key, st.key.keylen, &st.key.hv,
+					&st.key.hv_caseless);
+		}
+
+		/* Array indexes have no leading zeroes */
+		if (st.key.keylen > 0 && isdigit ((unsigned char)st.key.key[0]) &&
+				(st.key.key[0] != '0' || st.key.keylen == 1)) {
+			st.key.index = 0;
+
+			for (i = 0; i < st.key.keylen; i ++) {
+				if (!isdigit ((unsigned char)st.key.key[i]) ||
+						st.key.index > (INT64_MAX - 9) / 10) {
+					st.key.index = -1;
+					break;
+				}
+				st.key.index = st.key.index * 10 + (st.key.key[i] - '0');
+			}
+		}
+
+		kv_push_safe (struct ucl_query_step, q->steps, st, enomem);
+	}
+
+	return true;
+
+enomem:
+	ucl_query_key_free (&st.key);
+	ucl_query_set_err (qp, "cannot allocate memory");
+
+	return false;
+}
+
+struct ucl_query *
+ucl_query_compile (const char *query, struct ucl_query_error *err)
+{
+	struct ucl_query *q;
+	struct ucl_query_parser qp;
+	bool ret;
+
+	if (err != NULL) {
+		err->pos = 0;
+		err->msg[0] = '\0';
+	}
+
+	if (query == NULL) {
+		return NULL;
+	}
+
+	qp.start = query;
+	qp.p = query;
+	qp.end = query + strlen (query);
+	qp.err = err;
+
+	q = UCL_ALLOC (sizeof (*q));
+
+	if (q == NULL) {
+		ucl_query_set_err (&qp, "cannot allocate memory");
+		return NULL;
+	}
+
+	kv_init (q->steps);
+	q->singular = true;
+
+	if (*query == '$') {
+		ret = ucl_query_parse_jsonpath (&qp, q);
+	}
+	else if (*query == '/' || *query == '\0') {
+		ret = ucl_query_parse_pointer (&qp, q);
+	}
+	else {
+		ucl_query_set_err (&qp, "query must start with '$' or '/'");
+		ret = false;
+	}
+
+	if (!ret) {
+		ucl_query_free (q);
+		return NULL;
+	}
+
+	return q;
+}
+
+/*
+ * Helpers to access nodes as arrays: UCL arrays and implicit arrays
+ */
+static inline bool
+ucl_query_is_implicit (const ucl_object_t *node, bool expanded)
+{
+	return !expanded && node->next != NULL;
+}
+
+static size_t
+ucl_query_list_len (const ucl_object_t *node, bool expanded)
+{
+	const ucl_object_t *cur;
+	size_t len = 0;
+
+	if (ucl_query_is_implicit (node, expanded)) {
+		LL_FOREACH (node, cur) {
+			len ++;
+		}
+	}
+	else if (node->type == UCL_ARRAY) {
+		len = ucl_array_size (node);
+	}
+
+	return len;
+}
+
+static const ucl_object_t *
+ucl_query_list_at (const ucl_object_t *node, bool expanded, size_t idx,
+		bool *child_expanded)
+{
+	const ucl_object_t *cur;
+
+	if (ucl_query_is_implicit (node, expanded)) {
+		*child_expanded = true;
+
+		LL_FOREACH (node, cur) {
+			if (idx-- == 0) {
+				return cur;
+			}
+		}
+
+		return NULL;
+	}
+
+	*child_expanded = false;
+
+	if (node->type == UCL_ARRAY) {
+		return ucl_array_find_index (node, idx);
+	}
+
+	return NULL;
+}
+
+static bool
+ucl_query_is_list (const ucl_object_t *node, bool expanded)
+{
+	return ucl_query_is_implicit (node, expanded) || node->type == UCL_ARRAY;
+}
+
+static const ucl_object_t *
+ucl_query_member (const ucl_object_t *node, bool expanded,
+		const struct ucl_query_key *key, bool *child_expanded)
+{
+	*child_expanded = false;
+
+	if (ucl_query_is_implicit (node, expanded)) {
+		if (key->index >= 0) {
+			return ucl_query_list_at (node, expanded, key->index,
+					child_expanded);
+		}
+
+		return NULL;
+	}
+
+	if (node->type == UCL_OBJECT) {
+		return ucl_hash_search_hashed (node->value.ov, key->key, key->keylen,
+				key->hv, key->hv_caseless);
+	}
+	else if (node->type == UCL_ARRAY && key->index >= 0) {
+		return ucl_array_find_index (node, key->index);
+	}
+
+	return NULL;
+}
+
+static const ucl_object_t *
+ucl_query_index (const ucl_object_t *node, bool expanded, int64_t index,
+		bool *child_expanded)
+{
+	size_t len;
+
+	if (!ucl_query_is_list (node, expanded)) {
+		return NULL;
+	}
+
+	if (index < 0) {
+		len = ucl_query_list_len (node, expanded);
+
+		if ((uint64_t)-index > len) {
+			return NULL;
+		}
+
+		index += len;
+	}
+
+	return ucl_query_list_at (node, expanded, index, child_expanded);
+}
+
+/*
+ * Returns the next child of a node stored in a frame
+ */
+static const ucl_object_t *
+ucl_query_next_child (struct ucl_query_frame *fr, bool *child_expanded)
+{
+	const ucl_object_t *node = fr->node, *res = NULL;
+
+	*child_expanded = false;
+
+	if (ucl_query_is_implicit (node, fr->expanded)) {
+		if (fr->idx == 0) {
+			res = node;
+		}
+		else if (fr->cursor != NULL) {
+			res = ((const ucl_object_t *)fr->cursor)->next;
+		}
+
+		fr->idx ++;
+		fr->cursor = res;
+		*child_expanded = true;
+	}
+	else if (node->type == UCL_ARRAY) {
+		while (res == NULL && fr->idx < ucl_array_size (node)) {
+			res = ucl_array_find_index (node, fr->idx ++);
+		}
+	}
+	else if (node->type == UCL_OBJECT) {
+		res = ucl_hash_iterate_cursor (node->value.ov, &fr->cursor);
+	}
+
+	return res;
+}
+
+static const ucl_object_t *
+ucl_query_resolve_operand (const struct ucl_query_operand *op,
+		const ucl_object_t *node, bool expanded)
+{
+	unsigned i;
+	const struct ucl_query_rel *rel;
+
+	if (op->literal != NULL) {
+		return op->literal;
+	}
+
+	for (i = 0; i < op->npath && node != NULL; i ++) {
+		rel = &op->path[i];
+
+		if (rel->is_index) {
+			node = ucl_query_index (node, expanded, rel->index, &expanded);
+		}
+		else {
+			node = ucl_query_member (node, expanded, &rel->key, &expanded);
+		}
+	}
+
+	return node;
+}
+
+static bool
+ucl_query_is_number (const ucl_object_t *obj)
+{
+	return obj->type == UCL_INT || obj->type == UCL_FLOAT ||
+			obj->type == UCL_TIME;
+}
+
+static bool
+ucl_query_compare (const ucl_object_t *o1, const ucl_object_t *o2,
+		enum ucl_query_op op)
+{
+	int cmp;
+	size_t minlen;
+	double d1, d2;
+
+	if (o1 == NULL || o2 == NULL) {
+		/* Missing values are only equal to each other */
+		switch (op) {
+		case UCL_QUERY_OP_EQ:
+		case UCL_QUERY_OP_LE:
+		case UCL_QUERY_OP_GE:
+			return o1 == o2;
+		case UCL_QUERY_OP_NE:
+			return o1 != o2;
+		default:
+			return false;
+		}
+	}
+
+	if (ucl_query_is_number (o1) && ucl_query_is_number (o2)) {
+		if (o1->type == UCL_INT && o2->type == UCL_INT) {
+			cmp = o1->value.iv < o2->value.iv ? -1 :
+					(o1->value.iv > o2->value.iv ? 1 : 0);
+		}
+		else {
+			d1 = ucl_object_todouble (o1);
+			d2 = ucl_object_todouble (o2);
+			cmp = d1 < d2 ? -1 : (d1 > d2 ? 1 : 0);
+		}
+	}
+	else if (o1->type == UCL_STRING && o2->type == UCL_STRING) {
+		minlen = o1->len < o2->len ? o1->len : o2->len;
+		cmp = memcmp (o1->value.sv, o2->value.sv, minlen);
+
+		if (cmp == 0) {
+			cmp = o1->len < o2->len ? -1 : (o1->len > o2->len ? 1 : 0);
+		}
+	}
+	else if (o1->type == o2->type) {
+		/* Booleans, nulls and containers can only be checked for equality */
+		switch (op) {
+		case UCL_QUERY_OP_EQ:
+		case UCL_QUERY_OP_LE:
+		case UCL_QUERY_OP_GE:
+			return ucl_object_compare (o1, o2) == 0;
+		case UCL_QUERY_OP_NE:
+			return ucl_object_compare (o1, o2) != 0;
+		default:
+			return false;
+		}
+	}
+	else {
+		return op == UCL_QUERY_OP_NE;
+	}
+
+	switch (op) {
+	case UCL_QUERY_OP_EQ:
+		return cmp == 0;
+	case UCL_QUERY_OP_NE:
+		return cmp != 0;
+	case UCL_QUERY_OP_LT:
+		return cmp < 0;
+	case UCL_QUERY_OP_LE:
+		return cmp <= 0;
+	case UCL_QUERY_OP_GT:
+		return cmp > 0;
+	case UCL_QUERY_OP_GE:
+		return cmp >= 0;
+	default:
+		break;
+	}
+
+	return false;
+}
+
+static bool
+ucl_query_eval (const struct ucl_query_expr *expr, const ucl_object_t *node,
+		bool expanded)
+{
+	switch (expr->op) {
+	case UCL_QUERY_OP_AND:
+		return ucl_query_eval (expr->left, node, expanded) &&
+				ucl_query_eval (expr->right, node, expanded);
+	case UCL_QUERY_OP_OR:
+		return ucl_query_eval (expr->left, node, expanded) ||
+				ucl_query_eval (expr->right, node, expanded);
+	case UCL_QUERY_OP_NOT:
+		return !ucl_query_eval (expr->left, node, expanded);
+	case UCL_QUERY_OP_EXISTS:
+		return ucl_query_resolve_operand (&expr->lhs, node, expanded) != NULL;
+	default:
+		break;
+	}
+
+	return ucl_query_compare (
+			ucl_query_resolve_operand (&expr->lhs, node, expanded),
+			ucl_query_resolve_operand (&expr->rhs, node, expanded),
+			expr->op);
+}
+
+/*
+ * Normalize slice bounds as defined in RFC 9535
+ */
+static void
+ucl_query_slice_bounds (const struct ucl_query_step *st, size_t len,
+		int64_t *lower, int64_t *upper)
+{
+	int64_t start, end, n = len;
+
+	if (st->step >= 0) {
+		start = st->has_start ? st->start : 0;
+		end = st->has_end ? st->end : n;
+	}
+	else {
+		start = st->has_start ? st->start : n - 1;
+		end = st->has_end ? st->end : -n - 1;
+	}
+
+	if (start < 0) {
+		start += n;
+	}
+	if (end < 0) {
+		end += n;
+	}
+
+	if (st->step >= 0) {
+		*lower = start < 0 ? 0 : (start > n ? n : start);
+		*upper = end < 0 ? 0 : (end > n ? n : end);
+	}
+	else {
+		*upper = start < -1 ? -1 : (start > n - 1 ? n - 1 : start);
+		*lower = end < -1 ? -1 : (end > n - 1 ? n - 1 : end);
+	}
+}
+
+/*
+ * Returns the next candidate selected by a step applied to a frame's node
+ */
+static const ucl_object_t *
+ucl_query_step_next (const struct ucl_query_step *st,
+		struct ucl_query_frame *fr, bool *child_expanded)
+{
+	const ucl_object_t *res = NULL;
+	int64_t lower, upper;
+	size_t len;
+
+	*child_expanded = false;
+
+	switch (st->type) {
+	case UCL_QUERY_STEP_MEMBER:
+		if (!fr->started) {
+			fr->started = true;
+			res = ucl_query_member (fr->node, fr->expanded, &st->key,
+					child_expanded);
+		}
+		break;
+	case UCL_QUERY_STEP_INDEX:
+		if (!fr->started) {
+			fr->started = true;
+			res = ucl_query_index (fr->node, fr->expanded, st->index,
+					child_expanded);
+		}
+		break;
+	case UCL_QUERY_STEP_WILDCARD:
+		res = ucl_query_next_child (fr, child_expanded);
+		break;
+	case UCL_QUERY_STEP_FILTER:
+		while ((res = ucl_query_next_child (fr, child_expanded)) != NULL) {
+			if (ucl_query_eval (st->filter, res, *child_expanded)) {
+				break;
+			}
+		}
+		break;
+	case UCL_QUERY_STEP_SLICE:
+		if (st->step == 0 || !ucl_query_is_list (fr->node, fr->expanded)) {
+			break;
+		}
+
+		len = ucl_query_list_len (fr->node, fr->expanded);
+		ucl_query_slice_bounds (st, len, &lower, &upper);
+
+		if (!fr->started) {
+			fr->started = true;
+			fr->pos = st->step > 0 ? lower : upper;
+		}
+
+		while (res == NULL) {
+			if (st->step > 0 ? fr->pos >= upper : fr->pos <= lower) {
+				break;
+			}
+
+			res = ucl_query_list_at (fr->node, fr->expanded, fr->pos,
+					child_expanded);
+			fr->pos += st->step;
+		}
+		break;
+	}
+
+	return res;
+}
+
+static bool
+ucl_query_push_frame (struct ucl_query_iter *it, const ucl_object_t *node,
+		bool expanded, unsigned step)
+{
+	struct ucl_query_frame fr;
+
+	memset (&fr, 0, sizeof (fr));
+	fr.node = node;
+	fr.expanded = expanded;
+	fr.step = step;
+
+	if (step < kv_size (it->query->steps) &&
+			kv_A (it->query->steps, step).descendant) {
+		fr.kind = UCL_QUERY_FRAME_DESCEND;
+	}
+	else {
+		fr.kind = UCL_QUERY_FRAME_APPLY;
+	}
+
+	kv_push_safe (struct ucl_query_frame, it->stack, fr, e0);
+
+	return true;
+e0:
+	return false;
+}
+
+struct ucl_query_iter *
+ucl_query_iterate_new (const struct ucl_query *query, const ucl_object_t *top)
+{
+	struct ucl_query_iter *it;
+
+	if (query == NULL) {
+		return NULL;
+	}
+
+	it = UCL_ALLOC (sizeof (*it));
+
+	if (it != NULL) {
+		it->query = query;
+		kv_init (it->stack);
+		ucl_query_iterate_reset (it, top);
+	}
+
+	return it;
+}
+
+void
+ucl_query_iterate_reset (struct ucl_query_iter *it, const ucl_object_t *top)
+{
+	if (it == NULL) {
+		return;
+	}
+
+	it->top = top;
+	kv_size (it->stack) = 0;
+
+	if (top != NULL) {
+		ucl_query_push_frame (it, top, false, 0);
+	}
+}
+
+const ucl_object_t *
+ucl_query_iterate_next (struct ucl_query_iter *it)
+{
+	struct ucl_query_frame *fr;
+	const struct ucl_query_step *st;
+	const ucl_object_t *res;
+	unsigned nsteps;
+	bool expanded;
+
+	if (it == NULL) {
+		return NULL;
+	}
+
+	nsteps = kv_size (it->query->steps);
+
+	while (kv_size (it->stack) > 0) {
+		fr = &kv_A (it->stack, kv_size (it->stack) - 1);
+
+		if (fr->step >= nsteps) {
+			/* All steps are applied */
+			res = fr->node;
+			kv_size (it->stack) --;
+
+			return res;
+		}
+
+		st = &kv_A (it->query->steps, fr->step);
+
+		if (fr->kind == UCL_QUERY_FRAME_DESCEND) {
+			/* Apply selector to the node itself first and then to children */
+			if (!fr->started) {
+				fr->started = true;
+
+				if (!ucl_query_push_frame (it, fr->node, fr->expanded,
+						fr->step)) {
+					return NULL;
+				}
+
+				kv_A (it->stack, kv_size (it->stack) - 1).kind =
+						UCL_QUERY_FRAME_APPLY;
+				continue;
+			}
+
+			res = ucl_query_next_child (fr, &expanded);
+
+			if (res == NULL) {
+				kv_size (it->stack) --;
+			}
+			else if (!ucl_query_push_frame (it, res, expanded, fr->step)) {
+				return NULL;
+			}
+
+			continue;
+		}
+
+		res = ucl_query_step_next (st, fr, &expanded);
+
+		if (res == NULL) {
+			kv_size (it->stack) --;
+			continue;
+		}
+
+		if (!ucl_query_push_frame (it, res, expanded, fr->step + 1)) {
+			return NULL;
+		}
+	}
+
+	return NULL;
+}
+
+void
+ucl_query_iterate_free (struct ucl_query_iter *it)
+{
+	if (it != NULL) {
+		kv_destroy (it->stack);
+		UCL_FREE (sizeof (*it), it);
+	}
+}
+
+const ucl_object_t *
+ucl_query_first (const struct ucl_query *query, const ucl_object_t *top)
+{
+	struct ucl_query_iter *it;
+	const struct ucl_query_step *st;
+	const ucl_object_t *res = top;
+	bool expanded = false;
+	unsigned i;
+
+	if (query == NULL || top == NULL) {
+		return NULL;
+	}
+
+	if (query->singular) {
+		/* No need to have an iterator for pointers and simple paths */
+		for (i = 0; i < kv_size (query->steps) && res != NULL; i ++) {
+			st = &kv_A (query->steps, i);
+
+			if (st->type == UCL_QUERY_STEP_MEMBER) {
+				res = ucl_query_member (res, expanded, &st->key, &expanded);
+			}
+			else {
+				res = ucl_query_index (res, expanded, st->index, &expanded);
+			}
+		}
+
+		return res;
+	}
+
+	it = ucl_query_iterate_new (query, top);
+
+	if (it == NULL) {
+		return NULL;
+	}
+
+	res = ucl_query_iterate_next (it);
+	ucl_query_iterate_free (it);
+
+	return res;
+}
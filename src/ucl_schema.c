@@ -428,6 +428,7 @@ ucl_schema_validate_string (const ucl_object_t *schema,
 
 struct ucl_compare_node {
 	const ucl_object_t *obj;
+	struct ucl_fingerprint fp;
 	TREE_ENTRY(ucl_compare_node) link;
 	struct ucl_compare_node *next;
 };
@@ -439,9 +440,18 @@ TREE_DEFINE(ucl_compare_node, link)
 static int
 ucl_schema_elt_compare (struct ucl_compare_node *n1, struct ucl_compare_node *n2)
 {
-	const ucl_object_t *o1 = n1->obj, *o2 = n2->obj;
+	/*
+	 * Elements are ordered by their fingerprints to avoid deep comparisons,
+	 * equal fingerprints are confirmed by comparing elements themselves
+	 */
+	if (n1->fp.h1 != n2->fp.h1) {
+		return n1->fp.h1 < n2->fp.h1 ? -1 : 1;
+	}
+	if (n1->fp.h2 != n2->fp.h2) {
+		return n1->fp.h2 < n2->fp.h2 ? -1 : 1;
+	}
 
-	return ucl_object_compare (o1, o2);
+	return ucl_object_compare (n1->obj, n2->obj);
 }
 
 static bool
@@ -455,6 +465,7 @@ ucl_schema_array_is_unique (const ucl_object_t *obj, struct ucl_schema_error *er
 
 	while ((elt = ucl_object_iterate (obj, &iter, true)) != NULL) {
 		test.obj = elt;
+		ucl_object_fingerprint (elt, &test.fp);
 		node = TREE_FIND (&tree, ucl_compare_node, link, &test);
 		if (node != NULL) {
 			ucl_schema_create_error (err, UCL_SCHEMA_CONSTRAINT, elt,
@@ -462,7 +473,7 @@ ucl_schema_array_is_unique (const ucl_object_t *obj, struct ucl_schema_error *er
 			ret = false;
 			break;
 		}
-		node = calloc (1, sizeof (*node));
+		node = ucl_calloc (1, sizeof (*node));
 		if (node == NULL) {
 			ucl_schema_create_error (err, UCL_SCHEMA_UNKNOWN, elt,
 					"cannot allocate tree node");
@@ -470,12 +481,13 @@ ucl_schema_array_is_unique (const ucl_object_t *obj, struct ucl_schema_error *er
 			break;
 		}
 		node->obj = elt;
+		node->fp = test.fp;
 		TREE_INSERT (&tree, ucl_compare_node, link, node);
 		LL_PREPEND (nodes, node);
 	}
 
 	LL_FOREACH_SAFE (nodes, node, tmp) {
-		free (node);
+		ucl_free (node);
 	}
 
 	return ret;
@@ -756,7 +768,7 @@ ucl_schema_resolve_ref (const ucl_object_t *root, const char *ref,
 		hash_ptr = strrchr (ref, '#');
 
 		if (hash_ptr) {
-			url_copy = malloc (hash_ptr - ref + 1);
+			url_copy = UCL_ALLOC (hash_ptr - ref + 1);
 
 			if (url_copy == NULL) {
 				ucl_schema_create_error (err, UCL_SCHEMA_INTERNAL_ERROR, root,
@@ -785,7 +797,7 @@ ucl_schema_resolve_ref (const ucl_object_t *root, const char *ref,
 							p,
 							url_err != NULL ? utstring_body (url_err)
 											: "unknown");
-					free (url_copy);
+					ucl_free (url_copy);
 
 					return NULL;
 				}
@@ -800,7 +812,7 @@ ucl_schema_resolve_ref (const ucl_object_t *root, const char *ref,
 							p,
 							url_err != NULL ? utstring_body (url_err)
 											: "unknown");
-					free (url_copy);
+					ucl_free (url_copy);
 
 					return NULL;
 				}
@@ -813,7 +825,7 @@ ucl_schema_resolve_ref (const ucl_object_t *root, const char *ref,
 						"cannot fetch reference %s: %s", p,
 						ucl_parser_get_error (parser));
 				ucl_parser_free (parser);
-				free (url_copy);
+				ucl_free (url_copy);
 
 				return NULL;
 			}
@@ -821,10 +833,10 @@ ucl_schema_resolve_ref (const ucl_object_t *root, const char *ref,
 			url_obj = ucl_parser_get_object (parser);
 			ext_obj = url_obj;
 			ucl_object_insert_key (ext_ref, url_obj, p, 0, true);
-			free (url_buf);
+			ucl_free (url_buf);
 		}
 
-		free (url_copy);
+		ucl_free (url_copy);
 
 		if (hash_ptr) {
 			p = hash_ptr + 1;
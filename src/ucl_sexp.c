@@ -95,7 +95,7 @@ ucl_parse_csexp (struct ucl_parser *parser)
 			break;
 
 		case read_obrace:
-			st = calloc (1, sizeof (*st));
+			st = ucl_calloc (1, sizeof (*st));
 
 			if (st == NULL) {
 				ucl_create_err (&parser->err, "no memory");
@@ -108,7 +108,7 @@ ucl_parse_csexp (struct ucl_parser *parser)
 			if (st->obj == NULL) {
 				ucl_create_err (&parser->err, "no memory");
 				state = parse_err;
-				free (st);
+				ucl_free (st);
 				continue;
 			}
 
@@ -205,7 +205,7 @@ ucl_parse_csexp (struct ucl_parser *parser)
 				continue;
 			}
 
-			free (st);
+			ucl_free (st);
 			st = NULL;
 			p++;
 			NEXT_STATE;
@@ -26,10 +26,22 @@
 #include "ucl_internal.h"
 #include "ucl_chartable.h"
 #include "kvec.h"
+#include "khash.h"
+#include "mum.h"
 #include <limits.h>
 #include <stdarg.h>
 #include <stdio.h> /* for snprintf */
 
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+
 #ifndef _WIN32
 #include <glob.h>
 #include <sys/param.h>
@@ -45,11 +57,6 @@
 #endif
 #endif
 
-typedef kvec_t(ucl_object_t *) ucl_array_t;
-
-#define UCL_ARRAY_GET(ar, obj) ucl_array_t *ar = \
-	(ucl_array_t *)((obj) != NULL ? (obj)->value.av : NULL)
-
 #ifdef HAVE_OPENSSL
 #include <openssl/err.h>
 #include <openssl/sha.h>
@@ -188,114 +195,385 @@ char *basename(char *path)
 #define ucl_realpath realpath
 #endif
 
-typedef void (*ucl_object_dtor) (ucl_object_t *obj);
-static void ucl_object_free_internal (ucl_object_t *obj, bool allow_rec,
-		ucl_object_dtor dtor);
-static void ucl_object_dtor_unref (ucl_object_t *obj);
+static void *
+ucl_default_malloc (size_t size, void *ud)
+{
+	return malloc (size);
+}
+
+static void *
+ucl_default_realloc (void *ptr, size_t size, void *ud)
+{
+	return realloc (ptr, size);
+}
+
+static void
+ucl_default_free (void *ptr, size_t size, void *ud)
+{
+	free (ptr);
+}
+
+static struct ucl_allocator ucl_global_allocator = {
+	.malloc_fn = ucl_default_malloc,
+	.realloc_fn = ucl_default_realloc,
+	.free_fn = ucl_default_free,
+	.ud = NULL
+};
+static UCL_THREAD_LOCAL const struct ucl_allocator *ucl_thread_allocator = NULL;
+
+#define UCL_CUR_ALLOCATOR (ucl_thread_allocator != NULL ? \
+	ucl_thread_allocator : &ucl_global_allocator)
+
+bool
+ucl_set_allocator (const struct ucl_allocator *allocator)
+{
+	if (allocator == NULL) {
+		ucl_global_allocator.malloc_fn = ucl_default_malloc;
+		ucl_global_allocator.realloc_fn = ucl_default_realloc;
+		ucl_global_allocator.free_fn = ucl_default_free;
+		ucl_global_allocator.ud = NULL;
+
+		return true;
+	}
+
+	if (allocator->malloc_fn == NULL || allocator->realloc_fn == NULL ||
+			allocator->free_fn == NULL) {
+		return false;
+	}
+
+	memcpy (&ucl_global_allocator, allocator, sizeof (*allocator));
+
+	return true;
+}
+
+const struct ucl_allocator *
+ucl_set_thread_allocator (const struct ucl_allocator *allocator)
+{
+	const struct ucl_allocator *prev = ucl_thread_allocator;
+
+	ucl_thread_allocator = allocator;
+
+	return prev;
+}
+
+void *
+ucl_malloc (size_t size)
+{
+	const struct ucl_allocator *a = UCL_CUR_ALLOCATOR;
+
+	return a->malloc_fn (size, a->ud);
+}
+
+void *
+ucl_realloc (void *ptr, size_t size)
+{
+	const struct ucl_allocator *a = UCL_CUR_ALLOCATOR;
+
+	return a->realloc_fn (ptr, size, a->ud);
+}
+
+void
+ucl_free_sized (void *ptr, size_t size)
+{
+	const struct ucl_allocator *a = UCL_CUR_ALLOCATOR;
+
+	if (ptr != NULL) {
+		a->free_fn (ptr, size, a->ud);
+	}
+}
+
+void
+ucl_free (void *ptr)
+{
+	ucl_free_sized (ptr, 0);
+}
+
+void *
+ucl_calloc (size_t nmemb, size_t size)
+{
+	void *ptr;
+
+	if (size != 0 && nmemb > SIZE_MAX / size) {
+		return NULL;
+	}
+
+	ptr = ucl_malloc (nmemb * size);
+
+	if (ptr != NULL) {
+		memset (ptr, 0, nmemb * size);
+	}
+
+	return ptr;
+}
+
+char *
+ucl_strdup (const char *s)
+{
+	size_t len = strlen (s) + 1;
+	char *ret;
+
+	ret = ucl_malloc (len);
+
+	if (ret != NULL) {
+		memcpy (ret, s, len);
+	}
+
+	return ret;
+}
+
+const struct ucl_allocator *
+ucl_allocator_current (void)
+{
+	return ucl_thread_allocator;
+}
+
+const struct ucl_allocator *
+ucl_allocator_enter (const struct ucl_allocator *allocator)
+{
+	const struct ucl_allocator *prev = ucl_thread_allocator;
+
+	ucl_thread_allocator = allocator;
+
+	return prev;
+}
+
+void
+ucl_allocator_leave (const struct ucl_allocator *prev)
+{
+	ucl_thread_allocator = prev;
+}
+
+const struct ucl_allocator *
+ucl_parser_allocator_enter (struct ucl_parser *parser)
+{
+	if (parser == NULL || parser->allocator == NULL) {
+		return NULL;
+	}
+
+	return ucl_allocator_enter (parser->allocator);
+}
+
+void
+ucl_parser_allocator_leave (struct ucl_parser *parser,
+		const struct ucl_allocator *prev)
+{
+	if (parser != NULL && parser->allocator != NULL) {
+		ucl_allocator_leave (prev);
+	}
+}
+
+/*
+ * Nodes created with a thread allocator are preceded by a header recording
+ * it, so they are freed with that allocator whatever is current then
+ */
+struct ucl_object_header {
+	const struct ucl_allocator *allocator;
+	union {
+		ucl_object_t obj;
+		struct ucl_object_userdata ud;
+	} u;
+};
+
+#define UCL_OBJECT_HEADER(obj) ((struct ucl_object_header *) \
+	((unsigned char *)(obj) - offsetof (struct ucl_object_header, u)))
+#define UCL_OBJECT_NODE_SIZE(obj) ((obj)->type == UCL_USERDATA ? \
+	sizeof (struct ucl_object_userdata) : sizeof (ucl_object_t))
+
+const struct ucl_allocator *
+ucl_object_allocator (const ucl_object_t *obj)
+{
+	if (obj == NULL || !(obj->flags & UCL_OBJECT_OWN_ALLOCATOR)) {
+		return NULL;
+	}
+
+	return UCL_OBJECT_HEADER (obj)->allocator;
+}
+
+/*
+ * Allocates a zeroed node of `size` bytes with the current allocator
+ */
+static ucl_object_t *
+ucl_object_node_alloc (size_t size)
+{
+	struct ucl_object_header *hdr;
+	ucl_object_t *obj;
+
+	if (ucl_thread_allocator == NULL) {
+		obj = UCL_ALLOC (size);
+
+		if (obj != NULL) {
+			memset (obj, 0, size);
+		}
+
+		return obj;
+	}
+
+	hdr = UCL_ALLOC (offsetof (struct ucl_object_header, u) + size);
+
+	if (hdr == NULL) {
+		return NULL;
+	}
+
+	memset (hdr, 0, offsetof (struct ucl_object_header, u) + size);
+	hdr->allocator = ucl_thread_allocator;
+	hdr->u.obj.flags = UCL_OBJECT_OWN_ALLOCATOR;
+
+	return &hdr->u.obj;
+}
+
+static void
+ucl_object_node_free (ucl_object_t *obj)
+{
+	size_t size = UCL_OBJECT_NODE_SIZE (obj);
+
+	if (obj->flags & UCL_OBJECT_OWN_ALLOCATOR) {
+		UCL_FREE (offsetof (struct ucl_object_header, u) + size,
+				UCL_OBJECT_HEADER (obj));
+	}
+	else {
+		UCL_FREE (size, obj);
+	}
+}
 
+/* Must be called with the allocator of `obj` current */
 static void
 ucl_object_dtor_free (ucl_object_t *obj)
 {
 	if (obj->trash_stack[UCL_TRASH_KEY] != NULL) {
-		UCL_FREE (obj->hh.keylen, obj->trash_stack[UCL_TRASH_KEY]);
+		ucl_free (obj->trash_stack[UCL_TRASH_KEY]);
 	}
 	if (obj->trash_stack[UCL_TRASH_VALUE] != NULL) {
-		UCL_FREE (obj->len, obj->trash_stack[UCL_TRASH_VALUE]);
+		ucl_free (obj->trash_stack[UCL_TRASH_VALUE]);
 	}
 	/* Do not free ephemeral objects */
 	if ((obj->flags & UCL_OBJECT_EPHEMERAL) == 0) {
-		if (obj->type != UCL_USERDATA) {
-			UCL_FREE (sizeof (ucl_object_t), obj);
-		}
-		else {
+		if (obj->type == UCL_USERDATA) {
 			struct ucl_object_userdata *ud = (struct ucl_object_userdata *)obj;
 			if (ud->dtor) {
 				ud->dtor (obj->value.ud);
 			}
-			UCL_FREE (sizeof (*ud), obj);
 		}
+
+		ucl_object_node_free (obj);
 	}
 }
 
 /*
- * This is a helper function that performs exactly the same as
- * `ucl_object_unref` but it doesn't iterate over elements allowing
- * to use it for individual elements of arrays and multiple values
+ * Trees are destroyed iteratively: dead nodes are linked into an intrusive
+ * stack via their `prev` pointers, which are never used after a node dies
+ * (chains are walked via `next`), so teardown needs neither memory nor
+ * native stack proportional to the depth of a tree
+ */
+static inline void
+ucl_object_dead_push (ucl_object_t **stack, ucl_object_t *obj)
+{
+	obj->prev = *stack;
+	*stack = obj;
+}
+
+/*
+ * Releases all elements of a chain owned by a dead node, elements that are
+ * dead now are pushed to the stack; if `unref` is false then all elements
+ * are freed regardless of their refcount
  */
 static void
-ucl_object_dtor_unref_single (ucl_object_t *obj)
+ucl_object_release_chain (ucl_object_t **stack, ucl_object_t *obj, bool unref)
 {
-	if (obj != NULL) {
+	ucl_object_t *next;
+
+	while (obj != NULL) {
+		next = obj->next;
+
+		if (!unref || obj->ref == 0) {
+			ucl_object_dead_push (stack, obj);
+		}
+		else {
+			/*
+			 * Frozen nodes keep their refcounts, so a frozen subtree is
+			 * released with the mutable container holding it
+			 */
 #ifdef HAVE_ATOMIC_BUILTINS
-		unsigned int rc = __sync_sub_and_fetch (&obj->ref, 1);
-		if (rc == 0) {
+			if (__sync_sub_and_fetch (&obj->ref, 1) == 0) {
 #else
-		if (--obj->ref == 0) {
+			if (--obj->ref == 0) {
 #endif
-			ucl_object_free_internal (obj, false, ucl_object_dtor_unref);
+				ucl_object_dead_push (stack, obj);
+			}
 		}
+
+		obj = next;
 	}
 }
 
+/*
+ * Destroys a dead node `obj` with all children (and its siblings if
+ * `allow_rec` is true)
+ */
 static void
-ucl_object_dtor_unref (ucl_object_t *obj)
+ucl_object_free_internal (ucl_object_t *obj, bool allow_rec, bool unref)
 {
-	if (obj->ref == 0) {
-		ucl_object_dtor_free (obj);
+	ucl_object_t *stack = NULL, *cur, *sub;
+	const struct ucl_allocator *prev;
+	const void *cursor;
+	unsigned int i;
+
+	if (obj == NULL) {
+		return;
 	}
-	else {
-		/* This may cause dtor unref being called one more time */
-		ucl_object_dtor_unref_single (obj);
+
+	if (allow_rec) {
+		ucl_object_release_chain (&stack, obj->next, unref);
 	}
-}
 
-static void
-ucl_object_free_internal (ucl_object_t *obj, bool allow_rec, ucl_object_dtor dtor)
-{
-	ucl_object_t *tmp, *sub;
+	ucl_object_dead_push (&stack, obj);
 
-	while (obj != NULL) {
-		if (obj->type == UCL_ARRAY) {
-			UCL_ARRAY_GET (vec, obj);
-			unsigned int i;
+	while (stack != NULL) {
+		cur = stack;
+		stack = cur->prev;
+
+		if (cur->type == UCL_ARRAY) {
+			UCL_ARRAY_GET (vec, cur);
 
 			if (vec != NULL) {
-				for (i = 0; i < vec->n; i ++) {
-					sub = kv_A (*vec, i);
-					if (sub != NULL) {
-						tmp = sub;
-						while (sub) {
-							tmp = sub->next;
-							dtor (sub);
-							sub = tmp;
-						}
+				/* Views of packed elements are ephemeral and are not released */
+				if (!UCL_ARRAY_IS_PACKED (vec)) {
+					for (i = 0; i < vec->n; i ++) {
+						ucl_object_release_chain (&stack, UCL_ARRAY_A (vec, i),
+								unref);
 					}
 				}
+				prev = ucl_allocator_enter (UCL_ARRAY_ALLOCATOR (vec));
+				ucl_array_ext_free (vec);
 				kv_destroy (*vec);
 				UCL_FREE (sizeof (*vec), vec);
+				ucl_allocator_leave (prev);
 			}
-			obj->value.av = NULL;
+			cur->value.av = NULL;
 		}
-		else if (obj->type == UCL_OBJECT) {
-			if (obj->value.ov != NULL) {
-				ucl_hash_destroy (obj->value.ov, (ucl_hash_free_func)dtor);
+		else if (cur->type == UCL_OBJECT) {
+			if (cur->value.ov != NULL) {
+				cursor = NULL;
+
+				while ((sub = (ucl_object_t *)ucl_hash_iterate_cursor (
+						cur->value.ov, &cursor)) != NULL) {
+					ucl_object_release_chain (&stack, sub, unref);
+				}
+
+				ucl_hash_destroy (cur->value.ov, NULL);
 			}
-			obj->value.ov = NULL;
+			cur->value.ov = NULL;
 		}
-		tmp = obj->next;
-		dtor (obj);
-		obj = tmp;
 
-		if (!allow_rec) {
-			break;
-		}
+		prev = ucl_object_allocator_enter (cur);
+		ucl_object_dtor_free (cur);
+		ucl_allocator_leave (prev);
 	}
 }
 
 void
 ucl_object_free (ucl_object_t *obj)
 {
-	ucl_object_free_internal (obj, true, ucl_object_dtor_free);
+	ucl_object_free_internal (obj, true, false);
 }
 
 size_t
@@ -494,17 +772,53 @@ ucl_unescape_squoted_string (char *str, size_t len)
 	return (t - str);
 }
 
-char *
-ucl_copy_key_trash (const ucl_object_t *obj)
+/*
+ * Frozen trees are read concurrently, so lazy copies of their keys and values
+ * are published atomically to the trash stack on the first read; keys, values
+ * and flags are updated when a tree is thawed
+ */
+static unsigned char *
+ucl_trash_publish (const ucl_object_t *obj, int idx, unsigned char *copy,
+		size_t len)
+{
+	ucl_object_t *deconst = __DECONST (ucl_object_t *, obj);
+
+	if (copy != NULL) {
+#ifdef HAVE_ATOMIC_BUILTINS
+		if (!__sync_bool_compare_and_swap (&deconst->trash_stack[idx], NULL,
+				copy)) {
+			/* Another thread has published its copy first */
+			UCL_FREE (len, copy);
+		}
+#else
+		deconst->trash_stack[idx] = copy;
+#endif
+	}
+
+	return obj->trash_stack[idx];
+}
+
+static char *
+ucl_copy_key_trash_internal (const ucl_object_t *obj)
 {
 	ucl_object_t *deconst;
+	unsigned char *copy;
 
-	if (obj == NULL) {
-		return NULL;
+	if (obj->trash_stack[UCL_TRASH_KEY] == NULL && obj->key != NULL &&
+			(obj->flags & UCL_OBJECT_FROZEN)) {
+		copy = UCL_ALLOC (obj->keylen + 1);
+
+		if (copy != NULL) {
+			memcpy (copy, obj->key, obj->keylen);
+			copy[obj->keylen] = '\0';
+		}
+
+		return (char *)ucl_trash_publish (obj, UCL_TRASH_KEY, copy,
+				obj->keylen + 1);
 	}
 	if (obj->trash_stack[UCL_TRASH_KEY] == NULL && obj->key != NULL) {
 		deconst = __DECONST (ucl_object_t *, obj);
-		deconst->trash_stack[UCL_TRASH_KEY] = malloc (obj->keylen + 1);
+		deconst->trash_stack[UCL_TRASH_KEY] = UCL_ALLOC (obj->keylen + 1);
 		if (deconst->trash_stack[UCL_TRASH_KEY] != NULL) {
 			memcpy (deconst->trash_stack[UCL_TRASH_KEY], obj->key, obj->keylen);
 			deconst->trash_stack[UCL_TRASH_KEY][obj->keylen] = '\0';
@@ -516,6 +830,24 @@ ucl_copy_key_trash (const ucl_object_t *obj)
 	return obj->trash_stack[UCL_TRASH_KEY];
 }
 
+/* Copies are released with the node, so they use its allocator */
+char *
+ucl_copy_key_trash (const ucl_object_t *obj)
+{
+	const struct ucl_allocator *prev;
+	char *ret;
+
+	if (obj == NULL) {
+		return NULL;
+	}
+
+	prev = ucl_object_allocator_enter (obj);
+	ret = ucl_copy_key_trash_internal (obj);
+	ucl_allocator_leave (prev);
+
+	return ret;
+}
+
 void
 ucl_chunk_free (struct ucl_chunk *chunk)
 {
@@ -537,29 +869,107 @@ ucl_chunk_free (struct ucl_chunk *chunk)
 
 		chunk->special_handlers = NULL;
 
+		if (chunk->stream) {
+			ucl_decompress_stream_free (chunk->stream);
+		}
+
 		if (chunk->fname) {
-			free (chunk->fname);
+			ucl_free (chunk->fname);
 		}
 
 		UCL_FREE (sizeof (*chunk), chunk);
 	}
 }
 
-char *
-ucl_copy_value_trash (const ucl_object_t *obj)
+/*
+ * String value of an object that must not be written: string and numeric
+ * values of frozen objects are published to the trash stack, numeric views
+ * of packed arrays use a thread local buffer valid until the next call
+ */
+static char *
+ucl_readonly_value_string (const ucl_object_t *obj)
 {
-	ucl_object_t *deconst;
+	static UCL_THREAD_LOCAL char numbuf[64];
+	unsigned char *emitted, *copy = NULL;
+	size_t len = 0;
 
-	if (obj == NULL) {
+	if (obj->flags & UCL_OBJECT_FROZEN) {
+		switch (obj->type) {
+		case UCL_STRING:
+			len = (obj->flags & UCL_OBJECT_BINARY) ? obj->len : obj->len + 1;
+			copy = UCL_ALLOC (len);
+
+			if (copy != NULL) {
+				memcpy (copy, obj->value.sv, obj->len);
+
+				if (!(obj->flags & UCL_OBJECT_BINARY)) {
+					copy[obj->len] = '\0';
+				}
+			}
+
+			return (char *)ucl_trash_publish (obj, UCL_TRASH_VALUE, copy, len);
+		case UCL_INT:
+		case UCL_FLOAT:
+		case UCL_TIME:
+			copy = ucl_object_emit_single_json (obj);
+
+			if (copy != NULL) {
+				len = strlen ((const char *)copy) + 1;
+			}
+
+			return (char *)ucl_trash_publish (obj, UCL_TRASH_VALUE, copy, len);
+		default:
+			break;
+		}
+	}
+
+	switch (obj->type) {
+	case UCL_OBJECT:
+		return (char *)"object";
+	case UCL_ARRAY:
+		return (char *)"array";
+	case UCL_USERDATA:
+		return (char *)"userdata";
+	case UCL_NULL:
+		return (char *)"null";
+	case UCL_BOOLEAN:
+		return (char *)(obj->value.iv ? "true" : "false");
+	case UCL_INT:
+	case UCL_FLOAT:
+	case UCL_TIME:
+		emitted = ucl_object_emit_single_json (obj);
+
+		if (emitted == NULL) {
+			return NULL;
+		}
+
+		ucl_strlcpy (numbuf, (const char *)emitted, sizeof (numbuf));
+		ucl_free (emitted);
+
+		return numbuf;
+	default:
 		return NULL;
 	}
+}
+
+static char *
+ucl_copy_value_trash_internal (const ucl_object_t *obj)
+{
+	ucl_object_t *deconst;
+
+	if (obj->trash_stack[UCL_TRASH_VALUE] == NULL &&
+			((obj->flags & UCL_OBJECT_FROZEN) ||
+			((obj->flags & UCL_OBJECT_EPHEMERAL) && obj->type != UCL_STRING))) {
+		/* Frozen trees are shared between threads */
+		return ucl_readonly_value_string (obj);
+	}
 	if (obj->trash_stack[UCL_TRASH_VALUE] == NULL) {
 		deconst = __DECONST (ucl_object_t *, obj);
 		if (obj->type == UCL_STRING) {
 
 			/* Special case for strings */
 			if (obj->flags & UCL_OBJECT_BINARY) {
-				deconst->trash_stack[UCL_TRASH_VALUE] = malloc (obj->len);
+				deconst->trash_stack[UCL_TRASH_VALUE] = UCL_ALLOC (obj->len);
 				if (deconst->trash_stack[UCL_TRASH_VALUE] != NULL) {
 					memcpy (deconst->trash_stack[UCL_TRASH_VALUE],
 							obj->value.sv,
@@ -568,7 +978,7 @@ ucl_copy_value_trash (const ucl_object_t *obj)
 				}
 			}
 			else {
-				deconst->trash_stack[UCL_TRASH_VALUE] = malloc (obj->len + 1);
+				deconst->trash_stack[UCL_TRASH_VALUE] = UCL_ALLOC (obj->len + 1);
 				if (deconst->trash_stack[UCL_TRASH_VALUE] != NULL) {
 					memcpy (deconst->trash_stack[UCL_TRASH_VALUE],
 							obj->value.sv,
@@ -589,16 +999,43 @@ ucl_copy_value_trash (const ucl_object_t *obj)
 	return obj->trash_stack[UCL_TRASH_VALUE];
 }
 
-ucl_object_t*
-ucl_parser_get_object (struct ucl_parser *parser)
+char *
+ucl_copy_value_trash (const ucl_object_t *obj)
 {
-	if (parser->state != UCL_STATE_ERROR && parser->top_obj != NULL) {
-		return ucl_object_ref (parser->top_obj);
-	}
+	const struct ucl_allocator *prev;
+	char *ret;
 
-	return NULL;
+	if (obj == NULL) {
+		return NULL;
+	}
+
+	prev = ucl_object_allocator_enter (obj);
+	ret = ucl_copy_value_trash_internal (obj);
+	ucl_allocator_leave (prev);
+
+	return ret;
+}
+
+ucl_object_t*
+ucl_parser_get_object (struct ucl_parser *parser)
+{
+	if (parser->state != UCL_STATE_ERROR && parser->top_obj != NULL) {
+		return ucl_object_ref (parser->top_obj);
+	}
+
+	return NULL;
 }
 
+struct ucl_decompress_handler {
+	struct ucl_parser_special_handler h;
+	enum ucl_compression codec;
+};
+
+static bool ucl_decompress_chunk (struct ucl_parser *parser,
+		const unsigned char *source, size_t source_len,
+		unsigned char **destination, size_t *dest_len,
+		void *user_data);
+
 void
 ucl_parser_free (struct ucl_parser *parser)
 {
@@ -607,12 +1044,21 @@ ucl_parser_free (struct ucl_parser *parser)
 	struct ucl_chunk *chunk, *ctmp;
 	struct ucl_pubkey *key, *ktmp;
 	struct ucl_variable *var, *vtmp;
+	struct ucl_parser_special_handler *handler, *htmp;
 	ucl_object_t *tr, *trtmp;
+	const struct ucl_allocator *allocator, *prev = NULL;
 
 	if (parser == NULL) {
 		return;
 	}
 
+	/* Parser memory itself is released with its allocator */
+	allocator = parser->allocator;
+
+	if (allocator != NULL) {
+		prev = ucl_allocator_enter (allocator);
+	}
+
 	if (parser->top_obj != NULL) {
 		ucl_object_unref (parser->top_obj);
 	}
@@ -622,26 +1068,32 @@ ucl_parser_free (struct ucl_parser *parser)
 	}
 
 	LL_FOREACH_SAFE (parser->stack, stack, stmp) {
-		free (stack);
+		ucl_free (stack);
 	}
 	HASH_ITER (hh, parser->macroes, macro, mtmp) {
-		free (macro->name);
+		ucl_free (macro->name);
 		HASH_DEL (parser->macroes, macro);
 		UCL_FREE (sizeof (struct ucl_macro), macro);
 	}
 	LL_FOREACH_SAFE (parser->chunks, chunk, ctmp) {
 		ucl_chunk_free (chunk);
 	}
+	/* Built-in handlers are owned by the parser, others by the caller */
+	LL_FOREACH_SAFE (parser->special_handlers, handler, htmp) {
+		if (handler->handler == ucl_decompress_chunk) {
+			UCL_FREE (sizeof (struct ucl_decompress_handler), handler);
+		}
+	}
 	LL_FOREACH_SAFE (parser->keys, key, ktmp) {
 		UCL_FREE (sizeof (struct ucl_pubkey), key);
 	}
 	LL_FOREACH_SAFE (parser->variables, var, vtmp) {
-		free (var->value);
-		free (var->var);
+		ucl_free (var->value);
+		ucl_free (var->var);
 		UCL_FREE (sizeof (struct ucl_variable), var);
 	}
 	LL_FOREACH_SAFE (parser->trash_objs, tr, trtmp) {
-		ucl_object_free_internal (tr, false, ucl_object_dtor_free);
+		ucl_object_free_internal (tr, false, false);
 	}
 
 	if (parser->err != NULL) {
@@ -649,7 +1101,7 @@ ucl_parser_free (struct ucl_parser *parser)
 	}
 
 	if (parser->cur_file) {
-		free (parser->cur_file);
+		ucl_free (parser->cur_file);
 	}
 
 	if (parser->comments) {
@@ -657,6 +1109,10 @@ ucl_parser_free (struct ucl_parser *parser)
 	}
 
 	UCL_FREE (sizeof (struct ucl_parser), parser);
+
+	if (allocator != NULL) {
+		ucl_allocator_leave (prev);
+	}
 }
 
 const char *
@@ -706,15 +1162,19 @@ ucl_parser_get_linenum(struct ucl_parser *parser)
 void
 ucl_parser_clear_error(struct ucl_parser *parser)
 {
+	const struct ucl_allocator *prev;
+
 	if (parser != NULL && parser->err != NULL) {
+		prev = ucl_parser_allocator_enter (parser);
 		utstring_free(parser->err);
+		ucl_parser_allocator_leave (parser, prev);
 		parser->err = NULL;
 		parser->err_code = 0;
 	}
 }
 
-bool
-ucl_pubkey_add (struct ucl_parser *parser, const unsigned char *key, size_t len)
+static bool
+ucl_pubkey_add_internal (struct ucl_parser *parser, const unsigned char *key, size_t len)
 {
 #ifndef HAVE_OPENSSL
 	ucl_create_err (&parser->err, "cannot check signatures without openssl");
@@ -747,1534 +1207,2247 @@ ucl_pubkey_add (struct ucl_parser *parser, const unsigned char *key, size_t len)
 	return true;
 }
 
+bool
+ucl_pubkey_add (struct ucl_parser *parser, const unsigned char *key, size_t len)
+{
+	const struct ucl_allocator *prev;
+	bool ret;
+
+	prev = ucl_parser_allocator_enter (parser);
+	ret = ucl_pubkey_add_internal (parser, key, len);
+	ucl_parser_allocator_leave (parser, prev);
+
+	return ret;
+}
+
 void ucl_parser_add_special_handler (struct ucl_parser *parser,
 		struct ucl_parser_special_handler *handler)
 {
 	LL_APPEND (parser->special_handlers, handler);
 }
 
-#ifdef CURL_FOUND
-struct ucl_curl_cbdata {
-	unsigned char *buf;
-	size_t buflen;
-};
-
-static size_t
-ucl_curl_write_callback (void* contents, size_t size, size_t nmemb, void* ud)
-{
-	struct ucl_curl_cbdata *cbdata = ud;
-	size_t realsize = size * nmemb;
-
-	cbdata->buf = realloc (cbdata->buf, cbdata->buflen + realsize + 1);
-	if (cbdata->buf == NULL) {
-		return 0;
-	}
+/*
+ * Built-in handlers of compressed chunks
+ */
+#ifdef HAVE_ZLIB
+static const unsigned char ucl_gzip_magic[] = {0x1f, 0x8b};
+#endif
+#ifdef HAVE_ZSTD
+static const unsigned char ucl_zstd_magic[] = {0x28, 0xb5, 0x2f, 0xfd};
+#endif
 
-	memcpy (&(cbdata->buf[cbdata->buflen]), contents, realsize);
-	cbdata->buflen += realsize;
-	cbdata->buf[cbdata->buflen] = 0;
+#ifdef HAVE_LZMA
+static const unsigned char ucl_xz_magic[] = {0xfd, '7', 'z', 'X', 'Z', 0x00};
+#endif
 
-	return realsize;
-}
+/* Larger sizes declared by compressed data are not trusted */
+#define UCL_DECOMPRESS_MAX_RATIO 1032
+/* Default limit of decompressed chunk size, see ucl_parser_set_decompress_limit */
+#ifndef UCL_DECOMPRESS_MAX_SIZE
+#define UCL_DECOMPRESS_MAX_SIZE (256UL * 1024 * 1024)
+#endif
+/* Size of decompressed windows fed to the msgpack lexer */
+#ifndef UCL_DECOMPRESS_WINDOW
+#define UCL_DECOMPRESS_WINDOW (64UL * 1024)
 #endif
 
-/**
- * Fetch a url and save results to the memory buffer
- * @param url url to fetch
- * @param len length of url
- * @param buf target buffer
- * @param buflen target length
- * @return
+/*
+ * Returns the decompressed size declared by the compressed data if any:
+ * gzip trailer, zstd frame header or xz index. It is only a hint, as
+ * data can consist of several members, frames or streams
  */
-bool
-ucl_fetch_url (const unsigned char *url, unsigned char **buf, size_t *buflen,
-		UT_string **err, bool must_exist)
+static size_t
+ucl_decompress_size_hint (enum ucl_compression codec,
+		const unsigned char *source, size_t source_len)
 {
+	uint64_t hint = 0;
 
-#ifdef HAVE_FETCH_H
-	struct url *fetch_url;
-	struct url_stat us;
-	FILE *in;
+#ifdef HAVE_ZLIB
+	if (codec == UCL_COMPRESSION_GZIP && source_len >= 18) {
+		const unsigned char *p = source + source_len - 4;
 
-	fetch_url = fetchParseURL (url);
-	if (fetch_url == NULL) {
-		ucl_create_err (err, "invalid URL %s: %s",
-				url, strerror (errno));
-		return false;
+		hint = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint64_t)p[3] << 24);
 	}
-	if ((in = fetchXGet (fetch_url, &us, "")) == NULL) {
-		if (!must_exist) {
-			ucl_create_err (err, "cannot fetch URL %s: %s",
-				url, strerror (errno));
+#endif
+#ifdef HAVE_ZSTD
+	if (codec == UCL_COMPRESSION_ZSTD) {
+		unsigned long long fsize = ZSTD_getFrameContentSize (source, source_len);
+
+		if (fsize != ZSTD_CONTENTSIZE_UNKNOWN && fsize != ZSTD_CONTENTSIZE_ERROR) {
+			hint = fsize;
 		}
-		fetchFreeURL (fetch_url);
-		return false;
 	}
-
-	*buflen = us.size;
-	*buf = malloc (*buflen);
-	if (*buf == NULL) {
-		ucl_create_err (err, "cannot allocate buffer for URL %s: %s",
-				url, strerror (errno));
-		fclose (in);
-		fetchFreeURL (fetch_url);
-		return false;
+#endif
+#ifdef HAVE_LZMA
+	if (codec == UCL_COMPRESSION_XZ && source_len >= 2 * LZMA_STREAM_HEADER_SIZE) {
+		lzma_stream_flags flags;
+		lzma_index *idx = NULL;
+		uint64_t memlimit = UINT64_MAX;
+		size_t pos = 0;
+		const unsigned char *footer = source + source_len - LZMA_STREAM_HEADER_SIZE;
+
+		if (lzma_stream_footer_decode (&flags, footer) == LZMA_OK &&
+				flags.backward_size <= source_len - 2 * LZMA_STREAM_HEADER_SIZE &&
+				lzma_index_buffer_decode (&idx, &memlimit, NULL,
+						footer - flags.backward_size, &pos,
+						flags.backward_size) == LZMA_OK) {
+			hint = lzma_index_uncompressed_size (idx);
+			lzma_index_end (idx, NULL);
+		}
 	}
+#endif
 
-	if (fread (*buf, *buflen, 1, in) != 1) {
-		ucl_create_err (err, "cannot read URL %s: %s",
-				url, strerror (errno));
-		fclose (in);
-		fetchFreeURL (fetch_url);
-		return false;
+	if (hint >= SIZE_MAX || hint / UCL_DECOMPRESS_MAX_RATIO > source_len) {
+		return 0;
 	}
 
-	fetchFreeURL (fetch_url);
-	return true;
-#elif defined(CURL_FOUND)
-	CURL *curl;
-	int r;
-	struct ucl_curl_cbdata cbdata;
+	return hint;
+}
 
-	curl = curl_easy_init ();
-	if (curl == NULL) {
-		ucl_create_err (err, "CURL interface is broken");
+/*
+ * Grow decompression output, sizes are doubled starting from the declared
+ * size or a guess based on the compressed size. Output is never grown past
+ * one byte over the limit, so exceeding it is detected without allocating
+ * the whole data
+ */
+static bool
+ucl_decompress_grow (struct ucl_parser *parser, unsigned char **buf,
+		size_t *size, size_t len, size_t srclen, size_t hint, size_t limit)
+{
+	unsigned char *nbuf;
+	size_t nsize;
+
+	if (len > limit) {
+		ucl_create_err (&parser->err, "decompressed chunk is larger than %lu bytes",
+				(unsigned long)limit);
 		return false;
 	}
-	if ((r = curl_easy_setopt (curl, CURLOPT_URL, url)) != CURLE_OK) {
-		ucl_create_err (err, "invalid URL %s: %s",
-				url, curl_easy_strerror (r));
-		curl_easy_cleanup (curl);
-		return false;
+
+	if (len < *size) {
+		return true;
 	}
-	curl_easy_setopt (curl, CURLOPT_WRITEFUNCTION, ucl_curl_write_callback);
-	cbdata.buf = NULL;
-	cbdata.buflen = 0;
-	curl_easy_setopt (curl, CURLOPT_WRITEDATA, &cbdata);
 
-	if ((r = curl_easy_perform (curl)) != CURLE_OK) {
-		if (!must_exist) {
-			ucl_create_err (err, "error fetching URL %s: %s",
-				url, curl_easy_strerror (r));
+	if (*size == 0) {
+		if (hint > 0) {
+			/* One more byte to see the end without growing */
+			nsize = hint + 1;
 		}
-		curl_easy_cleanup (curl);
-		if (cbdata.buf) {
-			free (cbdata.buf);
+		else {
+			nsize = srclen < SIZE_MAX / 4 ? srclen * 4 : SIZE_MAX;
+			if (nsize < 4096) {
+				nsize = 4096;
+			}
 		}
+	}
+	else if (*size > SIZE_MAX / 2) {
+		nsize = SIZE_MAX;
+	}
+	else {
+		nsize = *size * 2;
+	}
+
+	if (limit < SIZE_MAX && nsize > limit) {
+		nsize = limit + 1;
+	}
+
+	nbuf = UCL_REALLOC (*buf, nsize);
+
+	if (nbuf == NULL) {
+		ucl_create_err (&parser->err, "cannot allocate decompression buffer");
 		return false;
 	}
-	*buf = cbdata.buf;
-	*buflen = cbdata.buflen;
 
-	curl_easy_cleanup (curl);
+	*buf = nbuf;
+	*size = nsize;
 
 	return true;
-#else
-	ucl_create_err (err, "URL support is disabled");
-	return false;
-#endif
 }
 
-/**
- * Fetch a file and save results to the memory buffer
- * @param filename filename to fetch
- * @param len length of filename
- * @param buf target buffer
- * @param buflen target length
- * @return
+/*
+ * Decompression stream of a chunk, all compressed data is available
  */
-bool
-ucl_fetch_file (const unsigned char *filename, unsigned char **buf, size_t *buflen,
-		UT_string **err, bool must_exist)
-{
-	int fd;
-	struct stat st;
-	if ((fd = open (filename, O_RDONLY)) == -1) {
-		ucl_create_err (err, "cannot open file %s: %s",
-				filename, strerror (errno));
-		return false;
-	}
+struct ucl_decompress_stream {
+	enum ucl_compression codec;
+#ifdef HAVE_ZLIB
+	z_stream zs;
+	/* Input that does not fit zlib's uInt counter yet */
+	size_t zleft;
+#endif
+#ifdef HAVE_ZSTD
+	ZSTD_DCtx *zd;
+	ZSTD_inBuffer in;
+#endif
+#ifdef HAVE_LZMA
+	lzma_stream xz;
+#endif
+	/* Decompressed size so far and its limit */
+	size_t total;
+	size_t limit;
+	bool eof;
+	/* Window of decompressed data for a chunk, see ucl_chunk_refill */
+	unsigned char *win;
+	size_t wsize;
+};
 
-	if (fstat (fd, &st) == -1) {
-		if (must_exist || errno == EPERM) {
-			ucl_create_err (err, "cannot stat file %s: %s",
-					filename, strerror (errno));
+static bool
+ucl_decompress_stream_init (struct ucl_decompress_stream *st,
+		enum ucl_compression codec, const unsigned char *source,
+		size_t source_len, size_t limit, UT_string **err)
+{
+	memset (st, 0, sizeof (*st));
+	st->codec = codec;
+	st->limit = limit;
+
+#ifdef HAVE_ZLIB
+	if (codec == UCL_COMPRESSION_GZIP) {
+		if (inflateInit2 (&st->zs, 15 + 16) != Z_OK) {
+			ucl_create_err (err, "cannot initialize gzip decompression");
+			return false;
 		}
-		close (fd);
 
-		return false;
+		st->zs.next_in = (unsigned char *)source;
+		st->zs.avail_in = source_len > UINT_MAX ? UINT_MAX : (uInt)source_len;
+		st->zleft = source_len - st->zs.avail_in;
+
+		return true;
 	}
-	if (!S_ISREG (st.st_mode)) {
-		if (must_exist) {
-			ucl_create_err (err, "file %s is not a regular file", filename);
+#endif
+#ifdef HAVE_ZSTD
+	if (codec == UCL_COMPRESSION_ZSTD) {
+		st->zd = ZSTD_createDCtx ();
+
+		if (st->zd == NULL) {
+			ucl_create_err (err, "cannot initialize zstd decompression");
+			return false;
 		}
-		close (fd);
 
-		return false;
-	}
+		st->in.src = source;
+		st->in.size = source_len;
+		st->in.pos = 0;
 
-	if (st.st_size == 0) {
-		/* Do not map empty files */
-		*buf = NULL;
-		*buflen = 0;
+		return true;
 	}
-	else {
-		if ((*buf = ucl_mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
-			close(fd);
-			ucl_create_err(err, "cannot mmap file %s: %s",
-					filename, strerror(errno));
-			*buf = NULL;
+#endif
+#ifdef HAVE_LZMA
+	if (codec == UCL_COMPRESSION_XZ) {
+		lzma_stream xz = LZMA_STREAM_INIT;
 
+		st->xz = xz;
+
+		if (lzma_stream_decoder (&st->xz, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK) {
+			ucl_create_err (err, "cannot initialize xz decompression");
 			return false;
 		}
-		*buflen = st.st_size;
+
+		st->xz.next_in = source;
+		st->xz.avail_in = source_len;
+
+		return true;
 	}
+#endif
 
-	close (fd);
+	ucl_create_err (err, "unsupported compression");
 
-	return true;
+	return false;
 }
 
-
-#if (defined(HAVE_OPENSSL) && OPENSSL_VERSION_NUMBER >= 0x10000000L)
-static inline bool
-ucl_sig_check (const unsigned char *data, size_t datalen,
-		const unsigned char *sig, size_t siglen, struct ucl_parser *parser)
+/*
+ * Decompress data to `out` until it is full or the end of data is reached
+ */
+static bool
+ucl_decompress_stream_read (struct ucl_decompress_stream *st,
+		unsigned char *out, size_t outlen, size_t *nread, UT_string **err)
 {
-	struct ucl_pubkey *key;
-	char dig[EVP_MAX_MD_SIZE];
-	unsigned int diglen;
-	EVP_PKEY_CTX *key_ctx;
-	EVP_MD_CTX *sign_ctx = NULL;
+	size_t len = 0;
+	bool ret = true;
 
-	sign_ctx = EVP_MD_CTX_create ();
+	if (st->eof || outlen == 0) {
+		*nread = 0;
+		return true;
+	}
 
-	LL_FOREACH (parser->keys, key) {
-		key_ctx = EVP_PKEY_CTX_new (key->key, NULL);
-		if (key_ctx != NULL) {
-			if (EVP_PKEY_verify_init (key_ctx) <= 0) {
-				EVP_PKEY_CTX_free (key_ctx);
-				continue;
+#ifdef HAVE_ZLIB
+	if (st->codec == UCL_COMPRESSION_GZIP) {
+		size_t orem = outlen;
+		int r;
+
+		st->zs.next_out = out;
+		st->zs.avail_out = 0;
+
+		for (;;) {
+			/* zlib counts both buffers in uInt, refill them by pieces */
+			if (st->zs.avail_out == 0) {
+				if (orem == 0) {
+					break;
+				}
+
+				st->zs.avail_out = orem > UINT_MAX ? UINT_MAX : (uInt)orem;
+				orem -= st->zs.avail_out;
 			}
-			if (EVP_PKEY_CTX_set_rsa_padding (key_ctx, RSA_PKCS1_PADDING) <= 0) {
-				EVP_PKEY_CTX_free (key_ctx);
-				continue;
+			if (st->zs.avail_in == 0 && st->zleft > 0) {
+				st->zs.avail_in = st->zleft > UINT_MAX ?
+						UINT_MAX : (uInt)st->zleft;
+				st->zleft -= st->zs.avail_in;
 			}
-			if (EVP_PKEY_CTX_set_signature_md (key_ctx, EVP_sha256 ()) <= 0) {
-				EVP_PKEY_CTX_free (key_ctx);
-				continue;
+
+			r = inflate (&st->zs, Z_NO_FLUSH);
+
+			if (r == Z_STREAM_END) {
+				if (st->zs.avail_in == 0 && st->zleft == 0) {
+					st->eof = true;
+					break;
+				}
+				/* Concatenated gzip members */
+				inflateReset (&st->zs);
 			}
-			EVP_DigestInit (sign_ctx, EVP_sha256 ());
-			EVP_DigestUpdate (sign_ctx, data, datalen);
-			EVP_DigestFinal (sign_ctx, dig, &diglen);
+			else if (r != Z_OK) {
+				ucl_create_err (err, "cannot decompress gzip chunk: %s",
+						st->zs.msg != NULL ? st->zs.msg : "truncated input");
+				ret = false;
+				break;
+			}
+		}
 
-			if (EVP_PKEY_verify (key_ctx, sig, siglen, dig, diglen) == 1) {
-				EVP_MD_CTX_destroy (sign_ctx);
-				EVP_PKEY_CTX_free (key_ctx);
-				return true;
+		len = outlen - orem - st->zs.avail_out;
+	}
+#endif
+#ifdef HAVE_ZSTD
+	if (st->codec == UCL_COMPRESSION_ZSTD) {
+		ZSTD_outBuffer zout = {out, outlen, 0};
+		size_t r;
+
+		while (zout.pos < zout.size) {
+			r = ZSTD_decompressStream (st->zd, &zout, &st->in);
+
+			if (ZSTD_isError (r)) {
+				ucl_create_err (err, "cannot decompress zstd chunk: %s",
+						ZSTD_getErrorName (r));
+				ret = false;
+				break;
+			}
+			if (st->in.pos == st->in.size && zout.pos < zout.size) {
+				/* All input is consumed and all output is flushed */
+				if (r == 0) {
+					st->eof = true;
+				}
+				else {
+					ucl_create_err (err,
+							"cannot decompress zstd chunk: truncated input");
+					ret = false;
+				}
+				break;
 			}
+		}
 
-			EVP_PKEY_CTX_free (key_ctx);
+		len = zout.pos;
+	}
+#endif
+#ifdef HAVE_LZMA
+	if (st->codec == UCL_COMPRESSION_XZ) {
+		lzma_ret r;
+
+		st->xz.next_out = out;
+		st->xz.avail_out = outlen;
+
+		while (st->xz.avail_out > 0) {
+			/* All input is available, so the stream is finished at once */
+			r = lzma_code (&st->xz, LZMA_FINISH);
+
+			if (r == LZMA_STREAM_END) {
+				st->eof = true;
+				break;
+			}
+			else if (r != LZMA_OK) {
+				ucl_create_err (err, "cannot decompress xz chunk: %s",
+						r == LZMA_BUF_ERROR ? "truncated input" : "corrupted input");
+				ret = false;
+				break;
+			}
 		}
+
+		len = outlen - st->xz.avail_out;
 	}
+#endif
 
-	EVP_MD_CTX_destroy (sign_ctx);
+	st->total += len;
+	*nread = len;
 
-	return false;
+	if (ret && st->total > st->limit) {
+		ucl_create_err (err, "decompressed chunk is larger than %lu bytes",
+				(unsigned long)st->limit);
+		ret = false;
+	}
+
+	return ret;
 }
-#endif
 
-struct ucl_include_params {
-	bool check_signature;
-	bool must_exist;
-	bool use_glob;
-	bool use_prefix;
-	bool soft_fail;
-	bool allow_glob;
-	unsigned priority;
-	enum ucl_duplicate_strategy strat;
-	enum ucl_parse_type parse_type;
-	const char *prefix;
-	const char *target;
-};
+static void
+ucl_decompress_stream_end (struct ucl_decompress_stream *st)
+{
+#ifdef HAVE_ZLIB
+	if (st->codec == UCL_COMPRESSION_GZIP) {
+		inflateEnd (&st->zs);
+	}
+#endif
+#ifdef HAVE_ZSTD
+	if (st->codec == UCL_COMPRESSION_ZSTD) {
+		ZSTD_freeDCtx (st->zd);
+	}
+#endif
+#ifdef HAVE_LZMA
+	if (st->codec == UCL_COMPRESSION_XZ) {
+		lzma_end (&st->xz);
+	}
+#endif
+}
 
-/**
- * Include an url to configuration
- * @param data
- * @param len
- * @param parser
- * @param err
- * @return
+/*
+ * Data is decompressed by the codec stream directly to the output buffer,
+ * so the only copy made is the final shrink if the size was not known
  */
 static bool
-ucl_include_url (const unsigned char *data, size_t len,
-		struct ucl_parser *parser,
-		struct ucl_include_params *params)
+ucl_decompress_chunk (struct ucl_parser *parser,
+		const unsigned char *source, size_t source_len,
+		unsigned char **destination, size_t *dest_len,
+		void *user_data)
 {
+	struct ucl_decompress_handler *dh = user_data;
+	struct ucl_decompress_stream st;
+	unsigned char *buf = NULL, *nbuf;
+	size_t size = 0, len = 0, n, hint, limit;
+	bool ret = true;
+
+	hint = ucl_decompress_size_hint (dh->codec, source, source_len);
+	limit = parser->decompress_limit > 0 ? parser->decompress_limit :
+			UCL_DECOMPRESS_MAX_SIZE;
+
+	if (!ucl_decompress_stream_init (&st, dh->codec, source, source_len,
+			limit, &parser->err)) {
+		return false;
+	}
 
-	bool res;
-	unsigned char *buf = NULL;
-	size_t buflen = 0;
-	struct ucl_chunk *chunk;
-	char urlbuf[PATH_MAX];
-	int prev_state;
-
-	snprintf (urlbuf, sizeof (urlbuf), "%.*s", (int)len, data);
+	while (ret && !st.eof) {
+		ret = ucl_decompress_grow (parser, &buf, &size, len, source_len,
+				hint, limit) &&
+				ucl_decompress_stream_read (&st, buf + len, size - len, &n,
+						&parser->err);
 
-	if (!ucl_fetch_url (urlbuf, &buf, &buflen, &parser->err, params->must_exist)) {
-		if (!params->must_exist) {
-			ucl_parser_clear_error (parser);
+		if (ret) {
+			len += n;
 		}
-		return !params->must_exist;
 	}
 
-	if (params->check_signature) {
-#if (defined(HAVE_OPENSSL) && OPENSSL_VERSION_NUMBER >= 0x10000000L)
-		unsigned char *sigbuf = NULL;
-		size_t siglen = 0;
-		/* We need to check signature first */
-		snprintf (urlbuf, sizeof (urlbuf), "%.*s.sig", (int)len, data);
-		if (!ucl_fetch_url (urlbuf, &sigbuf, &siglen, &parser->err, true)) {
-			return false;
-		}
-		if (!ucl_sig_check (buf, buflen, sigbuf, siglen, parser)) {
-			ucl_create_err (&parser->err, "cannot verify url %s: %s",
-							urlbuf,
-							ERR_error_string (ERR_get_error (), NULL));
-			if (siglen > 0) {
-				ucl_munmap (sigbuf, siglen);
-			}
-			return false;
-		}
-		if (siglen > 0) {
-			ucl_munmap (sigbuf, siglen);
+	ucl_decompress_stream_end (&st);
+
+	if (!ret) {
+		if (buf != NULL) {
+			UCL_FREE (size, buf);
 		}
-#endif
-	}
 
-	prev_state = parser->state;
-	parser->state = UCL_STATE_INIT;
+		return false;
+	}
 
-	res = ucl_parser_add_chunk_full (parser, buf, buflen, params->priority,
-			params->strat, params->parse_type);
-	if (res == true) {
-		/* Remove chunk from the stack */
-		chunk = parser->chunks;
-		if (chunk != NULL) {
-			parser->chunks = chunk->next;
-			ucl_chunk_free (chunk);
-		}
+	if (len == 0) {
+		UCL_FREE (size, buf);
+		buf = NULL;
+	}
+	else if (len < size && (nbuf = UCL_REALLOC (buf, len)) != NULL) {
+		buf = nbuf;
 	}
 
-	parser->state = prev_state;
-	free (buf);
+	*destination = buf;
+	*dest_len = len;
 
-	return res;
+	return true;
 }
 
-/**
- * Include a single file to the parser
- * @param data
- * @param len
- * @param parser
- * @param check_signature
- * @param must_exist
- * @param allow_glob
- * @param priority
- * @return
- */
-static bool
-ucl_include_file_single (const unsigned char *data, size_t len,
-		struct ucl_parser *parser, struct ucl_include_params *params)
+bool
+ucl_chunk_decompress_open (struct ucl_parser *parser, struct ucl_chunk *chunk,
+		const struct ucl_parser_special_handler *handler,
+		const unsigned char *data, size_t len)
 {
-	bool res;
-	struct ucl_chunk *chunk;
-	unsigned char *buf = NULL;
-	char *old_curfile, *ext;
-	size_t buflen = 0;
-	char filebuf[PATH_MAX], realbuf[PATH_MAX];
-	int prev_state;
-	struct ucl_variable *cur_var, *tmp_var, *old_curdir = NULL,
-			*old_filename = NULL;
-	ucl_object_t *nest_obj = NULL, *old_obj = NULL, *new_obj = NULL;
-	ucl_hash_t *container = NULL;
-	struct ucl_stack *st = NULL;
+	struct ucl_decompress_handler *dh;
+	struct ucl_decompress_stream *st;
+	UT_string *err = NULL;
+	size_t limit, n;
 
-	if (parser->state == UCL_STATE_ERROR) {
-		/* Return immediately if we are in the error state... */
+	if (handler->handler != ucl_decompress_chunk) {
 		return false;
 	}
 
-	snprintf (filebuf, sizeof (filebuf), "%.*s", (int)len, data);
-	if (ucl_realpath (filebuf, realbuf) == NULL) {
-		if (params->soft_fail) {
-			return false;
-		}
-		if (!params->must_exist && errno != EPERM) {
-			return true;
-		}
+	dh = handler->user_data;
+	limit = parser->decompress_limit > 0 ? parser->decompress_limit :
+			UCL_DECOMPRESS_MAX_SIZE;
+	st = UCL_ALLOC (sizeof (*st));
 
-		ucl_create_err (&parser->err, "cannot open file %s: %s",
-									filebuf,
-									strerror (errno));
+	if (st == NULL) {
 		return false;
 	}
 
-	if (parser->cur_file && strcmp (realbuf, parser->cur_file) == 0) {
-		/* We are likely including the file itself */
-		if (params->soft_fail) {
-			return false;
-		}
+	if (!ucl_decompress_stream_init (st, dh->codec, data, len, limit, &err)) {
+		UCL_FREE (sizeof (*st), st);
+		utstring_free (err);
 
-		ucl_create_err (&parser->err, "trying to include the file %s from itself",
-				realbuf);
 		return false;
 	}
 
-	if (!ucl_fetch_file (realbuf, &buf, &buflen, &parser->err, params->must_exist)) {
-		if (params->soft_fail) {
-			return false;
-		}
+	st->wsize = limit < UCL_DECOMPRESS_WINDOW ? limit + 1 : UCL_DECOMPRESS_WINDOW;
+	st->win = UCL_ALLOC (st->wsize);
 
-		if (params->must_exist || parser->err != NULL) {
-			/* The case of fatal errors */
-			return false;
+	/* Errors are reported when the chunk is decompressed as a whole */
+	if (st->win == NULL ||
+			!ucl_decompress_stream_read (st, st->win, st->wsize, &n, &err)) {
+		ucl_decompress_stream_free (st);
+
+		if (err != NULL) {
+			utstring_free (err);
 		}
 
-		ucl_parser_clear_error (parser);
+		return false;
+	}
+
+	chunk->stream = st;
+	chunk->begin = st->win;
+	chunk->pos = st->win;
+	chunk->end = st->win + n;
+	chunk->remain = n;
+
+	return true;
+}
 
+bool
+ucl_chunk_refill (struct ucl_parser *parser, struct ucl_chunk *chunk,
+		const unsigned char *keep, size_t need)
+{
+	struct ucl_decompress_stream *st = chunk->stream;
+	unsigned char *nwin;
+	size_t off, tail, wsize, n;
+
+	if (st == NULL || st->eof || (size_t)(chunk->end - chunk->pos) >= need) {
 		return true;
 	}
 
-	if (params->check_signature) {
-#if (defined(HAVE_OPENSSL) && OPENSSL_VERSION_NUMBER >= 0x10000000L)
-		unsigned char *sigbuf = NULL;
-		size_t siglen = 0;
-		/* We need to check signature first */
-		snprintf (filebuf, sizeof (filebuf), "%s.sig", realbuf);
-		if (!ucl_fetch_file (filebuf, &sigbuf, &siglen, &parser->err, true)) {
-			if (buf) {
-				ucl_munmap (buf, buflen);
-			}
+	/* Data before `keep` is parsed, the rest is moved to the window start */
+	off = chunk->pos - keep;
+	tail = chunk->end - keep;
 
-			return false;
+	if (keep != st->win && tail > 0) {
+		memmove (st->win, keep, tail);
+	}
+
+	if (need > SIZE_MAX - off) {
+		need = SIZE_MAX - off;
+	}
+
+	if (off + need > st->wsize) {
+		/* Element is larger than the window */
+		wsize = st->wsize;
+
+		while (wsize < off + need && wsize <= SIZE_MAX / 2) {
+			wsize *= 2;
 		}
-		if (!ucl_sig_check (buf, buflen, sigbuf, siglen, parser)) {
-			ucl_create_err (&parser->err, "cannot verify file %s: %s",
-							filebuf,
-							ERR_error_string (ERR_get_error (), NULL));
-			if (sigbuf) {
-				ucl_munmap (sigbuf, siglen);
-			}
-			if (buf) {
-				ucl_munmap (buf, buflen);
-			}
 
-			return false;
+		if (wsize < off + need) {
+			wsize = off + need;
+		}
+		if (st->limit < SIZE_MAX && wsize > st->limit + 1) {
+			wsize = st->limit + 1;
 		}
 
-		if (sigbuf) {
-			ucl_munmap (sigbuf, siglen);
+		nwin = UCL_REALLOC (st->win, wsize);
+
+		if (nwin == NULL) {
+			ucl_create_err (&parser->err, "cannot allocate decompression window");
+			return false;
 		}
-#endif
+
+		st->win = nwin;
+		st->wsize = wsize;
 	}
 
-	old_curfile = parser->cur_file;
-	parser->cur_file = NULL;
+	if (!ucl_decompress_stream_read (st, st->win + tail, st->wsize - tail, &n,
+			&parser->err)) {
+		return false;
+	}
 
-	/* Store old file vars */
-	DL_FOREACH_SAFE (parser->variables, cur_var, tmp_var) {
-		if (strcmp (cur_var->var, "CURDIR") == 0) {
-			old_curdir = cur_var;
-			DL_DELETE (parser->variables, cur_var);
-		}
-		else if (strcmp (cur_var->var, "FILENAME") == 0) {
-			old_filename = cur_var;
-			DL_DELETE (parser->variables, cur_var);
+	chunk->begin = st->win;
+	chunk->pos = st->win + off;
+	chunk->end = st->win + tail + n;
+	chunk->remain = chunk->end - chunk->pos;
+
+	return true;
+}
+
+void
+ucl_decompress_stream_free (struct ucl_decompress_stream *st)
+{
+	if (st != NULL) {
+		ucl_decompress_stream_end (st);
+
+		if (st->win != NULL) {
+			UCL_FREE (st->wsize, st->win);
 		}
+
+		UCL_FREE (sizeof (*st), st);
 	}
+}
 
-	ucl_parser_set_filevars (parser, realbuf, false);
+static void
+ucl_decompress_free (unsigned char *data, size_t len, void *user_data)
+{
+	/* Output may be larger than its length if it could not be shrunk */
+	ucl_free (data);
+}
 
-	prev_state = parser->state;
-	parser->state = UCL_STATE_INIT;
+bool
+ucl_parser_add_decompress_handlers (struct ucl_parser *parser)
+{
+	static const struct {
+		enum ucl_compression codec;
+		const unsigned char *magic;
+		size_t magic_len;
+	} codecs[] = {
+#ifdef HAVE_ZLIB
+		{UCL_COMPRESSION_GZIP, ucl_gzip_magic, sizeof (ucl_gzip_magic)},
+#endif
+#ifdef HAVE_ZSTD
+		{UCL_COMPRESSION_ZSTD, ucl_zstd_magic, sizeof (ucl_zstd_magic)},
+#endif
+#ifdef HAVE_LZMA
+		{UCL_COMPRESSION_XZ, ucl_xz_magic, sizeof (ucl_xz_magic)},
+#endif
+		{UCL_COMPRESSION_GZIP, NULL, 0}
+	};
+	struct ucl_parser_special_handler *cur;
+	struct ucl_decompress_handler *dh;
+	const struct ucl_allocator *prev;
+	bool added = false, found;
+	unsigned int i;
 
-	if (params->use_prefix && params->prefix == NULL) {
-		/* Auto generate a key name based on the included filename */
-		params->prefix = basename (realbuf);
-		ext = strrchr (params->prefix, '.');
-		if (ext != NULL && (strcmp (ext, ".conf") == 0 || strcmp (ext, ".ucl") == 0)) {
-			/* Strip off .conf or .ucl */
-			*ext = '\0';
-		}
+	if (parser == NULL) {
+		return false;
 	}
-	if (params->prefix != NULL) {
-		/* This is a prefixed include */
-		container = parser->stack->obj->value.ov;
-
-		old_obj = __DECONST (ucl_object_t *, ucl_hash_search (container,
-				params->prefix, strlen (params->prefix)));
-
-		if (strcasecmp (params->target, "array") == 0) {
-			if (old_obj == NULL) {
-				/* Create an array with key: prefix */
-				old_obj = ucl_object_new_full (UCL_ARRAY, params->priority);
-				old_obj->key = params->prefix;
-				old_obj->keylen = strlen (params->prefix);
-				ucl_copy_key_trash (old_obj);
-				old_obj->prev = old_obj;
-				old_obj->next = NULL;
-
-				container = ucl_hash_insert_object (container, old_obj,
-						parser->flags & UCL_PARSER_KEY_LOWERCASE);
-				parser->stack->obj->len++;
-
-				nest_obj = ucl_object_new_full (UCL_OBJECT, params->priority);
-				nest_obj->prev = nest_obj;
-				nest_obj->next = NULL;
-
-				ucl_array_append (old_obj, nest_obj);
-			}
-			else {
-				if (ucl_object_type (old_obj) == UCL_ARRAY) {
-					/* Append to the existing array */
-					nest_obj = ucl_object_new_full (UCL_OBJECT,
-							params->priority);
-					if (nest_obj == NULL) {
-						ucl_create_err (&parser->err,
-								"cannot allocate memory for an object");
-						if (buf) {
-							ucl_munmap (buf, buflen);
-						}
-
-						return false;
-					}
-					nest_obj->prev = nest_obj;
-					nest_obj->next = NULL;
-
-					ucl_array_append (old_obj, nest_obj);
-				}
-				else {
-					/* Convert the object to an array */
-					new_obj = ucl_object_typed_new (UCL_ARRAY);
-					if (new_obj == NULL) {
-						ucl_create_err (&parser->err,
-								"cannot allocate memory for an object");
-						if (buf) {
-							ucl_munmap (buf, buflen);
-						}
-
-						return false;
-					}
-					new_obj->key = old_obj->key;
-					new_obj->keylen = old_obj->keylen;
-					new_obj->flags |= UCL_OBJECT_MULTIVALUE;
-					new_obj->prev = new_obj;
-					new_obj->next = NULL;
-
-					nest_obj = ucl_object_new_full (UCL_OBJECT,
-							params->priority);
-					if (nest_obj == NULL) {
-						ucl_create_err (&parser->err,
-								"cannot allocate memory for an object");
-						if (buf) {
-							ucl_munmap (buf, buflen);
-						}
 
-						ucl_object_unref (new_obj);
+	prev = ucl_parser_allocator_enter (parser);
 
-						return false;
-					}
-					nest_obj->prev = nest_obj;
-					nest_obj->next = NULL;
+	for (i = 0; codecs[i].magic != NULL; i ++) {
+		found = false;
 
-					ucl_array_append (new_obj, old_obj);
-					ucl_array_append (new_obj, nest_obj);
-					ucl_hash_replace (container, old_obj, new_obj);
-				}
+		LL_FOREACH (parser->special_handlers, cur) {
+			if (cur->handler == ucl_decompress_chunk &&
+					((struct ucl_decompress_handler *)cur)->codec == codecs[i].codec) {
+				found = true;
+				break;
 			}
 		}
-		else {
-			/* Case of object */
-			if (old_obj == NULL) {
-				/* Create an object with key: prefix */
-				nest_obj = ucl_object_new_full (UCL_OBJECT, params->priority);
-
-				if (nest_obj == NULL) {
-					ucl_create_err (&parser->err, "cannot allocate memory for an object");
-					if (buf) {
-						ucl_munmap (buf, buflen);
-					}
-
-					return false;
-				}
 
-				nest_obj->key = params->prefix;
-				nest_obj->keylen = strlen (params->prefix);
-				ucl_copy_key_trash(nest_obj);
-				nest_obj->prev = nest_obj;
-				nest_obj->next = NULL;
+		if (found) {
+			added = true;
+			continue;
+		}
 
-				container = ucl_hash_insert_object (container, nest_obj,
-						parser->flags & UCL_PARSER_KEY_LOWERCASE);
-				parser->stack->obj->len ++;
-			}
-			else {
-				if (ucl_object_type (old_obj) == UCL_OBJECT) {
-					/* Append to existing Object*/
-					nest_obj = old_obj;
-				}
-				else {
-					/* The key is not an object */
-					ucl_create_err (&parser->err,
-							"Conflicting type for key: %s, asked %s, has %s",
-							params->prefix, params->target,
-							ucl_object_type_to_string (ucl_object_type (old_obj)));
-					if (buf) {
-						ucl_munmap (buf, buflen);
-					}
+		dh = UCL_ALLOC (sizeof (*dh));
 
-					return false;
-				}
-			}
+		if (dh == NULL) {
+			break;
 		}
 
+		memset (dh, 0, sizeof (*dh));
+		dh->h.magic = codecs[i].magic;
+		dh->h.magic_len = codecs[i].magic_len;
+		dh->h.flags = UCL_SPECIAL_HANDLER_RELEASE_PARSED;
+		dh->h.handler = ucl_decompress_chunk;
+		dh->h.free_function = ucl_decompress_free;
+		dh->h.user_data = dh;
+		dh->codec = codecs[i].codec;
+		LL_APPEND (parser->special_handlers, &dh->h);
+		added = true;
+	}
 
-		/* Put all of the content of the include inside that object */
-		parser->stack->obj->value.ov = container;
-
-		st = UCL_ALLOC (sizeof (struct ucl_stack));
-		if (st == NULL) {
-			ucl_create_err (&parser->err, "cannot allocate memory for an object");
-			ucl_object_unref (nest_obj);
+	ucl_parser_allocator_leave (parser, prev);
 
-			if (buf) {
-				ucl_munmap (buf, buflen);
-			}
+	return added;
+}
 
-			return false;
-		}
-		st->obj = nest_obj;
-		st->e.params.level = parser->stack->e.params.level;
-		st->e.params.flags = parser->stack->e.params.flags;
-		st->e.params.line = parser->stack->e.params.line;
-		st->chunk = parser->chunks;
-		LL_PREPEND (parser->stack, st);
-		parser->cur_obj = nest_obj;
+bool
+ucl_parser_set_decompress_limit (struct ucl_parser *parser, size_t limit)
+{
+	if (parser == NULL) {
+		return false;
 	}
 
-	res = ucl_parser_add_chunk_full (parser, buf, buflen, params->priority,
-			params->strat, params->parse_type);
-
-	if (res) {
-		/* Stop nesting the include, take 1 level off the stack */
-		if (params->prefix != NULL && nest_obj != NULL) {
-			parser->stack = st->next;
-			UCL_FREE (sizeof (struct ucl_stack), st);
-		}
+	parser->decompress_limit = limit;
 
-		/* Remove chunk from the stack */
-		chunk = parser->chunks;
-		if (chunk != NULL) {
-			parser->chunks = chunk->next;
-			ucl_chunk_free (chunk);
-			parser->recursion--;
-		}
+	return true;
+}
 
-		/* Restore old file vars */
-		if (parser->cur_file) {
-			free (parser->cur_file);
-		}
+#ifdef CURL_FOUND
+struct ucl_curl_cbdata {
+	unsigned char *buf;
+	size_t buflen;
+};
 
-		parser->cur_file = old_curfile;
-		DL_FOREACH_SAFE (parser->variables, cur_var, tmp_var) {
-			if (strcmp (cur_var->var, "CURDIR") == 0 && old_curdir) {
-				DL_DELETE (parser->variables, cur_var);
-				free (cur_var->var);
-				free (cur_var->value);
-				UCL_FREE (sizeof (struct ucl_variable), cur_var);
-			} else if (strcmp (cur_var->var, "FILENAME") == 0 && old_filename) {
-				DL_DELETE (parser->variables, cur_var);
-				free (cur_var->var);
-				free (cur_var->value);
-				UCL_FREE (sizeof (struct ucl_variable), cur_var);
-			}
-		}
-		if (old_filename) {
-			DL_APPEND (parser->variables, old_filename);
-		}
-		if (old_curdir) {
-			DL_APPEND (parser->variables, old_curdir);
-		}
+static size_t
+ucl_curl_write_callback (void* contents, size_t size, size_t nmemb, void* ud)
+{
+	struct ucl_curl_cbdata *cbdata = ud;
+	size_t realsize = size * nmemb;
 
-		parser->state = prev_state;
+	cbdata->buf = UCL_REALLOC (cbdata->buf, cbdata->buflen + realsize + 1);
+	if (cbdata->buf == NULL) {
+		return 0;
 	}
 
-	if (buflen > 0) {
-		ucl_munmap (buf, buflen);
-	}
+	memcpy (&(cbdata->buf[cbdata->buflen]), contents, realsize);
+	cbdata->buflen += realsize;
+	cbdata->buf[cbdata->buflen] = 0;
 
-	return res;
+	return realsize;
 }
+#endif
 
 /**
- * Include a file to configuration
- * @param data
- * @param len
- * @param parser
- * @param err
+ * Fetch a url and save results to the memory buffer
+ * @param url url to fetch
+ * @param len length of url
+ * @param buf target buffer
+ * @param buflen target length
  * @return
  */
-static bool
-ucl_include_file (const unsigned char *data, size_t len,
-				  struct ucl_parser *parser,
-				  struct ucl_include_params *params,
-				  const ucl_object_t *args)
+bool
+ucl_fetch_url (const unsigned char *url, unsigned char **buf, size_t *buflen,
+		UT_string **err, bool must_exist)
 {
-	const unsigned char *p = data, *end = data + len;
-	bool need_glob = false;
-	int cnt = 0;
-	char glob_pattern[PATH_MAX];
-	size_t i;
 
-#ifndef _WIN32
-	if (!params->allow_glob) {
-		return ucl_include_file_single (data, len, parser, params);
-	}
-	else {
-		/* Check for special symbols in a filename */
-		while (p != end) {
-			if (*p == '*' || *p == '?') {
-				need_glob = true;
-				break;
-			}
-			p ++;
+#ifdef HAVE_FETCH_H
+	struct url *fetch_url;
+	struct url_stat us;
+	FILE *in;
+
+	fetch_url = fetchParseURL (url);
+	if (fetch_url == NULL) {
+		ucl_create_err (err, "invalid URL %s: %s",
+				url, strerror (errno));
+		return false;
+	}
+	if ((in = fetchXGet (fetch_url, &us, "")) == NULL) {
+		if (!must_exist) {
+			ucl_create_err (err, "cannot fetch URL %s: %s",
+				url, strerror (errno));
 		}
-		if (need_glob) {
-			glob_t globbuf;
-			memset (&globbuf, 0, sizeof (globbuf));
-			ucl_strlcpy (glob_pattern, (const char *)data,
-				(len + 1 < sizeof (glob_pattern) ? len + 1 : sizeof (glob_pattern)));
-			if (glob (glob_pattern, 0, NULL, &globbuf) != 0) {
-				return (!params->must_exist || false);
-			}
-			for (i = 0; i < globbuf.gl_pathc; i ++) {
+		fetchFreeURL (fetch_url);
+		return false;
+	}
 
-				if (parser->include_trace_func) {
-					const ucl_object_t *parent = NULL;
+	*buflen = us.size;
+	*buf = UCL_ALLOC (*buflen);
+	if (*buf == NULL) {
+		ucl_create_err (err, "cannot allocate buffer for URL %s: %s",
+				url, strerror (errno));
+		fclose (in);
+		fetchFreeURL (fetch_url);
+		return false;
+	}
 
-					if (parser->stack) {
-						parent = parser->stack->obj;
-					}
+	if (fread (*buf, *buflen, 1, in) != 1) {
+		ucl_create_err (err, "cannot read URL %s: %s",
+				url, strerror (errno));
+		fclose (in);
+		fetchFreeURL (fetch_url);
+		return false;
+	}
 
-					parser->include_trace_func (parser, parent, NULL,
-							globbuf.gl_pathv[i],
-							strlen (globbuf.gl_pathv[i]),
-							parser->include_trace_ud);
-				}
+	fetchFreeURL (fetch_url);
+	return true;
+#elif defined(CURL_FOUND)
+	CURL *curl;
+	int r;
+	struct ucl_curl_cbdata cbdata;
 
-				if (!ucl_include_file_single ((unsigned char *)globbuf.gl_pathv[i],
-						strlen (globbuf.gl_pathv[i]), parser, params)) {
-					if (params->soft_fail) {
-						continue;
-					}
-					globfree (&globbuf);
-					return false;
-				}
-				cnt ++;
-			}
-			globfree (&globbuf);
+	curl = curl_easy_init ();
+	if (curl == NULL) {
+		ucl_create_err (err, "CURL interface is broken");
+		return false;
+	}
+	if ((r = curl_easy_setopt (curl, CURLOPT_URL, url)) != CURLE_OK) {
+		ucl_create_err (err, "invalid URL %s: %s",
+				url, curl_easy_strerror (r));
+		curl_easy_cleanup (curl);
+		return false;
+	}
+	curl_easy_setopt (curl, CURLOPT_WRITEFUNCTION, ucl_curl_write_callback);
+	cbdata.buf = NULL;
+	cbdata.buflen = 0;
+	curl_easy_setopt (curl, CURLOPT_WRITEDATA, &cbdata);
 
-			if (cnt == 0 && params->must_exist) {
-				ucl_create_err (&parser->err, "cannot match any files for pattern %s",
-					glob_pattern);
-				return false;
-			}
+	if ((r = curl_easy_perform (curl)) != CURLE_OK) {
+		if (!must_exist) {
+			ucl_create_err (err, "error fetching URL %s: %s",
+				url, curl_easy_strerror (r));
 		}
-		else {
-			return ucl_include_file_single (data, len, parser, params);
+		curl_easy_cleanup (curl);
+		if (cbdata.buf) {
+			ucl_free (cbdata.buf);
 		}
+		return false;
 	}
-#else
-	/* Win32 compilers do not support globbing. Therefore, for Win32,
-	   treat allow_glob/need_glob as a NOOP and just return */
-	return ucl_include_file_single (data, len, parser, params);
-#endif
+	*buf = cbdata.buf;
+	*buflen = cbdata.buflen;
+
+	curl_easy_cleanup (curl);
 
 	return true;
+#else
+	ucl_create_err (err, "URL support is disabled");
+	return false;
+#endif
 }
 
 /**
- * Common function to handle .*include* macros
- * @param data
- * @param len
- * @param args
- * @param parser
- * @param default_try
- * @param default_sign
+ * Fetch a file and save results to the memory buffer
+ * @param filename filename to fetch
+ * @param len length of filename
+ * @param buf target buffer
+ * @param buflen target length
  * @return
  */
-static bool
-ucl_include_common (const unsigned char *data, size_t len,
-		const ucl_object_t *args, struct ucl_parser *parser,
-		bool default_try,
-		bool default_sign)
+bool
+ucl_fetch_file (const unsigned char *filename, unsigned char **buf, size_t *buflen,
+		UT_string **err, bool must_exist)
 {
-	bool allow_url = false, search = false;
-	const char *duplicate;
-	const ucl_object_t *param;
-	ucl_object_iter_t it = NULL, ip = NULL;
-	char ipath[PATH_MAX];
-	struct ucl_include_params params;
-
-	/* Default values */
-	params.soft_fail = default_try;
-	params.allow_glob = false;
-	params.check_signature = default_sign;
-	params.use_prefix = false;
-	params.target = "object";
-	params.prefix = NULL;
-	params.priority = 0;
-	params.parse_type = UCL_PARSE_UCL;
-	params.strat = UCL_DUPLICATE_APPEND;
-	params.must_exist = !default_try;
-
-	if (parser->include_trace_func) {
-		const ucl_object_t *parent = NULL;
+	int fd;
+	struct stat st;
+	if ((fd = open (filename, O_RDONLY)) == -1) {
+		ucl_create_err (err, "cannot open file %s: %s",
+				filename, strerror (errno));
+		return false;
+	}
 
-		if (parser->stack) {
-			parent = parser->stack->obj;
+	if (fstat (fd, &st) == -1) {
+		if (must_exist || errno == EPERM) {
+			ucl_create_err (err, "cannot stat file %s: %s",
+					filename, strerror (errno));
 		}
+		close (fd);
 
-		parser->include_trace_func (parser, parent, args,
-				data, len, parser->include_trace_ud);
+		return false;
 	}
+	if (!S_ISREG (st.st_mode)) {
+		if (must_exist) {
+			ucl_create_err (err, "file %s is not a regular file", filename);
+		}
+		close (fd);
 
-	/* Process arguments */
-	if (args != NULL && args->type == UCL_OBJECT) {
-		while ((param = ucl_object_iterate (args, &it, true)) != NULL) {
-			if (param->type == UCL_BOOLEAN) {
-				if (strncmp (param->key, "try", param->keylen) == 0) {
-					params.must_exist = !ucl_object_toboolean (param);
-				}
-				else if (strncmp (param->key, "sign", param->keylen) == 0) {
-					params.check_signature = ucl_object_toboolean (param);
-				}
-				else if (strncmp (param->key, "glob", param->keylen) == 0) {
-					params.allow_glob = ucl_object_toboolean (param);
-				}
-				else if (strncmp (param->key, "url", param->keylen) == 0) {
-					allow_url = ucl_object_toboolean (param);
-				}
-				else if (strncmp (param->key, "prefix", param->keylen) == 0) {
-					params.use_prefix = ucl_object_toboolean (param);
-				}
-			}
-			else if (param->type == UCL_STRING) {
-				if (strncmp (param->key, "key", param->keylen) == 0) {
-					params.prefix = ucl_object_tostring (param);
-				}
-				else if (strncmp (param->key, "target", param->keylen) == 0) {
-					params.target = ucl_object_tostring (param);
-				}
-				else if (strncmp (param->key, "duplicate", param->keylen) == 0) {
-					duplicate = ucl_object_tostring (param);
+		return false;
+	}
 
-					if (strcmp (duplicate, "append") == 0) {
-						params.strat = UCL_DUPLICATE_APPEND;
-					}
-					else if (strcmp (duplicate, "merge") == 0) {
-						params.strat = UCL_DUPLICATE_MERGE;
-					}
-					else if (strcmp (duplicate, "rewrite") == 0) {
-						params.strat = UCL_DUPLICATE_REWRITE;
-					}
-					else if (strcmp (duplicate, "error") == 0) {
-						params.strat = UCL_DUPLICATE_ERROR;
-					}
-				}
-			}
-			else if (param->type == UCL_ARRAY) {
-				if (strncmp (param->key, "path", param->keylen) == 0) {
-					ucl_set_include_path (parser, __DECONST(ucl_object_t *, param));
-				}
-			}
-			else if (param->type == UCL_INT) {
-				if (strncmp (param->key, "priority", param->keylen) == 0) {
-					params.priority = ucl_object_toint (param);
-				}
-			}
-		}
+	if (st.st_size == 0) {
+		/* Do not map empty files */
+		*buf = NULL;
+		*buflen = 0;
 	}
+	else {
+		if ((*buf = ucl_mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+			close(fd);
+			ucl_create_err(err, "cannot mmap file %s: %s",
+					filename, strerror(errno));
+			*buf = NULL;
 
-	if (parser->includepaths == NULL) {
-		if (allow_url && ucl_strnstr (data, "://", len) != NULL) {
-			/* Globbing is not used for URL's */
-			return ucl_include_url (data, len, parser, &params);
-		}
-		else if (data != NULL) {
-			/* Try to load a file */
-			return ucl_include_file (data, len, parser, &params, args);
+			return false;
 		}
+		*buflen = st.st_size;
 	}
-	else {
-		if (allow_url && ucl_strnstr (data, "://", len) != NULL) {
-			/* Globbing is not used for URL's */
-			return ucl_include_url (data, len, parser, &params);
-		}
 
-		ip = ucl_object_iterate_new (parser->includepaths);
-		while ((param = ucl_object_iterate_safe (ip, true)) != NULL) {
-			if (ucl_object_type(param) == UCL_STRING) {
-				snprintf (ipath, sizeof (ipath), "%s/%.*s", ucl_object_tostring(param),
-						(int)len, data);
-				if ((search = ucl_include_file (ipath, strlen (ipath),
-						parser, &params, args))) {
-					if (!params.allow_glob) {
-						break;
-					}
-				}
-			}
-		}
-		ucl_object_iterate_free (ip);
-		if (search == true) {
-			return true;
-		}
-		else {
-			ucl_create_err (&parser->err,
-					"cannot find file: %.*s in search path",
-					(int)len, data);
-			return false;
-		}
-	}
+	close (fd);
 
-	return false;
+	return true;
 }
 
-/**
- * Handle include macro
- * @param data include data
- * @param len length of data
- * @param args UCL object representing arguments to the macro
- * @param ud user data
- * @return
- */
-bool
-ucl_include_handler (const unsigned char *data, size_t len,
-		const ucl_object_t *args, void* ud)
+
+#if (defined(HAVE_OPENSSL) && OPENSSL_VERSION_NUMBER >= 0x10000000L)
+static inline bool
+ucl_sig_check (const unsigned char *data, size_t datalen,
+		const unsigned char *sig, size_t siglen, struct ucl_parser *parser)
 {
-	struct ucl_parser *parser = ud;
+	struct ucl_pubkey *key;
+	char dig[EVP_MAX_MD_SIZE];
+	unsigned int diglen;
+	EVP_PKEY_CTX *key_ctx;
+	EVP_MD_CTX *sign_ctx = NULL;
 
-	return ucl_include_common (data, len, args, parser, false, false);
-}
+	sign_ctx = EVP_MD_CTX_create ();
 
-/**
- * Handle includes macro
- * @param data include data
- * @param len length of data
- * @param args UCL object representing arguments to the macro
- * @param ud user data
- * @return
- */
-bool
-ucl_includes_handler (const unsigned char *data, size_t len,
-		const ucl_object_t *args, void* ud)
-{
-	struct ucl_parser *parser = ud;
+	LL_FOREACH (parser->keys, key) {
+		key_ctx = EVP_PKEY_CTX_new (key->key, NULL);
+		if (key_ctx != NULL) {
+			if (EVP_PKEY_verify_init (key_ctx) <= 0) {
+				EVP_PKEY_CTX_free (key_ctx);
+				continue;
+			}
+			if (EVP_PKEY_CTX_set_rsa_padding (key_ctx, RSA_PKCS1_PADDING) <= 0) {
+				EVP_PKEY_CTX_free (key_ctx);
+				continue;
+			}
+			if (EVP_PKEY_CTX_set_signature_md (key_ctx, EVP_sha256 ()) <= 0) {
+				EVP_PKEY_CTX_free (key_ctx);
+				continue;
+			}
+			EVP_DigestInit (sign_ctx, EVP_sha256 ());
+			EVP_DigestUpdate (sign_ctx, data, datalen);
+			EVP_DigestFinal (sign_ctx, dig, &diglen);
 
-	return ucl_include_common (data, len, args, parser, false, true);
-}
+			if (EVP_PKEY_verify (key_ctx, sig, siglen, dig, diglen) == 1) {
+				EVP_MD_CTX_destroy (sign_ctx);
+				EVP_PKEY_CTX_free (key_ctx);
+				return true;
+			}
 
-/**
- * Handle tryinclude macro
- * @param data include data
- * @param len length of data
- * @param args UCL object representing arguments to the macro
- * @param ud user data
- * @return
- */
-bool
-ucl_try_include_handler (const unsigned char *data, size_t len,
-		const ucl_object_t *args, void* ud)
-{
-	struct ucl_parser *parser = ud;
+			EVP_PKEY_CTX_free (key_ctx);
+		}
+	}
 
-	return ucl_include_common (data, len, args, parser, true, false);
+	EVP_MD_CTX_destroy (sign_ctx);
+
+	return false;
 }
+#endif
+
+struct ucl_include_params {
+	bool check_signature;
+	bool must_exist;
+	bool use_glob;
+	bool use_prefix;
+	bool soft_fail;
+	bool allow_glob;
+	unsigned priority;
+	enum ucl_duplicate_strategy strat;
+	enum ucl_parse_type parse_type;
+	const char *prefix;
+	const char *target;
+};
 
 /**
- * Handle priority macro
- * @param data include data
- * @param len length of data
- * @param args UCL object representing arguments to the macro
- * @param ud user data
+ * Include an url to configuration
+ * @param data
+ * @param len
+ * @param parser
+ * @param err
  * @return
  */
-bool
-ucl_priority_handler (const unsigned char *data, size_t len,
-		const ucl_object_t *args, void* ud)
+static bool
+ucl_include_url (const unsigned char *data, size_t len,
+		struct ucl_parser *parser,
+		struct ucl_include_params *params)
 {
-	struct ucl_parser *parser = ud;
-	unsigned priority = 255;
-	const ucl_object_t *param;
-	bool found = false;
-	char *value = NULL, *leftover = NULL;
-	ucl_object_iter_t it = NULL;
 
-	if (parser == NULL) {
-		return false;
-	}
+	bool res;
+	unsigned char *buf = NULL;
+	size_t buflen = 0;
+	struct ucl_chunk *chunk;
+	char urlbuf[PATH_MAX];
+	int prev_state;
 
-	/* Process arguments */
-	if (args != NULL && args->type == UCL_OBJECT) {
-		while ((param = ucl_object_iterate (args, &it, true)) != NULL) {
-			if (param->type == UCL_INT) {
-				if (strncmp (param->key, "priority", param->keylen) == 0) {
-					priority = ucl_object_toint (param);
-					found = true;
-				}
-			}
+	snprintf (urlbuf, sizeof (urlbuf), "%.*s", (int)len, data);
+
+	if (!ucl_fetch_url (urlbuf, &buf, &buflen, &parser->err, params->must_exist)) {
+		if (!params->must_exist) {
+			ucl_parser_clear_error (parser);
 		}
+		return !params->must_exist;
 	}
 
-	if (len > 0) {
-		value = malloc(len + 1);
-		ucl_strlcpy(value, (const char *)data, len + 1);
-		priority = strtol(value, &leftover, 10);
-		if (*leftover != '\0') {
-			ucl_create_err (&parser->err, "Invalid priority value in macro: %s",
-				value);
-			free(value);
+	if (params->check_signature) {
+#if (defined(HAVE_OPENSSL) && OPENSSL_VERSION_NUMBER >= 0x10000000L)
+		unsigned char *sigbuf = NULL;
+		size_t siglen = 0;
+		/* We need to check signature first */
+		snprintf (urlbuf, sizeof (urlbuf), "%.*s.sig", (int)len, data);
+		if (!ucl_fetch_url (urlbuf, &sigbuf, &siglen, &parser->err, true)) {
 			return false;
 		}
-		free(value);
-		found = true;
+		if (!ucl_sig_check (buf, buflen, sigbuf, siglen, parser)) {
+			ucl_create_err (&parser->err, "cannot verify url %s: %s",
+							urlbuf,
+							ERR_error_string (ERR_get_error (), NULL));
+			if (siglen > 0) {
+				ucl_munmap (sigbuf, siglen);
+			}
+			return false;
+		}
+		if (siglen > 0) {
+			ucl_munmap (sigbuf, siglen);
+		}
+#endif
 	}
 
-	if (found == true) {
-		parser->chunks->priority = priority;
-		return true;
+	prev_state = parser->state;
+	parser->state = UCL_STATE_INIT;
+
+	res = ucl_parser_add_chunk_full (parser, buf, buflen, params->priority,
+			params->strat, params->parse_type);
+	if (res == true) {
+		/* Remove chunk from the stack */
+		chunk = parser->chunks;
+		if (chunk != NULL) {
+			parser->chunks = chunk->next;
+			ucl_chunk_free (chunk);
+		}
 	}
 
-	ucl_create_err (&parser->err, "Unable to parse priority macro");
-	return false;
+	parser->state = prev_state;
+	ucl_free (buf);
+
+	return res;
 }
 
 /**
- * Handle load macro
- * @param data include data
- * @param len length of data
- * @param args UCL object representing arguments to the macro
- * @param ud user data
+ * Include a single file to the parser
+ * @param data
+ * @param len
+ * @param parser
+ * @param check_signature
+ * @param must_exist
+ * @param allow_glob
+ * @param priority
  * @return
  */
-bool
-ucl_load_handler (const unsigned char *data, size_t len,
-		const ucl_object_t *args, void* ud)
+static bool
+ucl_include_file_single (const unsigned char *data, size_t len,
+		struct ucl_parser *parser, struct ucl_include_params *params)
 {
-	struct ucl_parser *parser = ud;
-	const ucl_object_t *param;
-	ucl_object_t *obj, *old_obj;
-	ucl_object_iter_t it = NULL;
-	bool try_load, multiline, test;
-	const char *target, *prefix;
-	char *load_file, *tmp;
-	unsigned char *buf;
-	size_t buflen;
-	unsigned priority;
-	int64_t iv;
-	ucl_object_t *container = NULL;
-	enum ucl_string_flags flags;
-
-	/* Default values */
-	try_load = false;
-	multiline = false;
-	test = false;
-	target = "string";
-	prefix = NULL;
-	load_file = NULL;
-	buf = NULL;
-	buflen = 0;
-	priority = 0;
-	obj = NULL;
-	old_obj = NULL;
-	flags = 0;
+	bool res;
+	struct ucl_chunk *chunk;
+	unsigned char *buf = NULL;
+	char *old_curfile, *ext;
+	size_t buflen = 0;
+	char filebuf[PATH_MAX], realbuf[PATH_MAX];
+	int prev_state;
+	struct ucl_variable *cur_var, *tmp_var, *old_curdir = NULL,
+			*old_filename = NULL;
+	ucl_object_t *nest_obj = NULL, *old_obj = NULL, *new_obj = NULL;
+	ucl_hash_t *container = NULL;
+	struct ucl_stack *st = NULL;
 
-	if (parser == NULL) {
+	if (parser->state == UCL_STATE_ERROR) {
+		/* Return immediately if we are in the error state... */
 		return false;
 	}
 
-	/* Process arguments */
-	if (args != NULL && args->type == UCL_OBJECT) {
-		while ((param = ucl_object_iterate (args, &it, true)) != NULL) {
-			if (param->type == UCL_BOOLEAN) {
-				if (strncmp (param->key, "try", param->keylen) == 0) {
-					try_load = ucl_object_toboolean (param);
-				}
-				else if (strncmp (param->key, "multiline", param->keylen) == 0) {
-					multiline = ucl_object_toboolean (param);
-				}
-				else if (strncmp (param->key, "escape", param->keylen) == 0) {
-					test = ucl_object_toboolean (param);
-					if (test) {
-						flags |= UCL_STRING_ESCAPE;
-					}
-				}
-				else if (strncmp (param->key, "trim", param->keylen) == 0) {
-					test = ucl_object_toboolean (param);
-					if (test) {
-						flags |= UCL_STRING_TRIM;
-					}
-				}
-			}
-			else if (param->type == UCL_STRING) {
-				if (strncmp (param->key, "key", param->keylen) == 0) {
-					prefix = ucl_object_tostring (param);
-				}
-				else if (strncmp (param->key, "target", param->keylen) == 0) {
-					target = ucl_object_tostring (param);
-				}
-			}
-			else if (param->type == UCL_INT) {
-				if (strncmp (param->key, "priority", param->keylen) == 0) {
-					priority = ucl_object_toint (param);
-				}
-			}
+	snprintf (filebuf, sizeof (filebuf), "%.*s", (int)len, data);
+	if (ucl_realpath (filebuf, realbuf) == NULL) {
+		if (params->soft_fail) {
+			return false;
+		}
+		if (!params->must_exist && errno != EPERM) {
+			return true;
 		}
-	}
 
-	if (prefix == NULL || strlen (prefix) == 0) {
-		ucl_create_err (&parser->err, "No Key specified in load macro");
+		ucl_create_err (&parser->err, "cannot open file %s: %s",
+									filebuf,
+									strerror (errno));
 		return false;
 	}
 
-	if (len > 0) {
-		load_file = malloc (len + 1);
-		if (!load_file) {
-			ucl_create_err (&parser->err, "cannot allocate memory for suffix");
-
+	if (parser->cur_file && strcmp (realbuf, parser->cur_file) == 0) {
+		/* We are likely including the file itself */
+		if (params->soft_fail) {
 			return false;
 		}
 
-		snprintf (load_file, len + 1, "%.*s", (int)len, data);
-
-		if (!ucl_fetch_file (load_file, &buf, &buflen, &parser->err,
-				!try_load)) {
-			free (load_file);
+		ucl_create_err (&parser->err, "trying to include the file %s from itself",
+				realbuf);
+		return false;
+	}
 
-			if (try_load) {
-				ucl_parser_clear_error (parser);
-			}
+	if (!ucl_fetch_file (realbuf, &buf, &buflen, &parser->err, params->must_exist)) {
+		if (params->soft_fail) {
+			return false;
+		}
 
-			return (try_load || false);
+		if (params->must_exist || parser->err != NULL) {
+			/* The case of fatal errors */
+			return false;
 		}
 
-		free (load_file);
-		container = parser->stack->obj;
-		old_obj = __DECONST (ucl_object_t *, ucl_object_lookup (container,
-				prefix));
+		ucl_parser_clear_error (parser);
 
-		if (old_obj != NULL) {
-			ucl_create_err (&parser->err, "Key %s already exists", prefix);
+		return true;
+	}
+
+	if (params->check_signature) {
+#if (defined(HAVE_OPENSSL) && OPENSSL_VERSION_NUMBER >= 0x10000000L)
+		unsigned char *sigbuf = NULL;
+		size_t siglen = 0;
+		/* We need to check signature first */
+		snprintf (filebuf, sizeof (filebuf), "%s.sig", realbuf);
+		if (!ucl_fetch_file (filebuf, &sigbuf, &siglen, &parser->err, true)) {
 			if (buf) {
 				ucl_munmap (buf, buflen);
 			}
 
 			return false;
 		}
-
-		if (strcasecmp (target, "string") == 0) {
-			obj = ucl_object_fromstring_common (buf, buflen, flags);
-			ucl_copy_value_trash (obj);
-			if (multiline) {
-				obj->flags |= UCL_OBJECT_MULTILINE;
+		if (!ucl_sig_check (buf, buflen, sigbuf, siglen, parser)) {
+			ucl_create_err (&parser->err, "cannot verify file %s: %s",
+							filebuf,
+							ERR_error_string (ERR_get_error (), NULL));
+			if (sigbuf) {
+				ucl_munmap (sigbuf, siglen);
 			}
-		}
-		else if (strcasecmp (target, "int") == 0) {
-			tmp = malloc (buflen + 1);
-
-			if (tmp == NULL) {
-				ucl_create_err (&parser->err, "Memory allocation failed");
-				if (buf) {
-					ucl_munmap (buf, buflen);
-				}
-
-				return false;
+			if (buf) {
+				ucl_munmap (buf, buflen);
 			}
 
-			snprintf (tmp, buflen + 1, "%.*s", (int)buflen, buf);
-			iv = strtoll (tmp, NULL, 10);
-			obj = ucl_object_fromint (iv);
-			free (tmp);
-		}
-
-		if (buf) {
-			ucl_munmap (buf, buflen);
+			return false;
 		}
 
-		if (obj != NULL) {
-			obj->key = prefix;
-			obj->keylen = strlen (prefix);
-			ucl_copy_key_trash (obj);
-			obj->prev = obj;
-			obj->next = NULL;
-			ucl_object_set_priority (obj, priority);
-			ucl_object_insert_key (container, obj, obj->key, obj->keylen, false);
+		if (sigbuf) {
+			ucl_munmap (sigbuf, siglen);
 		}
-
-		return true;
+#endif
 	}
 
-	ucl_create_err (&parser->err, "Unable to parse load macro");
-	return false;
-}
-
-bool
-ucl_inherit_handler (const unsigned char *data, size_t len,
-		const ucl_object_t *args, const ucl_object_t *ctx, void* ud)
-{
-	const ucl_object_t *parent, *cur;
-	ucl_object_t *target, *copy;
-	ucl_object_iter_t it = NULL;
-	bool replace = false;
-	struct ucl_parser *parser = ud;
-
-	parent = ucl_object_lookup_len (ctx, data, len);
-
-	/* Some sanity checks */
-	if (parent == NULL || ucl_object_type (parent) != UCL_OBJECT) {
-		ucl_create_err (&parser->err, "Unable to find inherited object %.*s",
-				(int)len, data);
-		return false;
-	}
+	old_curfile = parser->cur_file;
+	parser->cur_file = NULL;
 
-	if (parser->stack == NULL || parser->stack->obj == NULL ||
-			ucl_object_type (parser->stack->obj) != UCL_OBJECT) {
-		ucl_create_err (&parser->err, "Invalid inherit context");
-		return false;
+	/* Store old file vars */
+	DL_FOREACH_SAFE (parser->variables, cur_var, tmp_var) {
+		if (strcmp (cur_var->var, "CURDIR") == 0) {
+			old_curdir = cur_var;
+			DL_DELETE (parser->variables, cur_var);
+		}
+		else if (strcmp (cur_var->var, "FILENAME") == 0) {
+			old_filename = cur_var;
+			DL_DELETE (parser->variables, cur_var);
+		}
 	}
 
-	target = parser->stack->obj;
+	ucl_parser_set_filevars (parser, realbuf, false);
 
-	if (args && (cur = ucl_object_lookup (args, "replace")) != NULL) {
-		replace = ucl_object_toboolean (cur);
-	}
+	prev_state = parser->state;
+	parser->state = UCL_STATE_INIT;
 
-	while ((cur = ucl_object_iterate (parent, &it, true))) {
-		/* We do not replace existing keys */
-		if (!replace && ucl_object_lookup_len (target, cur->key, cur->keylen)) {
-			continue;
+	if (params->use_prefix && params->prefix == NULL) {
+		/* Auto generate a key name based on the included filename */
+		params->prefix = basename (realbuf);
+		ext = strrchr (params->prefix, '.');
+		if (ext != NULL && (strcmp (ext, ".conf") == 0 || strcmp (ext, ".ucl") == 0)) {
+			/* Strip off .conf or .ucl */
+			*ext = '\0';
 		}
+	}
+	if (params->prefix != NULL) {
+		/* This is a prefixed include */
+		container = parser->stack->obj->value.ov;
 
-		copy = ucl_object_copy (cur);
-
-		if (!replace) {
-			copy->flags |= UCL_OBJECT_INHERITED;
-		}
+		old_obj = __DECONST (ucl_object_t *, ucl_hash_search (container,
+				params->prefix, strlen (params->prefix)));
 
-		ucl_object_insert_key (target, copy, copy->key,
-				copy->keylen, false);
-	}
+		if (strcasecmp (params->target, "array") == 0) {
+			if (old_obj == NULL) {
+				/* Create an array with key: prefix */
+				old_obj = ucl_object_new_full (UCL_ARRAY, params->priority);
+				old_obj->key = params->prefix;
+				old_obj->keylen = strlen (params->prefix);
+				ucl_copy_key_trash (old_obj);
+				old_obj->prev = old_obj;
+				old_obj->next = NULL;
 
-	return true;
-}
+				container = ucl_hash_insert_object (container, old_obj,
+						parser->flags & UCL_PARSER_KEY_LOWERCASE);
+				parser->stack->obj->len++;
 
-bool
-ucl_parser_set_filevars (struct ucl_parser *parser, const char *filename, bool need_expand)
-{
-	char realbuf[PATH_MAX], *curdir;
+				nest_obj = ucl_object_new_full (UCL_OBJECT, params->priority);
+				nest_obj->prev = nest_obj;
+				nest_obj->next = NULL;
 
-	if (filename != NULL) {
-		if (need_expand) {
-			if (ucl_realpath (filename, realbuf) == NULL) {
-				return false;
+				ucl_array_append (old_obj, nest_obj);
 			}
-		}
-		else {
-			ucl_strlcpy (realbuf, filename, sizeof (realbuf));
-		}
+			else {
+				if (ucl_object_type (old_obj) == UCL_ARRAY) {
+					/* Append to the existing array */
+					nest_obj = ucl_object_new_full (UCL_OBJECT,
+							params->priority);
+					if (nest_obj == NULL) {
+						ucl_create_err (&parser->err,
+								"cannot allocate memory for an object");
+						if (buf) {
+							ucl_munmap (buf, buflen);
+						}
 
-		if (parser->cur_file) {
-			free (parser->cur_file);
-		}
+						return false;
+					}
+					nest_obj->prev = nest_obj;
+					nest_obj->next = NULL;
 
-		parser->cur_file = strdup (realbuf);
+					ucl_array_append (old_obj, nest_obj);
+				}
+				else {
+					/* Convert the object to an array */
+					new_obj = ucl_object_typed_new (UCL_ARRAY);
+					if (new_obj == NULL) {
+						ucl_create_err (&parser->err,
+								"cannot allocate memory for an object");
+						if (buf) {
+							ucl_munmap (buf, buflen);
+						}
 
-		/* Define variables */
-		ucl_parser_register_variable (parser, "FILENAME", realbuf);
-		curdir = dirname (realbuf);
-		ucl_parser_register_variable (parser, "CURDIR", curdir);
-	}
-	else {
-		/* Set everything from the current dir */
-		curdir = getcwd (realbuf, sizeof (realbuf));
-		ucl_parser_register_variable (parser, "FILENAME", "undef");
-		ucl_parser_register_variable (parser, "CURDIR", curdir);
-	}
+						return false;
+					}
+					new_obj->key = old_obj->key;
+					new_obj->keylen = old_obj->keylen;
+					new_obj->flags |= UCL_OBJECT_MULTIVALUE;
+					new_obj->prev = new_obj;
+					new_obj->next = NULL;
 
-	return true;
-}
+					nest_obj = ucl_object_new_full (UCL_OBJECT,
+							params->priority);
+					if (nest_obj == NULL) {
+						ucl_create_err (&parser->err,
+								"cannot allocate memory for an object");
+						if (buf) {
+							ucl_munmap (buf, buflen);
+						}
 
-bool
-ucl_parser_add_file_full (struct ucl_parser *parser, const char *filename,
-		unsigned priority, enum ucl_duplicate_strategy strat,
-		enum ucl_parse_type parse_type)
-{
-	unsigned char *buf;
-	size_t len;
-	bool ret;
-	char realbuf[PATH_MAX];
+						ucl_object_unref (new_obj);
 
-	if (ucl_realpath (filename, realbuf) == NULL) {
-		ucl_create_err (&parser->err, "cannot open file %s: %s",
-				filename,
-				strerror (errno));
-		return false;
-	}
+						return false;
+					}
+					nest_obj->prev = nest_obj;
+					nest_obj->next = NULL;
 
-	if (!ucl_fetch_file (realbuf, &buf, &len, &parser->err, true)) {
-		return false;
-	}
+					ucl_array_append (new_obj, old_obj);
+					ucl_array_append (new_obj, nest_obj);
+					ucl_hash_replace (container, old_obj, new_obj);
+				}
+			}
+		}
+		else {
+			/* Case of object */
+			if (old_obj == NULL) {
+				/* Create an object with key: prefix */
+				nest_obj = ucl_object_new_full (UCL_OBJECT, params->priority);
 
-	ucl_parser_set_filevars (parser, realbuf, false);
-	ret = ucl_parser_add_chunk_full (parser, buf, len, priority, strat,
-			parse_type);
+				if (nest_obj == NULL) {
+					ucl_create_err (&parser->err, "cannot allocate memory for an object");
+					if (buf) {
+						ucl_munmap (buf, buflen);
+					}
 
-	if (len > 0) {
-		ucl_munmap (buf, len);
-	}
+					return false;
+				}
 
-	return ret;
-}
+				nest_obj->key = params->prefix;
+				nest_obj->keylen = strlen (params->prefix);
+				ucl_copy_key_trash(nest_obj);
+				nest_obj->prev = nest_obj;
+				nest_obj->next = NULL;
 
-bool
-ucl_parser_add_file_priority (struct ucl_parser *parser, const char *filename,
-		unsigned priority)
-{
-	if (parser == NULL) {
-		return false;
-	}
+				container = ucl_hash_insert_object (container, nest_obj,
+						parser->flags & UCL_PARSER_KEY_LOWERCASE);
+				parser->stack->obj->len ++;
+			}
+			else {
+				if (ucl_object_type (old_obj) == UCL_OBJECT) {
+					/* Append to existing Object*/
+					nest_obj = old_obj;
+				}
+				else {
+					/* The key is not an object */
+					ucl_create_err (&parser->err,
+							"Conflicting type for key: %s, asked %s, has %s",
+							params->prefix, params->target,
+							ucl_object_type_to_string (ucl_object_type (old_obj)));
+					if (buf) {
+						ucl_munmap (buf, buflen);
+					}
 
-	return ucl_parser_add_file_full(parser, filename, priority,
-			UCL_DUPLICATE_APPEND, UCL_PARSE_UCL);
-}
+					return false;
+				}
+			}
+		}
 
-bool
-ucl_parser_add_file (struct ucl_parser *parser, const char *filename)
-{
-	if (parser == NULL) {
-		return false;
-	}
 
-	return ucl_parser_add_file_full(parser, filename,
-			parser->default_priority, UCL_DUPLICATE_APPEND,
-			UCL_PARSE_UCL);
-}
+		/* Put all of the content of the include inside that object */
+		parser->stack->obj->value.ov = container;
 
+		st = UCL_ALLOC (sizeof (struct ucl_stack));
+		if (st == NULL) {
+			ucl_create_err (&parser->err, "cannot allocate memory for an object");
+			ucl_object_unref (nest_obj);
 
-bool
-ucl_parser_add_fd_full (struct ucl_parser *parser, int fd,
-		unsigned priority, enum ucl_duplicate_strategy strat,
-		enum ucl_parse_type parse_type)
-{
-	unsigned char *buf;
-	size_t len;
-	bool ret;
-	struct stat st;
+			if (buf) {
+				ucl_munmap (buf, buflen);
+			}
 
-	if (fstat (fd, &st) == -1) {
-		ucl_create_err (&parser->err, "cannot stat fd %d: %s",
-			fd, strerror (errno));
-		return false;
-	}
-	if (st.st_size == 0) {
-		return true;
-	}
-	if ((buf = ucl_mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
-		ucl_create_err (&parser->err, "cannot mmap fd %d: %s",
-			fd, strerror (errno));
-		return false;
+			return false;
+		}
+		st->obj = nest_obj;
+		st->e.params.level = parser->stack->e.params.level;
+		st->e.params.flags = parser->stack->e.params.flags;
+		st->e.params.line = parser->stack->e.params.line;
+		st->chunk = parser->chunks;
+		LL_PREPEND (parser->stack, st);
+		parser->cur_obj = nest_obj;
 	}
 
-	if (parser->cur_file) {
-		free (parser->cur_file);
+	res = ucl_parser_add_chunk_full (parser, buf, buflen, params->priority,
+			params->strat, params->parse_type);
+
+	if (res) {
+		/* Stop nesting the include, take 1 level off the stack */
+		if (params->prefix != NULL && nest_obj != NULL) {
+			parser->stack = st->next;
+			UCL_FREE (sizeof (struct ucl_stack), st);
+		}
+
+		/* Remove chunk from the stack */
+		chunk = parser->chunks;
+		if (chunk != NULL) {
+			parser->chunks = chunk->next;
+			ucl_chunk_free (chunk);
+			parser->recursion--;
+		}
+
+		/* Restore old file vars */
+		if (parser->cur_file) {
+			ucl_free (parser->cur_file);
+		}
+
+		parser->cur_file = old_curfile;
+		DL_FOREACH_SAFE (parser->variables, cur_var, tmp_var) {
+			if (strcmp (cur_var->var, "CURDIR") == 0 && old_curdir) {
+				DL_DELETE (parser->variables, cur_var);
+				ucl_free (cur_var->var);
+				ucl_free (cur_var->value);
+				UCL_FREE (sizeof (struct ucl_variable), cur_var);
+			} else if (strcmp (cur_var->var, "FILENAME") == 0 && old_filename) {
+				DL_DELETE (parser->variables, cur_var);
+				ucl_free (cur_var->var);
+				ucl_free (cur_var->value);
+				UCL_FREE (sizeof (struct ucl_variable), cur_var);
+			}
+		}
+		if (old_filename) {
+			DL_APPEND (parser->variables, old_filename);
+		}
+		if (old_curdir) {
+			DL_APPEND (parser->variables, old_curdir);
+		}
+
+		parser->state = prev_state;
 	}
-	parser->cur_file = NULL;
-	len = st.st_size;
-	ret = ucl_parser_add_chunk_full (parser, buf, len, priority, strat,
-			parse_type);
 
-	if (len > 0) {
-		ucl_munmap (buf, len);
+	if (buflen > 0) {
+		ucl_munmap (buf, buflen);
 	}
 
-	return ret;
+	return res;
 }
 
-bool
-ucl_parser_add_fd_priority (struct ucl_parser *parser, int fd,
-		unsigned priority)
-{
-	if (parser == NULL) {
-		return false;
-	}
-
-	return ucl_parser_add_fd_full(parser, fd, parser->default_priority,
-			UCL_DUPLICATE_APPEND, UCL_PARSE_UCL);
-}
-
-bool
-ucl_parser_add_fd (struct ucl_parser *parser, int fd)
-{
-	if (parser == NULL) {
-		return false;
-	}
-
-	return ucl_parser_add_fd_priority(parser, fd, parser->default_priority);
-}
-
-size_t
-ucl_strlcpy (char *dst, const char *src, size_t siz)
+/**
+ * Include a file to configuration
+ * @param data
+ * @param len
+ * @param parser
+ * @param err
+ * @return
+ */
+static bool
+ucl_include_file (const unsigned char *data, size_t len,
+				  struct ucl_parser *parser,
+				  struct ucl_include_params *params,
+				  const ucl_object_t *args)
 {
-	char *d = dst;
-	const char *s = src;
-	size_t n = siz;
+	const unsigned char *p = data, *end = data + len;
+	bool need_glob = false;
+	int cnt = 0;
+	char glob_pattern[PATH_MAX];
+	size_t i;
 
-	/* Copy as many bytes as will fit */
-	if (n != 0) {
-		while (--n != 0) {
-			if ((*d++ = *s++) == '\0') {
+#ifndef _WIN32
+	if (!params->allow_glob) {
+		return ucl_include_file_single (data, len, parser, params);
+	}
+	else {
+		/* Check for special symbols in a filename */
+		while (p != end) {
+			if (*p == '*' || *p == '?') {
+				need_glob = true;
 				break;
 			}
+			p ++;
 		}
-	}
-
-	if (n == 0 && siz != 0) {
-		*d = '\0';
-	}
+		if (need_glob) {
+			glob_t globbuf;
+			memset (&globbuf, 0, sizeof (globbuf));
+			ucl_strlcpy (glob_pattern, (const char *)data,
+				(len + 1 < sizeof (glob_pattern) ? len + 1 : sizeof (glob_pattern)));
+			if (glob (glob_pattern, 0, NULL, &globbuf) != 0) {
+				return (!params->must_exist || false);
+			}
+			for (i = 0; i < globbuf.gl_pathc; i ++) {
 
-	return (s - src - 1);    /* count does not include NUL */
-}
+				if (parser->include_trace_func) {
+					const ucl_object_t *parent = NULL;
 
-size_t
-ucl_strlcpy_unsafe (char *dst, const char *src, size_t siz)
-{
-	memcpy (dst, src, siz - 1);
-	dst[siz - 1] = '\0';
+					if (parser->stack) {
+						parent = parser->stack->obj;
+					}
 
-	return siz - 1;
-}
+					parser->include_trace_func (parser, parent, NULL,
+							globbuf.gl_pathv[i],
+							strlen (globbuf.gl_pathv[i]),
+							parser->include_trace_ud);
+				}
 
-size_t
-ucl_strlcpy_tolower (char *dst, const char *src, size_t siz)
-{
-	char *d = dst;
-	const char *s = src;
-	size_t n = siz;
+				if (!ucl_include_file_single ((unsigned char *)globbuf.gl_pathv[i],
+						strlen (globbuf.gl_pathv[i]), parser, params)) {
+					if (params->soft_fail) {
+						continue;
+					}
+					globfree (&globbuf);
+					return false;
+				}
+				cnt ++;
+			}
+			globfree (&globbuf);
 
-	/* Copy as many bytes as will fit */
-	if (n != 0) {
-		while (--n != 0) {
-			if ((*d++ = tolower (*s++)) == '\0') {
-				break;
+			if (cnt == 0 && params->must_exist) {
+				ucl_create_err (&parser->err, "cannot match any files for pattern %s",
+					glob_pattern);
+				return false;
 			}
 		}
+		else {
+			return ucl_include_file_single (data, len, parser, params);
+		}
 	}
+#else
+	/* Win32 compilers do not support globbing. Therefore, for Win32,
+	   treat allow_glob/need_glob as a NOOP and just return */
+	return ucl_include_file_single (data, len, parser, params);
+#endif
 
-	if (n == 0 && siz != 0) {
-		*d = '\0';
-	}
-
-	return (s - src);    /* count does not include NUL */
+	return true;
 }
 
-/*
- * Find the first occurrence of find in s
+/**
+ * Common function to handle .*include* macros
+ * @param data
+ * @param len
+ * @param args
+ * @param parser
+ * @param default_try
+ * @param default_sign
+ * @return
  */
-char *
-ucl_strnstr (const char *s, const char *find, int len)
+static bool
+ucl_include_common (const unsigned char *data, size_t len,
+		const ucl_object_t *args, struct ucl_parser *parser,
+		bool default_try,
+		bool default_sign)
 {
-	char c, sc;
-	int mlen;
-
-	if ((c = *find++) != 0) {
-		mlen = strlen (find);
-		do {
-			do {
-				if ((sc = *s++) == 0 || len-- < mlen)
-					return (NULL);
-			} while (sc != c);
-		} while (strncmp (s, find, mlen) != 0);
-		s--;
-	}
-	return ((char *)s);
-}
+	bool allow_url = false, search = false;
+	const char *duplicate;
+	const ucl_object_t *param;
+	ucl_object_iter_t it = NULL, ip = NULL;
+	char ipath[PATH_MAX];
+	struct ucl_include_params params;
 
-/*
- * Find the first occurrence of find in s, ignore case.
- */
-char *
-ucl_strncasestr (const char *s, const char *find, int len)
-{
-	char c, sc;
-	int mlen;
+	/* Default values */
+	params.soft_fail = default_try;
+	params.allow_glob = false;
+	params.check_signature = default_sign;
+	params.use_prefix = false;
+	params.target = "object";
+	params.prefix = NULL;
+	params.priority = 0;
+	params.parse_type = UCL_PARSE_UCL;
+	params.strat = UCL_DUPLICATE_APPEND;
+	params.must_exist = !default_try;
 
-	if ((c = *find++) != 0) {
-		c = tolower (c);
-		mlen = strlen (find);
-		do {
-			do {
-				if ((sc = *s++) == 0 || len-- == 0)
-					return (NULL);
-			} while (tolower (sc) != c);
-		} while (strncasecmp (s, find, mlen) != 0);
-		s--;
-	}
-	return ((char *)s);
-}
+	if (parser->include_trace_func) {
+		const ucl_object_t *parent = NULL;
 
-ucl_object_t *
-ucl_object_fromstring_common (const char *str, size_t len, enum ucl_string_flags flags)
-{
-	ucl_object_t *obj;
-	const char *start, *end, *p, *pos;
-	char *dst, *d;
-	size_t escaped_len;
+		if (parser->stack) {
+			parent = parser->stack->obj;
+		}
 
-	if (str == NULL) {
-		return NULL;
+		parser->include_trace_func (parser, parent, args,
+				data, len, parser->include_trace_ud);
 	}
 
-	obj = ucl_object_new ();
-	if (obj) {
-		if (len == 0) {
-			len = strlen (str);
-		}
-		if (flags & UCL_STRING_TRIM) {
-			/* Skip leading spaces */
-			for (start = str; (size_t)(start - str) < len; start ++) {
-				if (!ucl_test_character (*start, UCL_CHARACTER_WHITESPACE_UNSAFE)) {
-					break;
+	/* Process arguments */
+	if (args != NULL && args->type == UCL_OBJECT) {
+		while ((param = ucl_object_iterate (args, &it, true)) != NULL) {
+			if (param->type == UCL_BOOLEAN) {
+				if (strncmp (param->key, "try", param->keylen) == 0) {
+					params.must_exist = !ucl_object_toboolean (param);
 				}
-			}
-			/* Skip trailing spaces */
-			for (end = str + len - 1; end > start; end --) {
-				if (!ucl_test_character (*end, UCL_CHARACTER_WHITESPACE_UNSAFE)) {
-					break;
+				else if (strncmp (param->key, "sign", param->keylen) == 0) {
+					params.check_signature = ucl_object_toboolean (param);
+				}
+				else if (strncmp (param->key, "glob", param->keylen) == 0) {
+					params.allow_glob = ucl_object_toboolean (param);
+				}
+				else if (strncmp (param->key, "url", param->keylen) == 0) {
+					allow_url = ucl_object_toboolean (param);
+				}
+				else if (strncmp (param->key, "prefix", param->keylen) == 0) {
+					params.use_prefix = ucl_object_toboolean (param);
 				}
 			}
-			end ++;
-		}
-		else {
-			start = str;
-			end = str + len;
-		}
-
-		obj->type = UCL_STRING;
-		if (flags & UCL_STRING_ESCAPE) {
-			for (p = start, escaped_len = 0; p < end; p ++, escaped_len ++) {
-				if (ucl_test_character (*p, UCL_CHARACTER_JSON_UNSAFE | UCL_CHARACTER_WHITESPACE_UNSAFE)) {
-					switch (*p) {
+			else if (param->type == UCL_STRING) {
+				if (strncmp (param->key, "key", param->keylen) == 0) {
+					params.prefix = ucl_object_tostring (param);
+				}
+				else if (strncmp (param->key, "target", param->keylen) == 0) {
+					params.target = ucl_object_tostring (param);
+				}
+				else if (strncmp (param->key, "duplicate", param->keylen) == 0) {
+					duplicate = ucl_object_tostring (param);
+
+					if (strcmp (duplicate, "append") == 0) {
+						params.strat = UCL_DUPLICATE_APPEND;
+					}
+					else if (strcmp (duplicate, "merge") == 0) {
+						params.strat = UCL_DUPLICATE_MERGE;
+					}
+					else if (strcmp (duplicate, "rewrite") == 0) {
+						params.strat = UCL_DUPLICATE_REWRITE;
+					}
+					else if (strcmp (duplicate, "error") == 0) {
+						params.strat = UCL_DUPLICATE_ERROR;
+					}
+				}
+			}
+			else if (param->type == UCL_ARRAY) {
+				if (strncmp (param->key, "path", param->keylen) == 0) {
+					ucl_set_include_path (parser, __DECONST(ucl_object_t *, param));
+				}
+			}
+			else if (param->type == UCL_INT) {
+				if (strncmp (param->key, "priority", param->keylen) == 0) {
+					params.priority = ucl_object_toint (param);
+				}
+			}
+		}
+	}
+
+	if (parser->includepaths == NULL) {
+		if (allow_url && ucl_strnstr (data, "://", len) != NULL) {
+			/* Globbing is not used for URL's */
+			return ucl_include_url (data, len, parser, &params);
+		}
+		else if (data != NULL) {
+			/* Try to load a file */
+			return ucl_include_file (data, len, parser, &params, args);
+		}
+	}
+	else {
+		if (allow_url && ucl_strnstr (data, "://", len) != NULL) {
+			/* Globbing is not used for URL's */
+			return ucl_include_url (data, len, parser, &params);
+		}
+
+		ip = ucl_object_iterate_new (parser->includepaths);
+		while ((param = ucl_object_iterate_safe (ip, true)) != NULL) {
+			if (ucl_object_type(param) == UCL_STRING) {
+				snprintf (ipath, sizeof (ipath), "%s/%.*s", ucl_object_tostring(param),
+						(int)len, data);
+				if ((search = ucl_include_file (ipath, strlen (ipath),
+						parser, &params, args))) {
+					if (!params.allow_glob) {
+						break;
+					}
+				}
+			}
+		}
+		ucl_object_iterate_free (ip);
+		if (search == true) {
+			return true;
+		}
+		else {
+			ucl_create_err (&parser->err,
+					"cannot find file: %.*s in search path",
+					(int)len, data);
+			return false;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Handle include macro
+ * @param data include data
+ * @param len length of data
+ * @param args UCL object representing arguments to the macro
+ * @param ud user data
+ * @return
+ */
+bool
+ucl_include_handler (const unsigned char *data, size_t len,
+		const ucl_object_t *args, void* ud)
+{
+	struct ucl_parser *parser = ud;
+
+	return ucl_include_common (data, len, args, parser, false, false);
+}
+
+/**
+ * Handle includes macro
+ * @param data include data
+ * @param len length of data
+ * @param args UCL object representing arguments to the macro
+ * @param ud user data
+ * @return
+ */
+bool
+ucl_includes_handler (const unsigned char *data, size_t len,
+		const ucl_object_t *args, void* ud)
+{
+	struct ucl_parser *parser = ud;
+
+	return ucl_include_common (data, len, args, parser, false, true);
+}
+
+/**
+ * Handle tryinclude macro
+ * @param data include data
+ * @param len length of data
+ * @param args UCL object representing arguments to the macro
+ * @param ud user data
+ * @return
+ */
+bool
+ucl_try_include_handler (const unsigned char *data, size_t len,
+		const ucl_object_t *args, void* ud)
+{
+	struct ucl_parser *parser = ud;
+
+	return ucl_include_common (data, len, args, parser, true, false);
+}
+
+/**
+ * Handle priority macro
+ * @param data include data
+ * @param len length of data
+ * @param args UCL object representing arguments to the macro
+ * @param ud user data
+ * @return
+ */
+bool
+ucl_priority_handler (const unsigned char *data, size_t len,
+		const ucl_object_t *args, void* ud)
+{
+	struct ucl_parser *parser = ud;
+	unsigned priority = 255;
+	const ucl_object_t *param;
+	bool found = false;
+	char *value = NULL, *leftover = NULL;
+	ucl_object_iter_t it = NULL;
+
+	if (parser == NULL) {
+		return false;
+	}
+
+	/* Process arguments */
+	if (args != NULL && args->type == UCL_OBJECT) {
+		while ((param = ucl_object_iterate (args, &it, true)) != NULL) {
+			if (param->type == UCL_INT) {
+				if (strncmp (param->key, "priority", param->keylen) == 0) {
+					priority = ucl_object_toint (param);
+					found = true;
+				}
+			}
+		}
+	}
+
+	if (len > 0) {
+		value = UCL_ALLOC (len + 1);
+		ucl_strlcpy(value, (const char *)data, len + 1);
+		priority = strtol(value, &leftover, 10);
+		if (*leftover != '\0') {
+			ucl_create_err (&parser->err, "Invalid priority value in macro: %s",
+				value);
+			ucl_free (value);
+			return false;
+		}
+		ucl_free (value);
+		found = true;
+	}
+
+	if (found == true) {
+		parser->chunks->priority = priority;
+		return true;
+	}
+
+	ucl_create_err (&parser->err, "Unable to parse priority macro");
+	return false;
+}
+
+/**
+ * Handle load macro
+ * @param data include data
+ * @param len length of data
+ * @param args UCL object representing arguments to the macro
+ * @param ud user data
+ * @return
+ */
+bool
+ucl_load_handler (const unsigned char *data, size_t len,
+		const ucl_object_t *args, void* ud)
+{
+	struct ucl_parser *parser = ud;
+	const ucl_object_t *param;
+	ucl_object_t *obj, *old_obj;
+	ucl_object_iter_t it = NULL;
+	bool try_load, multiline, test;
+	const char *target, *prefix;
+	char *load_file, *tmp;
+	unsigned char *buf;
+	size_t buflen;
+	unsigned priority;
+	int64_t iv;
+	ucl_object_t *container = NULL;
+	enum ucl_string_flags flags;
+
+	/* Default values */
+	try_load = false;
+	multiline = false;
+	test = false;
+	target = "string";
+	prefix = NULL;
+	load_file = NULL;
+	buf = NULL;
+	buflen = 0;
+	priority = 0;
+	obj = NULL;
+	old_obj = NULL;
+	flags = 0;
+
+	if (parser == NULL) {
+		return false;
+	}
+
+	/* Process arguments */
+	if (args != NULL && args->type == UCL_OBJECT) {
+		while ((param = ucl_object_iterate (args, &it, true)) != NULL) {
+			if (param->type == UCL_BOOLEAN) {
+				if (strncmp (param->key, "try", param->keylen) == 0) {
+					try_load = ucl_object_toboolean (param);
+				}
+				else if (strncmp (param->key, "multiline", param->keylen) == 0) {
+					multiline = ucl_object_toboolean (param);
+				}
+				else if (strncmp (param->key, "escape", param->keylen) == 0) {
+					test = ucl_object_toboolean (param);
+					if (test) {
+						flags |= UCL_STRING_ESCAPE;
+					}
+				}
+				else if (strncmp (param->key, "trim", param->keylen) == 0) {
+					test = ucl_object_toboolean (param);
+					if (test) {
+						flags |= UCL_STRING_TRIM;
+					}
+				}
+			}
+			else if (param->type == UCL_STRING) {
+				if (strncmp (param->key, "key", param->keylen) == 0) {
+					prefix = ucl_object_tostring (param);
+				}
+				else if (strncmp (param->key, "target", param->keylen) == 0) {
+					target = ucl_object_tostring (param);
+				}
+			}
+			else if (param->type == UCL_INT) {
+				if (strncmp (param->key, "priority", param->keylen) == 0) {
+					priority = ucl_object_toint (param);
+				}
+			}
+		}
+	}
+
+	if (prefix == NULL || strlen (prefix) == 0) {
+		ucl_create_err (&parser->err, "No Key specified in load macro");
+		return false;
+	}
+
+	if (len > 0) {
+		load_file = UCL_ALLOC (len + 1);
+		if (!load_file) {
+			ucl_create_err (&parser->err, "cannot allocate memory for suffix");
+
+			return false;
+		}
+
+		snprintf (load_file, len + 1, "%.*s", (int)len, data);
+
+		if (!ucl_fetch_file (load_file, &buf, &buflen, &parser->err,
+				!try_load)) {
+			ucl_free (load_file);
+
+			if (try_load) {
+				ucl_parser_clear_error (parser);
+			}
+
+			return (try_load || false);
+		}
+
+		ucl_free (load_file);
+		container = parser->stack->obj;
+		old_obj = __DECONST (ucl_object_t *, ucl_object_lookup (container,
+				prefix));
+
+		if (old_obj != NULL) {
+			ucl_create_err (&parser->err, "Key %s already exists", prefix);
+			if (buf) {
+				ucl_munmap (buf, buflen);
+			}
+
+			return false;
+		}
+
+		if (strcasecmp (target, "string") == 0) {
+			obj = ucl_object_fromstring_common (buf, buflen, flags);
+			ucl_copy_value_trash (obj);
+			if (multiline) {
+				obj->flags |= UCL_OBJECT_MULTILINE;
+			}
+		}
+		else if (strcasecmp (target, "int") == 0) {
+			tmp = UCL_ALLOC (buflen + 1);
+
+			if (tmp == NULL) {
+				ucl_create_err (&parser->err, "Memory allocation failed");
+				if (buf) {
+					ucl_munmap (buf, buflen);
+				}
+
+				return false;
+			}
+
+			snprintf (tmp, buflen + 1, "%.*s", (int)buflen, buf);
+			iv = strtoll (tmp, NULL, 10);
+			obj = ucl_object_fromint (iv);
+			ucl_free (tmp);
+		}
+
+		if (buf) {
+			ucl_munmap (buf, buflen);
+		}
+
+		if (obj != NULL) {
+			obj->key = prefix;
+			obj->keylen = strlen (prefix);
+			ucl_copy_key_trash (obj);
+			obj->prev = obj;
+			obj->next = NULL;
+			ucl_object_set_priority (obj, priority);
+			ucl_object_insert_key (container, obj, obj->key, obj->keylen, false);
+		}
+
+		return true;
+	}
+
+	ucl_create_err (&parser->err, "Unable to parse load macro");
+	return false;
+}
+
+bool
+ucl_inherit_handler (const unsigned char *data, size_t len,
+		const ucl_object_t *args, const ucl_object_t *ctx, void* ud)
+{
+	const ucl_object_t *parent, *cur;
+	ucl_object_t *target, *copy;
+	ucl_object_iter_t it = NULL;
+	bool replace = false;
+	struct ucl_parser *parser = ud;
+
+	parent = ucl_object_lookup_len (ctx, data, len);
+
+	/* Some sanity checks */
+	if (parent == NULL || ucl_object_type (parent) != UCL_OBJECT) {
+		ucl_create_err (&parser->err, "Unable to find inherited object %.*s",
+				(int)len, data);
+		return false;
+	}
+
+	if (parser->stack == NULL || parser->stack->obj == NULL ||
+			ucl_object_type (parser->stack->obj) != UCL_OBJECT) {
+		ucl_create_err (&parser->err, "Invalid inherit context");
+		return false;
+	}
+
+	target = parser->stack->obj;
+
+	if (args && (cur = ucl_object_lookup (args, "replace")) != NULL) {
+		replace = ucl_object_toboolean (cur);
+	}
+
+	while ((cur = ucl_object_iterate (parent, &it, true))) {
+		/* We do not replace existing keys */
+		if (!replace && ucl_object_lookup_len (target, cur->key, cur->keylen)) {
+			continue;
+		}
+
+		copy = ucl_object_copy (cur);
+
+		if (!replace) {
+			copy->flags |= UCL_OBJECT_INHERITED;
+		}
+
+		ucl_object_insert_key (target, copy, copy->key,
+				copy->keylen, false);
+	}
+
+	return true;
+}
+
+static bool
+ucl_parser_set_filevars_internal (struct ucl_parser *parser, const char *filename, bool need_expand)
+{
+	char realbuf[PATH_MAX], *curdir;
+
+	if (filename != NULL) {
+		if (need_expand) {
+			if (ucl_realpath (filename, realbuf) == NULL) {
+				return false;
+			}
+		}
+		else {
+			ucl_strlcpy (realbuf, filename, sizeof (realbuf));
+		}
+
+		if (parser->cur_file) {
+			ucl_free (parser->cur_file);
+		}
+
+		parser->cur_file = ucl_strdup (realbuf);
+
+		/* Define variables */
+		ucl_parser_register_variable (parser, "FILENAME", realbuf);
+		curdir = dirname (realbuf);
+		ucl_parser_register_variable (parser, "CURDIR", curdir);
+	}
+	else {
+		/* Set everything from the current dir */
+		curdir = getcwd (realbuf, sizeof (realbuf));
+		ucl_parser_register_variable (parser, "FILENAME", "undef");
+		ucl_parser_register_variable (parser, "CURDIR", curdir);
+	}
+
+	return true;
+}
+
+bool
+ucl_parser_set_filevars (struct ucl_parser *parser, const char *filename,
+		bool need_expand)
+{
+	const struct ucl_allocator *prev;
+	bool ret;
+
+	prev = ucl_parser_allocator_enter (parser);
+	ret = ucl_parser_set_filevars_internal (parser, filename, need_expand);
+	ucl_parser_allocator_leave (parser, prev);
+
+	return ret;
+}
+
+static bool
+ucl_parser_add_file_full_internal (struct ucl_parser *parser, const char *filename,
+		unsigned priority, enum ucl_duplicate_strategy strat,
+		enum ucl_parse_type parse_type)
+{
+	unsigned char *buf;
+	size_t len;
+	bool ret;
+	char realbuf[PATH_MAX];
+
+	if (ucl_realpath (filename, realbuf) == NULL) {
+		ucl_create_err (&parser->err, "cannot open file %s: %s",
+				filename,
+				strerror (errno));
+		return false;
+	}
+
+	if (!ucl_fetch_file (realbuf, &buf, &len, &parser->err, true)) {
+		return false;
+	}
+
+	ucl_parser_set_filevars (parser, realbuf, false);
+	ret = ucl_parser_add_chunk_full (parser, buf, len, priority, strat,
+			parse_type);
+
+	if (len > 0) {
+		ucl_munmap (buf, len);
+	}
+
+	return ret;
+}
+
+bool
+ucl_parser_add_file_full (struct ucl_parser *parser, const char *filename,
+		unsigned priority, enum ucl_duplicate_strategy strat,
+		enum ucl_parse_type parse_type)
+{
+	const struct ucl_allocator *prev;
+	bool ret;
+
+	prev = ucl_parser_allocator_enter (parser);
+	ret = ucl_parser_add_file_full_internal (parser, filename, priority, strat,
+			parse_type);
+	ucl_parser_allocator_leave (parser, prev);
+
+	return ret;
+}
+
+bool
+ucl_parser_add_file_priority (struct ucl_parser *parser, const char *filename,
+		unsigned priority)
+{
+	if (parser == NULL) {
+		return false;
+	}
+
+	return ucl_parser_add_file_full(parser, filename, priority,
+			UCL_DUPLICATE_APPEND, UCL_PARSE_UCL);
+}
+
+bool
+ucl_parser_add_file (struct ucl_parser *parser, const char *filename)
+{
+	if (parser == NULL) {
+		return false;
+	}
+
+	return ucl_parser_add_file_full(parser, filename,
+			parser->default_priority, UCL_DUPLICATE_APPEND,
+			UCL_PARSE_UCL);
+}
+
+
+static bool
+ucl_parser_add_fd_full_internal (struct ucl_parser *parser, int fd,
+		unsigned priority, enum ucl_duplicate_strategy strat,
+		enum ucl_parse_type parse_type)
+{
+	unsigned char *buf;
+	size_t len;
+	bool ret;
+	struct stat st;
+
+	if (fstat (fd, &st) == -1) {
+		ucl_create_err (&parser->err, "cannot stat fd %d: %s",
+			fd, strerror (errno));
+		return false;
+	}
+	if (st.st_size == 0) {
+		return true;
+	}
+	if ((buf = ucl_mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		ucl_create_err (&parser->err, "cannot mmap fd %d: %s",
+			fd, strerror (errno));
+		return false;
+	}
+
+	if (parser->cur_file) {
+		ucl_free (parser->cur_file);
+	}
+	parser->cur_file = NULL;
+	len = st.st_size;
+	ret = ucl_parser_add_chunk_full (parser, buf, len, priority, strat,
+			parse_type);
+
+	if (len > 0) {
+		ucl_munmap (buf, len);
+	}
+
+	return ret;
+}
+
+bool
+ucl_parser_add_fd_full (struct ucl_parser *parser, int fd,
+		unsigned priority, enum ucl_duplicate_strategy strat,
+		enum ucl_parse_type parse_type)
+{
+	const struct ucl_allocator *prev;
+	bool ret;
+
+	prev = ucl_parser_allocator_enter (parser);
+	ret = ucl_parser_add_fd_full_internal (parser, fd, priority, strat, parse_type);
+	ucl_parser_allocator_leave (parser, prev);
+
+	return ret;
+}
+
+bool
+ucl_parser_add_fd_priority (struct ucl_parser *parser, int fd,
+		unsigned priority)
+{
+	if (parser == NULL) {
+		return false;
+	}
+
+	return ucl_parser_add_fd_full(parser, fd, parser->default_priority,
+			UCL_DUPLICATE_APPEND, UCL_PARSE_UCL);
+}
+
+bool
+ucl_parser_add_fd (struct ucl_parser *parser, int fd)
+{
+	if (parser == NULL) {
+		return false;
+	}
+
+	return ucl_parser_add_fd_priority(parser, fd, parser->default_priority);
+}
+
+size_t
+ucl_strlcpy (char *dst, const char *src, size_t siz)
+{
+	char *d = dst;
+	const char *s = src;
+	size_t n = siz;
+
+	/* Copy as many bytes as will fit */
+	if (n != 0) {
+		while (--n != 0) {
+			if ((*d++ = *s++) == '\0') {
+				break;
+			}
+		}
+	}
+
+	if (n == 0 && siz != 0) {
+		*d = '\0';
+	}
+
+	return (s - src - 1);    /* count does not include NUL */
+}
+
+size_t
+ucl_strlcpy_unsafe (char *dst, const char *src, size_t siz)
+{
+	memcpy (dst, src, siz - 1);
+	dst[siz - 1] = '\0';
+
+	return siz - 1;
+}
+
+size_t
+ucl_strlcpy_tolower (char *dst, const char *src, size_t siz)
+{
+	char *d = dst;
+	const char *s = src;
+	size_t n = siz;
+
+	/* Copy as many bytes as will fit */
+	if (n != 0) {
+		while (--n != 0) {
+			if ((*d++ = tolower (*s++)) == '\0') {
+				break;
+			}
+		}
+	}
+
+	if (n == 0 && siz != 0) {
+		*d = '\0';
+	}
+
+	return (s - src);    /* count does not include NUL */
+}
+
+/*
+ * Find the first occurrence of find in s
+ */
+char *
+ucl_strnstr (const char *s, const char *find, int len)
+{
+	char c, sc;
+	int mlen;
+
+	if ((c = *find++) != 0) {
+		mlen = strlen (find);
+		do {
+			do {
+				if ((sc = *s++) == 0 || len-- < mlen)
+					return (NULL);
+			} while (sc != c);
+		} while (strncmp (s, find, mlen) != 0);
+		s--;
+	}
+	return ((char *)s);
+}
+
+/*
+ * Find the first occurrence of find in s, ignore case.
+ */
+char *
+ucl_strncasestr (const char *s, const char *find, int len)
+{
+	char c, sc;
+	int mlen;
+
+	if ((c = *find++) != 0) {
+		c = tolower (c);
+		mlen = strlen (find);
+		do {
+			do {
+				if ((sc = *s++) == 0 || len-- == 0)
+					return (NULL);
+			} while (tolower (sc) != c);
+		} while (strncasecmp (s, find, mlen) != 0);
+		s--;
+	}
+	return ((char *)s);
+}
+
+ucl_object_t *
+ucl_object_fromstring_common (const char *str, size_t len, enum ucl_string_flags flags)
+{
+	ucl_object_t *obj;
+	const char *start, *end, *p, *pos;
+	char *dst, *d;
+	size_t escaped_len;
+
+	if (str == NULL) {
+		return NULL;
+	}
+
+	obj = ucl_object_new ();
+	if (obj) {
+		if (len == 0) {
+			len = strlen (str);
+		}
+		if (flags & UCL_STRING_TRIM) {
+			/* Skip leading spaces */
+			for (start = str; (size_t)(start - str) < len; start ++) {
+				if (!ucl_test_character (*start, UCL_CHARACTER_WHITESPACE_UNSAFE)) {
+					break;
+				}
+			}
+			/* Skip trailing spaces */
+			for (end = str + len - 1; end > start; end --) {
+				if (!ucl_test_character (*end, UCL_CHARACTER_WHITESPACE_UNSAFE)) {
+					break;
+				}
+			}
+			end ++;
+		}
+		else {
+			start = str;
+			end = str + len;
+		}
+
+		obj->type = UCL_STRING;
+		if (flags & UCL_STRING_ESCAPE) {
+			for (p = start, escaped_len = 0; p < end; p ++, escaped_len ++) {
+				if (ucl_test_character (*p, UCL_CHARACTER_JSON_UNSAFE | UCL_CHARACTER_WHITESPACE_UNSAFE)) {
+					switch (*p) {
 					case '\v':
 					case '\0':
 						escaped_len += 5;
@@ -2287,7 +3460,7 @@ ucl_object_fromstring_common (const char *str, size_t len, enum ucl_string_flags
 					}
 				}
 			}
-			dst = malloc (escaped_len + 1);
+			dst = UCL_ALLOC (escaped_len + 1);
 			if (dst != NULL) {
 				for (p = start, d = dst; p < end; p ++, d ++) {
 					if (ucl_test_character (*p, UCL_CHARACTER_JSON_UNSAFE | UCL_CHARACTER_WHITESPACE_UNSAFE)) {
@@ -2342,1369 +3515,2046 @@ ucl_object_fromstring_common (const char *str, size_t len, enum ucl_string_flags
 						}
 					}
 					else {
-						*d = *p;
+						*d = *p;
+					}
+				}
+				*d = '\0';
+				obj->value.sv = dst;
+				obj->trash_stack[UCL_TRASH_VALUE] = dst;
+				obj->len = escaped_len;
+			}
+		}
+		else {
+			dst = UCL_ALLOC (end - start + 1);
+			if (dst != NULL) {
+				ucl_strlcpy_unsafe (dst, start, end - start + 1);
+				obj->value.sv = dst;
+				obj->trash_stack[UCL_TRASH_VALUE] = dst;
+				obj->len = end - start;
+			}
+		}
+		if ((flags & UCL_STRING_PARSE) && dst != NULL) {
+			/* Parse what we have */
+			if (flags & UCL_STRING_PARSE_BOOLEAN) {
+				if (!ucl_maybe_parse_boolean (obj, dst, obj->len) && (flags & UCL_STRING_PARSE_NUMBER)) {
+					ucl_maybe_parse_number (obj, dst, dst + obj->len, &pos,
+							flags & UCL_STRING_PARSE_DOUBLE,
+							flags & UCL_STRING_PARSE_BYTES,
+							flags & UCL_STRING_PARSE_TIME);
+				}
+			}
+			else {
+				ucl_maybe_parse_number (obj, dst, dst + obj->len, &pos,
+						flags & UCL_STRING_PARSE_DOUBLE,
+						flags & UCL_STRING_PARSE_BYTES,
+						flags & UCL_STRING_PARSE_TIME);
+			}
+		}
+	}
+
+	return obj;
+}
+
+static bool
+ucl_object_insert_key_common (ucl_object_t *top, ucl_object_t *elt,
+		const char *key, size_t keylen, bool copy_key, bool merge, bool replace)
+{
+	ucl_object_t *found, *tmp;
+	const ucl_object_t *cur;
+	const struct ucl_allocator *prev;
+	ucl_object_iter_t it = NULL;
+	int ret = true;
+
+	if (elt == NULL || key == NULL) {
+		return false;
+	}
+
+	/* Frozen nodes are shared, so neither side can be relinked */
+	if (top == NULL || ((top->flags | elt->flags) & UCL_OBJECT_FROZEN)) {
+		return false;
+	}
+
+	if (top->type != UCL_OBJECT) {
+		/* It is possible to convert NULL type to an object */
+		if (top->type == UCL_NULL) {
+			top->type = UCL_OBJECT;
+		}
+		else {
+			/* Refuse converting of other object types */
+			return false;
+		}
+	}
+
+	if (top->value.ov == NULL) {
+		prev = ucl_object_allocator_enter (top);
+		top->value.ov = ucl_hash_create (false);
+		ucl_allocator_leave (prev);
+	}
+
+	if (keylen == 0) {
+		keylen = strlen (key);
+	}
+
+	if (ucl_key_need_escape (key, keylen)) {
+		elt->flags |= UCL_OBJECT_NEED_KEY_ESCAPE;
+	}
+
+	/* workaround for some use cases */
+	if (elt->trash_stack[UCL_TRASH_KEY] != NULL &&
+			key != (const char *)elt->trash_stack[UCL_TRASH_KEY]) {
+		/* Remove copied key */
+		prev = ucl_object_allocator_enter (elt);
+		ucl_free (elt->trash_stack[UCL_TRASH_KEY]);
+		ucl_allocator_leave (prev);
+		elt->trash_stack[UCL_TRASH_KEY] = NULL;
+		elt->flags &= ~UCL_OBJECT_ALLOCATED_KEY;
+	}
+
+	elt->key = key;
+	elt->keylen = keylen;
+
+	if (copy_key) {
+		ucl_copy_key_trash (elt);
+	}
+
+	found = __DECONST (ucl_object_t *, ucl_hash_search_obj (top->value.ov, elt));
+
+	if (found == NULL) {
+		top->value.ov = ucl_hash_insert_object (top->value.ov, elt, false);
+		top->len ++;
+		if (replace) {
+			ret = false;
+		}
+	}
+	else {
+		if (replace) {
+			ucl_hash_replace (top->value.ov, found, elt);
+			ucl_object_unref (found);
+		}
+		else if (merge) {
+			if (found->type != UCL_OBJECT && elt->type == UCL_OBJECT) {
+				/* Insert old elt to new one */
+				ucl_object_insert_key_common (elt, found, found->key,
+						found->keylen, copy_key, false, false);
+				ucl_hash_delete (top->value.ov, found);
+				top->value.ov = ucl_hash_insert_object (top->value.ov, elt, false);
+			}
+			else if (found->type == UCL_OBJECT && elt->type != UCL_OBJECT) {
+				/* Insert new to old */
+				ucl_object_insert_key_common (found, elt, elt->key,
+						elt->keylen, copy_key, false, false);
+			}
+			else if (found->type == UCL_OBJECT && elt->type == UCL_OBJECT) {
+				/* Mix two hashes */
+				while ((cur = ucl_object_iterate (elt, &it, true)) != NULL) {
+					tmp = ucl_object_ref (cur);
+					ucl_object_insert_key_common (found, tmp, cur->key,
+							cur->keylen, copy_key, true, false);
+				}
+				ucl_object_unref (elt);
+			}
+			else {
+				/* Just make a list of scalars */
+				DL_CONCAT (found, elt);
+				ucl_container_modified (ucl_hash_meta (top->value.ov));
+			}
+		}
+		else {
+			DL_CONCAT (found, elt);
+			ucl_container_modified (ucl_hash_meta (top->value.ov));
+		}
+	}
+
+	return ret;
+}
+
+bool
+ucl_object_delete_keyl (ucl_object_t *top, const char *key, size_t keylen)
+{
+	ucl_object_t *found;
+
+	if (top == NULL || key == NULL || (top->flags & UCL_OBJECT_FROZEN)) {
+		return false;
+	}
+
+	found = __DECONST (ucl_object_t *, ucl_object_lookup_len (top, key, keylen));
+
+	if (found == NULL) {
+		return false;
+	}
+
+	ucl_hash_delete (top->value.ov, found);
+	ucl_object_unref (found);
+	top->len --;
+
+	return true;
+}
+
+bool
+ucl_object_delete_key (ucl_object_t *top, const char *key)
+{
+	return ucl_object_delete_keyl (top, key, strlen (key));
+}
+
+ucl_object_t*
+ucl_object_pop_keyl (ucl_object_t *top, const char *key, size_t keylen)
+{
+	const ucl_object_t *found;
+
+	if (top == NULL || key == NULL || (top->flags & UCL_OBJECT_FROZEN)) {
+		return false;
+	}
+	found = ucl_object_lookup_len (top, key, keylen);
+
+	if (found == NULL) {
+		return NULL;
+	}
+	ucl_hash_delete (top->value.ov, found);
+	top->len --;
+
+	return __DECONST (ucl_object_t *, found);
+}
+
+ucl_object_t*
+ucl_object_pop_key (ucl_object_t *top, const char *key)
+{
+	return ucl_object_pop_keyl (top, key, strlen (key));
+}
+
+bool
+ucl_object_insert_key (ucl_object_t *top, ucl_object_t *elt,
+		const char *key, size_t keylen, bool copy_key)
+{
+	return ucl_object_insert_key_common (top, elt, key, keylen, copy_key, false, false);
+}
+
+bool
+ucl_object_insert_key_merged (ucl_object_t *top, ucl_object_t *elt,
+		const char *key, size_t keylen, bool copy_key)
+{
+	return ucl_object_insert_key_common (top, elt, key, keylen, copy_key, true, false);
+}
+
+bool
+ucl_object_replace_key (ucl_object_t *top, ucl_object_t *elt,
+		const char *key, size_t keylen, bool copy_key)
+{
+	return ucl_object_insert_key_common (top, elt, key, keylen, copy_key, false, true);
+}
+
+bool
+ucl_object_merge (ucl_object_t *top, ucl_object_t *elt, bool copy)
+{
+	ucl_object_t *cur = NULL, *cp = NULL, *found = NULL;
+	const struct ucl_allocator *prev;
+	ucl_object_iter_t iter = NULL;
+
+	if (top == NULL || elt == NULL || (top->flags & UCL_OBJECT_FROZEN)) {
+		return false;
+	}
+
+	if (!copy && (elt->flags & UCL_OBJECT_FROZEN)) {
+		/* Children of frozen trees cannot be moved to another parent */
+		return false;
+	}
+
+	if (top->type == UCL_OBJECT && top->value.ov == NULL) {
+		prev = ucl_object_allocator_enter (top);
+		top->value.ov = ucl_hash_create (false);
+		ucl_allocator_leave (prev);
+	}
+
+	if (top->type == UCL_ARRAY) {
+		if (elt->type == UCL_ARRAY) {
+			/* Merge two arrays */
+			return ucl_array_merge (top, elt, copy);
+		}
+		else {
+			if (copy) {
+				ucl_array_append (top, ucl_object_copy (elt));
+
+				return true;
+			}
+			else {
+				ucl_array_append (top, ucl_object_ref (elt));
+
+				return true;
+			}
+		}
+	}
+	else if (top->type == UCL_OBJECT) {
+		if (elt->type == UCL_OBJECT) {
+			/* Mix two hashes */
+			while ((cur = (ucl_object_t *) ucl_hash_iterate (elt->value.ov,
+					&iter))) {
+
+				if (copy) {
+					cp = ucl_object_copy (cur);
+				} else {
+					cp = ucl_object_ref (cur);
+				}
+
+				found = __DECONST(ucl_object_t *,
+						ucl_hash_search (top->value.ov, cp->key, cp->keylen));
+
+				if (found == NULL) {
+					/* The key does not exist */
+					top->value.ov = ucl_hash_insert_object (top->value.ov, cp,
+							false);
+					top->len++;
+				}
+				else {
+					/* The key already exists, merge it recursively */
+					if (found->type == UCL_OBJECT || found->type == UCL_ARRAY) {
+						if (!ucl_object_merge (found, cp, copy)) {
+							return false;
+						}
+						ucl_object_unref (cp);
+					}
+					else {
+						ucl_hash_replace (top->value.ov, found, cp);
+						ucl_object_unref (found);
 					}
 				}
-				*d = '\0';
-				obj->value.sv = dst;
-				obj->trash_stack[UCL_TRASH_VALUE] = dst;
-				obj->len = escaped_len;
 			}
 		}
 		else {
-			dst = malloc (end - start + 1);
-			if (dst != NULL) {
-				ucl_strlcpy_unsafe (dst, start, end - start + 1);
-				obj->value.sv = dst;
-				obj->trash_stack[UCL_TRASH_VALUE] = dst;
-				obj->len = end - start;
+			if (copy) {
+				cp = ucl_object_copy (elt);
 			}
-		}
-		if ((flags & UCL_STRING_PARSE) && dst != NULL) {
-			/* Parse what we have */
-			if (flags & UCL_STRING_PARSE_BOOLEAN) {
-				if (!ucl_maybe_parse_boolean (obj, dst, obj->len) && (flags & UCL_STRING_PARSE_NUMBER)) {
-					ucl_maybe_parse_number (obj, dst, dst + obj->len, &pos,
-							flags & UCL_STRING_PARSE_DOUBLE,
-							flags & UCL_STRING_PARSE_BYTES,
-							flags & UCL_STRING_PARSE_TIME);
+			else {
+				cp = ucl_object_ref (elt);
+			}
+
+			found = __DECONST(ucl_object_t *,
+					ucl_hash_search (top->value.ov, cp->key, cp->keylen));
+
+			if (found == NULL) {
+				/* The key does not exist */
+				top->value.ov = ucl_hash_insert_object (top->value.ov, cp,
+						false);
+				top->len++;
+			}
+			else {
+				/* The key already exists, merge it recursively */
+				if (found->type == UCL_OBJECT || found->type == UCL_ARRAY) {
+					if (!ucl_object_merge (found, cp, copy)) {
+						return false;
+					}
+					ucl_object_unref (cp);
+				}
+				else {
+					ucl_hash_replace (top->value.ov, found, cp);
+					ucl_object_unref (found);
 				}
 			}
+		}
+	}
+	else {
+		/* Cannot merge trivial objects */
+		return false;
+	}
+
+	return true;
+}
+
+const ucl_object_t *
+ucl_object_lookup_len (const ucl_object_t *obj, const char *key, size_t klen)
+{
+	const ucl_object_t *ret;
+	ucl_object_t srch;
+
+	if (obj == NULL || obj->type != UCL_OBJECT || key == NULL) {
+		return NULL;
+	}
+
+	srch.key = key;
+	srch.keylen = klen;
+	ret = ucl_hash_search_obj (obj->value.ov, &srch);
+
+	return ret;
+}
+
+size_t
+ucl_object_lookup_many_len (const ucl_object_t *obj, const char **keys,
+		const size_t *klens, size_t n, const ucl_object_t **out)
+{
+	size_t i;
+
+	if (keys == NULL || out == NULL) {
+		return 0;
+	}
+
+	if (obj == NULL || obj->type != UCL_OBJECT) {
+		for (i = 0; i < n; i ++) {
+			out[i] = NULL;
+		}
+
+		return 0;
+	}
+
+	return ucl_hash_search_many (obj->value.ov, keys, klens, n, out);
+}
+
+size_t
+ucl_object_lookup_many (const ucl_object_t *obj, const char **keys, size_t n,
+		const ucl_object_t **out)
+{
+	return ucl_object_lookup_many_len (obj, keys, NULL, n, out);
+}
+
+const ucl_object_t *
+ucl_object_lookup (const ucl_object_t *obj, const char *key)
+{
+	if (key == NULL) {
+		return NULL;
+	}
+
+	return ucl_object_lookup_len (obj, key, strlen (key));
+}
+
+const ucl_object_t*
+ucl_object_lookup_any (const ucl_object_t *obj,
+		const char *key, ...)
+{
+	va_list ap;
+	const ucl_object_t *ret = NULL;
+	const char *nk = NULL;
+
+	if (obj == NULL || key == NULL) {
+		return NULL;
+	}
+
+	ret = ucl_object_lookup_len (obj, key, strlen (key));
+
+	if (ret == NULL) {
+		va_start (ap, key);
+
+		while (ret == NULL) {
+			nk = va_arg (ap, const char *);
+
+			if (nk == NULL) {
+				break;
+			}
 			else {
-				ucl_maybe_parse_number (obj, dst, dst + obj->len, &pos,
-						flags & UCL_STRING_PARSE_DOUBLE,
-						flags & UCL_STRING_PARSE_BYTES,
-						flags & UCL_STRING_PARSE_TIME);
+				ret = ucl_object_lookup_len (obj, nk, strlen (nk));
+			}
+		}
+
+		va_end (ap);
+	}
+
+	return ret;
+}
+
+const ucl_object_t*
+ucl_object_iterate_with_error (const ucl_object_t *obj, ucl_object_iter_t *iter, bool expand_values,
+    int *ep)
+{
+	const ucl_object_t *elt = NULL;
+
+	if (obj == NULL || iter == NULL) {
+		return NULL;
+	}
+
+	if (expand_values) {
+		switch (obj->type) {
+		case UCL_OBJECT:
+			return (const ucl_object_t*)ucl_hash_iterate2 (obj->value.ov, iter, ep);
+			break;
+		case UCL_ARRAY: {
+			unsigned int idx;
+			UCL_ARRAY_GET (vec, obj);
+			idx = (unsigned int)(uintptr_t)(*iter);
+
+			if (UCL_ARRAY_IS_PACKED (vec)) {
+				if (idx < vec->n &&
+						(elt = ucl_array_packed_view_at (vec, idx)) != NULL) {
+					idx ++;
+				}
+				*iter = (void *)(uintptr_t)idx;
+			}
+			else if (vec != NULL) {
+				while (idx < kv_size (*vec)) {
+					if ((elt = UCL_ARRAY_A (vec, idx)) != NULL) {
+						idx ++;
+						break;
+					}
+					idx ++;
+				}
+				*iter = (void *)(uintptr_t)idx;
 			}
+
+			return elt;
+			break;
+		}
+		default:
+			/* Go to linear iteration */
+			break;
 		}
 	}
+	/* Treat everything as a linear list */
+	elt = *iter;
+	if (elt == NULL) {
+		elt = obj;
+	}
+	else if (elt == obj) {
+		return NULL;
+	}
+	*iter = __DECONST (void *, elt->next ? elt->next : obj);
+	return elt;
+
+	/* Not reached */
+	return NULL;
+}
+
+enum ucl_safe_iter_flags {
+	UCL_ITERATE_FLAG_UNDEFINED = 0,
+	UCL_ITERATE_FLAG_INSIDE_ARRAY,
+	UCL_ITERATE_FLAG_INSIDE_OBJECT,
+	UCL_ITERATE_FLAG_IMPLICIT,
+	UCL_ITERATE_FLAG_EXCEPTION
+};
+
+static const char safe_iter_magic[4] = {'u', 'i', 't', 'e'};
+/* Layout of a safe iterator is public as `struct ucl_object_stack_iter` */
+#define ucl_object_safe_iter ucl_object_stack_iter
+
+#define UCL_SAFE_ITER(ptr) (struct ucl_object_safe_iter *)(ptr)
+#define UCL_SAFE_ITER_CHECK(it) do { \
+	assert (it != NULL); \
+	assert (memcmp (it->magic, safe_iter_magic, sizeof (it->magic)) == 0); \
+ } while (0)
+
+ucl_object_iter_t
+ucl_object_iterate_new (const ucl_object_t *obj)
+{
+	struct ucl_object_safe_iter *it;
+
+	it = UCL_ALLOC (sizeof (*it));
+	if (it != NULL) {
+		memcpy (it->magic, safe_iter_magic, sizeof (it->magic));
+		it->flags = UCL_ITERATE_FLAG_UNDEFINED;
+		it->expl_it = NULL;
+		it->impl_it = obj;
+	}
+
+	return (ucl_object_iter_t)it;
+}
+
+ucl_object_iter_t
+ucl_object_iterate_init (struct ucl_object_stack_iter *it,
+		const ucl_object_t *obj)
+{
+	if (it != NULL) {
+		memcpy (it->magic, safe_iter_magic, sizeof (it->magic));
+		it->flags = UCL_ITERATE_FLAG_UNDEFINED;
+		it->expl_it = NULL;
+		it->impl_it = obj;
+	}
+
+	return (ucl_object_iter_t)it;
+}
 
-	return obj;
+bool
+ucl_object_iter_chk_excpn(ucl_object_iter_t *it)
+{
+        struct ucl_object_safe_iter *rit = UCL_SAFE_ITER (it);
+
+        UCL_SAFE_ITER_CHECK (rit);
+
+	return (rit->flags == UCL_ITERATE_FLAG_EXCEPTION);
 }
 
-static bool
-ucl_object_insert_key_common (ucl_object_t *top, ucl_object_t *elt,
-		const char *key, size_t keylen, bool copy_key, bool merge, bool replace)
+ucl_object_iter_t
+ucl_object_iterate_reset (ucl_object_iter_t it, const ucl_object_t *obj)
 {
-	ucl_object_t *found, *tmp;
-	const ucl_object_t *cur;
-	ucl_object_iter_t it = NULL;
-	const char *p;
-	int ret = true;
+	struct ucl_object_safe_iter *rit = UCL_SAFE_ITER (it);
 
-	if (elt == NULL || key == NULL) {
-		return false;
-	}
+	UCL_SAFE_ITER_CHECK (rit);
 
-	if (top == NULL) {
-		return false;
-	}
+	rit->impl_it = obj;
+	rit->expl_it = NULL;
+	rit->flags = UCL_ITERATE_FLAG_UNDEFINED;
 
-	if (top->type != UCL_OBJECT) {
-		/* It is possible to convert NULL type to an object */
-		if (top->type == UCL_NULL) {
-			top->type = UCL_OBJECT;
-		}
-		else {
-			/* Refuse converting of other object types */
-			return false;
-		}
-	}
+	return it;
+}
 
-	if (top->value.ov == NULL) {
-		top->value.ov = ucl_hash_create (false);
-	}
+const ucl_object_t*
+ucl_object_iterate_safe (ucl_object_iter_t it, bool expand_values)
+{
+	return ucl_object_iterate_full (it, expand_values ? UCL_ITERATE_BOTH :
+			UCL_ITERATE_IMPLICIT);
+}
 
-	if (keylen == 0) {
-		keylen = strlen (key);
-	}
+const ucl_object_t*
+ucl_object_iterate_full (ucl_object_iter_t it, enum ucl_iterate_type type)
+{
+	struct ucl_object_safe_iter *rit = UCL_SAFE_ITER (it);
+	const ucl_object_t *ret = NULL;
+	int ern;
 
-	for (p = key; p < key + keylen; p ++) {
-		if (ucl_test_character (*p, UCL_CHARACTER_UCL_UNSAFE)) {
-			elt->flags |= UCL_OBJECT_NEED_KEY_ESCAPE;
-			break;
-		}
-	}
+	UCL_SAFE_ITER_CHECK (rit);
 
-	/* workaround for some use cases */
-	if (elt->trash_stack[UCL_TRASH_KEY] != NULL &&
-			key != (const char *)elt->trash_stack[UCL_TRASH_KEY]) {
-		/* Remove copied key */
-		free (elt->trash_stack[UCL_TRASH_KEY]);
-		elt->trash_stack[UCL_TRASH_KEY] = NULL;
-		elt->flags &= ~UCL_OBJECT_ALLOCATED_KEY;
+	if (rit->impl_it == NULL) {
+		return NULL;
 	}
 
-	elt->key = key;
-	elt->keylen = keylen;
+	if (rit->impl_it->type == UCL_OBJECT) {
+		rit->flags = UCL_ITERATE_FLAG_INSIDE_OBJECT;
+		ret = ucl_object_iterate_with_error (rit->impl_it, &rit->expl_it, true, &ern);
 
-	if (copy_key) {
-		ucl_copy_key_trash (elt);
+		if (ret == NULL && ern != 0) {
+			rit->flags = UCL_ITERATE_FLAG_EXCEPTION;
+			return NULL;
+		}
+
+		if (ret == NULL && (type & UCL_ITERATE_IMPLICIT)) {
+			/* Need to switch to another implicit object in chain */
+			rit->impl_it = rit->impl_it->next;
+			rit->expl_it = NULL;
+
+			return ucl_object_iterate_safe (it, type);
+		}
 	}
+	else if (rit->impl_it->type == UCL_ARRAY) {
+		rit->flags = UCL_ITERATE_FLAG_INSIDE_ARRAY;
+		ret = ucl_object_iterate (rit->impl_it, &rit->expl_it, true);
 
-	found = __DECONST (ucl_object_t *, ucl_hash_search_obj (top->value.ov, elt));
+		if (ret == NULL && (type & UCL_ITERATE_IMPLICIT)) {
+			/* Need to switch to another implicit object in chain */
+			rit->impl_it = rit->impl_it->next;
+			rit->expl_it = NULL;
 
-	if (found == NULL) {
-		top->value.ov = ucl_hash_insert_object (top->value.ov, elt, false);
-		top->len ++;
-		if (replace) {
-			ret = false;
+			return ucl_object_iterate_safe (it, type);
 		}
 	}
 	else {
-		if (replace) {
-			ucl_hash_replace (top->value.ov, found, elt);
-			ucl_object_unref (found);
-		}
-		else if (merge) {
-			if (found->type != UCL_OBJECT && elt->type == UCL_OBJECT) {
-				/* Insert old elt to new one */
-				ucl_object_insert_key_common (elt, found, found->key,
-						found->keylen, copy_key, false, false);
-				ucl_hash_delete (top->value.ov, found);
-				top->value.ov = ucl_hash_insert_object (top->value.ov, elt, false);
-			}
-			else if (found->type == UCL_OBJECT && elt->type != UCL_OBJECT) {
-				/* Insert new to old */
-				ucl_object_insert_key_common (found, elt, elt->key,
-						elt->keylen, copy_key, false, false);
-			}
-			else if (found->type == UCL_OBJECT && elt->type == UCL_OBJECT) {
-				/* Mix two hashes */
-				while ((cur = ucl_object_iterate (elt, &it, true)) != NULL) {
-					tmp = ucl_object_ref (cur);
-					ucl_object_insert_key_common (found, tmp, cur->key,
-							cur->keylen, copy_key, true, false);
-				}
-				ucl_object_unref (elt);
-			}
-			else {
-				/* Just make a list of scalars */
-				DL_CONCAT (found, elt);
+		/* Just iterate over the implicit array */
+		rit->flags = UCL_ITERATE_FLAG_IMPLICIT;
+		ret = rit->impl_it;
+		rit->impl_it = rit->impl_it->next;
+
+		if (type & UCL_ITERATE_EXPLICIT) {
+			/* We flatten objects if need to expand values */
+			if (ret->type == UCL_OBJECT || ret->type == UCL_ARRAY) {
+				return ucl_object_iterate_safe (it, type);
 			}
 		}
-		else {
-			DL_CONCAT (found, elt);
-		}
 	}
 
 	return ret;
 }
 
-bool
-ucl_object_delete_keyl (ucl_object_t *top, const char *key, size_t keylen)
+void
+ucl_object_iterate_free (ucl_object_iter_t it)
 {
-	ucl_object_t *found;
+	struct ucl_object_safe_iter *rit = UCL_SAFE_ITER (it);
 
-	if (top == NULL || key == NULL) {
-		return false;
-	}
+	UCL_SAFE_ITER_CHECK (rit);
 
-	found = __DECONST (ucl_object_t *, ucl_object_lookup_len (top, key, keylen));
+	UCL_FREE (sizeof (*rit), it);
+}
 
-	if (found == NULL) {
-		return false;
-	}
+const ucl_object_t *
+ucl_object_lookup_path (const ucl_object_t *top, const char *path_in) {
+	return ucl_object_lookup_path_char (top, path_in, '.');
+}
 
-	ucl_hash_delete (top->value.ov, found);
-	ucl_object_unref (found);
-	top->len --;
 
-	return true;
-}
+const ucl_object_t *
+ucl_object_lookup_path_char (const ucl_object_t *top, const char *path_in, const char sep) {
+	const ucl_object_t *o = NULL, *found;
+	const char *p, *c;
+	char *err_str;
+	unsigned index;
 
-bool
-ucl_object_delete_key (ucl_object_t *top, const char *key)
-{
-	return ucl_object_delete_keyl (top, key, strlen (key));
-}
+	if (path_in == NULL || top == NULL) {
+		return NULL;
+	}
 
-ucl_object_t*
-ucl_object_pop_keyl (ucl_object_t *top, const char *key, size_t keylen)
-{
-	const ucl_object_t *found;
+	found = NULL;
+	p = path_in;
 
-	if (top == NULL || key == NULL) {
-		return false;
+	/* Skip leading dots */
+	while (*p == sep) {
+		p ++;
 	}
-	found = ucl_object_lookup_len (top, key, keylen);
 
-	if (found == NULL) {
-		return NULL;
+	c = p;
+	while (*p != '\0') {
+		p ++;
+		if (*p == sep || *p == '\0') {
+			if (p > c) {
+				switch (top->type) {
+				case UCL_ARRAY:
+					/* Key should be an int */
+					index = strtoul (c, &err_str, 10);
+					if (err_str != NULL && (*err_str != sep && *err_str != '\0')) {
+						return NULL;
+					}
+					o = ucl_array_find_index (top, index);
+					break;
+				default:
+					o = ucl_object_lookup_len (top, c, p - c);
+					break;
+				}
+				if (o == NULL) {
+					return NULL;
+				}
+				top = o;
+			}
+			if (*p != '\0') {
+				c = p + 1;
+			}
+		}
 	}
-	ucl_hash_delete (top->value.ov, found);
-	top->len --;
+	found = o;
 
-	return __DECONST (ucl_object_t *, found);
+	return found;
 }
 
-ucl_object_t*
-ucl_object_pop_key (ucl_object_t *top, const char *key)
-{
-	return ucl_object_pop_keyl (top, key, strlen (key));
-}
+struct ucl_path_segment {
+	const char *key;
+	unsigned keylen;
+	unsigned index;
+	bool is_index;
+	uint32_t hv;
+	uint32_t hv_caseless;
+};
 
-bool
-ucl_object_insert_key (ucl_object_t *top, ucl_object_t *elt,
-		const char *key, size_t keylen, bool copy_key)
-{
-	return ucl_object_insert_key_common (top, elt, key, keylen, copy_key, false, false);
-}
+struct ucl_path {
+	unsigned nsegments;
+	int flags;
+	/* Cached result for UCL_PATH_CACHE */
+	const ucl_object_t *cached_top;
+	const ucl_object_t *cached_result;
+	unsigned int cached_epoch;
+	unsigned int cached_thaw_epoch;
+	struct ucl_path_segment *segments;
+	char *keys;
+	size_t keyslen;
+};
 
-bool
-ucl_object_insert_key_merged (ucl_object_t *top, ucl_object_t *elt,
-		const char *key, size_t keylen, bool copy_key)
+/*
+ * Each frozen tree is stamped with a new epoch in the metadata of its root,
+ * so freezing and thawing of other trees do not invalidate cached paths;
+ * the thaw epoch changes only when a part of a frozen tree is thawed
+ */
+static unsigned int ucl_freeze_epoch = 0;
+static unsigned int ucl_thaw_epoch = 0;
+
+#ifdef HAVE_ATOMIC_BUILTINS
+#define UCL_EPOCH_LOAD(p) __atomic_load_n ((p), __ATOMIC_ACQUIRE)
+#else
+#define UCL_EPOCH_LOAD(p) (*(p))
+#endif
+
+static unsigned int
+ucl_object_frozen_epoch (const ucl_object_t *obj)
 {
-	return ucl_object_insert_key_common (top, elt, key, keylen, copy_key, true, false);
+	struct ucl_container_meta *meta;
+
+	if (!(obj->flags & UCL_OBJECT_FROZEN)) {
+		return 0;
+	}
+
+	meta = ucl_object_container_meta (obj);
+
+	return meta != NULL ? UCL_EPOCH_LOAD (&meta->frozen_epoch) : 0;
 }
 
-bool
-ucl_object_replace_key (ucl_object_t *top, ucl_object_t *elt,
-		const char *key, size_t keylen, bool copy_key)
+struct ucl_path *
+ucl_path_compile (const char *path)
 {
-	return ucl_object_insert_key_common (top, elt, key, keylen, copy_key, false, true);
+	return ucl_path_compile_full (path, '.', UCL_PATH_DEFAULT);
 }
 
-bool
-ucl_object_merge (ucl_object_t *top, ucl_object_t *elt, bool copy)
+struct ucl_path *
+ucl_path_compile_full (const char *path_in, const char sep, int flags)
 {
-	ucl_object_t *cur = NULL, *cp = NULL, *found = NULL;
-	ucl_object_iter_t iter = NULL;
-
-	if (top == NULL || elt == NULL) {
-		return false;
+	struct ucl_path *path;
+	struct ucl_path_segment *seg;
+	const char *c;
+	char *p, *err_str;
+	unsigned nseg = 0;
+	size_t plen;
+
+	if (path_in == NULL) {
+		return NULL;
 	}
 
-	if (top->type == UCL_ARRAY) {
-		if (elt->type == UCL_ARRAY) {
-			/* Merge two arrays */
-			return ucl_array_merge (top, elt, copy);
+	plen = strlen (path_in);
+
+	for (c = path_in; *c != '\0'; c ++) {
+		if (*c != sep && (c[1] == sep || c[1] == '\0')) {
+			nseg ++;
 		}
-		else {
-			if (copy) {
-				ucl_array_append (top, ucl_object_copy (elt));
+	}
 
-				return true;
-			}
-			else {
-				ucl_array_append (top, ucl_object_ref (elt));
+	path = UCL_ALLOC (sizeof (*path));
 
-				return true;
-			}
-		}
+	if (path == NULL) {
+		return NULL;
 	}
-	else if (top->type == UCL_OBJECT) {
-		if (elt->type == UCL_OBJECT) {
-			/* Mix two hashes */
-			while ((cur = (ucl_object_t *) ucl_hash_iterate (elt->value.ov,
-					&iter))) {
 
-				if (copy) {
-					cp = ucl_object_copy (cur);
-				} else {
-					cp = ucl_object_ref (cur);
-				}
+	memset (path, 0, sizeof (*path));
+	path->flags = flags;
+	path->segments = UCL_ALLOC (sizeof (*seg) * (nseg > 0 ? nseg : 1));
+	path->keys = UCL_ALLOC (plen + 1);
+	path->keyslen = plen + 1;
 
-				found = __DECONST(ucl_object_t *,
-						ucl_hash_search (top->value.ov, cp->key, cp->keylen));
+	if (path->segments == NULL || path->keys == NULL) {
+		ucl_path_free (path);
 
-				if (found == NULL) {
-					/* The key does not exist */
-					top->value.ov = ucl_hash_insert_object (top->value.ov, cp,
-							false);
-					top->len++;
-				}
-				else {
-					/* The key already exists, merge it recursively */
-					if (found->type == UCL_OBJECT || found->type == UCL_ARRAY) {
-						if (!ucl_object_merge (found, cp, copy)) {
-							return false;
-						}
-						ucl_object_unref (cp);
-					}
-					else {
-						ucl_hash_replace (top->value.ov, found, cp);
-						ucl_object_unref (found);
-					}
-				}
-			}
-		}
-		else {
-			if (copy) {
-				cp = ucl_object_copy (elt);
-			}
-			else {
-				cp = ucl_object_ref (elt);
-			}
+		return NULL;
+	}
 
-			found = __DECONST(ucl_object_t *,
-					ucl_hash_search (top->value.ov, cp->key, cp->keylen));
+	/* Segments are stored NULL terminated to allow strtoul on them */
+	memcpy (path->keys, path_in, plen + 1);
+	p = path->keys;
 
-			if (found == NULL) {
-				/* The key does not exist */
-				top->value.ov = ucl_hash_insert_object (top->value.ov, cp,
-						false);
-				top->len++;
-			}
-			else {
-				/* The key already exists, merge it recursively */
-				if (found->type == UCL_OBJECT || found->type == UCL_ARRAY) {
-					if (!ucl_object_merge (found, cp, copy)) {
-						return false;
-					}
-					ucl_object_unref (cp);
-				}
-				else {
-					ucl_hash_replace (top->value.ov, found, cp);
-					ucl_object_unref (found);
-				}
-			}
+	while (*p != '\0') {
+		/* Skip separators */
+		while (*p == sep) {
+			p ++;
 		}
-	}
-	else {
-		/* Cannot merge trivial objects */
-		return false;
-	}
 
-	return true;
-}
+		if (*p == '\0') {
+			break;
+		}
 
-const ucl_object_t *
-ucl_object_lookup_len (const ucl_object_t *obj, const char *key, size_t klen)
-{
-	const ucl_object_t *ret;
-	ucl_object_t srch;
+		c = p;
 
-	if (obj == NULL || obj->type != UCL_OBJECT || key == NULL) {
-		return NULL;
-	}
+		while (*p != sep && *p != '\0') {
+			p ++;
+		}
 
-	srch.key = key;
-	srch.keylen = klen;
-	ret = ucl_hash_search_obj (obj->value.ov, &srch);
+		seg = &path->segments[path->nsegments ++];
+		seg->key = c;
+		seg->keylen = p - c;
 
-	return ret;
-}
+		if (*p == sep) {
+			*p++ = '\0';
+		}
 
-const ucl_object_t *
-ucl_object_lookup (const ucl_object_t *obj, const char *key)
-{
-	if (key == NULL) {
-		return NULL;
+		seg->index = strtoul (c, &err_str, 10);
+		seg->is_index = (err_str == c + seg->keylen);
+		ucl_hash_key_hashes (seg->key, seg->keylen, &seg->hv,
+				&seg->hv_caseless);
 	}
 
-	return ucl_object_lookup_len (obj, key, strlen (key));
+	return path;
 }
 
-const ucl_object_t*
-ucl_object_lookup_any (const ucl_object_t *obj,
-		const char *key, ...)
+const ucl_object_t *
+ucl_path_lookup (const ucl_object_t *top, struct ucl_path *path)
 {
-	va_list ap;
-	const ucl_object_t *ret = NULL;
-	const char *nk = NULL;
+	const ucl_object_t *o = NULL, *orig_top = top;
+	const struct ucl_path_segment *seg;
+	unsigned i, epoch = 0, thaw_epoch = 0;
 
-	if (obj == NULL || key == NULL) {
+	if (path == NULL || top == NULL) {
 		return NULL;
 	}
 
-	ret = ucl_object_lookup_len (obj, key, strlen (key));
+	if (path->flags & UCL_PATH_CACHE) {
+		epoch = ucl_object_frozen_epoch (top);
+		thaw_epoch = UCL_EPOCH_LOAD (&ucl_thaw_epoch);
 
-	if (ret == NULL) {
-		va_start (ap, key);
+		if (epoch != 0 && path->cached_top == top &&
+				path->cached_epoch == epoch &&
+				path->cached_thaw_epoch == thaw_epoch) {
+			return path->cached_result;
+		}
+	}
 
-		while (ret == NULL) {
-			nk = va_arg (ap, const char *);
+	for (i = 0; i < path->nsegments; i ++) {
+		seg = &path->segments[i];
 
-			if (nk == NULL) {
-				break;
-			}
-			else {
-				ret = ucl_object_lookup_len (obj, nk, strlen (nk));
+		switch (top->type) {
+		case UCL_ARRAY:
+			if (!seg->is_index) {
+				return NULL;
 			}
+			o = ucl_array_find_index (top, seg->index);
+			break;
+		case UCL_OBJECT:
+			o = ucl_hash_search_hashed (top->value.ov, seg->key, seg->keylen,
+					seg->hv, seg->hv_caseless);
+			break;
+		default:
+			o = NULL;
+			break;
 		}
 
-		va_end (ap);
+		if (o == NULL) {
+			return NULL;
+		}
+
+		top = o;
 	}
 
-	return ret;
+	/* Views of packed elements are not kept, see ucl_array_packed_view_at */
+	if (epoch != 0 && (o == NULL || !(o->flags & UCL_OBJECT_EPHEMERAL))) {
+		path->cached_top = orig_top;
+		path->cached_result = o;
+		path->cached_epoch = epoch;
+		path->cached_thaw_epoch = thaw_epoch;
+	}
+
+	return o;
 }
 
-const ucl_object_t*
-ucl_object_iterate_with_error (const ucl_object_t *obj, ucl_object_iter_t *iter, bool expand_values,
-    int *ep)
+void
+ucl_path_free (struct ucl_path *path)
 {
-	const ucl_object_t *elt = NULL;
-
-	if (obj == NULL || iter == NULL) {
-		return NULL;
+	if (path != NULL) {
+		if (path->segments != NULL) {
+			UCL_FREE (sizeof (*path->segments) * path->nsegments,
+					path->segments);
+		}
+		if (path->keys != NULL) {
+			UCL_FREE (path->keyslen, path->keys);
+		}
+		UCL_FREE (sizeof (*path), path);
 	}
+}
 
-	if (expand_values) {
-		switch (obj->type) {
-		case UCL_OBJECT:
-			return (const ucl_object_t*)ucl_hash_iterate2 (obj->value.ov, iter, ep);
-			break;
-		case UCL_ARRAY: {
-			unsigned int idx;
-			UCL_ARRAY_GET (vec, obj);
-			idx = (unsigned int)(uintptr_t)(*iter);
 
-			if (vec != NULL) {
-				while (idx < kv_size (*vec)) {
-					if ((elt = kv_A (*vec, idx)) != NULL) {
-						idx ++;
-						break;
+ucl_object_t *
+ucl_object_new (void)
+{
+	return ucl_object_typed_new (UCL_NULL);
+}
+
+ucl_object_t *
+ucl_object_typed_new (ucl_type_t type)
+{
+	return ucl_object_new_full (type, 0);
+}
+
+ucl_object_t *
+ucl_object_new_full (ucl_type_t type, unsigned priority)
+{
+	ucl_object_t *new;
+
+	if (type != UCL_USERDATA) {
+		new = ucl_object_node_alloc (sizeof (ucl_object_t));
+		if (new != NULL) {
+			new->ref = 1;
+			new->type = (type <= UCL_NULL ? type : UCL_NULL);
+			new->next = NULL;
+			new->prev = new;
+			ucl_object_set_priority (new, priority);
+
+			if (type == UCL_ARRAY) {
+				new->value.av = ucl_array_new ();
+				if (new->value.av) {
+					UCL_ARRAY_GET (vec, new);
+
+					/* Preallocate some space for arrays */
+					if (!ucl_array_resize (vec, 8)) {
+						goto enomem;
 					}
-					idx ++;
 				}
-				*iter = (void *)(uintptr_t)idx;
 			}
+		}
+	}
+	else {
+		new = ucl_object_new_userdata (NULL, NULL, NULL);
+		ucl_object_set_priority (new, priority);
+	}
+enomem:
+	return new;
+}
 
-			return elt;
-			break;
+bool ucl_object_reserve (ucl_object_t *obj, size_t reserved)
+{
+	if (obj->flags & UCL_OBJECT_FROZEN) {
+		return false;
+	}
+
+	if (obj->type == UCL_ARRAY) {
+		UCL_ARRAY_GET (vec, obj);
+
+		if (!UCL_ARRAY_UNPACK (vec, obj)) {
+			return false;
 		}
-		default:
-			/* Go to linear iteration */
-			break;
+
+		if (vec->m < reserved) {
+			/* Preallocate some space for arrays */
+			if (!ucl_array_resize (vec, reserved)) {
+				goto e0;
+			}
 		}
 	}
-	/* Treat everything as a linear list */
-	elt = *iter;
-	if (elt == NULL) {
-		elt = obj;
+	else if (obj->type == UCL_OBJECT) {
+		ucl_hash_reserve (obj->value.ov, reserved);
+	}
+	return true;
+e0:
+	return false;
+}
+
+ucl_object_t*
+ucl_object_new_userdata (ucl_userdata_dtor dtor,
+		ucl_userdata_emitter emitter,
+		void *ptr)
+{
+	struct ucl_object_userdata *new;
+	size_t nsize = sizeof (*new);
+
+	new = (struct ucl_object_userdata *)ucl_object_node_alloc (nsize);
+	if (new != NULL) {
+		new->obj.ref = 1;
+		new->obj.type = UCL_USERDATA;
+		new->obj.next = NULL;
+		new->obj.prev = (ucl_object_t *)new;
+		new->dtor = dtor;
+		new->emitter = emitter;
+		new->obj.value.ud = ptr;
 	}
-	else if (elt == obj) {
-		return NULL;
+
+	return (ucl_object_t *)new;
+}
+
+ucl_type_t
+ucl_object_type (const ucl_object_t *obj)
+{
+	if (obj == NULL) {
+		return UCL_NULL;
 	}
-	*iter = __DECONST (void *, elt->next ? elt->next : obj);
-	return elt;
 
-	/* Not reached */
-	return NULL;
+	return obj->type;
 }
 
-enum ucl_safe_iter_flags {
-	UCL_ITERATE_FLAG_UNDEFINED = 0,
-	UCL_ITERATE_FLAG_INSIDE_ARRAY,
-	UCL_ITERATE_FLAG_INSIDE_OBJECT,
-	UCL_ITERATE_FLAG_IMPLICIT,
-	UCL_ITERATE_FLAG_EXCEPTION
-};
+ucl_object_t*
+ucl_object_fromstring (const char *str)
+{
+	return ucl_object_fromstring_common (str, 0, UCL_STRING_RAW);
+}
 
-static const char safe_iter_magic[4] = {'u', 'i', 't', 'e'};
-struct ucl_object_safe_iter {
-	char magic[4]; /* safety check */
-	uint32_t flags;
-	const ucl_object_t *impl_it; /* implicit object iteration */
-	ucl_object_iter_t expl_it; /* explicit iteration */
-};
+ucl_object_t *
+ucl_object_fromlstring (const char *str, size_t len)
+{
+	return ucl_object_fromstring_common (str, len, UCL_STRING_RAW);
+}
 
-#define UCL_SAFE_ITER(ptr) (struct ucl_object_safe_iter *)(ptr)
-#define UCL_SAFE_ITER_CHECK(it) do { \
-	assert (it != NULL); \
-	assert (memcmp (it->magic, safe_iter_magic, sizeof (it->magic)) == 0); \
- } while (0)
+ucl_object_t *
+ucl_object_fromint (int64_t iv)
+{
+	ucl_object_t *obj;
 
-ucl_object_iter_t
-ucl_object_iterate_new (const ucl_object_t *obj)
+	obj = ucl_object_new ();
+	if (obj != NULL) {
+		obj->type = UCL_INT;
+		obj->value.iv = iv;
+	}
+
+	return obj;
+}
+
+ucl_object_t *
+ucl_object_fromdouble (double dv)
 {
-	struct ucl_object_safe_iter *it;
+	ucl_object_t *obj;
 
-	it = UCL_ALLOC (sizeof (*it));
-	if (it != NULL) {
-		memcpy (it->magic, safe_iter_magic, sizeof (it->magic));
-		it->flags = UCL_ITERATE_FLAG_UNDEFINED;
-		it->expl_it = NULL;
-		it->impl_it = obj;
+	obj = ucl_object_new ();
+	if (obj != NULL) {
+		obj->type = UCL_FLOAT;
+		obj->value.dv = dv;
 	}
 
-	return (ucl_object_iter_t)it;
+	return obj;
 }
 
-bool
-ucl_object_iter_chk_excpn(ucl_object_iter_t *it)
+ucl_object_t*
+ucl_object_frombool (bool bv)
 {
-        struct ucl_object_safe_iter *rit = UCL_SAFE_ITER (it);
+	ucl_object_t *obj;
 
-        UCL_SAFE_ITER_CHECK (rit);
+	obj = ucl_object_new ();
+	if (obj != NULL) {
+		obj->type = UCL_BOOLEAN;
+		obj->value.iv = bv;
+	}
 
-	return (rit->flags == UCL_ITERATE_FLAG_EXCEPTION);
+	return obj;
 }
 
-ucl_object_iter_t
-ucl_object_iterate_reset (ucl_object_iter_t it, const ucl_object_t *obj)
+ucl_object_t *
+ucl_elt_append (ucl_object_t *head, ucl_object_t *elt)
 {
-	struct ucl_object_safe_iter *rit = UCL_SAFE_ITER (it);
 
-	UCL_SAFE_ITER_CHECK (rit);
+	if (elt->flags & UCL_OBJECT_FROZEN) {
+		return NULL;
+	}
 
-	if (rit->expl_it != NULL) {
-		if (rit->flags == UCL_ITERATE_FLAG_INSIDE_OBJECT) {
-			UCL_FREE (sizeof (*rit->expl_it), rit->expl_it);
+	if (head == NULL) {
+		elt->next = NULL;
+		elt->prev = elt;
+		head = elt;
+	}
+	else {
+		if (head->flags & UCL_OBJECT_FROZEN) {
+			return NULL;
+		}
+		if (head->type == UCL_USERDATA) {
+			/* Userdata objects are VERY special! */
+			struct ucl_object_userdata *ud = (struct ucl_object_userdata *)head;
+			elt->prev = ud->obj.prev;
+			ud->obj.prev->next = elt;
+			ud->obj.prev = elt;
+			elt->next = NULL;
+		}
+		else {
+			elt->prev = head->prev;
+			head->prev->next = elt;
+			head->prev = elt;
+			elt->next = NULL;
 		}
 	}
 
-	rit->impl_it = obj;
-	rit->expl_it = NULL;
-	rit->flags = UCL_ITERATE_FLAG_UNDEFINED;
-
-	return it;
+	return head;
 }
 
-const ucl_object_t*
-ucl_object_iterate_safe (ucl_object_iter_t it, bool expand_values)
+bool
+ucl_object_todouble_safe (const ucl_object_t *obj, double *target)
 {
-	return ucl_object_iterate_full (it, expand_values ? UCL_ITERATE_BOTH :
-			UCL_ITERATE_IMPLICIT);
+	if (obj == NULL || target == NULL) {
+		return false;
+	}
+	switch (obj->type) {
+	case UCL_INT:
+		*target = obj->value.iv; /* Probably could cause overflow */
+		break;
+	case UCL_FLOAT:
+	case UCL_TIME:
+		*target = obj->value.dv;
+		break;
+	default:
+		return false;
+	}
+
+	return true;
 }
 
-const ucl_object_t*
-ucl_object_iterate_full (ucl_object_iter_t it, enum ucl_iterate_type type)
+double
+ucl_object_todouble (const ucl_object_t *obj)
 {
-	struct ucl_object_safe_iter *rit = UCL_SAFE_ITER (it);
-	const ucl_object_t *ret = NULL;
-	int ern;
+	double result = 0.;
 
-	UCL_SAFE_ITER_CHECK (rit);
+	ucl_object_todouble_safe (obj, &result);
+	return result;
+}
 
-	if (rit->impl_it == NULL) {
-		return NULL;
+bool
+ucl_object_toint_safe (const ucl_object_t *obj, int64_t *target)
+{
+	if (obj == NULL || target == NULL) {
+		return false;
+	}
+	switch (obj->type) {
+	case UCL_INT:
+		*target = obj->value.iv;
+		break;
+	case UCL_FLOAT:
+	case UCL_TIME:
+		*target = obj->value.dv; /* Losing of decimal points */
+		break;
+	default:
+		return false;
 	}
 
-	if (rit->impl_it->type == UCL_OBJECT) {
-		rit->flags = UCL_ITERATE_FLAG_INSIDE_OBJECT;
-		ret = ucl_object_iterate_with_error (rit->impl_it, &rit->expl_it, true, &ern);
+	return true;
+}
 
-		if (ret == NULL && ern != 0) {
-			rit->flags = UCL_ITERATE_FLAG_EXCEPTION;
-			return NULL;
-		}
+int64_t
+ucl_object_toint (const ucl_object_t *obj)
+{
+	int64_t result = 0;
 
-		if (ret == NULL && (type & UCL_ITERATE_IMPLICIT)) {
-			/* Need to switch to another implicit object in chain */
-			rit->impl_it = rit->impl_it->next;
-			rit->expl_it = NULL;
+	ucl_object_toint_safe (obj, &result);
+	return result;
+}
 
-			return ucl_object_iterate_safe (it, type);
-		}
+bool
+ucl_object_toboolean_safe (const ucl_object_t *obj, bool *target)
+{
+	if (obj == NULL || target == NULL) {
+		return false;
 	}
-	else if (rit->impl_it->type == UCL_ARRAY) {
-		rit->flags = UCL_ITERATE_FLAG_INSIDE_ARRAY;
-		ret = ucl_object_iterate (rit->impl_it, &rit->expl_it, true);
-
-		if (ret == NULL && (type & UCL_ITERATE_IMPLICIT)) {
-			/* Need to switch to another implicit object in chain */
-			rit->impl_it = rit->impl_it->next;
-			rit->expl_it = NULL;
-
-			return ucl_object_iterate_safe (it, type);
-		}
+	switch (obj->type) {
+	case UCL_BOOLEAN:
+		*target = (obj->value.iv == true);
+		break;
+	default:
+		return false;
 	}
-	else {
-		/* Just iterate over the implicit array */
-		rit->flags = UCL_ITERATE_FLAG_IMPLICIT;
-		ret = rit->impl_it;
-		rit->impl_it = rit->impl_it->next;
 
-		if (type & UCL_ITERATE_EXPLICIT) {
-			/* We flatten objects if need to expand values */
-			if (ret->type == UCL_OBJECT || ret->type == UCL_ARRAY) {
-				return ucl_object_iterate_safe (it, type);
-			}
-		}
-	}
+	return true;
+}
 
-	return ret;
+bool
+ucl_object_toboolean (const ucl_object_t *obj)
+{
+	bool result = false;
+
+	ucl_object_toboolean_safe (obj, &result);
+	return result;
 }
 
-void
-ucl_object_iterate_free (ucl_object_iter_t it)
+bool
+ucl_object_tostring_safe (const ucl_object_t *obj, const char **target)
 {
-	struct ucl_object_safe_iter *rit = UCL_SAFE_ITER (it);
-
-	UCL_SAFE_ITER_CHECK (rit);
+	if (obj == NULL || target == NULL) {
+		return false;
+	}
 
-	if (rit->expl_it != NULL) {
-		if (rit->flags == UCL_ITERATE_FLAG_INSIDE_OBJECT) {
-			UCL_FREE (sizeof (*rit->expl_it), rit->expl_it);
+	switch (obj->type) {
+	case UCL_STRING:
+		if (!(obj->flags & UCL_OBJECT_BINARY)) {
+			*target = ucl_copy_value_trash (obj);
 		}
+		break;
+	default:
+		return false;
 	}
 
-	UCL_FREE (sizeof (*rit), it);
-}
-
-const ucl_object_t *
-ucl_object_lookup_path (const ucl_object_t *top, const char *path_in) {
-	return ucl_object_lookup_path_char (top, path_in, '.');
+	return true;
 }
 
+const char *
+ucl_object_tostring (const ucl_object_t *obj)
+{
+	const char *result = NULL;
 
-const ucl_object_t *
-ucl_object_lookup_path_char (const ucl_object_t *top, const char *path_in, const char sep) {
-	const ucl_object_t *o = NULL, *found;
-	const char *p, *c;
-	char *err_str;
-	unsigned index;
+	ucl_object_tostring_safe (obj, &result);
+	return result;
+}
 
-	if (path_in == NULL || top == NULL) {
-		return NULL;
+const char *
+ucl_object_tostring_forced (const ucl_object_t *obj)
+{
+	/* TODO: For binary strings we might encode string here */
+	if (!(obj->flags & UCL_OBJECT_BINARY)) {
+		return ucl_copy_value_trash (obj);
 	}
 
-	found = NULL;
-	p = path_in;
+	return NULL;
+}
 
-	/* Skip leading dots */
-	while (*p == sep) {
-		p ++;
+bool
+ucl_object_tolstring_safe (const ucl_object_t *obj, const char **target, size_t *tlen)
+{
+	if (obj == NULL || target == NULL) {
+		return false;
 	}
-
-	c = p;
-	while (*p != '\0') {
-		p ++;
-		if (*p == sep || *p == '\0') {
-			if (p > c) {
-				switch (top->type) {
-				case UCL_ARRAY:
-					/* Key should be an int */
-					index = strtoul (c, &err_str, 10);
-					if (err_str != NULL && (*err_str != sep && *err_str != '\0')) {
-						return NULL;
-					}
-					o = ucl_array_find_index (top, index);
-					break;
-				default:
-					o = ucl_object_lookup_len (top, c, p - c);
-					break;
-				}
-				if (o == NULL) {
-					return NULL;
-				}
-				top = o;
-			}
-			if (*p != '\0') {
-				c = p + 1;
-			}
+	switch (obj->type) {
+	case UCL_STRING:
+		*target = obj->value.sv;
+		if (tlen != NULL) {
+			*tlen = obj->len;
 		}
+		break;
+	default:
+		return false;
 	}
-	found = o;
 
-	return found;
+	return true;
 }
 
-
-ucl_object_t *
-ucl_object_new (void)
+const char *
+ucl_object_tolstring (const ucl_object_t *obj, size_t *tlen)
 {
-	return ucl_object_typed_new (UCL_NULL);
+	const char *result = NULL;
+
+	ucl_object_tolstring_safe (obj, &result, tlen);
+	return result;
 }
 
-ucl_object_t *
-ucl_object_typed_new (ucl_type_t type)
+const char *
+ucl_object_key (const ucl_object_t *obj)
 {
-	return ucl_object_new_full (type, 0);
+	return ucl_copy_key_trash (obj);
 }
 
-ucl_object_t *
-ucl_object_new_full (ucl_type_t type, unsigned priority)
+const char *
+ucl_object_keyl (const ucl_object_t *obj, size_t *len)
 {
-	ucl_object_t *new;
-
-	if (type != UCL_USERDATA) {
-		new = UCL_ALLOC (sizeof (ucl_object_t));
-		if (new != NULL) {
-			memset (new, 0, sizeof (ucl_object_t));
-			new->ref = 1;
-			new->type = (type <= UCL_NULL ? type : UCL_NULL);
-			new->next = NULL;
-			new->prev = new;
-			ucl_object_set_priority (new, priority);
-
-			if (type == UCL_ARRAY) {
-				new->value.av = UCL_ALLOC (sizeof (ucl_array_t));
-				if (new->value.av) {
-					memset (new->value.av, 0, sizeof (ucl_array_t));
-					UCL_ARRAY_GET (vec, new);
-
-					/* Preallocate some space for arrays */
-					kv_resize_safe (ucl_object_t *, *vec, 8, enomem);
-				}
-			}
-		}
-	}
-	else {
-		new = ucl_object_new_userdata (NULL, NULL, NULL);
-		ucl_object_set_priority (new, priority);
+	if (len == NULL || obj == NULL) {
+		return NULL;
 	}
-enomem:
-	return new;
+	*len = obj->keylen;
+	return obj->key;
 }
 
-bool ucl_object_reserve (ucl_object_t *obj, size_t reserved)
+ucl_object_t *
+ucl_object_ref (const ucl_object_t *obj)
 {
-	if (obj->type == UCL_ARRAY) {
-		UCL_ARRAY_GET (vec, obj);
+	ucl_object_t *res = NULL;
 
-		if (vec->m < reserved) {
-			/* Preallocate some space for arrays */
-			kv_resize_safe (ucl_object_t *, *vec, reserved, e0);
+	if (obj != NULL) {
+		if (obj->flags & UCL_OBJECT_FROZEN) {
+			/* Frozen trees are immutable and do not need refcounting */
+			res = __DECONST (ucl_object_t *, obj);
+		}
+		else if (obj->flags & UCL_OBJECT_EPHEMERAL) {
+			/*
+			 * Use deep copy for ephemeral objects, note that its refcount
+			 * is NOT increased, since ephemeral objects does not need refcount
+			 * at all
+			 */
+			res = ucl_object_copy (obj);
+		}
+		else {
+			res = __DECONST (ucl_object_t *, obj);
+#ifdef HAVE_ATOMIC_BUILTINS
+			(void)__sync_add_and_fetch (&res->ref, 1);
+#else
+			res->ref ++;
+#endif
 		}
 	}
-	else if (obj->type == UCL_OBJECT) {
-		ucl_hash_reserve (obj->value.ov, reserved);
-	}
-	return true;
-e0:
-	return false;
+	return res;
 }
 
-ucl_object_t*
-ucl_object_new_userdata (ucl_userdata_dtor dtor,
-		ucl_userdata_emitter emitter,
-		void *ptr)
+ucl_object_t *
+ucl_object_copy_internal (const ucl_object_t *other, bool allow_array)
 {
-	struct ucl_object_userdata *new;
-	size_t nsize = sizeof (*new);
 
-	new = UCL_ALLOC (nsize);
-	if (new != NULL) {
-		memset (new, 0, nsize);
-		new->obj.ref = 1;
-		new->obj.type = UCL_USERDATA;
-		new->obj.next = NULL;
-		new->obj.prev = (ucl_object_t *)new;
-		new->dtor = dtor;
-		new->emitter = emitter;
-		new->obj.value.ud = ptr;
+	ucl_object_t *new;
+	ucl_object_iter_t it = NULL;
+	const ucl_object_t *cur;
+	size_t sz = sizeof(*new);
+	uint16_t own;
+
+	if (other->type == UCL_USERDATA) {
+		sz = sizeof (struct ucl_object_userdata);
 	}
+	new = ucl_object_node_alloc (sz);
 
-	return (ucl_object_t *)new;
-}
+	if (new != NULL) {
+		own = new->flags & UCL_OBJECT_OWN_ALLOCATOR;
+		memcpy (new, other, sz);
+		/* Copied object is always non ephemeral and mutable */
+		new->flags &= ~(UCL_OBJECT_EPHEMERAL|UCL_OBJECT_FROZEN|
+				UCL_OBJECT_OWN_ALLOCATOR);
+		new->flags |= own;
+		new->ref = 1;
+		/* Unlink from others */
+		new->next = NULL;
+		new->prev = new;
 
-ucl_type_t
-ucl_object_type (const ucl_object_t *obj)
-{
-	if (obj == NULL) {
-		return UCL_NULL;
-	}
+		/* deep copy of values stored */
+		if (other->trash_stack[UCL_TRASH_KEY] != NULL) {
+			new->trash_stack[UCL_TRASH_KEY] = NULL;
+			if (other->key == (const char *)other->trash_stack[UCL_TRASH_KEY]) {
+				new->trash_stack[UCL_TRASH_KEY] = UCL_ALLOC (other->keylen + 1);
+				memcpy(new->trash_stack[UCL_TRASH_KEY], other->trash_stack[UCL_TRASH_KEY], other->keylen);
+				new->trash_stack[UCL_TRASH_KEY][other->keylen] = '\0';
+				new->key = new->trash_stack[UCL_TRASH_KEY];
+			}
+		}
+		if (other->trash_stack[UCL_TRASH_VALUE] != NULL) {
+			new->trash_stack[UCL_TRASH_VALUE] =
+					ucl_strdup (other->trash_stack[UCL_TRASH_VALUE]);
+			if (new->type == UCL_STRING) {
+				new->value.sv = new->trash_stack[UCL_TRASH_VALUE];
+			}
+		}
 
-	return obj->type;
-}
+		if (other->type == UCL_ARRAY || other->type == UCL_OBJECT) {
+			/* reset old value */
+			memset (&new->value, 0, sizeof (new->value));
 
-ucl_object_t*
-ucl_object_fromstring (const char *str)
-{
-	return ucl_object_fromstring_common (str, 0, UCL_STRING_RAW);
+			if (other->type == UCL_ARRAY &&
+					ucl_array_copy_packed (new, other)) {
+				return new;
+			}
+
+			/* children are re-added below and counted again */
+			new->len = 0;
+
+			while ((cur = ucl_object_iterate (other, &it, true)) != NULL) {
+				if (other->type == UCL_ARRAY) {
+					ucl_array_append (new, ucl_object_copy_internal (cur, false));
+				}
+				else {
+					ucl_object_t *cp = ucl_object_copy_internal (cur, true);
+					if (cp != NULL) {
+						ucl_object_insert_key (new, cp, cp->key, cp->keylen,
+								false);
+					}
+				}
+			}
+		}
+		else if (allow_array && other->next != NULL) {
+			LL_FOREACH (other->next, cur) {
+				ucl_object_t *cp = ucl_object_copy_internal (cur, false);
+				if (cp != NULL) {
+					DL_APPEND (new, cp);
+				}
+			}
+		}
+	}
+
+	return new;
 }
 
 ucl_object_t *
-ucl_object_fromlstring (const char *str, size_t len)
+ucl_object_copy (const ucl_object_t *other)
 {
-	return ucl_object_fromstring_common (str, len, UCL_STRING_RAW);
+	return ucl_object_copy_internal (other, true);
 }
 
-ucl_object_t *
-ucl_object_fromint (int64_t iv)
+void
+ucl_object_unref (ucl_object_t *obj)
 {
-	ucl_object_t *obj;
-
-	obj = ucl_object_new ();
-	if (obj != NULL) {
-		obj->type = UCL_INT;
-		obj->value.iv = iv;
+	if (obj != NULL && !(obj->flags & UCL_OBJECT_FROZEN)) {
+#ifdef HAVE_ATOMIC_BUILTINS
+		unsigned int rc = __sync_sub_and_fetch (&obj->ref, 1);
+		if (rc == 0) {
+#else
+		if (--obj->ref == 0) {
+#endif
+			ucl_object_free_internal (obj, true, true);
+		}
 	}
-
-	return obj;
 }
 
-ucl_object_t *
-ucl_object_fromdouble (double dv)
+/* Trees retired by `ucl_object_unref_deferred` linked via `prev` */
+static ucl_object_t *ucl_retired_trees = NULL;
+
+void
+ucl_object_unref_deferred (ucl_object_t *obj)
 {
-	ucl_object_t *obj;
+	if (obj != NULL && !(obj->flags & UCL_OBJECT_FROZEN)) {
+#ifdef HAVE_ATOMIC_BUILTINS
+		unsigned int rc = __sync_sub_and_fetch (&obj->ref, 1);
+		if (rc == 0) {
+			ucl_object_t *head;
 
-	obj = ucl_object_new ();
-	if (obj != NULL) {
-		obj->type = UCL_FLOAT;
-		obj->value.dv = dv;
+			do {
+				head = ucl_retired_trees;
+				obj->prev = head;
+			} while (!__sync_bool_compare_and_swap (&ucl_retired_trees,
+					head, obj));
+		}
+#else
+		if (--obj->ref == 0) {
+			obj->prev = ucl_retired_trees;
+			ucl_retired_trees = obj;
+		}
+#endif
 	}
-
-	return obj;
 }
 
-ucl_object_t*
-ucl_object_frombool (bool bv)
+unsigned int
+ucl_object_reclaim (void)
 {
-	ucl_object_t *obj;
+	ucl_object_t *cur, *next;
+	unsigned int n = 0;
 
-	obj = ucl_object_new ();
-	if (obj != NULL) {
-		obj->type = UCL_BOOLEAN;
-		obj->value.iv = bv;
+#ifdef HAVE_ATOMIC_BUILTINS
+	cur = __sync_lock_test_and_set (&ucl_retired_trees, NULL);
+#else
+	cur = ucl_retired_trees;
+	ucl_retired_trees = NULL;
+#endif
+
+	while (cur != NULL) {
+		next = cur->prev;
+		ucl_object_free_internal (cur, true, true);
+		cur = next;
+		n ++;
 	}
 
-	return obj;
+	return n;
 }
 
-bool
-ucl_array_append (ucl_object_t *top, ucl_object_t *elt)
+static bool ucl_object_fp_update (const ucl_object_t *obj);
+
+/*
+ * Returns the next child of a container, packed arrays have no element
+ * objects
+ */
+static ucl_object_t *
+ucl_object_next_child (ucl_object_t *obj, const void **cursor, unsigned int *i)
 {
-	UCL_ARRAY_GET (vec, top);
+	ucl_object_t *sub = NULL;
 
-	if (elt == NULL || top == NULL) {
-		return false;
+	if (obj->type == UCL_OBJECT) {
+		sub = (ucl_object_t *)ucl_hash_iterate_cursor (obj->value.ov, cursor);
 	}
+	else if (obj->type == UCL_ARRAY) {
+		UCL_ARRAY_GET (vec, obj);
 
-	if (vec == NULL) {
-		vec = UCL_ALLOC (sizeof (*vec));
-
-		if (vec == NULL) {
-			return false;
+		if (vec != NULL && !UCL_ARRAY_IS_PACKED (vec)) {
+			while (sub == NULL && *i < vec->n) {
+				sub = UCL_ARRAY_A (vec, *i);
+				(*i) ++;
+			}
 		}
-
-		kv_init (*vec);
-		top->value.av = (void *)vec;
 	}
 
-	kv_push_safe (ucl_object_t *, *vec, elt, e0);
-
-	top->len ++;
-
-	return true;
-e0:
-	return false;
+	return sub;
 }
 
-bool
-ucl_array_prepend (ucl_object_t *top, ucl_object_t *elt)
+/*
+ * Lazy copies published while a node was frozen become its key and value
+ */
+static void
+ucl_object_adopt_trash (ucl_object_t *obj)
 {
-	UCL_ARRAY_GET (vec, top);
+	unsigned char *trash;
 
-	if (elt == NULL || top == NULL) {
-		return false;
-	}
+	trash = obj->trash_stack[UCL_TRASH_KEY];
 
-	if (vec == NULL) {
-		vec = UCL_ALLOC (sizeof (*vec));
-		kv_init (*vec);
-		top->value.av = (void *)vec;
-		kv_push_safe (ucl_object_t *, *vec, elt, e0);
-	}
-	else {
-		/* Slow O(n) algorithm */
-		kv_prepend_safe (ucl_object_t *, *vec, elt, e0);
+	if (trash != NULL && obj->key != (const char *)trash) {
+		obj->key = (const char *)trash;
+		obj->flags |= UCL_OBJECT_ALLOCATED_KEY;
 	}
 
-	top->len ++;
+	trash = obj->trash_stack[UCL_TRASH_VALUE];
 
-	return true;
-e0:
-	return false;
+	/* Numbers keep their string form in the trash stack only */
+	if (trash != NULL && obj->type == UCL_STRING &&
+			obj->value.sv != (const char *)trash) {
+		obj->value.sv = (const char *)trash;
+		obj->flags |= UCL_OBJECT_ALLOCATED_VALUE;
+	}
 }
 
-bool
-ucl_array_merge (ucl_object_t *top, ucl_object_t *elt, bool copy)
+/*
+ * Trees are walked with an explicit stack of implicit arrays, so deep trees
+ * cannot exhaust the native stack
+ */
+static void
+ucl_object_set_frozen (ucl_object_t *obj, bool frozen)
 {
-	unsigned i;
-	ucl_object_t *cp = NULL;
-	ucl_object_t **obj;
+	kvec_t (ucl_object_t *) stack;
+	ucl_object_t *cur, *sub;
+	struct ucl_container_meta *meta;
+	const void *cursor;
+	unsigned int i;
 
-	if (elt == NULL || top == NULL || top->type != UCL_ARRAY || elt->type != UCL_ARRAY) {
-		return false;
-	}
+	kv_init (stack);
 
-	if (copy) {
-		cp = ucl_object_copy (elt);
-	}
-	else {
-		cp = ucl_object_ref (elt);
-	}
+	while (obj != NULL) {
+		LL_FOREACH (obj, cur) {
+			/* Nested roots of frozen trees become parts of this one */
+			meta = ucl_object_container_meta (cur);
+
+			if (meta != NULL) {
+				meta->frozen_epoch = 0;
+			}
 
-	UCL_ARRAY_GET (v1, top);
-	UCL_ARRAY_GET (v2, cp);
+			if (frozen) {
+				cur->flags |= UCL_OBJECT_FROZEN;
+			}
+			else {
+				cur->flags &= ~UCL_OBJECT_FROZEN;
+				ucl_object_adopt_trash (cur);
+			}
 
-	if (v1 && v2) {
-		kv_concat_safe (ucl_object_t *, *v1, *v2, e0);
+			cursor = NULL;
+			i = 0;
 
-		for (i = v2->n; i < v1->n; i ++) {
-			obj = &kv_A (*v1, i);
-			if (*obj == NULL) {
+			while ((sub = ucl_object_next_child (cur, &cursor, &i)) != NULL) {
+				kv_push_safe (ucl_object_t *, stack, sub, e0);
 				continue;
+e0:
+				/* No memory to grow the stack, walk the subtree in place */
+				ucl_object_set_frozen (sub, frozen);
 			}
-			top->len ++;
 		}
+
+		obj = kv_size (stack) > 0 ? kv_pop (stack) : NULL;
 	}
 
-	return true;
-e0:
-	return false;
+	kv_destroy (stack);
 }
 
-ucl_object_t *
-ucl_array_delete (ucl_object_t *top, ucl_object_t *elt)
+const ucl_object_t *
+ucl_object_freeze (ucl_object_t *top)
 {
-	UCL_ARRAY_GET (vec, top);
-	ucl_object_t *ret = NULL;
-	unsigned i;
+	const ucl_object_t *cur;
+	struct ucl_container_meta *meta;
+	unsigned int epoch;
+
+	if (top != NULL && !(top->flags & UCL_OBJECT_FROZEN)) {
+		/*
+		 * Frozen trees are read only, so fingerprints are computed here and
+		 * emit caches, which are not used for frozen trees, are released
+		 */
+		LL_FOREACH (top, cur) {
+			if (cur->type == UCL_OBJECT || cur->type == UCL_ARRAY) {
+				ucl_object_fp_update (cur);
+				ucl_object_emit_cache_clear (cur);
+			}
+		}
 
-	if (vec == NULL) {
-		return NULL;
-	}
+		ucl_object_set_frozen (top, true);
+		meta = ucl_object_container_meta_new (top);
 
-	for (i = 0; i < vec->n; i ++) {
-		if (kv_A (*vec, i) == elt) {
-			kv_del (ucl_object_t *, *vec, i);
-			ret = elt;
-			top->len --;
-			break;
+		if (meta != NULL) {
+#ifdef HAVE_ATOMIC_BUILTINS
+			epoch = __sync_add_and_fetch (&ucl_freeze_epoch, 1);
+			__atomic_store_n (&meta->frozen_epoch, epoch, __ATOMIC_RELEASE);
+#else
+			epoch = ++ ucl_freeze_epoch;
+			meta->frozen_epoch = epoch;
+#endif
 		}
 	}
 
-	return ret;
+	return top;
 }
 
-const ucl_object_t *
-ucl_array_head (const ucl_object_t *top)
+ucl_object_t *
+ucl_object_thaw (const ucl_object_t *top)
 {
-	UCL_ARRAY_GET (vec, top);
-
-	if (vec == NULL || top == NULL || top->type != UCL_ARRAY ||
-			top->value.av == NULL) {
-		return NULL;
-	}
+	ucl_object_t *deconst = __DECONST (ucl_object_t *, top);
 
-	return (vec->n > 0 ? vec->a[0] : NULL);
-}
-
-const ucl_object_t *
-ucl_array_tail (const ucl_object_t *top)
-{
-	UCL_ARRAY_GET (vec, top);
+	if (deconst != NULL && (deconst->flags & UCL_OBJECT_FROZEN)) {
+		if (ucl_object_frozen_epoch (deconst) == 0) {
+			/* A part of a frozen tree, its root is not known */
+#ifdef HAVE_ATOMIC_BUILTINS
+			(void)__sync_add_and_fetch (&ucl_thaw_epoch, 1);
+#else
+			ucl_thaw_epoch ++;
+#endif
+		}
 
-	if (top == NULL || top->type != UCL_ARRAY || top->value.av == NULL) {
-		return NULL;
+		ucl_object_set_frozen (deconst, false);
 	}
 
-	return (vec->n > 0 ? vec->a[vec->n - 1] : NULL);
+	return deconst;
 }
 
-ucl_object_t *
-ucl_array_pop_last (ucl_object_t *top)
+bool
+ucl_object_is_frozen (const ucl_object_t *obj)
 {
-	UCL_ARRAY_GET (vec, top);
-	ucl_object_t **obj, *ret = NULL;
-
-	if (vec != NULL && vec->n > 0) {
-		obj = &kv_A (*vec, vec->n - 1);
-		ret = *obj;
-		kv_del (ucl_object_t *, *vec, vec->n - 1);
-		top->len --;
-	}
-
-	return ret;
+	return obj != NULL && (obj->flags & UCL_OBJECT_FROZEN) != 0;
 }
 
-ucl_object_t *
-ucl_array_pop_first (ucl_object_t *top)
-{
-	UCL_ARRAY_GET (vec, top);
-	ucl_object_t **obj, *ret = NULL;
+/* Fixed seeds, so fingerprints are stable between processes */
+static const uint64_t ucl_fp_seeds[2] = {
+	0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL
+};
 
-	if (vec != NULL && vec->n > 0) {
-		obj = &kv_A (*vec, 0);
-		ret = *obj;
-		kv_del (ucl_object_t *, *vec, 0);
-		top->len --;
+struct ucl_container_meta *
+ucl_object_container_meta (const ucl_object_t *obj)
+{
+	if (obj->type == UCL_OBJECT) {
+		return ucl_hash_meta (obj->value.ov);
+	}
+	else if (obj->type == UCL_ARRAY && obj->value.av != NULL) {
+		return UCL_ARRAY_META ((ucl_array_t *)obj->value.av);
 	}
 
-	return ret;
+	return NULL;
 }
 
-unsigned int
-ucl_array_size (const ucl_object_t *top)
+struct ucl_container_meta *
+ucl_object_container_meta_new (const ucl_object_t *obj)
 {
-	if (top == NULL || top->type != UCL_ARRAY) {
-		return 0;
-	}
+	struct ucl_array_ext *ext;
 
-	UCL_ARRAY_GET (vec, top);
+	if (obj->type == UCL_OBJECT) {
+		return ucl_hash_meta_new (obj->value.ov);
+	}
+	else if (obj->type == UCL_ARRAY && obj->value.av != NULL) {
+		ext = ucl_array_ext_get ((ucl_array_t *)obj->value.av);
 
-	if (vec != NULL) {
-		return kv_size(*vec);
+		return ext != NULL ? &ext->meta : NULL;
 	}
 
-	return 0;
+	return NULL;
 }
 
-const ucl_object_t *
-ucl_array_find_index (const ucl_object_t *top, unsigned int index)
-{
-	UCL_ARRAY_GET (vec, top);
-
-	if (vec != NULL && vec->n > 0 && index < vec->n) {
-		return kv_A (*vec, index);
-	}
+static void ucl_object_fp_values (const ucl_object_t *obj, uint64_t fp[2]);
 
-	return NULL;
+/*
+ * Returns true if a cached fingerprint of a container can be used as is
+ */
+static inline bool
+ucl_object_fp_ready (const ucl_object_t *obj, struct ucl_container_meta *meta)
+{
+	return meta != NULL && meta->fp_valid && meta->fp_version == meta->version &&
+			(obj->flags & UCL_OBJECT_FROZEN);
 }
 
-unsigned int
-ucl_array_index_of (ucl_object_t *top, ucl_object_t *elt)
+/*
+ * Check cached fingerprints of a container and all nested containers,
+ * recomputing stale ones. Returns true if the fingerprint of `obj` has been
+ * recomputed.
+ */
+static bool
+ucl_object_fp_update (const ucl_object_t *obj)
 {
-	UCL_ARRAY_GET (vec, top);
-	unsigned i;
+	struct ucl_container_meta *meta;
+	const ucl_object_t *cur, *elt;
+	ucl_object_t tmp;
+	const void *cursor = NULL;
+	uint64_t fp[2], sum[2] = {0, 0};
+	bool stale;
+	unsigned i, j;
+
+	meta = ucl_object_container_meta_new (obj);
+
+	if (meta == NULL) {
+		/* Empty container, nothing to cache */
+		return false;
+	}
 
-	if (vec == NULL) {
-		return (unsigned int)(-1);
+	if (ucl_object_fp_ready (obj, meta)) {
+		return false;
 	}
 
-	for (i = 0; i < vec->n; i ++) {
-		if (kv_A (*vec, i) == elt) {
-			return i;
+	stale = !meta->fp_valid || meta->fp_version != meta->version;
+
+	/* Validate nested containers, scalars are never modified in place */
+	if (obj->type == UCL_OBJECT) {
+		while ((cur = ucl_hash_iterate_cursor (obj->value.ov, &cursor))) {
+			LL_FOREACH (cur, elt) {
+				if ((elt->type == UCL_OBJECT || elt->type == UCL_ARRAY) &&
+						ucl_object_fp_update (elt)) {
+					stale = true;
+				}
+			}
 		}
 	}
+	else {
+		UCL_ARRAY_GET (vec, obj);
 
-	return (unsigned int)(-1);
-}
+		for (i = 0; i < vec->n; i ++) {
+			elt = ucl_array_get (vec, i, &tmp);
 
-ucl_object_t *
-ucl_array_replace_index (ucl_object_t *top, ucl_object_t *elt,
-	unsigned int index)
-{
-	UCL_ARRAY_GET (vec, top);
-	ucl_object_t *ret = NULL;
+			if (elt != NULL && (elt->type == UCL_OBJECT ||
+					elt->type == UCL_ARRAY) && ucl_object_fp_update (elt)) {
+				stale = true;
+			}
+		}
+	}
 
-	if (vec != NULL && vec->n > 0 && index < vec->n) {
-		ret = kv_A (*vec, index);
-		kv_A (*vec, index) = elt;
+	if (!stale) {
+		return false;
 	}
 
-	return ret;
-}
+	if (obj->type == UCL_OBJECT) {
+		/* Members are combined regardless of their order */
+		cursor = NULL;
 
-ucl_object_t *
-ucl_elt_append (ucl_object_t *head, ucl_object_t *elt)
-{
+		while ((cur = ucl_hash_iterate_cursor (obj->value.ov, &cursor))) {
+			ucl_object_fp_values (cur, fp);
 
-	if (head == NULL) {
-		elt->next = NULL;
-		elt->prev = elt;
-		head = elt;
-	}
-	else {
-		if (head->type == UCL_USERDATA) {
-			/* Userdata objects are VERY special! */
-			struct ucl_object_userdata *ud = (struct ucl_object_userdata *)head;
-			elt->prev = ud->obj.prev;
-			ud->obj.prev->next = elt;
-			ud->obj.prev = elt;
-			elt->next = NULL;
-		}
-		else {
-			elt->prev = head->prev;
-			head->prev->next = elt;
-			head->prev = elt;
-			elt->next = NULL;
+			for (j = 0; j < 2; j ++) {
+				sum[j] += mum_hash_finish (mum_hash_step (
+						mum_hash (cur->key, cur->keylen, ucl_fp_seeds[j]),
+						fp[j]));
+			}
 		}
-	}
-
-	return head;
-}
 
-bool
-ucl_object_todouble_safe (const ucl_object_t *obj, double *target)
-{
-	if (obj == NULL || target == NULL) {
-		return false;
-	}
-	switch (obj->type) {
-	case UCL_INT:
-		*target = obj->value.iv; /* Probably could cause overflow */
-		break;
-	case UCL_FLOAT:
-	case UCL_TIME:
-		*target = obj->value.dv;
-		break;
-	default:
-		return false;
+		for (j = 0; j < 2; j ++) {
+			meta->fp[j] = mum_hash_finish (mum_hash_step (
+					mum_hash_step (ucl_fp_seeds[j], UCL_OBJECT), sum[j]));
+		}
 	}
+	else {
+		UCL_ARRAY_GET (vec, obj);
 
-	return true;
-}
+		for (j = 0; j < 2; j ++) {
+			sum[j] = mum_hash_step (mum_hash_step (ucl_fp_seeds[j], UCL_ARRAY),
+					vec->n);
+		}
 
-double
-ucl_object_todouble (const ucl_object_t *obj)
-{
-	double result = 0.;
+		for (i = 0; i < vec->n; i ++) {
+			ucl_object_fp_values (ucl_array_get (vec, i, &tmp), fp);
 
-	ucl_object_todouble_safe (obj, &result);
-	return result;
-}
+			for (j = 0; j < 2; j ++) {
+				sum[j] = mum_hash_step (sum[j], fp[j]);
+			}
+		}
 
-bool
-ucl_object_toint_safe (const ucl_object_t *obj, int64_t *target)
-{
-	if (obj == NULL || target == NULL) {
-		return false;
-	}
-	switch (obj->type) {
-	case UCL_INT:
-		*target = obj->value.iv;
-		break;
-	case UCL_FLOAT:
-	case UCL_TIME:
-		*target = obj->value.dv; /* Losing of decimal points */
-		break;
-	default:
-		return false;
+		for (j = 0; j < 2; j ++) {
+			meta->fp[j] = mum_hash_finish (sum[j]);
+		}
 	}
 
+	meta->fp_version = meta->version;
+	meta->fp_valid = true;
+
 	return true;
 }
 
-int64_t
-ucl_object_toint (const ucl_object_t *obj)
+/*
+ * Fingerprint of a single value, containers must be updated by a caller
+ */
+static void
+ucl_object_fp_node (const ucl_object_t *obj, uint64_t fp[2])
 {
-	int64_t result = 0;
+	struct ucl_container_meta *meta;
+	uint64_t v = 0;
+	double d;
+	unsigned j;
 
-	ucl_object_toint_safe (obj, &result);
-	return result;
-}
+	if (obj == NULL) {
+		for (j = 0; j < 2; j ++) {
+			fp[j] = mum_hash_finish (mum_hash_step (ucl_fp_seeds[j], UCL_NULL));
+		}
 
-bool
-ucl_object_toboolean_safe (const ucl_object_t *obj, bool *target)
-{
-	if (obj == NULL || target == NULL) {
-		return false;
+		return;
 	}
-	switch (obj->type) {
-	case UCL_BOOLEAN:
-		*target = (obj->value.iv == true);
-		break;
-	default:
-		return false;
+
+	if (obj->type == UCL_OBJECT || obj->type == UCL_ARRAY) {
+		meta = ucl_object_container_meta (obj);
+
+		if (meta != NULL) {
+			fp[0] = meta->fp[0];
+			fp[1] = meta->fp[1];
+
+			return;
+		}
 	}
 
-	return true;
+	for (j = 0; j < 2; j ++) {
+		switch (obj->type) {
+		case UCL_INT:
+		case UCL_BOOLEAN:
+			v = obj->value.iv;
+			break;
+		case UCL_FLOAT:
+		case UCL_TIME:
+			/* Do not distinguish -0 and 0 */
+			d = obj->value.dv == 0 ? 0 : obj->value.dv;
+			memcpy (&v, &d, sizeof (v));
+			break;
+		case UCL_STRING:
+			v = mum_hash (obj->value.sv, obj->len, ucl_fp_seeds[j]);
+			break;
+		case UCL_USERDATA:
+			v = (uint64_t)(uintptr_t)obj->value.ud;
+			break;
+		default:
+			/* Empty containers and nulls */
+			v = 0;
+			break;
+		}
+
+		fp[j] = mum_hash_finish (mum_hash_step (
+				mum_hash_step (ucl_fp_seeds[j], obj->type), v));
+	}
 }
 
-bool
-ucl_object_toboolean (const ucl_object_t *obj)
+/*
+ * Fingerprint of all values of a key: implicit arrays are treated as arrays
+ */
+static void
+ucl_object_fp_values (const ucl_object_t *obj, uint64_t fp[2])
 {
-	bool result = false;
+	const ucl_object_t *cur;
+	uint64_t h[2], efp[2];
+	unsigned len = 0, j;
 
-	ucl_object_toboolean_safe (obj, &result);
-	return result;
-}
+	if (obj == NULL || obj->next == NULL) {
+		ucl_object_fp_node (obj, fp);
+		return;
+	}
 
-bool
-ucl_object_tostring_safe (const ucl_object_t *obj, const char **target)
-{
-	if (obj == NULL || target == NULL) {
-		return false;
+	LL_FOREACH (obj, cur) {
+		len ++;
 	}
 
-	switch (obj->type) {
-	case UCL_STRING:
-		if (!(obj->flags & UCL_OBJECT_BINARY)) {
-			*target = ucl_copy_value_trash (obj);
-		}
-		break;
-	default:
-		return false;
+	for (j = 0; j < 2; j ++) {
+		h[j] = mum_hash_step (mum_hash_step (ucl_fp_seeds[j], UCL_ARRAY), len);
 	}
 
-	return true;
-}
+	LL_FOREACH (obj, cur) {
+		ucl_object_fp_node (cur, efp);
 
-const char *
-ucl_object_tostring (const ucl_object_t *obj)
-{
-	const char *result = NULL;
+		for (j = 0; j < 2; j ++) {
+			h[j] = mum_hash_step (h[j], efp[j]);
+		}
+	}
 
-	ucl_object_tostring_safe (obj, &result);
-	return result;
+	for (j = 0; j < 2; j ++) {
+		fp[j] = mum_hash_finish (h[j]);
+	}
 }
 
-const char *
-ucl_object_tostring_forced (const ucl_object_t *obj)
+void
+ucl_object_fingerprint_values (const ucl_object_t *obj, bool update,
+		struct ucl_fingerprint *fp)
 {
-	/* TODO: For binary strings we might encode string here */
-	if (!(obj->flags & UCL_OBJECT_BINARY)) {
-		return ucl_copy_value_trash (obj);
+	const ucl_object_t *cur;
+	uint64_t h[2];
+
+	if (update) {
+		LL_FOREACH (obj, cur) {
+			if (cur->type == UCL_OBJECT || cur->type == UCL_ARRAY) {
+				ucl_object_fp_update (cur);
+			}
+		}
 	}
 
-	return NULL;
+	ucl_object_fp_values (obj, h);
+	fp->h1 = h[0];
+	fp->h2 = h[1];
 }
 
 bool
-ucl_object_tolstring_safe (const ucl_object_t *obj, const char **target, size_t *tlen)
+ucl_object_fingerprint (const ucl_object_t *obj, struct ucl_fingerprint *fp)
 {
-	if (obj == NULL || target == NULL) {
+	uint64_t h[2];
+
+	if (obj == NULL || fp == NULL) {
 		return false;
 	}
-	switch (obj->type) {
-	case UCL_STRING:
-		*target = obj->value.sv;
-		if (tlen != NULL) {
-			*tlen = obj->len;
-		}
-		break;
-	default:
-		return false;
+
+	if (obj->type == UCL_OBJECT || obj->type == UCL_ARRAY) {
+		ucl_object_fp_update (obj);
 	}
 
+	ucl_object_fp_node (obj, h);
+	fp->h1 = h[0];
+	fp->h2 = h[1];
+
 	return true;
 }
 
-const char *
-ucl_object_tolstring (const ucl_object_t *obj, size_t *tlen)
-{
-	const char *result = NULL;
-
-	ucl_object_tolstring_safe (obj, &result, tlen);
-	return result;
-}
+#define ucl_memory_ptr_hash_func(p) \
+	kh_int64_hash_func ((uint64_t)(uintptr_t)(p))
 
-const char *
-ucl_object_key (const ucl_object_t *obj)
-{
-	return ucl_copy_key_trash (obj);
-}
+/* Set of shared nodes that have been accounted already */
+KHASH_INIT (ucl_memory_seen, const ucl_object_t *, char, 0,
+		ucl_memory_ptr_hash_func, kh_int64_hash_equal);
 
-const char *
-ucl_object_keyl (const ucl_object_t *obj, size_t *len)
+/*
+ * Accounts `obj` (and its implicit array siblings if `allow_rec` is true);
+ * nodes with extra references are accounted once and start shared subtrees
+ */
+static bool
+ucl_object_memory_walk (const ucl_object_t *obj, struct ucl_memory_stats *st,
+		khash_t(ucl_memory_seen) *seen, bool allow_rec, bool in_shared)
 {
-	if (len == NULL || obj == NULL) {
-		return NULL;
-	}
-	*len = obj->keylen;
-	return obj->key;
-}
+	const ucl_object_t *cur, *elt;
+	const void *cursor;
+	size_t before, i;
+	bool shared_root;
+	int ret;
 
-ucl_object_t *
-ucl_object_ref (const ucl_object_t *obj)
-{
-	ucl_object_t *res = NULL;
+	for (cur = obj; cur != NULL; cur = allow_rec ? cur->next : NULL) {
+		shared_root = false;
 
-	if (obj != NULL) {
-		if (obj->flags & UCL_OBJECT_EPHEMERAL) {
-			/*
-			 * Use deep copy for ephemeral objects, note that its refcount
-			 * is NOT increased, since ephemeral objects does not need refcount
-			 * at all
-			 */
-			res = ucl_object_copy (obj);
-		}
-		else {
-			res = __DECONST (ucl_object_t *, obj);
-#ifdef HAVE_ATOMIC_BUILTINS
-			(void)__sync_add_and_fetch (&res->ref, 1);
-#else
-			res->ref ++;
-#endif
-		}
-	}
-	return res;
-}
+		if (cur->ref > 1) {
+			kh_put (ucl_memory_seen, seen, cur, &ret);
 
-static ucl_object_t *
-ucl_object_copy_internal (const ucl_object_t *other, bool allow_array)
-{
+			if (ret < 0) {
+				return false;
+			}
+			else if (ret == 0) {
+				/* Already accounted via another path */
+				continue;
+			}
 
-	ucl_object_t *new;
-	ucl_object_iter_t it = NULL;
-	const ucl_object_t *cur;
-	size_t sz = sizeof(*new);
+			if (!in_shared) {
+				shared_root = true;
+				st->shared ++;
+			}
+		}
 
-	if (other->type == UCL_USERDATA) {
-		sz = sizeof (struct ucl_object_userdata);
-	}
-	new = malloc (sz);
+		before = st->nodes + st->keys + st->strings + st->hashes + st->elts +
+				st->arrays;
+		st->objects ++;
 
-	if (new != NULL) {
-		memcpy (new, other, sz);
-		if (other->flags & UCL_OBJECT_EPHEMERAL) {
-			/* Copied object is always non ephemeral */
-			new->flags &= ~UCL_OBJECT_EPHEMERAL;
-		}
-		new->ref = 1;
-		/* Unlink from others */
-		new->next = NULL;
-		new->prev = new;
+		if (!(cur->flags & UCL_OBJECT_EPHEMERAL)) {
+			st->nodes += UCL_OBJECT_NODE_SIZE (cur);
 
-		/* deep copy of values stored */
-		if (other->trash_stack[UCL_TRASH_KEY] != NULL) {
-			new->trash_stack[UCL_TRASH_KEY] = NULL;
-			if (other->key == (const char *)other->trash_stack[UCL_TRASH_KEY]) {
-				new->trash_stack[UCL_TRASH_KEY] = malloc(other->keylen + 1);
-				memcpy(new->trash_stack[UCL_TRASH_KEY], other->trash_stack[UCL_TRASH_KEY], other->keylen);
-				new->trash_stack[UCL_TRASH_KEY][other->keylen] = '\0';
-				new->key = new->trash_stack[UCL_TRASH_KEY];
+			if (cur->flags & UCL_OBJECT_OWN_ALLOCATOR) {
+				st->nodes += offsetof (struct ucl_object_header, u);
 			}
 		}
-		if (other->trash_stack[UCL_TRASH_VALUE] != NULL) {
-			new->trash_stack[UCL_TRASH_VALUE] =
-					strdup (other->trash_stack[UCL_TRASH_VALUE]);
-			if (new->type == UCL_STRING) {
-				new->value.sv = new->trash_stack[UCL_TRASH_VALUE];
-			}
+		if (cur->trash_stack[UCL_TRASH_KEY] != NULL) {
+			st->keys += cur->keylen + 1;
+		}
+		if (cur->trash_stack[UCL_TRASH_VALUE] != NULL) {
+			st->strings += cur->type == UCL_STRING ? cur->len + 1 : cur->len;
 		}
 
-		if (other->type == UCL_ARRAY || other->type == UCL_OBJECT) {
-			/* reset old value */
-			memset (&new->value, 0, sizeof (new->value));
+		if (cur->type == UCL_OBJECT && cur->value.ov != NULL) {
+			ucl_hash_memory_usage (cur->value.ov, &st->hashes, &st->elts);
+			cursor = NULL;
 
-			while ((cur = ucl_object_iterate (other, &it, true)) != NULL) {
-				if (other->type == UCL_ARRAY) {
-					ucl_array_append (new, ucl_object_copy_internal (cur, false));
-				}
-				else {
-					ucl_object_t *cp = ucl_object_copy_internal (cur, true);
-					if (cp != NULL) {
-						ucl_object_insert_key (new, cp, cp->key, cp->keylen,
-								false);
-					}
+			while ((elt = ucl_hash_iterate_cursor (cur->value.ov, &cursor))) {
+				if (!ucl_object_memory_walk (elt, st, seen, true,
+						in_shared || shared_root)) {
+					return false;
 				}
 			}
 		}
-		else if (allow_array && other->next != NULL) {
-			LL_FOREACH (other->next, cur) {
-				ucl_object_t *cp = ucl_object_copy_internal (cur, false);
-				if (cp != NULL) {
-					DL_APPEND (new, cp);
+		else if (cur->type == UCL_ARRAY && cur->value.av != NULL) {
+			UCL_ARRAY_GET (vec, cur);
+
+			ucl_array_memory_usage (vec, st);
+
+			for (i = 0; i < vec->n && !UCL_ARRAY_IS_PACKED (vec); i ++) {
+				elt = UCL_ARRAY_A (vec, i);
+
+				if (elt != NULL && !ucl_object_memory_walk (elt, st, seen,
+						true, in_shared || shared_root)) {
+					return false;
 				}
 			}
 		}
+
+		if (!in_shared && !shared_root &&
+				(cur->type == UCL_OBJECT || cur->type == UCL_ARRAY)) {
+			st->exclusive ++;
+		}
+
+		if (shared_root) {
+			st->shared_bytes += st->nodes + st->keys + st->strings +
+					st->hashes + st->elts + st->arrays - before;
+		}
 	}
 
-	return new;
+	return true;
 }
 
-ucl_object_t *
-ucl_object_copy (const ucl_object_t *other)
+bool
+ucl_object_memory_usage (const ucl_object_t *obj, struct ucl_memory_stats *stats)
 {
-	return ucl_object_copy_internal (other, true);
-}
+	khash_t(ucl_memory_seen) *seen;
+	bool ret;
 
-void
-ucl_object_unref (ucl_object_t *obj)
-{
-	if (obj != NULL) {
-#ifdef HAVE_ATOMIC_BUILTINS
-		unsigned int rc = __sync_sub_and_fetch (&obj->ref, 1);
-		if (rc == 0) {
-#else
-		if (--obj->ref == 0) {
-#endif
-			ucl_object_free_internal (obj, true, ucl_object_dtor_unref);
-		}
+	if (obj == NULL || stats == NULL) {
+		return false;
+	}
+
+	memset (stats, 0, sizeof (*stats));
+	seen = kh_init (ucl_memory_seen);
+
+	if (seen == NULL) {
+		return false;
 	}
+
+	ret = ucl_object_memory_walk (obj, stats, seen, true, false);
+	kh_destroy (ucl_memory_seen, seen);
+
+	stats->total = stats->nodes + stats->keys + stats->strings +
+			stats->hashes + stats->elts + stats->arrays;
+
+	return ret;
 }
 
 int
 ucl_object_compare (const ucl_object_t *o1, const ucl_object_t *o2)
 {
 	const ucl_object_t *it1, *it2;
+	ucl_object_t tmp1, tmp2;
 	ucl_object_iter_t iter = NULL;
 	int ret = 0;
 
@@ -3721,10 +5571,13 @@ ucl_object_compare (const ucl_object_t *o1, const ucl_object_t *o2)
 			ret = o1->len - o2->len;
 		}
 		break;
-	case UCL_FLOAT:
 	case UCL_INT:
+		ret = (o1->value.iv > o2->value.iv) - (o1->value.iv < o2->value.iv);
+		break;
+	case UCL_FLOAT:
 	case UCL_TIME:
-		ret = ucl_object_todouble (o1) - ucl_object_todouble (o2);
+		/* Differences below one must not truncate to equality */
+		ret = (o1->value.dv > o2->value.dv) - (o1->value.dv < o2->value.dv);
 		break;
 	case UCL_BOOLEAN:
 		ret = ucl_object_toboolean (o1) - ucl_object_toboolean (o2);
@@ -3737,8 +5590,8 @@ ucl_object_compare (const ucl_object_t *o1, const ucl_object_t *o2)
 
 			/* Compare all elements in both arrays */
 			for (i = 0; i < vec1->n; i ++) {
-				it1 = kv_A (*vec1, i);
-				it2 = kv_A (*vec2, i);
+				it1 = ucl_array_get (vec1, i, &tmp1);
+				it2 = ucl_array_get (vec2, i, &tmp2);
 
 				if (it1 == NULL && it2 != NULL) {
 					return -1;
@@ -3766,7 +5619,18 @@ ucl_object_compare (const ucl_object_t *o1, const ucl_object_t *o2)
 					ret = 1;
 					break;
 				}
-				ret = ucl_object_compare (it1, it2);
+				/* Values of implicit arrays are compared one by one */
+				while (it1 != NULL && it2 != NULL) {
+					ret = ucl_object_compare (it1, it2);
+					if (ret != 0) {
+						break;
+					}
+					it1 = it1->next;
+					it2 = it2->next;
+				}
+				if (ret == 0 && (it1 != NULL || it2 != NULL)) {
+					ret = it1 != NULL ? 1 : -1;
+				}
 				if (ret != 0) {
 					break;
 				}
@@ -3791,24 +5655,11 @@ ucl_object_compare_qsort (const ucl_object_t **o1,
 	return ucl_object_compare (*o1, *o2);
 }
 
-void
-ucl_object_array_sort (ucl_object_t *ar,
-		int (*cmp)(const ucl_object_t **o1, const ucl_object_t **o2))
-{
-	UCL_ARRAY_GET (vec, ar);
-
-	if (cmp == NULL || ar == NULL || ar->type != UCL_ARRAY) {
-		return;
-	}
-
-	qsort (vec->a, vec->n, sizeof (ucl_object_t *),
-			(int (*)(const void *, const void *))cmp);
-}
-
 void ucl_object_sort_keys (ucl_object_t *obj,
 		enum ucl_object_keys_sort_flags how)
 {
-	if (obj != NULL && obj->type == UCL_OBJECT) {
+	if (obj != NULL && obj->type == UCL_OBJECT &&
+			!(obj->flags & UCL_OBJECT_FROZEN)) {
 		ucl_hash_sort (obj->value.ov, how);
 	}
 }
@@ -3829,7 +5680,7 @@ void
 ucl_object_set_priority (ucl_object_t *obj,
 		unsigned int priority)
 {
-	if (obj != NULL) {
+	if (obj != NULL && !(obj->flags & UCL_OBJECT_FROZEN)) {
 		priority &= (0x1 << PRIOBITS) - 1;
 		priority <<= ((sizeof (obj->flags) * NBBY) - PRIOBITS);
 		priority |= obj->flags & ((1 << ((sizeof (obj->flags) * NBBY) -
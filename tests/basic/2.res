@@ -27,7 +27,7 @@ key3 = 1024;
 key3 = "111some";
 key4 = 5000000;
 key4 = "s1";
-key5 = 0.010000;
+key5 = 0.01;
 key5 = "\n\r123";
 key6 = 315360000.0;
 keyvar = "unknowntest";
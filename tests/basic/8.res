@@ -30,7 +30,7 @@ section {
 }
 section {
     foo {
-        param = 123.200000;
+        param = 123.2;
     }
 }
 array [
@@ -1,18 +1,18 @@
-key0 = 0.100000;
+key0 = 0.1;
 key1 = "test string";
 key2 = "test \\nstring\\n\\r\\n\\b\\t\\f\\\\\\\"";
 key3 = "  test string    \n";
 key4 [
-    9.999000,
+    9.999,
     10,
-    10.100000,
+    10.1,
 ]
 key4 = true;
 key5 = "";
 key6 = "";
 key7 = "   \\n";
 key8 = 1048576;
-key9 = 3.140000;
+key9 = 3.14;
 key10 = true;
 key11 = false;
 key12 = "gslin@gslin.org";
@@ -20,8 +20,8 @@ key13 = "#test";
 "k=3" = true;
 key14 [
     10,
-    9.999000,
-    10.100000,
+    9.999,
+    10.1,
     "abc",
     "cde",
     "😎",
@@ -34,8 +34,8 @@ key16 = "tes";
 key17 [
     "test",
     10,
-    9.999000,
-    10.100000,
+    9.999,
+    10.1,
     "abc",
     "cde",
     "😎",
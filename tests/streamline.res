@@ -3,6 +3,6 @@ key2 = "test \\nstring";
 key3 = "  test string    \n";
 key4 [
     10,
-    10.100000,
-    9.999000,
+    10.1,
+    9.999,
 ]
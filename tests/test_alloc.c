@@ -0,0 +1,301 @@
+/* Copyright (c) 2026, Vsevolod Stakhov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *       * Redistributions of source code must retain the above copyright
+ *         notice, this list of conditions and the following disclaimer.
+ *       * Redistributions in binary form must reproduce the above copyright
+ *         notice, this list of conditions and the following disclaimer in the
+ *         documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "ucl.h"
+
+struct counting_allocator {
+	size_t live;
+	size_t total;
+};
+
+static void *
+counting_malloc (size_t size, void *ud)
+{
+	struct counting_allocator *ca = ud;
+
+	ca->live ++;
+	ca->total ++;
+
+	return malloc (size);
+}
+
+static void *
+counting_realloc (void *ptr, size_t size, void *ud)
+{
+	struct counting_allocator *ca = ud;
+
+	if (ptr == NULL) {
+		ca->live ++;
+		ca->total ++;
+	}
+
+	return realloc (ptr, size);
+}
+
+static void
+counting_free (void *ptr, size_t size, void *ud)
+{
+	struct counting_allocator *ca = ud;
+
+	assert (ca->live > 0);
+	ca->live --;
+	free (ptr);
+}
+
+static struct counting_allocator counts = {0, 0};
+static struct ucl_allocator alloc = {counting_malloc, counting_realloc,
+		counting_free, &counts};
+
+static bool
+var_handler (const unsigned char *data, size_t len, unsigned char **replace,
+		size_t *replace_len, bool *need_free, void *ud)
+{
+	if (len < 3 || memcmp (data, "VAR", 3) != 0) {
+		return false;
+	}
+
+	*replace = UCL_ALLOC (5);
+	memcpy (*replace, "value", 5);
+	*replace_len = 5;
+	*need_free = true;
+
+	return true;
+}
+
+/*
+ * Custom allocators
+ */
+static void
+test_allocators (void)
+{
+	ucl_object_t *test_obj, *cur;
+	struct ucl_parser *parser;
+	const struct ucl_allocator *prev_alloc;
+	unsigned char *emitted;
+	size_t sz;
+
+	parser = ucl_parser_new_full (UCL_PARSER_PACK_ARRAYS, &alloc);
+	assert (parser != NULL && counts.live > 0);
+	ucl_parser_set_variables_handler (parser, var_handler, NULL);
+	assert (ucl_parser_add_string (parser, "i = [1, 2]; o { s = x; }", 0));
+	assert (ucl_parser_add_string (parser, "v = \"${VAR}\"", 0));
+	test_obj = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+	assert (counts.live > 0);
+	assert (strcmp (ucl_object_tostring (ucl_object_lookup (test_obj, "v")),
+			"value") == 0);
+	sz = counts.total;
+	cur = ucl_object_fromint (1);
+	assert (counts.total == sz);
+
+	/* Trees mixing allocators are modified and freed with their own ones */
+	ucl_object_insert_key (test_obj, cur, "n", 0, true);
+	ucl_array_append ((ucl_object_t *)ucl_object_lookup (test_obj, "i"),
+			ucl_object_fromint (3));
+	ucl_object_delete_key (test_obj, "v");
+	assert (counts.total > sz);
+	emitted = ucl_object_emit (test_obj, UCL_EMIT_JSON_COMPACT);
+	assert (strcmp ((const char *)emitted,
+			"{\"i\":[1,2,3],\"o\":{\"s\":\"x\"},\"n\":1}") == 0);
+	ucl_free (emitted);
+	cur = ucl_object_copy (test_obj);
+	ucl_object_unref (test_obj);
+	assert (counts.live == 0);
+	ucl_object_unref (cur);
+	assert (counts.live == 0);
+
+	/* Objects of a thread allocator may be released under another one */
+	prev_alloc = ucl_set_thread_allocator (&alloc);
+	test_obj = ucl_object_typed_new (UCL_OBJECT);
+	ucl_object_insert_key (test_obj, ucl_object_fromstring ("value"),
+			"key", 0, true);
+	cur = ucl_object_typed_new (UCL_ARRAY);
+	ucl_array_append (cur, ucl_object_fromint (1));
+	assert (ucl_set_thread_allocator (prev_alloc) == &alloc);
+	ucl_object_insert_key (test_obj, cur, "a", 0, false);
+	ucl_object_unref_deferred (test_obj);
+	assert (counts.live > 0);
+	assert (ucl_object_reclaim () == 1);
+	assert (counts.live == 0);
+
+	alloc.free_fn = NULL;
+	assert (!ucl_set_allocator (&alloc));
+	assert (ucl_set_allocator (NULL));
+	alloc.free_fn = counting_free;
+}
+
+/*
+ * Memory accounting
+ */
+static void
+test_memory_usage (void)
+{
+	ucl_object_t *test_obj, *ar, *ar1;
+	const ucl_object_t *cur;
+	ucl_object_iter_t it;
+	struct ucl_memory_stats mst;
+	size_t sz, dlen;
+	int fd;
+
+	test_obj = ucl_object_typed_new (UCL_OBJECT);
+	ucl_object_insert_key (test_obj, ucl_object_fromstring ("value"),
+			"key", 0, true);
+	assert (ucl_object_memory_usage (test_obj, &mst));
+	assert (mst.objects == 2 && mst.exclusive == 1 && mst.shared == 0);
+	assert (mst.keys == sizeof ("key") && mst.strings == sizeof ("value"));
+	assert (mst.nodes == 2 * sizeof (ucl_object_t) && mst.hashes > 0 &&
+			mst.elts > 0 && mst.shared_bytes == 0);
+	sz = mst.total;
+	ar = ucl_object_typed_new (UCL_ARRAY);
+	ucl_array_append (ar, ucl_object_fromint (1));
+	ar1 = ucl_object_typed_new (UCL_ARRAY);
+	ucl_array_append (ar1, ar);
+	ucl_array_append (ar1, ucl_object_ref (ar));
+	ucl_object_insert_key (test_obj, ar1, "a", 0, false);
+	assert (ucl_object_memory_usage (test_obj, &mst));
+	assert (mst.objects == 5 && mst.shared == 1 && mst.exclusive == 2);
+	assert (mst.shared_bytes > 2 * sizeof (ucl_object_t) &&
+			mst.shared_bytes < mst.arrays + 2 * sizeof (ucl_object_t));
+	assert (mst.total > sz && mst.total == mst.nodes + mst.keys +
+			mst.strings + mst.hashes + mst.elts + mst.arrays);
+	ucl_object_unref (test_obj);
+	/* Packed arrays own no element slots */
+	for (fd = 0; fd < 2; fd ++) {
+		test_obj = ucl_object_typed_new (UCL_ARRAY);
+		for (sz = 0; sz < (fd == 0 ? 1 : 1000); sz ++) {
+			ucl_array_append (test_obj, ucl_object_fromint (sz));
+		}
+		assert (ucl_array_pack (test_obj));
+		assert (ucl_object_memory_usage (test_obj, &mst));
+		assert (mst.objects == 1 && mst.nodes == sizeof (ucl_object_t));
+		if (fd == 0) {
+			dlen = mst.arrays;
+		}
+		else {
+			assert (mst.arrays == dlen + 999 * sizeof (int64_t));
+			/* Reading elements allocates nothing */
+			dlen = mst.arrays;
+			assert (ucl_object_toint (ucl_array_find_index (test_obj, 500)) == 500);
+			assert (ucl_array_index_of (test_obj,
+					(ucl_object_t *)ucl_array_find_index (test_obj, 501)) == 501);
+			it = NULL;
+			sz = 0;
+			while ((cur = ucl_object_iterate (test_obj, &it, true)) != NULL) {
+				assert (ucl_object_toint (cur) == (int64_t)sz ++);
+			}
+			assert (sz == 1000);
+			assert (ucl_object_memory_usage (test_obj, &mst));
+			assert (mst.arrays == dlen);
+		}
+		ucl_object_unref (test_obj);
+	}
+}
+
+/*
+ * Deep trees are destroyed without recursion
+ */
+static void
+test_destruction (void)
+{
+	ucl_object_t *test_obj, *cur, *ar;
+	const struct ucl_allocator *prev_alloc;
+	size_t sz;
+
+	test_obj = ucl_object_typed_new (UCL_ARRAY);
+	cur = test_obj;
+	for (sz = 0; sz < 100000; sz ++) {
+		ar = ucl_object_typed_new (sz % 2 ? UCL_ARRAY : UCL_OBJECT);
+		if (cur->type == UCL_ARRAY) {
+			ucl_array_append (cur, ar);
+		}
+		else {
+			ucl_object_insert_key (cur, ar, "k", 0, false);
+		}
+		cur = ar;
+	}
+	ucl_object_unref (test_obj);
+
+	/* Deferred destruction */
+	prev_alloc = ucl_set_thread_allocator (&alloc);
+	test_obj = ucl_object_typed_new (UCL_OBJECT);
+	ucl_object_insert_key (test_obj, ucl_object_fromstring ("value"),
+			"key", 0, true);
+	ar = ucl_object_ref (test_obj);
+	ucl_object_unref_deferred (test_obj);
+	assert (ucl_object_reclaim () == 0);
+	ucl_object_unref_deferred (ar);
+	assert (counts.live > 0);
+	assert (ucl_object_reclaim () == 1);
+	assert (counts.live == 0);
+	ucl_set_thread_allocator (prev_alloc);
+}
+
+/*
+ * Stack iterators do not allocate memory
+ */
+static void
+test_stack_iterators (void)
+{
+	ucl_object_t *obj;
+	ucl_object_iter_t it;
+	const ucl_object_t *it_obj;
+	struct ucl_object_stack_iter sit;
+	const struct ucl_allocator *prev_alloc;
+	unsigned int ref_cnt;
+	size_t sz;
+
+	obj = ucl_object_typed_new (UCL_OBJECT);
+	ucl_object_insert_key (obj, ucl_object_fromint (1), "a", 0, false);
+	ucl_object_insert_key (obj, ucl_object_fromint (2), "a", 0, false);
+	ucl_object_insert_key (obj, ucl_object_fromstring ("x"), "b", 0, false);
+	ref_cnt = 0;
+	sz = counts.total;
+	prev_alloc = ucl_set_thread_allocator (&alloc);
+	it = ucl_object_iterate_init (&sit, obj);
+	while ((it_obj = ucl_object_iterate_safe (it, false)) != NULL) {
+		assert (!ucl_object_iter_chk_excpn (it));
+		ref_cnt ++;
+	}
+	assert (ref_cnt > 0);
+	it = NULL;
+	while ((it_obj = ucl_object_iterate (obj, &it, true)) != NULL) {
+		ref_cnt --;
+	}
+	assert (ref_cnt == 0 && counts.total == sz);
+	ucl_set_thread_allocator (prev_alloc);
+	ucl_object_unref (obj);
+}
+
+int
+main (int argc, char **argv)
+{
+	test_allocators ();
+	test_memory_usage ();
+	test_destruction ();
+	test_stack_iterators ();
+
+	return 0;
+}
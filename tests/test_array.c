@@ -0,0 +1,149 @@
+/* Copyright (c) 2026, Vsevolod Stakhov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *       * Redistributions of source code must retain the above copyright
+ *         notice, this list of conditions and the following disclaimer.
+ *       * Redistributions in binary form must reproduce the above copyright
+ *         notice, this list of conditions and the following disclaimer in the
+ *         documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "ucl.h"
+
+static const char packed_doc[] = "i = [1, 2, 3, -4]; f = [1.5, 2.5];"
+		"m = [1, 2.5]; o = [{a = [1]}];";
+static const char packed_json[] = "{\"i\":[1,2,3,-4],\"f\":[1.5,2.5],"
+		"\"m\":[1,2.5],\"o\":[{\"a\":[1]}]}";
+
+/*
+ * Deque arrays: wrap around the ring buffer and grow while wrapped
+ */
+static void
+test_deque (void)
+{
+	ucl_object_t *ar, *cur;
+	const ucl_object_t *test;
+	int64_t sum;
+
+	ar = ucl_object_typed_new (UCL_ARRAY);
+	for (sum = 0; sum < 6; sum ++) {
+		ucl_array_append (ar, ucl_object_fromint (sum));
+	}
+	for (sum = 0; sum < 3; sum ++) {
+		ucl_object_unref (ucl_array_pop_first (ar));
+	}
+	for (sum = 6; sum < 10; sum ++) {
+		ucl_array_append (ar, ucl_object_fromint (sum));
+	}
+	ucl_array_prepend (ar, ucl_object_fromint (2));
+	assert (ucl_array_enable_index (ar, true));
+	ucl_array_prepend (ar, ucl_object_fromint (1));
+	assert (ucl_array_size (ar) == 9);
+	for (sum = 0; sum < 9; sum ++) {
+		test = ucl_array_find_index (ar, sum);
+		assert (ucl_object_toint (test) == sum + 1);
+		assert (ucl_array_index_of (ar, (ucl_object_t *)test) == sum);
+	}
+	cur = ucl_array_delete (ar, (ucl_object_t *)ucl_array_find_index (ar, 3));
+	assert (ucl_object_toint (cur) == 4);
+	assert (ucl_array_index_of (ar, cur) == (unsigned int)-1);
+	ucl_object_unref (ucl_array_replace_index (ar, cur, 1));
+	assert (ucl_array_index_of (ar, cur) == 1);
+	assert (ucl_object_toint (ucl_array_head (ar)) == 1);
+	assert (ucl_object_toint (ucl_array_tail (ar)) == 9);
+	assert (ucl_array_index_of (ar,
+			(ucl_object_t *)ucl_array_tail (ar)) == 7);
+	ucl_object_unref (ucl_array_pop_last (ar));
+	ucl_object_unref (ucl_array_pop_first (ar));
+	assert (ucl_array_index_of (ar, cur) == 0);
+	ucl_array_append (ar, ucl_object_fromint (0));
+	ucl_object_array_sort (ar, ucl_object_compare_qsort);
+	assert (ucl_object_toint (ucl_array_head (ar)) == 0);
+	assert (ucl_array_index_of (ar, cur) == 2);
+	ucl_array_append (ar, ucl_object_ref (cur));
+	assert (ucl_array_index_of (ar, cur) == 2);
+	assert (!ucl_array_enable_index (ar, true));
+	ucl_object_unref (ucl_array_delete (ar, cur));
+	assert (ucl_array_index_of (ar, cur) == 6);
+	ucl_object_unref (ar);
+}
+
+/*
+ * Packed arrays
+ */
+static void
+test_packed (void)
+{
+	ucl_object_t *test_obj, *ar, *ar1, *cur;
+	const ucl_object_t *test;
+	struct ucl_parser *parser;
+	unsigned char *emitted;
+	size_t sz;
+
+	parser = ucl_parser_new (UCL_PARSER_PACK_ARRAYS);
+	assert (ucl_parser_add_string (parser, packed_doc, 0));
+	test_obj = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+	ar = (ucl_object_t *)ucl_object_lookup (test_obj, "i");
+	assert (ucl_array_packed_int (ar, &sz) != NULL && sz == 4);
+	assert (ucl_array_packed_int (ar, NULL)[3] == -4);
+	assert (ucl_array_packed_float (ucl_object_lookup (test_obj, "f"),
+			&sz)[1] == 2.5);
+	assert (ucl_array_packed_int (ucl_object_lookup (test_obj, "m"),
+			NULL) == NULL);
+	test = ucl_array_find_index (ar, 2);
+	assert (ucl_object_toint (test) == 3);
+	assert (ucl_array_index_of (ar, (ucl_object_t *)test) == 2);
+	cur = ucl_object_ref (test);
+	assert (cur != test && ucl_object_toint (cur) == 3);
+	emitted = ucl_object_emit (test_obj, UCL_EMIT_JSON_COMPACT);
+	assert (strcmp ((const char *)emitted, packed_json) == 0);
+	free (emitted);
+	emitted = ucl_object_emit_len (test_obj, UCL_EMIT_MSGPACK, &sz);
+	parser = ucl_parser_new (UCL_PARSER_PACK_ARRAYS);
+	assert (ucl_parser_add_chunk_full (parser, emitted, sz, 0,
+			UCL_DUPLICATE_APPEND, UCL_PARSE_MSGPACK));
+	free (emitted);
+	ar1 = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+	assert (ucl_array_packed_float (ucl_object_lookup (ar1, "f"),
+			NULL) != NULL);
+	assert (ucl_object_compare (ar1, test_obj) == 0);
+	ucl_object_unref (ar1);
+	/* Heterogeneous element converts array back to objects */
+	assert (ucl_array_append (ar, ucl_object_fromstring ("x")));
+	assert (ucl_array_packed_int (ar, NULL) == NULL);
+	assert (ucl_array_size (ar) == 5);
+	assert (ucl_object_toint (ucl_array_find_index (ar, 3)) == -4);
+	assert (!ucl_array_pack (ar));
+	ucl_object_unref (ucl_array_pop_last (ar));
+	assert (ucl_array_pack (ar));
+	assert (ucl_object_compare (ucl_array_find_index (ar, 2), cur) == 0);
+	ucl_object_unref (cur);
+	ucl_object_unref (test_obj);
+}
+
+int
+main (int argc, char **argv)
+{
+	test_deque ();
+	test_packed ();
+
+	return 0;
+}
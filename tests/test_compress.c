@@ -0,0 +1,326 @@
+/* Copyright (c) 2026, Vsevolod Stakhov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *       * Redistributions of source code must retain the above copyright
+ *         notice, this list of conditions and the following disclaimer.
+ *       * Redistributions in binary form must reproduce the above copyright
+ *         notice, this list of conditions and the following disclaimer in the
+ *         documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "ucl.h"
+
+static unsigned int released_chunks = 0;
+
+/* Strips `#!` before parsing */
+static bool
+strip_handler (struct ucl_parser *parser,
+		const unsigned char *source, size_t source_len,
+		unsigned char **destination, size_t *dest_len,
+		void *user_data)
+{
+	*dest_len = source_len - 2;
+	*destination = malloc (*dest_len);
+	memcpy (*destination, source + 2, *dest_len);
+
+	return true;
+}
+
+static void
+strip_free (unsigned char *data, size_t len, void *user_data)
+{
+	released_chunks ++;
+	free (data);
+}
+
+/* Largest single allocation */
+static void *
+peak_malloc (size_t size, void *ud)
+{
+	size_t *peak = ud;
+
+	if (size > *peak) {
+		*peak = size;
+	}
+
+	return malloc (size);
+}
+
+static void *
+peak_realloc (void *ptr, size_t size, void *ud)
+{
+	size_t *peak = ud;
+
+	if (size > *peak) {
+		*peak = size;
+	}
+
+	return realloc (ptr, size);
+}
+
+static void
+peak_free (void *ptr, size_t size, void *ud)
+{
+	free (ptr);
+}
+
+/*
+ * Compressed msgpack is parsed by windows smaller than the decompressed data
+ */
+static void
+test_windowed (void)
+{
+	ucl_object_t *test_obj, *ar1, *ar2, *elt, *bin;
+	struct ucl_emitter_functions *fn;
+	struct ucl_parser *parser;
+	struct ucl_allocator alloc;
+	const struct ucl_allocator *prev;
+	unsigned char *packed, *fd_out, *mem;
+	char sbuf[400];
+	size_t sz, plen, peak;
+	FILE *tmp;
+	int codec;
+
+	test_obj = ucl_object_typed_new (UCL_OBJECT);
+	for (sz = 0; sz < 3000; sz ++) {
+		/* Keys and values cross window boundaries */
+		snprintf (sbuf, sizeof (sbuf), "key%zu", sz);
+		memset (sbuf + strlen (sbuf), 'a' + sz % 26, 200 + sz % 100);
+		sbuf[200 + sz % 100] = '\0';
+		ucl_object_insert_key (test_obj, ucl_object_fromstring (sbuf + 3),
+				sbuf, 0, true);
+	}
+	/* Strings larger than a window */
+	mem = malloc (150000);
+	for (sz = 0; sz < 150000; sz ++) {
+		mem[sz] = sz * 7 % 251;
+	}
+	elt = ucl_object_fromlstring ((char *)mem, 150000);
+	elt->flags |= UCL_OBJECT_BINARY;
+	ucl_object_insert_key (test_obj, elt, "binary", 0, false);
+	memset (mem, 'y', 100000);
+	ar1 = ucl_object_typed_new (UCL_ARRAY);
+	ucl_array_append (ar1, ucl_object_fromlstring ((char *)mem, 100000));
+	ucl_array_append (ar1, ucl_object_fromdouble (1.5));
+	ucl_object_insert_key (test_obj, ar1, "array", 0, false);
+	free (mem);
+
+	packed = ucl_object_emit_len (test_obj, UCL_EMIT_MSGPACK, &plen);
+	assert (packed != NULL && plen > 800000);
+	parser = ucl_parser_new (0);
+	assert (ucl_parser_add_chunk_full (parser, packed, plen, 0,
+			UCL_DUPLICATE_APPEND, UCL_PARSE_MSGPACK));
+	ar2 = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+	free (packed);
+	/* Binary strings are not compared by ucl_object_compare */
+	bin = ucl_object_ref (ucl_object_lookup (ar2, "binary"));
+	assert (bin != NULL && (bin->flags & UCL_OBJECT_BINARY));
+	assert (ucl_object_delete_key (ar2, "binary"));
+
+	alloc.malloc_fn = peak_malloc;
+	alloc.realloc_fn = peak_realloc;
+	alloc.free_fn = peak_free;
+	alloc.ud = &peak;
+
+	for (codec = UCL_COMPRESSION_GZIP; codec <= UCL_COMPRESSION_XZ; codec ++) {
+		struct stat st;
+		int cfd;
+
+		tmp = tmpfile ();
+		assert (tmp != NULL);
+		cfd = fileno (tmp);
+		fn = ucl_object_emit_compressed_funcs (cfd, codec, 0);
+
+		if (fn == NULL) {
+			fclose (tmp);
+			continue;
+		}
+
+		assert (ucl_object_emit_full (test_obj, UCL_EMIT_MSGPACK, fn, NULL));
+		ucl_object_emit_funcs_free (fn);
+		assert (fstat (cfd, &st) == 0 && st.st_size > 0);
+		sz = st.st_size;
+		fd_out = malloc (sz);
+		assert (lseek (cfd, 0, SEEK_SET) == 0);
+		assert (read (cfd, fd_out, sz) == (ssize_t)sz);
+		fclose (tmp);
+
+		peak = 0;
+		prev = ucl_set_thread_allocator (&alloc);
+		parser = ucl_parser_new (0);
+		assert (ucl_parser_add_decompress_handlers (parser));
+		assert (ucl_parser_add_chunk_full (parser, fd_out, sz, 0,
+				UCL_DUPLICATE_APPEND, UCL_PARSE_AUTO));
+		ar1 = ucl_parser_get_object (parser);
+		ucl_parser_free (parser);
+		elt = (ucl_object_t *)ucl_object_lookup (ar1, "binary");
+		assert (elt != NULL && (elt->flags & UCL_OBJECT_BINARY) &&
+				elt->len == bin->len &&
+				memcmp (elt->value.sv, bin->value.sv, elt->len) == 0);
+		assert (ucl_object_delete_key (ar1, "binary"));
+		assert (ucl_object_compare (ar1, ar2) == 0);
+		ucl_object_unref (ar1);
+		/* Truncated input fails in the middle of parsing */
+		parser = ucl_parser_new (0);
+		assert (ucl_parser_add_decompress_handlers (parser));
+		assert (!ucl_parser_add_chunk_full (parser, fd_out, sz / 2, 0,
+				UCL_DUPLICATE_APPEND, UCL_PARSE_AUTO));
+		assert (strstr (ucl_parser_get_error (parser), "truncated") != NULL);
+		ucl_parser_free (parser);
+		ucl_set_thread_allocator (prev);
+		/* Decompressed data is never held as a whole */
+		assert (peak < plen / 2);
+		free (fd_out);
+	}
+
+	ucl_object_unref (bin);
+	ucl_object_unref (ar2);
+	ucl_object_unref (test_obj);
+}
+
+/*
+ * Compressed descriptor output is parsed back with decompression handlers
+ */
+static void
+test_compressed (void)
+{
+	ucl_object_t *test_obj, *ar1;
+	struct ucl_emitter_functions *fn;
+	struct ucl_parser *parser;
+	unsigned char *emitted, *mem, *fd_out;
+	char sbuf[100];
+	size_t sz, dlen;
+	FILE *tmp;
+	int fd;
+	int codec;
+
+	test_obj = ucl_object_typed_new (UCL_OBJECT);
+	for (sz = 0; sz < 2000; sz ++) {
+		snprintf (sbuf, sizeof (sbuf), "key%zu", sz);
+		ucl_object_insert_key (test_obj, ucl_object_fromint (sz), sbuf, 0, true);
+	}
+	mem = malloc (100000);
+	memset (mem, 'x', 100000);
+	ucl_object_insert_key (test_obj, ucl_object_fromlstring ((char *)mem, 100000),
+			"large", 0, false);
+	free (mem);
+	for (codec = UCL_COMPRESSION_GZIP; codec <= UCL_COMPRESSION_XZ; codec ++) {
+		struct stat st;
+		int cfd;
+
+		tmp = tmpfile ();
+		assert (tmp != NULL);
+		cfd = fileno (tmp);
+		fn = ucl_object_emit_compressed_funcs (cfd, codec, 0);
+
+		if (fn == NULL) {
+			/* Codec is not built */
+			fclose (tmp);
+			continue;
+		}
+
+		assert (ucl_object_emit_full (test_obj, UCL_EMIT_JSON_COMPACT, fn, NULL));
+		ucl_object_emit_funcs_free (fn);
+		assert (fstat (cfd, &st) == 0 && st.st_size > 0 && st.st_size < 50000);
+		sz = st.st_size;
+		fd_out = malloc (sz);
+		assert (lseek (cfd, 0, SEEK_SET) == 0);
+		assert (read (cfd, fd_out, sz) == (ssize_t)sz);
+		fclose (tmp);
+
+		/* Decompressed data is released after parsing unless zero-copy */
+		for (fd = 0; fd < 2; fd ++) {
+			parser = ucl_parser_new (fd == 0 ? 0 : UCL_PARSER_ZEROCOPY);
+			assert (ucl_parser_add_decompress_handlers (parser));
+			assert (ucl_parser_add_chunk (parser, (unsigned char *)fd_out, sz));
+			ar1 = ucl_parser_get_object (parser);
+			/* Zero-copy objects reference data owned by the parser */
+			assert (ucl_object_compare (ar1, test_obj) == 0);
+			ucl_object_unref (ar1);
+			ucl_parser_free (parser);
+		}
+		/* Truncated input is an error */
+		parser = ucl_parser_new (0);
+		assert (ucl_parser_add_decompress_handlers (parser));
+		assert (!ucl_parser_add_chunk (parser, (unsigned char *)fd_out, sz / 2));
+		ucl_parser_free (parser);
+		/* Output larger than the limit is rejected, the exact size is not */
+		emitted = ucl_object_emit_len (test_obj, UCL_EMIT_JSON_COMPACT, &dlen);
+		free (emitted);
+		for (fd = 0; fd < 3; fd ++) {
+			parser = ucl_parser_new (0);
+			assert (ucl_parser_add_decompress_handlers (parser));
+			assert (ucl_parser_set_decompress_limit (parser,
+					fd == 0 ? 4096 : dlen - 2 + fd));
+			if (fd < 2) {
+				assert (!ucl_parser_add_chunk (parser, (unsigned char *)fd_out, sz));
+				assert (strstr (ucl_parser_get_error (parser), "larger than") != NULL);
+			}
+			else {
+				assert (ucl_parser_add_chunk (parser, (unsigned char *)fd_out, sz));
+			}
+			ucl_parser_free (parser);
+		}
+		free (fd_out);
+	}
+	/* Uncompressed input is parsed as usual */
+	parser = ucl_parser_new (0);
+	ucl_parser_add_decompress_handlers (parser);
+	assert (ucl_parser_add_string (parser, "key = value;", 0));
+	ucl_parser_free (parser);
+	ucl_object_unref (test_obj);
+	/* Output of special handlers is released once it is parsed */
+	{
+		struct ucl_parser_special_handler sh = {
+			.magic = (const unsigned char *)"#!",
+			.magic_len = 2,
+			.flags = UCL_SPECIAL_HANDLER_RELEASE_PARSED,
+			.handler = strip_handler,
+			.free_function = strip_free
+		};
+		ucl_object_t *top;
+
+		for (fd = 0; fd < 2; fd ++) {
+			released_chunks = 0;
+			parser = ucl_parser_new (fd == 0 ? 0 : UCL_PARSER_ZEROCOPY);
+			ucl_parser_add_special_handler (parser, &sh);
+			assert (ucl_parser_add_string (parser, "#!key = value;", 0));
+			assert (released_chunks == (fd == 0 ? 1 : 0));
+			top = ucl_parser_get_object (parser);
+			assert (strcmp (ucl_object_tostring (ucl_object_lookup (top, "key")),
+					"value") == 0);
+			ucl_object_unref (top);
+			ucl_parser_free (parser);
+			assert (released_chunks == 1);
+		}
+	}
+}
+
+int
+main (int argc, char **argv)
+{
+	test_compressed ();
+	test_windowed ();
+
+	return 0;
+}
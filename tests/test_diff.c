@@ -0,0 +1,293 @@
+/* Copyright (c) 2026, Vsevolod Stakhov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *       * Redistributions of source code must retain the above copyright
+ *         notice, this list of conditions and the following disclaimer.
+ *       * Redistributions in binary form must reproduce the above copyright
+ *         notice, this list of conditions and the following disclaimer in the
+ *         documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "ucl.h"
+
+static const char diff_old[] = "a = 1; b { c = 2; d = [1, 2, 3]; }; e = x;"
+		"\"f/g\" = 1; m = 1; m = 2;";
+static const char diff_new[] = "a = 1; b { c = 3; d = [1, 5, 2, 3]; };"
+		"\"f/g\" = 2; h = true; m = 1; m = 3;";
+static const char diff_extra[] = "[{op = test; path = \"/b/c\"; value = 3},"
+		"{op = move; from = \"/b/d/1\"; path = \"/b/x\"},"
+		"{op = copy; from = \"/a\"; path = \"/b/d/-\"},"
+		"{op = test; path = \"/b/d/1\"; value = 2}]";
+static const char diff_nested[] = "a = 1; o { x = 1; y = [1, 2]; z { w = 1; } }";
+
+static ucl_object_t *
+parse_string (const char *str)
+{
+	struct ucl_parser *parser;
+	ucl_object_t *obj;
+
+	parser = ucl_parser_new (0);
+	assert (ucl_parser_add_string (parser, str, 0));
+	obj = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+
+	return obj;
+}
+
+/*
+ * Patch produced by a diff transforms the old tree into the new one
+ */
+static void
+test_diff_patch (void)
+{
+	ucl_object_t *old, *new, *patch;
+	const ucl_object_t *op;
+
+	old = parse_string (diff_old);
+	new = parse_string (diff_new);
+	patch = ucl_object_diff (old, new);
+	assert (ucl_array_size (patch) == 6);
+	op = ucl_array_find_index (patch, 1);
+	assert (strcmp (ucl_object_tostring (ucl_object_lookup (op, "op")),
+			"add") == 0);
+	assert (strcmp (ucl_object_tostring (ucl_object_lookup (op, "path")),
+			"/b/d/1") == 0);
+	op = ucl_array_find_index (patch, 3);
+	assert (strcmp (ucl_object_tostring (ucl_object_lookup (op, "path")),
+			"/f~1g") == 0);
+	assert (ucl_object_patch (old, patch));
+	ucl_object_unref (patch);
+	patch = ucl_object_diff (old, new);
+	assert (ucl_array_size (patch) == 0);
+	ucl_object_unref (patch);
+	ucl_object_unref (new);
+
+	/* Operations that are not produced by a diff */
+	patch = parse_string (diff_extra);
+	assert (ucl_object_patch (old, patch));
+	assert (ucl_object_toint (ucl_object_lookup_path (old, "b.x")) == 5);
+	assert (ucl_array_size (ucl_object_lookup_path (old, "b.d")) == 4);
+	assert (!ucl_object_patch (old, patch));
+	ucl_object_unref (patch);
+	ucl_object_unref (old);
+}
+
+/*
+ * Containers added by a patch are copied exactly
+ */
+static void
+test_diff_nested (void)
+{
+	ucl_object_t *old, *new, *patch, *copy;
+	struct ucl_parser *parser;
+	unsigned char *emitted;
+	size_t sz;
+
+	old = parse_string ("a = 1;");
+	new = parse_string (diff_nested);
+	patch = ucl_object_diff (old, new);
+	assert (ucl_object_patch (old, patch));
+	ucl_object_unref (patch);
+	assert (ucl_object_compare (old, new) == 0);
+	emitted = ucl_object_emit_len (old, UCL_EMIT_MSGPACK, &sz);
+	parser = ucl_parser_new (0);
+	assert (ucl_parser_add_chunk_full (parser, emitted, sz, 0,
+			UCL_DUPLICATE_APPEND, UCL_PARSE_MSGPACK));
+	copy = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+	free (emitted);
+	assert (ucl_object_compare (copy, new) == 0);
+	ucl_object_unref (copy);
+	ucl_object_unref (new);
+	ucl_object_unref (old);
+}
+
+/*
+ * Top object is replaced in place when its type changes
+ */
+static void
+test_diff_top (void)
+{
+	ucl_object_t *old, *new, *patch, *ref;
+
+	old = ucl_object_typed_new (UCL_OBJECT);
+	ucl_object_insert_key (old, ucl_object_fromint (1), "a", 0, false);
+	new = parse_string ("[1, {b = 2}]");
+	ref = ucl_object_ref (old);
+	patch = ucl_object_diff (old, new);
+	assert (ucl_array_size (patch) == 1);
+	assert (ucl_object_patch (old, patch));
+	ucl_object_unref (patch);
+	assert (old == ref && old->type == UCL_ARRAY);
+	assert (ucl_object_compare (old, new) == 0);
+	ucl_object_unref (ref);
+
+	/* Top object becomes its own child */
+	patch = parse_string ("[{op = test; path = \"\"; value = [1, {b = 2}]},"
+			"{op = move; from = \"/1\"; path = \"\"},"
+			"{op = test; path = \"/b\"; value = 2}]");
+	assert (ucl_object_patch (old, patch));
+	ucl_object_unref (patch);
+	assert (old->type == UCL_OBJECT && old->len == 1);
+	/* Values are compared by content */
+	patch = parse_string ("[{op = test; path = \"\"; value = {b = 3}}]");
+	assert (!ucl_object_patch (old, patch));
+	ucl_object_unref (patch);
+	ucl_object_unref (new);
+	ucl_object_unref (old);
+}
+
+/*
+ * Numbers are tested by value and diffed without truncation
+ */
+static void
+test_diff_float (void)
+{
+	ucl_object_t *old, *new, *patch;
+	const ucl_object_t *op;
+
+	old = parse_string ("a = 1.5; b = [0.25]");
+	patch = parse_string ("[{op = test; path = \"/a\"; value = 1.0}]");
+	assert (!ucl_object_patch (old, patch));
+	ucl_object_unref (patch);
+	patch = parse_string ("[{op = test; path = \"/a\"; value = 1.9}]");
+	assert (!ucl_object_patch (old, patch));
+	ucl_object_unref (patch);
+	patch = parse_string ("[{op = test; path = \"/b\"; value = [0.5]}]");
+	assert (!ucl_object_patch (old, patch));
+	ucl_object_unref (patch);
+	patch = parse_string ("[{op = test; path = \"/a\"; value = 1.5},"
+			"{op = test; path = \"/b\"; value = [0.25]}]");
+	assert (ucl_object_patch (old, patch));
+	ucl_object_unref (patch);
+
+	new = parse_string ("a = 1.0; b = [0.25]");
+	patch = ucl_object_diff (old, new);
+	assert (ucl_array_size (patch) == 1);
+	op = ucl_array_find_index (patch, 0);
+	assert (strcmp (ucl_object_tostring (ucl_object_lookup (op, "op")),
+			"replace") == 0);
+	assert (ucl_object_patch (old, patch));
+	ucl_object_unref (patch);
+	assert (ucl_object_todouble (ucl_object_lookup (old, "a")) == 1.0);
+	ucl_object_unref (new);
+	ucl_object_unref (old);
+
+	old = parse_string ("a = 1; b = [1.0, 2]");
+	assert (ucl_object_type (ucl_object_lookup (old, "a")) == UCL_INT);
+	patch = parse_string ("[{op = test; path = \"/a\"; value = 1.0},"
+			"{op = test; path = \"/b\"; value = [1, 2.0]}]");
+	assert (ucl_object_patch (old, patch));
+	ucl_object_unref (patch);
+	patch = parse_string ("[{op = test; path = \"/a\"; value = 1.5}]");
+	assert (!ucl_object_patch (old, patch));
+	ucl_object_unref (patch);
+	ucl_object_unref (old);
+}
+
+/*
+ * Fingerprints follow modifications and are cached for frozen trees
+ */
+static void
+test_fingerprints (void)
+{
+	ucl_object_t *old, *new, *ar, *patch;
+	struct ucl_fingerprint fp1, fp2;
+
+	old = parse_string (diff_old);
+	new = parse_string (diff_new);
+	patch = ucl_object_diff (old, new);
+	assert (ucl_object_patch (old, patch));
+	ucl_object_unref (patch);
+
+	assert (ucl_object_fingerprint (old, &fp1));
+	assert (ucl_object_fingerprint (new, &fp2));
+	assert (fp1.h1 == fp2.h1 && fp1.h2 == fp2.h2);
+	ar = (ucl_object_t *)ucl_object_lookup_path (new, "b.d");
+	ucl_array_append (ar, ucl_object_fromint (4));
+	assert (ucl_object_fingerprint (new, &fp2));
+	assert (fp1.h1 != fp2.h1 || fp1.h2 != fp2.h2);
+	ucl_object_unref (ucl_array_pop_last (ar));
+	assert (ucl_object_fingerprint (new, &fp2));
+	assert (fp1.h1 == fp2.h1 && fp1.h2 == fp2.h2);
+	ucl_object_freeze (new);
+	ucl_object_freeze (old);
+	assert (ucl_object_fingerprint (new, &fp2));
+	assert (fp1.h1 == fp2.h1 && fp1.h2 == fp2.h2);
+	assert (ucl_object_compare (old, new) == 0);
+	ucl_object_thaw (old);
+	ucl_object_thaw (new);
+	/* Frozen objects with different fingerprints are not equal */
+	ar = (ucl_object_t *)ucl_object_lookup_path (new, "b.d");
+	ucl_array_append (ar, ucl_object_fromint (4));
+	ucl_object_freeze (new);
+	ucl_object_freeze (old);
+	assert (ucl_object_compare (old, new) != 0);
+	assert (ucl_object_compare (old, new) == -ucl_object_compare (new, old));
+	ucl_object_thaw (old);
+	ucl_object_thaw (new);
+	ucl_object_unref (new);
+	ucl_object_unref (old);
+}
+
+/*
+ * Freezing does not change the order of objects
+ */
+static void
+test_compare_frozen (void)
+{
+	static const char *pairs[][2] = {
+		{"a = x", "a = y"},
+		{"a = 1.5", "a = 1.0"},
+		{"a = 1.0", "a = 1.9"},
+		{"x = 1; x = 2", "x = 1; x = 3"},
+		{"x = 1; x = 2", "x = 1"},
+		{"a = 9007199254740993", "a = 9007199254740992"}
+	};
+	ucl_object_t *o1, *o2;
+	unsigned i;
+	int ret;
+
+	for (i = 0; i < sizeof (pairs) / sizeof (pairs[0]); i ++) {
+		o1 = parse_string (pairs[i][0]);
+		o2 = parse_string (pairs[i][1]);
+		ret = ucl_object_compare (o1, o2);
+		assert (ret != 0 && (ucl_object_compare (o2, o1) < 0) == (ret > 0));
+		ucl_object_freeze (o1);
+		ucl_object_freeze (o2);
+		assert ((ucl_object_compare (o1, o2) > 0) == (ret > 0));
+		ucl_object_thaw (o1);
+		ucl_object_thaw (o2);
+		ucl_object_unref (o1);
+		ucl_object_unref (o2);
+	}
+}
+
+int
+main (int argc, char **argv)
+{
+	test_diff_patch ();
+	test_diff_nested ();
+	test_diff_top ();
+	test_diff_float ();
+	test_fingerprints ();
+	test_compare_frozen ();
+
+	return 0;
+}
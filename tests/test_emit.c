@@ -0,0 +1,1005 @@
+/* Copyright (c) 2026, Vsevolod Stakhov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *       * Redistributions of source code must retain the above copyright
+ *         notice, this list of conditions and the following disclaimer.
+ *       * Redistributions in binary form must reproduce the above copyright
+ *         notice, this list of conditions and the following disclaimer in the
+ *         documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <math.h>
+#include "ucl.h"
+
+struct fnv_digest {
+	uint64_t h;
+	size_t calls;
+};
+
+static void
+fnv_update (const unsigned char *data, size_t len, void *ud)
+{
+	struct fnv_digest *d = ud;
+
+	while (len --) {
+		d->h = (d->h ^ *data ++) * 0x100000001b3ULL;
+	}
+
+	d->calls ++;
+}
+
+struct counting_output {
+	unsigned char *mem;
+	size_t len;
+	size_t calls;
+};
+
+static int
+counting_append_len (const unsigned char *str, size_t len, void *ud)
+{
+	struct counting_output *co = ud;
+
+	co->mem = realloc (co->mem, co->len + len + 1);
+	memcpy (co->mem + co->len, str, len);
+	co->len += len;
+	co->mem[co->len] = '\0';
+	co->calls ++;
+
+	return 0;
+}
+
+static int
+counting_append_character (unsigned char c, size_t len, void *ud)
+{
+	unsigned char buf[64];
+
+	assert (len <= sizeof (buf));
+	memset (buf, c, len);
+
+	return counting_append_len (buf, len, ud);
+}
+
+static int
+counting_append_int (int64_t val, void *ud)
+{
+	char buf[UCL_NUMBER_BUF_SIZE];
+
+	return counting_append_len ((unsigned char *)buf, ucl_itoa (val, buf), ud);
+}
+
+static int
+counting_append_double (double val, void *ud)
+{
+	char buf[UCL_NUMBER_BUF_SIZE];
+
+	return counting_append_len ((unsigned char *)buf, ucl_dtoa (val, buf), ud);
+}
+
+struct stream_output {
+	unsigned char *mem;
+	size_t len;
+	size_t max;
+	unsigned int calls;
+};
+
+/* Writes at most 100 bytes and blocks on every other call */
+static bool
+stream_flush (const unsigned char *data, size_t len, size_t *written, void *ud)
+{
+	struct stream_output *so = ud;
+
+	if (len > so->max) {
+		so->max = len;
+	}
+
+	if (so->calls ++ % 2 == 1) {
+		*written = 0;
+		return true;
+	}
+
+	if (len > 100) {
+		len = 100;
+	}
+
+	so->mem = realloc (so->mem, so->len + len + 1);
+	memcpy (so->mem + so->len, data, len);
+	so->len += len;
+	so->mem[so->len] = '\0';
+	*written = len;
+
+	return true;
+}
+
+static unsigned int ud_emit_calls = 0;
+
+/*
+ * Compare cached output with the usual one, returns number of writes
+ */
+static size_t
+check_cached_emit (const ucl_object_t *obj, enum ucl_emitter type)
+{
+	struct counting_output co = {NULL, 0, 0};
+	struct ucl_emitter_functions func = {
+		.ucl_emitter_append_character = counting_append_character,
+		.ucl_emitter_append_len = counting_append_len,
+		.ucl_emitter_append_int = counting_append_int,
+		.ucl_emitter_append_double = counting_append_double,
+		.ud = &co
+	};
+	unsigned char *expected;
+	size_t len;
+
+	expected = ucl_object_emit_len (obj, type, &len);
+	ud_emit_calls = 0;
+	assert (ucl_object_emit_cached (obj, type, &func, 1024));
+	assert (co.len == len && memcmp (co.mem, expected, len) == 0);
+	free (expected);
+	free (co.mem);
+
+	return co.calls;
+}
+
+/*
+ * Compare resumable output into `bufsize` buffers with the usual one
+ */
+static void
+check_resumable_emit (const ucl_object_t *obj, enum ucl_emitter type,
+		const ucl_object_t *comments, size_t bufsize)
+{
+	struct counting_output co = {NULL, 0, 0};
+	struct ucl_emitter_functions func = {
+		.ucl_emitter_append_character = counting_append_character,
+		.ucl_emitter_append_len = counting_append_len,
+		.ucl_emitter_append_int = counting_append_int,
+		.ucl_emitter_append_double = counting_append_double,
+		.ud = &co
+	};
+	struct ucl_emitter_resumable *rctx;
+	enum ucl_emitter_stream_status st;
+	unsigned char *out = NULL;
+	size_t len = 0, written;
+
+	assert (ucl_object_emit_full (obj, type, &func, comments));
+	/* Unfinished output can be abandoned */
+	rctx = ucl_object_emit_resumable_new (obj, type, comments);
+	out = malloc (bufsize);
+	ucl_object_emit_resumable (rctx, out, bufsize, &written);
+	ucl_object_emit_resumable_free (rctx);
+	free (out);
+	out = NULL;
+	rctx = ucl_object_emit_resumable_new (obj, type, comments);
+	assert (rctx != NULL);
+
+	do {
+		out = realloc (out, len + bufsize);
+		st = ucl_object_emit_resumable (rctx, out + len, bufsize, &written);
+		assert (st != UCL_EMIT_STREAM_ERROR);
+		/* Suspended output fills the whole buffer */
+		assert (st == UCL_EMIT_STREAM_OK || written == bufsize);
+		len += written;
+	} while (st == UCL_EMIT_STREAM_AGAIN);
+
+	ucl_object_emit_resumable_free (rctx);
+	assert (len == co.len && memcmp (out, co.mem, len) == 0);
+	free (out);
+	free (co.mem);
+}
+
+static const char *
+ud_emit_counted (void *ptr)
+{
+	ud_emit_calls ++;
+
+	return "counted";
+}
+
+#ifdef __GNUC__
+static __thread bool ud_main_thread = false;
+#else
+static bool ud_main_thread = true;
+#endif
+
+/* Userdata emitters must not be called by workers of parallel emitting */
+static const char *
+ud_emit_main_thread (void *ptr)
+{
+	assert (ud_main_thread);
+
+	return "main";
+}
+
+static unsigned int ud_emit_serial = 9;
+
+/* Output of each call differs, its length changes after a few calls */
+static const char *
+ud_emit_serial_call (void *ptr)
+{
+	static char buf[32];
+
+	snprintf (buf, sizeof (buf), "call-%u", ud_emit_serial ++);
+
+	return buf;
+}
+
+/*
+ * Number of write syscalls issued by this process so far or -1 if it is
+ * not known
+ */
+static long
+count_write_syscalls (void)
+{
+	long n = -1;
+#ifdef __linux__
+	FILE *fp;
+	char line[128];
+
+	fp = fopen ("/proc/self/io", "r");
+
+	if (fp != NULL) {
+		while (fgets (line, sizeof (line), fp) != NULL) {
+			if (sscanf (line, "syscw: %ld", &n) == 1) {
+				break;
+			}
+		}
+
+		fclose (fp);
+	}
+#endif
+
+	return n;
+}
+
+/*
+ * Emit a string with a special character at `pos` and compare against the
+ * escaping done by hand
+ */
+static void
+check_escape (char *buf, size_t len, size_t pos, char c, const char *esc,
+		bool squoted)
+{
+	ucl_object_t *obj;
+	unsigned char *emitted;
+	size_t elen = strlen (esc);
+
+	memset (buf, 'a', len);
+	buf[pos] = c;
+	obj = ucl_object_fromlstring (buf, len);
+
+	if (squoted) {
+		obj->flags |= UCL_OBJECT_SQUOTED;
+		emitted = ucl_object_emit (obj, UCL_EMIT_CONFIG);
+		assert (emitted[0] == '\'' && emitted[len + elen] == '\'');
+	}
+	else {
+		emitted = ucl_object_emit (obj, UCL_EMIT_JSON_COMPACT);
+		assert (emitted[0] == '"' && emitted[len + elen] == '"');
+	}
+
+	assert (strlen ((char *)emitted) == len + elen + 1);
+	assert (memcmp (emitted + 1, buf, pos) == 0);
+	assert (memcmp (emitted + 1 + pos, esc, elen) == 0);
+	assert (memcmp (emitted + 1 + pos + elen, buf + pos + 1,
+			len - pos - 1) == 0);
+	free (emitted);
+	ucl_object_unref (obj);
+}
+
+/*
+ * Escapes around vector boundaries
+ */
+static void
+test_escapes (void)
+{
+	ucl_object_t *obj, *cur;
+	char sbuf[100];
+	size_t sz;
+
+	for (sz = 0; sz < sizeof (sbuf); sz ++) {
+		check_escape (sbuf, sizeof (sbuf), sz, '"', "\\\"", false);
+		check_escape (sbuf, sizeof (sbuf), sz, '\\', "\\\\", false);
+		check_escape (sbuf, sizeof (sbuf), sz, '\n', "\\n", false);
+		check_escape (sbuf, sizeof (sbuf), sz, '\v', "\\u000B", false);
+		check_escape (sbuf, sizeof (sbuf), sz, '\x7f', "\\uFFFD", false);
+		check_escape (sbuf, sizeof (sbuf), sz, ' ', " ", false);
+		check_escape (sbuf, sizeof (sbuf), sz, '\'', "\\'", true);
+	}
+
+	obj = ucl_object_typed_new (UCL_OBJECT);
+	memset (sbuf, 'a', sizeof (sbuf));
+	cur = ucl_object_fromint (1);
+	ucl_object_insert_key (obj, cur, sbuf, sizeof (sbuf), true);
+	assert (!(cur->flags & UCL_OBJECT_NEED_KEY_ESCAPE));
+	ucl_object_delete_keyl (obj, sbuf, sizeof (sbuf));
+	sbuf[sizeof (sbuf) - 1] = '=';
+	cur = ucl_object_fromint (1);
+	ucl_object_insert_key (obj, cur, sbuf, sizeof (sbuf), true);
+	assert (cur->flags & UCL_OBJECT_NEED_KEY_ESCAPE);
+	ucl_object_delete_keyl (obj, sbuf, sizeof (sbuf));
+	sbuf[sizeof (sbuf) - 1] = '\x01';
+	cur = ucl_object_fromint (1);
+	ucl_object_insert_key (obj, cur, sbuf, sizeof (sbuf), true);
+	assert (!(cur->flags & UCL_OBJECT_NEED_KEY_ESCAPE));
+	ucl_object_delete_keyl (obj, sbuf, sizeof (sbuf));
+	ucl_object_unref (obj);
+}
+
+/*
+ * Number formatting
+ */
+static void
+test_numbers (void)
+{
+	static const double fp_vals[] = {0.1, 1.0 / 3.0, -2.5e-7, 1e21, 1e22,
+			123456.789, 1.7976931348623157e308, 2.2250738585072014e-308,
+			5.3070081386547595e-165};
+	ucl_object_t *test_obj;
+	const ucl_object_t *test;
+	struct ucl_parser *parser;
+	unsigned char *mem;
+	char sbuf[100];
+	size_t sz;
+
+	assert (ucl_dtoa (0.1, sbuf) == 3 && strcmp (sbuf, "0.1") == 0);
+	assert (ucl_dtoa (-0.0, sbuf) == 4 && strcmp (sbuf, "-0.0") == 0);
+	assert (ucl_dtoa (1e21, sbuf) == 4 && strcmp (sbuf, "1e21") == 0);
+	ucl_dtoa (100.0, sbuf);
+	assert (strcmp (sbuf, "100.0") == 0);
+	ucl_dtoa (1.5e-7, sbuf);
+	assert (strcmp (sbuf, "1.5e-7") == 0);
+	ucl_dtoa (0.000123, sbuf);
+	assert (strcmp (sbuf, "0.000123") == 0);
+	/* Grisu3 cannot prove this one is the shortest, so it is searched */
+	ucl_dtoa (5.3070081386547595e-165, sbuf);
+	assert (strcmp (sbuf, "5.30700813865476e-165") == 0);
+	assert (ucl_itoa (INT64_MIN, sbuf) == 20 &&
+			strcmp (sbuf, "-9223372036854775808") == 0);
+	assert (ucl_itoa (0, sbuf) == 1 && strcmp (sbuf, "0") == 0);
+	/* Emitted doubles are read back exactly */
+	test_obj = ucl_object_typed_new (UCL_ARRAY);
+	for (sz = 0; sz < sizeof (fp_vals) / sizeof (fp_vals[0]); sz ++) {
+		ucl_array_append (test_obj, ucl_object_fromdouble (fp_vals[sz]));
+	}
+	mem = ucl_object_emit (test_obj, UCL_EMIT_JSON_COMPACT);
+	ucl_object_unref (test_obj);
+	parser = ucl_parser_new (0);
+	assert (ucl_parser_add_string (parser, (const char *)mem, 0));
+	test_obj = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+	for (sz = 0; sz < sizeof (fp_vals) / sizeof (fp_vals[0]); sz ++) {
+		test = ucl_array_find_index (test_obj, sz);
+		assert (ucl_object_type (test) == UCL_FLOAT);
+		assert (ucl_object_todouble (test) == fp_vals[sz]);
+	}
+	ucl_object_unref (test_obj);
+	free (mem);
+}
+
+/*
+ * Exact size emission
+ */
+static void
+test_exact_size (void)
+{
+	ucl_object_t *test_obj;
+	unsigned char *mem;
+	char sbuf[100];
+	size_t sz;
+
+	test_obj = ucl_object_typed_new (UCL_ARRAY);
+	ucl_array_append (test_obj, ucl_object_fromstring ("exact \"size\""));
+	ucl_array_append (test_obj, ucl_object_fromdouble (0.25));
+	ucl_array_append (test_obj, ucl_object_fromint (-42));
+	mem = ucl_object_emit_len (test_obj, UCL_EMIT_JSON_COMPACT, &sz);
+	assert (sz == strlen ((const char *)mem));
+	assert (ucl_object_emit_size (test_obj, UCL_EMIT_JSON_COMPACT) == sz);
+	assert (!ucl_object_emit_into (test_obj, UCL_EMIT_JSON_COMPACT,
+			(unsigned char *)sbuf, 4, &sz));
+	assert (sz == strlen ((const char *)mem));
+	assert (ucl_object_emit_into (test_obj, UCL_EMIT_JSON_COMPACT,
+			(unsigned char *)sbuf, sz + 1, &sz));
+	assert (strcmp (sbuf, (const char *)mem) == 0);
+	free (mem);
+	mem = ucl_object_emit_len (test_obj, UCL_EMIT_MSGPACK, &sz);
+	assert (ucl_object_emit_size (test_obj, UCL_EMIT_MSGPACK) == sz);
+	assert (ucl_object_emit_into (test_obj, UCL_EMIT_MSGPACK,
+			(unsigned char *)sbuf, sizeof (sbuf), &sz));
+	assert (memcmp (sbuf, mem, sz) == 0);
+	free (mem);
+	ucl_object_unref (test_obj);
+
+	/* Output grows if userdata emits more than it did while sizing */
+	test_obj = ucl_object_typed_new (UCL_OBJECT);
+	ucl_object_insert_key (test_obj,
+			ucl_object_new_userdata (NULL, ud_emit_serial_call, NULL),
+			"u", 0, false);
+	mem = ucl_object_emit_len (test_obj, UCL_EMIT_JSON_COMPACT, &sz);
+	assert (mem != NULL && ud_emit_serial == 11);
+	assert (strcmp ((const char *)mem, "{\"u\":\"call-10\"}") == 0);
+	assert (sz == strlen ((const char *)mem));
+	free (mem);
+	ucl_object_unref (test_obj);
+}
+
+/*
+ * Buffered descriptor output
+ */
+static void
+test_fd_output (void)
+{
+	ucl_object_t *test_obj;
+	struct ucl_emitter_functions *fn;
+	unsigned char *mem, *fd_out;
+	char sbuf[100];
+	size_t sz;
+	FILE *tmp;
+	int fd;
+	long syscw;
+
+	test_obj = ucl_object_typed_new (UCL_OBJECT);
+	for (sz = 0; sz < 2000; sz ++) {
+		snprintf (sbuf, sizeof (sbuf), "key%zu", sz);
+		ucl_object_insert_key (test_obj, ucl_object_fromint (sz), sbuf, 0, true);
+	}
+	mem = malloc (10000);
+	memset (mem, 'x', 10000);
+	ucl_object_insert_key (test_obj, ucl_object_fromlstring ((char *)mem, 10000),
+			"large", 0, false);
+	free (mem);
+	mem = ucl_object_emit_len (test_obj, UCL_EMIT_JSON_COMPACT, &sz);
+	tmp = tmpfile ();
+	assert (tmp != NULL);
+	fd = fileno (tmp);
+	syscw = count_write_syscalls ();
+	fn = ucl_object_emit_fd_funcs_full (fd, 4096);
+	assert (ucl_object_emit_full (test_obj, UCL_EMIT_JSON_COMPACT, fn, NULL));
+	/* A syscall per buffer, the large string goes with a buffer in writev */
+	assert (syscw == -1 || count_write_syscalls () - syscw <= sz / 4096 + 1);
+	ucl_object_emit_funcs_free (fn);
+	fd_out = malloc (sz + 1);
+	assert (lseek (fd, 0, SEEK_SET) == 0);
+	assert (read (fd, fd_out, sz + 1) == (ssize_t)sz);
+	assert (memcmp (fd_out, mem, sz) == 0);
+	free (fd_out);
+	/* FILE output is flushed once the object is emitted */
+	assert (ftruncate (fd, 0) == 0 && lseek (fd, 0, SEEK_SET) == 0);
+	fn = ucl_object_emit_file_funcs (tmp);
+	assert (ucl_object_emit_full (test_obj, UCL_EMIT_JSON_COMPACT, fn, NULL));
+	fd_out = malloc (sz + 1);
+	assert (lseek (fd, 0, SEEK_SET) == 0);
+	assert (read (fd, fd_out, sz + 1) == (ssize_t)sz);
+	assert (memcmp (fd_out, mem, sz) == 0);
+	assert (ucl_object_emit_funcs_flush (fn));
+	ucl_object_emit_funcs_free (fn);
+	free (fd_out);
+	free (mem);
+	fclose (tmp);
+	/* Write errors are reported */
+	fd = open ("/dev/null", O_RDONLY);
+	fn = ucl_object_emit_fd_funcs (fd);
+	assert (!ucl_object_emit_full (test_obj, UCL_EMIT_JSON, fn, NULL));
+	assert (errno == EBADF);
+	assert (!ucl_object_emit_funcs_flush (fn));
+	ucl_object_emit_funcs_free (fn);
+	close (fd);
+	ucl_object_unref (test_obj);
+}
+
+/*
+ * Parallel output must match sequential one
+ */
+static void
+test_parallel (void)
+{
+	ucl_object_t *test_obj, *cur, *ar;
+	struct ucl_emitter_functions *fn;
+	unsigned char *emitted, *mem;
+	char sbuf[100];
+	size_t sz;
+	int fd;
+
+	test_obj = ucl_object_typed_new (UCL_OBJECT);
+	ar = ucl_object_typed_new (UCL_ARRAY);
+	for (sz = 0; sz < 5000; sz ++) {
+		snprintf (sbuf, sizeof (sbuf), "key%zu", sz);
+		cur = ucl_object_typed_new (UCL_OBJECT);
+		ucl_object_insert_key (cur, ucl_object_fromint (sz), "n", 0, false);
+		ucl_object_insert_key (cur, ucl_object_fromstring (sbuf), "s", 0, false);
+		if (sz == 4000) {
+			ucl_object_insert_key (cur,
+					ucl_object_new_userdata (NULL, ud_emit_main_thread, NULL),
+					"ud", 0, false);
+		}
+		ucl_array_append (ar, cur);
+		ucl_object_insert_key (test_obj, ucl_object_fromdouble (sz / 4.0),
+				sbuf, 0, true);
+	}
+	ucl_object_insert_key (test_obj, ar, "array", 0, false);
+	ucl_object_insert_key (test_obj, ucl_object_fromint (1), "dup", 0, false);
+	ucl_object_insert_key (test_obj, ucl_object_fromint (2), "dup", 0, false);
+	ud_main_thread = true;
+	for (fd = UCL_EMIT_JSON; fd <= UCL_EMIT_MSGPACK; fd ++) {
+		unsigned int nthreads;
+
+		mem = ucl_object_emit_len (test_obj, fd, &sz);
+		emitted = NULL;
+		fn = ucl_object_emit_memory_funcs ((void **)&emitted);
+		assert (ucl_object_emit_parallel (test_obj, fd, fn, 4));
+		assert (memcmp (emitted, mem, sz) == 0);
+		ucl_object_emit_funcs_free (fn);
+		free (emitted);
+		/* Thread count is capped by the number of elements */
+		for (nthreads = 4; nthreads <= 4096; nthreads *= 32) {
+			size_t cnt, total;
+
+			fn = ucl_object_emit_iovec_funcs (0);
+			assert (ucl_object_emit_parallel (test_obj, fd, fn, nthreads));
+			assert (ucl_object_emit_funcs_iovec (fn, &cnt, &total) != NULL);
+			assert (total == sz);
+			ucl_object_emit_funcs_free (fn);
+		}
+		free (mem);
+	}
+	ucl_object_unref (test_obj);
+}
+
+/*
+ * Iovec output references long strings
+ */
+static void
+test_iovec (void)
+{
+	ucl_object_t *test_obj;
+	const ucl_object_t *test;
+	struct ucl_emitter_functions *fn;
+	unsigned char *mem, *fd_out;
+	char sbuf[100];
+	size_t sz;
+	FILE *tmp;
+	int fd;
+
+	test_obj = ucl_object_typed_new (UCL_OBJECT);
+	mem = malloc (10000);
+	memset (mem, 'x', 10000);
+	ucl_object_insert_key (test_obj, ucl_object_fromlstring ((char *)mem, 10000),
+			"large", 0, false);
+	mem[5000] = '"';
+	ucl_object_insert_key (test_obj, ucl_object_fromlstring ((char *)mem, 10000),
+			"escaped", 0, false);
+	free (mem);
+	for (sz = 0; sz < 1000; sz ++) {
+		snprintf (sbuf, sizeof (sbuf), "key%zu", sz);
+		ucl_object_insert_key (test_obj, ucl_object_fromint (sz), sbuf, 0, true);
+	}
+	test = ucl_object_lookup (test_obj, "large");
+	for (fd = UCL_EMIT_JSON; fd <= UCL_EMIT_MSGPACK; fd ++) {
+		const struct iovec *iov;
+		size_t cnt, total, i, off, nref = 0;
+
+		mem = ucl_object_emit_len (test_obj, fd, &sz);
+		fn = ucl_object_emit_iovec_funcs (0);
+		assert (ucl_object_emit_full (test_obj, fd, fn, NULL));
+		iov = ucl_object_emit_funcs_iovec (fn, &cnt, &total);
+		assert (iov != NULL && total == sz);
+		for (i = 0, off = 0; i < cnt; i ++) {
+			assert (memcmp (mem + off, iov[i].iov_base, iov[i].iov_len) == 0);
+			off += iov[i].iov_len;
+			if (iov[i].iov_base == (void *)ucl_object_tostring (test)) {
+				nref ++;
+			}
+		}
+		assert (off == sz && nref == 1);
+		tmp = tmpfile ();
+		assert (tmp != NULL);
+		assert (ucl_object_emit_funcs_writev (fn, fileno (tmp)));
+		fd_out = malloc (sz + 1);
+		assert (lseek (fileno (tmp), 0, SEEK_SET) == 0);
+		assert (read (fileno (tmp), fd_out, sz + 1) == (ssize_t)sz);
+		assert (memcmp (fd_out, mem, sz) == 0);
+		fclose (tmp);
+		free (fd_out);
+		ucl_object_emit_funcs_free (fn);
+		free (mem);
+	}
+	ucl_object_unref (test_obj);
+}
+
+/*
+ * Canonical JSON
+ */
+static void
+test_canonical (void)
+{
+	ucl_object_t *test_obj, *cur, *ar;
+	struct ucl_emitter_functions *fn;
+	unsigned char *mem, *fd_out;
+	char sbuf[100];
+	size_t sz;
+
+	test_obj = ucl_object_typed_new (UCL_OBJECT);
+	ucl_object_insert_key (test_obj, ucl_object_fromint (1), "b", 0, false);
+	cur = ucl_object_typed_new (UCL_OBJECT);
+	ucl_object_insert_key (cur, ucl_object_frombool (true), "z", 0, false);
+	ucl_object_insert_key (cur, ucl_object_typed_new (UCL_NULL), "\xc3\xa9",
+			0, false);
+	ar = ucl_object_typed_new (UCL_ARRAY);
+	ucl_array_append (ar, ucl_object_fromint (3));
+	ucl_array_append (ar, ucl_object_fromdouble (2.5));
+	ucl_object_insert_key (cur, ar, "y", 0, false);
+	ucl_object_insert_key (test_obj, cur, "a", 0, false);
+	ucl_object_insert_key (test_obj,
+			ucl_object_fromstring ("\x01\t\"\\\x7f\xe2\x82\xac"), "", 0, false);
+	ucl_object_insert_key (test_obj, ucl_object_fromdouble (1.0), "c", 0, false);
+	ucl_object_insert_key (test_obj, ucl_object_fromdouble (-0.0), "c", 0, false);
+	ucl_object_insert_key (test_obj, ucl_object_fromdouble (1e21), "d", 0, false);
+	ucl_object_insert_key (test_obj, ucl_object_fromdouble (1e-7), "e", 0, false);
+	ucl_object_insert_key (test_obj, ucl_object_fromdouble (1e-6), "f", 0, false);
+	ucl_object_insert_key (test_obj, ucl_object_fromdouble (123.456), "g", 0, false);
+	ucl_object_insert_key (test_obj, ucl_object_fromdouble (NAN), "h", 0, false);
+	ucl_object_insert_key (test_obj, ucl_object_fromint (1), "A", 0, false);
+	mem = ucl_object_emit (test_obj, UCL_EMIT_JSON_CANONICAL);
+	assert (strcmp ((const char *)mem, "{\"\":\"\\u0001\\t\\\"\\\\\x7f\xe2\x82\xac\","
+			"\"A\":1,\"a\":{\"y\":[3,2.5],\"z\":true,\"\xc3\xa9\":null},\"b\":1,"
+			"\"c\":[1,0],\"d\":1e+21,\"e\":1e-7,\"f\":0.000001,"
+			"\"g\":123.456,\"h\":null}") == 0);
+	free (mem);
+	/* Source order is kept */
+	mem = ucl_object_emit (test_obj, UCL_EMIT_JSON_COMPACT);
+	assert (strncmp ((const char *)mem, "{\"b\":1,\"a\":{\"z\":true", 20) == 0);
+	free (mem);
+	ucl_object_unref (test_obj);
+
+	/* Insertion order does not matter, output may be hashed on the fly */
+	test_obj = ucl_object_typed_new (UCL_OBJECT);
+	ar = ucl_object_typed_new (UCL_OBJECT);
+	for (sz = 0; sz < 1000; sz ++) {
+		snprintf (sbuf, sizeof (sbuf), "k%zu", sz);
+		ucl_object_insert_key (test_obj, ucl_object_fromint (sz), sbuf, 0, true);
+		snprintf (sbuf, sizeof (sbuf), "k%zu", 999 - sz);
+		ucl_object_insert_key (ar, ucl_object_fromint (999 - sz), sbuf, 0, true);
+	}
+	mem = ucl_object_emit_len (test_obj, UCL_EMIT_JSON_CANONICAL, &sz);
+	fd_out = ucl_object_emit (ar, UCL_EMIT_JSON_CANONICAL);
+	assert (strcmp ((const char *)mem, (const char *)fd_out) == 0);
+	free (fd_out);
+	{
+		struct fnv_digest d1 = {0xcbf29ce484222325ULL, 0},
+				d2 = {0xcbf29ce484222325ULL, 0};
+
+		fnv_update (mem, sz, &d1);
+		fn = ucl_object_emit_digest_funcs (fnv_update, &d2);
+		assert (ucl_object_emit_full (ar, UCL_EMIT_JSON_CANONICAL, fn, NULL));
+		assert (d2.h == d1.h && d2.calls <= sz / 2048 + 1);
+		ucl_object_emit_funcs_free (fn);
+	}
+	free (mem);
+	ucl_object_unref (ar);
+	ucl_object_unref (test_obj);
+}
+
+/*
+ * NDJSON
+ */
+static void
+test_ndjson (void)
+{
+	ucl_object_t *test_obj, *cur, *ar;
+	struct ucl_emitter_functions *fn;
+	unsigned char *emitted;
+	int fd;
+
+	ar = ucl_object_typed_new (UCL_ARRAY);
+	cur = ucl_object_typed_new (UCL_OBJECT);
+	ucl_object_insert_key (cur, ucl_object_fromint (1), "a", 0, false);
+	ucl_object_insert_key (cur, ucl_object_fromstring ("b\nc"), "b", 0, false);
+	ucl_array_append (ar, cur);
+	cur = ucl_object_typed_new (UCL_ARRAY);
+	ucl_array_append (cur, ucl_object_fromint (1));
+	ucl_array_append (cur, ucl_object_frombool (true));
+	ucl_array_append (ar, cur);
+	ucl_array_append (ar, ucl_object_fromstring ("str"));
+	emitted = ucl_object_emit (ar, UCL_EMIT_NDJSON);
+	assert (strcmp ((const char *)emitted,
+			"{\"a\":1,\"b\":\"b\\nc\"}\n[1,true]\n\"str\"\n") == 0);
+	free (emitted);
+	emitted = ucl_object_emit (cur, UCL_EMIT_NDJSON);
+	assert (strcmp ((const char *)emitted, "1\ntrue\n") == 0);
+	free (emitted);
+	emitted = ucl_object_emit (ucl_array_head (ar), UCL_EMIT_NDJSON);
+	assert (strcmp ((const char *)emitted, "{\"a\":1,\"b\":\"b\\nc\"}\n") == 0);
+	free (emitted);
+	test_obj = ucl_object_typed_new (UCL_ARRAY);
+	ucl_array_append (test_obj, ucl_object_fromint (1));
+	ucl_array_append (test_obj, ucl_object_fromint (2));
+	ucl_array_append (test_obj, ucl_object_fromint (3));
+	assert (ucl_array_pack (test_obj));
+	emitted = ucl_object_emit (test_obj, UCL_EMIT_NDJSON);
+	assert (strcmp ((const char *)emitted, "1\n2\n3\n") == 0);
+	free (emitted);
+	for (fd = UCL_EMIT_JSON; fd < UCL_EMIT_MAX; fd ++) {
+		check_resumable_emit (test_obj, fd, NULL, 2);
+	}
+	ucl_object_unref (test_obj);
+	/* Streamlined elements of a top array are lines as well */
+	{
+		struct ucl_emitter_context *sctx;
+
+		test_obj = ucl_object_typed_new (UCL_ARRAY);
+		ucl_array_append (test_obj, ucl_object_fromint (0));
+		emitted = NULL;
+		fn = ucl_object_emit_memory_funcs ((void **)&emitted);
+		sctx = ucl_object_emit_streamline_new (test_obj, UCL_EMIT_NDJSON, fn);
+		ucl_object_emit_streamline_add_object (sctx, ucl_array_head (ar));
+		ucl_object_emit_streamline_start_container (sctx, cur);
+		ucl_object_emit_streamline_end_container (sctx);
+		ucl_object_emit_streamline_add_object (sctx, ucl_array_tail (ar));
+		ucl_object_emit_streamline_finish (sctx);
+		ucl_object_emit_funcs_free (fn);
+		assert (strcmp ((const char *)emitted,
+				"0\n{\"a\":1,\"b\":\"b\\nc\"}\n[1,true]\n\"str\"\n") == 0);
+		free (emitted);
+		ucl_object_unref (test_obj);
+	}
+	for (fd = UCL_EMIT_JSON; fd < UCL_EMIT_MAX; fd ++) {
+		check_resumable_emit (ar, fd, NULL, 3);
+		check_resumable_emit (ucl_array_head (ar), fd, NULL, 3);
+	}
+	ucl_object_unref (ar);
+}
+
+/*
+ * Cached output follows modifications
+ */
+static void
+test_cached (void)
+{
+	ucl_object_t *test_obj, *cur, *ar;
+	char sbuf[100];
+	size_t sz;
+	int fd;
+
+	test_obj = ucl_object_typed_new (UCL_OBJECT);
+	for (sz = 0; sz < 50; sz ++) {
+		snprintf (sbuf, sizeof (sbuf), "section%zu", sz);
+		cur = ucl_object_typed_new (UCL_OBJECT);
+		ar = ucl_object_typed_new (UCL_ARRAY);
+		for (fd = 0; fd < 100; fd ++) {
+			snprintf (sbuf, sizeof (sbuf), "value %d", fd);
+			ucl_object_insert_key (cur, ucl_object_fromstring (sbuf), sbuf, 0, true);
+			ucl_array_append (ar, ucl_object_fromdouble (fd / 3.0));
+		}
+		ucl_object_insert_key (cur, ar, "list", 0, false);
+		ucl_object_insert_key (cur,
+				ucl_object_new_userdata (NULL, ud_emit_counted, sbuf), "ud", 0, false);
+		snprintf (sbuf, sizeof (sbuf), "section%zu", sz);
+		ucl_object_insert_key (test_obj, cur, sbuf, 0, true);
+	}
+	for (fd = UCL_EMIT_JSON; fd < UCL_EMIT_MAX; fd ++) {
+		check_cached_emit (test_obj, fd);
+		/* Everything is cached as a whole, NDJSON adds a newline */
+		assert (check_cached_emit (test_obj, fd) ==
+				(fd == UCL_EMIT_NDJSON ? 2 : 1));
+		assert (ud_emit_calls == 0);
+	}
+	cur = (ucl_object_t *)ucl_object_lookup (test_obj, "section7");
+	ucl_object_insert_key (cur, ucl_object_fromint (1), "new", 0, false);
+	ar = (ucl_object_t *)ucl_object_lookup (cur, "list");
+	for (fd = UCL_EMIT_JSON; fd < UCL_EMIT_MAX; fd ++) {
+		/* Only the modified section is emitted again */
+		check_cached_emit (test_obj, fd);
+		assert (ud_emit_calls == 1);
+	}
+	ucl_array_append (ar, ucl_object_fromstring ("appended"));
+	check_cached_emit (test_obj, UCL_EMIT_JSON);
+	ucl_object_insert_key (cur, ucl_object_fromint (2), "new", 0, false);
+	check_cached_emit (test_obj, UCL_EMIT_JSON);
+	assert (ucl_object_delete_key (cur, "value 5"));
+	check_cached_emit (test_obj, UCL_EMIT_JSON);
+	ucl_object_replace_key (test_obj, ucl_object_fromint (3), "section9", 0, false);
+	check_cached_emit (test_obj, UCL_EMIT_JSON);
+	ucl_object_emit_cache_clear (test_obj);
+	check_cached_emit (test_obj, UCL_EMIT_JSON);
+	assert (ud_emit_calls == 49);
+	/* Cached output includes keys of moved containers */
+	cur = ucl_object_ref (ucl_object_lookup (test_obj, "section3"));
+	assert (ucl_object_delete_key (test_obj, "section3"));
+	ucl_object_insert_key (test_obj, cur, "moved", 0, false);
+	for (fd = UCL_EMIT_JSON; fd < UCL_EMIT_MAX; fd ++) {
+		check_cached_emit (test_obj, fd);
+	}
+	/* Frozen trees are emitted as usual and never written */
+	ucl_object_freeze (test_obj);
+	check_cached_emit (test_obj, UCL_EMIT_JSON);
+	assert (check_cached_emit (test_obj, UCL_EMIT_JSON) > 1);
+	assert (ud_emit_calls == 49);
+	ucl_object_thaw (test_obj);
+	ucl_object_unref (test_obj);
+}
+
+/*
+ * Buffered streamline output
+ */
+static void
+test_streamline_buffered (void)
+{
+	ucl_object_t *test_obj, *cur, *ar, *ar1, *streamed;
+	struct ucl_parser *parser;
+	char sbuf[100];
+	size_t sz;
+	int fd;
+
+	test_obj = ucl_object_typed_new (UCL_OBJECT);
+	ar = ucl_object_typed_new (UCL_ARRAY);
+	for (sz = 0; sz < 1000; sz ++) {
+		cur = ucl_object_typed_new (UCL_OBJECT);
+		ucl_object_insert_key (cur, ucl_object_fromint (sz), "id", 0, false);
+		snprintf (sbuf, sizeof (sbuf), "item %zu", sz);
+		ucl_object_insert_key (cur, ucl_object_fromstring (sbuf), "name", 0, true);
+		ucl_array_append (ar, cur);
+	}
+	ucl_object_insert_key (test_obj, ar, "items", 0, false);
+	cur = ucl_object_typed_new (UCL_OBJECT);
+	ucl_object_insert_key (cur, ucl_object_fromint (1), "a", 0, false);
+	ucl_object_insert_key (cur, ucl_object_fromstring ("x"), "b", 0, false);
+	ucl_object_insert_key (test_obj, cur, "meta", 0, false);
+	ucl_object_insert_key (test_obj, ucl_object_fromint (1000), "count", 0, false);
+	/* Containers to stream elements of the tree into */
+	streamed = ucl_object_typed_new (UCL_OBJECT);
+	ucl_object_insert_key (streamed, ucl_object_typed_new (UCL_ARRAY),
+			"items", 0, false);
+	ucl_object_insert_key (streamed, ucl_object_typed_new (UCL_OBJECT),
+			"meta", 0, false);
+
+	for (fd = UCL_EMIT_JSON; fd < UCL_EMIT_MAX; fd ++) {
+		struct stream_output so = {NULL, 0, 0, 0};
+		struct ucl_emitter_context *sctx;
+		ucl_object_t *top;
+		ucl_object_iter_t it = NULL;
+		const ucl_object_t *elt;
+
+		if (fd == UCL_EMIT_YAML || fd == UCL_EMIT_JSON_CANONICAL) {
+			continue;
+		}
+
+		top = ucl_object_typed_new (UCL_OBJECT);
+		sctx = ucl_object_emit_streamline_buffered_new (top, fd,
+				stream_flush, &so, 512);
+		assert (sctx != NULL);
+		/* Declared counts let msgpack output be flushed early */
+		assert (ucl_object_emit_streamline_set_count (sctx, 3));
+		ucl_object_emit_streamline_start_container (sctx,
+				ucl_object_lookup (streamed, "items"));
+		assert (ucl_object_emit_streamline_set_count (sctx, 1000));
+		assert (!ucl_object_emit_streamline_set_count (sctx, 1000));
+		for (sz = 0; sz < 1000; sz ++) {
+			ucl_object_emit_streamline_add_object (sctx,
+					ucl_array_find_index (ar, sz));
+			while (ucl_object_emit_streamline_status (sctx) ==
+					UCL_EMIT_STREAM_AGAIN) {
+				ucl_object_emit_streamline_flush (sctx);
+			}
+		}
+		ucl_object_emit_streamline_end_container (sctx);
+		ucl_object_emit_streamline_start_container (sctx,
+				ucl_object_lookup (streamed, "meta"));
+		while ((elt = ucl_object_iterate (cur, &it, true)) != NULL) {
+			ucl_object_emit_streamline_add_object (sctx, elt);
+		}
+		ucl_object_emit_streamline_end_container (sctx);
+		ucl_object_emit_streamline_add_object (sctx,
+				ucl_object_lookup (test_obj, "count"));
+
+		/* Output is flushed while it is produced */
+		assert (so.len > 0 && so.max < 1024);
+
+		if (ucl_object_emit_streamline_close (sctx) != UCL_EMIT_STREAM_OK) {
+			while (ucl_object_emit_streamline_flush (sctx) !=
+					UCL_EMIT_STREAM_OK);
+		}
+		ucl_object_emit_streamline_finish (sctx);
+		ucl_object_unref (top);
+
+		parser = ucl_parser_new (0);
+		assert (ucl_parser_add_chunk_full (parser, so.mem, so.len, 0,
+				UCL_DUPLICATE_APPEND,
+				fd == UCL_EMIT_MSGPACK ? UCL_PARSE_MSGPACK : UCL_PARSE_UCL));
+		ar1 = ucl_parser_get_object (parser);
+		ucl_parser_free (parser);
+		assert (ucl_object_compare (ar1, test_obj) == 0);
+		ucl_object_unref (ar1);
+		free (so.mem);
+	}
+	ucl_object_unref (streamed);
+	{
+		struct stream_output so = {NULL, 0, 0, 0};
+		struct ucl_emitter_context *sctx;
+		ucl_object_t *top;
+
+		/* Canonical JSON requires sorted keys */
+		top = ucl_object_typed_new (UCL_OBJECT);
+		assert (ucl_object_emit_streamline_buffered_new (top,
+				UCL_EMIT_JSON_CANONICAL, stream_flush, &so, 0) == NULL);
+		/* Wrong declared count is an error */
+		sctx = ucl_object_emit_streamline_buffered_new (top,
+				UCL_EMIT_MSGPACK, stream_flush, &so, 0);
+		assert (ucl_object_emit_streamline_set_count (sctx, 2));
+		ucl_object_emit_streamline_add_object (sctx,
+				ucl_object_lookup (test_obj, "count"));
+		assert (ucl_object_emit_streamline_close (sctx) == UCL_EMIT_STREAM_ERROR);
+		ucl_object_emit_streamline_finish (sctx);
+		ucl_object_unref (top);
+		free (so.mem);
+	}
+	/* Resumable output continues where the previous buffer has ended */
+	for (fd = UCL_EMIT_JSON; fd < UCL_EMIT_MAX; fd ++) {
+		check_resumable_emit (test_obj, fd, NULL, 4096);
+		check_resumable_emit (test_obj, fd, NULL, 1);
+	}
+	ucl_object_unref (test_obj);
+}
+
+/*
+ * Resumable output keeps comments
+ */
+static void
+test_resumable (void)
+{
+	ucl_object_t *obj, *comments, *ar;
+	int fd;
+
+	obj = ucl_object_typed_new (UCL_OBJECT);
+	ucl_object_insert_key (obj, ucl_object_fromint (1), "a", 0, false);
+	ar = ucl_object_typed_new (UCL_ARRAY);
+	ucl_array_append (ar, ucl_object_fromint (1));
+	ucl_array_append (ar, ucl_object_fromstring ("two"));
+	ucl_object_insert_key (obj, ar, "b", 0, false);
+	ucl_object_insert_key (obj, ucl_object_fromstring ("str"), "c", 0, false);
+	ucl_object_insert_key (obj, ucl_object_fromstring ("str2"), "c", 0, false);
+	comments = ucl_object_typed_new (UCL_OBJECT);
+	ucl_comments_add (comments, ar, "# test comment");
+
+	for (fd = UCL_EMIT_JSON; fd < UCL_EMIT_MAX; fd ++) {
+		check_resumable_emit (obj, fd, comments, 7);
+		check_resumable_emit (obj, fd, comments, 1);
+	}
+
+	ucl_object_unref (obj);
+	ucl_object_unref (comments);
+}
+
+int
+main (int argc, char **argv)
+{
+	test_escapes ();
+	test_numbers ();
+	test_exact_size ();
+	test_fd_output ();
+	test_parallel ();
+	test_iovec ();
+	test_canonical ();
+	test_ndjson ();
+	test_cached ();
+	test_streamline_buffered ();
+	test_resumable ();
+
+	return 0;
+}
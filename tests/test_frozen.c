@@ -0,0 +1,164 @@
+/* Copyright (c) 2026, Vsevolod Stakhov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *       * Redistributions of source code must retain the above copyright
+ *         notice, this list of conditions and the following disclaimer.
+ *       * Redistributions in binary form must reproduce the above copyright
+ *         notice, this list of conditions and the following disclaimer in the
+ *         documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <assert.h>
+#include "ucl.h"
+
+static const char frozen_doc[] = "key0 = 0.1; key1 = test;"
+		"key4 = [9.999, 10, 10.1]; key4 = true";
+
+/*
+ * Frozen trees skip refcounting and refuse modifications
+ */
+static void
+test_frozen (void)
+{
+	ucl_object_t *obj, *cur, *ar, *test_obj;
+	const ucl_object_t *found;
+	struct ucl_parser *parser;
+	unsigned int ref_cnt;
+
+	parser = ucl_parser_new (0);
+	assert (ucl_parser_add_string (parser, frozen_doc, 0));
+	obj = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+
+	assert (ucl_object_freeze (obj) == obj);
+	assert (ucl_object_is_frozen (obj));
+	found = ucl_object_lookup (obj, "key4");
+	assert (found != NULL && ucl_object_is_frozen (found));
+	ref_cnt = found->ref;
+	cur = ucl_object_ref (found);
+	assert (cur == found && cur->ref == ref_cnt);
+	ucl_object_unref (cur);
+	assert (found->ref == ref_cnt);
+	assert (ucl_array_pop_last (cur) == NULL);
+	assert (ucl_object_pop_key (obj, "key0") == NULL);
+	assert (!ucl_object_delete_key (obj, "key1"));
+	cur = ucl_object_fromint (1);
+	assert (!ucl_object_insert_key (obj, cur, "frozen", 0, false));
+	assert (!ucl_array_append ((ucl_object_t *)found, cur));
+	ucl_object_unref (cur);
+	/* Frozen nodes are not relinked into other containers */
+	test_obj = ucl_object_typed_new (UCL_OBJECT);
+	cur = ucl_object_ref (found);
+	assert (!ucl_object_insert_key (test_obj, cur, "zz", 0, true));
+	assert (!ucl_object_replace_key (test_obj, cur, "zz", 0, true));
+	ar = ucl_object_typed_new (UCL_ARRAY);
+	assert (!ucl_array_append (ar, cur) && !ucl_array_prepend (ar, cur));
+	assert (ucl_elt_append (NULL, cur) == NULL);
+	assert (!ucl_object_merge (test_obj, obj, false));
+	ucl_object_unref (ar);
+	assert (ucl_object_insert_key (test_obj, ucl_object_copy (cur), "zz", 0, true));
+	assert (ucl_object_lookup (obj, "key4") == found);
+	assert (strcmp (ucl_object_key (found), "key4") == 0);
+	assert (found->next != NULL && found->prev != found);
+	ucl_object_unref (test_obj);
+	cur = ucl_object_copy (found);
+	assert (!ucl_object_is_frozen (cur));
+	ucl_object_unref (cur);
+	assert (ucl_object_thaw (obj) == obj);
+	assert (!ucl_object_is_frozen (obj) && !ucl_object_is_frozen (found));
+	assert (found->ref == ref_cnt);
+	ucl_object_unref (obj);
+}
+
+/*
+ * Reading frozen values writes nothing but lazy copies published to the
+ * trash stack of their nodes
+ */
+static void
+test_frozen_forced (void)
+{
+	static const char *forced[][2] = {
+		{"a", "1"}, {"b", "1.5"}, {"c", "str"}, {"d", "true"}, {"f", "object"}
+	};
+	struct ucl_parser *parser;
+	ucl_object_t *test_obj, *cur, snap;
+	size_t i;
+
+	parser = ucl_parser_new (UCL_PARSER_ZEROCOPY);
+	assert (ucl_parser_add_string (parser,
+			"a = 1; b = 1.5; c = str; d = true; e = [1, 2]; f {}", 0));
+	test_obj = ucl_parser_get_object (parser);
+	assert (ucl_array_pack ((ucl_object_t *)ucl_object_lookup (test_obj, "e")));
+	ucl_object_freeze (test_obj);
+
+	for (i = 0; i < sizeof (forced) / sizeof (forced[0]); i ++) {
+		cur = (ucl_object_t *)ucl_object_lookup (test_obj, forced[i][0]);
+		memcpy (&snap, cur, sizeof (snap));
+		assert (strcmp (ucl_object_tostring_forced (cur), forced[i][1]) == 0);
+		assert (strcmp (ucl_object_key (cur), forced[i][0]) == 0);
+		memcpy (snap.trash_stack, cur->trash_stack, sizeof (snap.trash_stack));
+		assert (memcmp (&snap, cur, sizeof (snap)) == 0);
+	}
+
+	cur = (ucl_object_t *)ucl_array_find_index (
+			ucl_object_lookup (test_obj, "e"), 1);
+	memcpy (&snap, cur, sizeof (snap));
+	assert (strcmp (ucl_object_tostring_forced (cur), "2") == 0);
+	assert (memcmp (&snap, cur, sizeof (snap)) == 0);
+	ucl_object_thaw (test_obj);
+
+	/* Thawed nodes use the published copies */
+	cur = (ucl_object_t *)ucl_object_lookup (test_obj, "c");
+	assert ((cur->flags & UCL_OBJECT_ALLOCATED_KEY) &&
+			(cur->flags & UCL_OBJECT_ALLOCATED_VALUE));
+	assert (strcmp (ucl_object_tostring (cur), "str") == 0);
+	ucl_object_unref (test_obj);
+	ucl_parser_free (parser);
+}
+
+/*
+ * A frozen subtree is released together with its mutable parent
+ */
+static void
+test_frozen_child (void)
+{
+	struct ucl_parser *parser;
+	ucl_object_t *test_obj, *cur;
+
+	parser = ucl_parser_new (0);
+	assert (ucl_parser_add_string (parser,
+			"a { b = [1, 2, str]; c { d = 1.5 } }; e = 1", 0));
+	test_obj = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+
+	cur = (ucl_object_t *)ucl_object_lookup (test_obj, "a");
+	ucl_object_freeze (cur);
+	assert (ucl_object_is_frozen (cur) && !ucl_object_is_frozen (test_obj));
+	assert (ucl_object_lookup_path (test_obj, "a.c.d") != NULL);
+	assert (ucl_object_delete_key (test_obj, "e"));
+	ucl_object_unref (test_obj);
+}
+
+int
+main (int argc, char **argv)
+{
+	test_frozen ();
+	test_frozen_forced ();
+	test_frozen_child ();
+
+	return 0;
+}
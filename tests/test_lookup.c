@@ -0,0 +1,120 @@
+/* Copyright (c) 2026, Vsevolod Stakhov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *       * Redistributions of source code must retain the above copyright
+ *         notice, this list of conditions and the following disclaimer.
+ *       * Redistributions in binary form must reproduce the above copyright
+ *         notice, this list of conditions and the following disclaimer in the
+ *         documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <assert.h>
+#include "ucl.h"
+
+static const char lookup_doc[] = "key0 = 0.1; key1 = test;"
+		"key4 = [9.999, 10, 10.1]; key4 = true; key16 = tes; \"k=3\" = true";
+
+static ucl_object_t *
+parse_string (const char *str)
+{
+	struct ucl_parser *parser;
+	ucl_object_t *obj;
+
+	parser = ucl_parser_new (0);
+	assert (ucl_parser_add_string (parser, str, 0));
+	obj = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+
+	return obj;
+}
+
+/*
+ * Several keys are looked up at once, missing keys are reported as NULL
+ */
+static void
+test_lookup_many (void)
+{
+	const char *many_keys[] = {"key0", "key100", "key16", "k=3"};
+	const ucl_object_t *many_found[4];
+	ucl_object_t *obj;
+
+	obj = parse_string (lookup_doc);
+	assert (ucl_object_lookup_many (obj, many_keys, 4, many_found) == 3);
+	assert (many_found[0] == ucl_object_lookup (obj, "key0"));
+	assert (many_found[1] == NULL);
+	assert (many_found[2] == ucl_object_lookup (obj, "key16"));
+	assert (many_found[3] == ucl_object_lookup (obj, "k=3"));
+	ucl_object_unref (obj);
+}
+
+/*
+ * Compiled paths find the same values as ucl_object_lookup_path, cached
+ * ones remember their result while a tree is frozen
+ */
+static void
+test_path (void)
+{
+	ucl_object_t *obj, *other, *ar;
+	const ucl_object_t *found;
+	struct ucl_path *path;
+
+	obj = parse_string (lookup_doc);
+	path = ucl_path_compile (".key4........1...");
+	found = ucl_path_lookup (obj, path);
+	assert (found != NULL && ucl_object_toint (found) == 10);
+	assert (found == ucl_object_lookup_path (obj, ".key4........1..."));
+	ucl_path_free (path);
+	path = ucl_path_compile ("key4.3");
+	assert (ucl_path_lookup (obj, path) == NULL);
+	ucl_path_free (path);
+	path = ucl_path_compile ("key4.1x");
+	assert (ucl_path_lookup (obj, path) == NULL);
+	ucl_path_free (path);
+	path = ucl_path_compile_full ("/key4/2", '/', UCL_PATH_CACHE);
+	found = ucl_path_lookup (obj, path);
+	assert (found != NULL && ucl_object_todouble (found) == 10.1);
+	ucl_object_freeze (obj);
+	assert (ucl_path_lookup (obj, path) == found);
+	assert (ucl_path_lookup (obj, path) == found);
+	/* Other trees do not affect cached results */
+	other = parse_string ("key4 = [1, 2, 3]");
+	ucl_object_freeze (other);
+	assert (ucl_object_toint (ucl_path_lookup (other, path)) == 3);
+	ucl_object_thaw (other);
+	assert (ucl_path_lookup (obj, path) == found);
+	/* Thawing a part of a frozen tree drops cached results */
+	ar = (ucl_object_t *)ucl_object_lookup (obj, "key4");
+	ucl_object_thaw (ar);
+	ucl_object_unref (ucl_array_pop_last (ar));
+	assert (ucl_array_append (ar, ucl_object_fromint (11)));
+	found = ucl_path_lookup (obj, path);
+	assert (found != NULL && ucl_object_toint (found) == 11);
+	ucl_object_thaw (obj);
+	assert (ucl_path_lookup (obj, path) == found);
+	ucl_path_free (path);
+	ucl_object_unref (other);
+	ucl_object_unref (obj);
+}
+
+int
+main (int argc, char **argv)
+{
+	test_lookup_many ();
+	test_path ();
+
+	return 0;
+}
@@ -0,0 +1,103 @@
+/* Copyright (c) 2026, Vsevolod Stakhov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *       * Redistributions of source code must retain the above copyright
+ *         notice, this list of conditions and the following disclaimer.
+ *       * Redistributions in binary form must reproduce the above copyright
+ *         notice, this list of conditions and the following disclaimer in the
+ *         documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <assert.h>
+#include "ucl.h"
+
+static const char query_doc[] = "store {"
+		"book [{title = a; price = 8; cat = ref},"
+		"{title = b; price = 12; cat = fiction},"
+		"{title = c; price = 9; cat = fiction; isbn = x}];"
+		"\"a/b\" = 1; \"m~n\" = 2; k = 1; k = 2; k = 3; }";
+
+int
+main (int argc, char **argv)
+{
+	ucl_object_t *test_obj;
+	const ucl_object_t *found;
+	struct ucl_parser *parser;
+	struct ucl_query *query;
+	struct ucl_query_iter *qit;
+	struct ucl_query_error qerr;
+	int64_t sum;
+
+	parser = ucl_parser_new (0);
+	assert (ucl_parser_add_string (parser, query_doc, 0));
+	test_obj = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+	query = ucl_query_compile ("/store/book/1/title", &qerr);
+	assert (query != NULL);
+	assert (strcmp (ucl_object_tostring (ucl_query_first (query, test_obj)),
+			"b") == 0);
+	ucl_query_free (query);
+	query = ucl_query_compile ("/store/a~1b", NULL);
+	assert (ucl_object_toint (ucl_query_first (query, test_obj)) == 1);
+	ucl_query_free (query);
+	query = ucl_query_compile ("/store/m~0n", NULL);
+	assert (ucl_object_toint (ucl_query_first (query, test_obj)) == 2);
+	ucl_query_free (query);
+	query = ucl_query_compile ("$.store.k[-1]", NULL);
+	assert (ucl_object_toint (ucl_query_first (query, test_obj)) == 3);
+	ucl_query_free (query);
+	query = ucl_query_compile ("$.store.book[?(@.price < 10 && "
+			"@.cat == 'fiction')].title", NULL);
+	qit = ucl_query_iterate_new (query, test_obj);
+	found = ucl_query_iterate_next (qit);
+	assert (strcmp (ucl_object_tostring (found), "c") == 0);
+	assert (ucl_query_iterate_next (qit) == NULL);
+	ucl_query_iterate_free (qit);
+	ucl_query_free (query);
+	query = ucl_query_compile ("$..price", NULL);
+	qit = ucl_query_iterate_new (query, test_obj);
+	for (sum = 0; (found = ucl_query_iterate_next (qit)) != NULL;) {
+		sum += ucl_object_toint (found);
+	}
+	assert (sum == 29);
+	ucl_query_iterate_reset (qit, test_obj);
+	assert (ucl_object_toint (ucl_query_iterate_next (qit)) == 8);
+	ucl_query_iterate_free (qit);
+	ucl_query_free (query);
+	query = ucl_query_compile ("$.store.book[::-2]['title']", NULL);
+	assert (strcmp (ucl_object_tostring (ucl_query_first (query, test_obj)),
+			"c") == 0);
+	ucl_query_free (query);
+	query = ucl_query_compile ("$..[?@.isbn].title", NULL);
+	assert (strcmp (ucl_object_tostring (ucl_query_first (query, test_obj)),
+			"c") == 0);
+	ucl_query_free (query);
+	query = ucl_query_compile ("$.store.k[1:]", NULL);
+	qit = ucl_query_iterate_new (query, test_obj);
+	for (sum = 0; (found = ucl_query_iterate_next (qit)) != NULL;) {
+		sum += ucl_object_toint (found);
+	}
+	assert (sum == 5);
+	ucl_query_iterate_free (qit);
+	ucl_query_free (query);
+	assert (ucl_query_compile ("$.store[?(@.x ==)]", &qerr) == NULL);
+	assert (qerr.msg[0] != '\0' && qerr.pos == 16);
+	assert (ucl_query_compile ("store", &qerr) == NULL);
+	ucl_object_unref (test_obj);
+
+	return 0;
+}
@@ -42,6 +42,16 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define oom abort
 #endif
 
+#ifndef utstring_malloc
+#define utstring_malloc(sz) malloc(sz)
+#endif
+#ifndef utstring_realloc
+#define utstring_realloc(ptr,sz) realloc(ptr,sz)
+#endif
+#ifndef utstring_release
+#define utstring_release(ptr) free(ptr)
+#endif
+
 typedef struct {
     char *d;
     void **pd;
@@ -52,7 +62,7 @@ typedef struct {
 #define utstring_reserve(s,amt)                            \
 do {                                                       \
   if (((s)->n - (s)->i) < (size_t)(amt)) {                 \
-     (s)->d = (char*)realloc((s)->d, (s)->n + amt);        \
+     (s)->d = (char*)utstring_realloc((s)->d, (s)->n + amt); \
      if ((s)->d == NULL) oom();                            \
      else {(s)->n += amt;                                  \
      if ((s)->pd) *((s)->pd) = (s)->d;}                    \
@@ -68,21 +78,21 @@ do {                                                       \
 
 #define utstring_done(s)                                   \
 do {                                                       \
-  if ((s)->d != NULL) free((s)->d);                        \
+  if ((s)->d != NULL) utstring_release((s)->d);            \
   (s)->n = 0;                                              \
 } while(0)
 
 #define utstring_free(s)                                   \
 do {                                                       \
   utstring_done(s);                                        \
-  free(s);                                                 \
+  utstring_release(s);                                     \
 } while(0)
 
 #define utstring_new(s)                                    \
 do {                                                       \
-   s = (UT_string*)calloc(1, sizeof(UT_string));          \
+   s = (UT_string*)utstring_malloc(sizeof(UT_string));     \
    if (!s) oom();                                          \
-   else utstring_init(s);                                  \
+   else { (s)->pd = NULL; utstring_init(s); }              \
 } while(0)
 
 #define utstring_renew(s)                                  \
@@ -342,7 +352,7 @@ _UNUSED_ static long utstring_find(
     V_HaystackLen = s->i - V_StartPosition;
     if ( (V_HaystackLen >= P_NeedleLen) && (P_NeedleLen > 0) )
     {
-        V_KMP_Table = (long *)malloc(sizeof(long) * (P_NeedleLen + 1));
+        V_KMP_Table = (long *)utstring_malloc(sizeof(long) * (P_NeedleLen + 1));
         if (V_KMP_Table != NULL)
         {
             _utstring_BuildTable(P_Needle, P_NeedleLen, V_KMP_Table);
@@ -357,7 +367,7 @@ _UNUSED_ static long utstring_find(
                 V_FindPosition += V_StartPosition;
             }
 
-            free(V_KMP_Table);
+            utstring_release(V_KMP_Table);
         }
     }
 
@@ -388,7 +398,7 @@ _UNUSED_ static long utstring_findR(
     V_HaystackLen = V_StartPosition + 1;
     if ( (V_HaystackLen >= P_NeedleLen) && (P_NeedleLen > 0) )
     {
-        V_KMP_Table = (long *)malloc(sizeof(long) * (P_NeedleLen + 1));
+        V_KMP_Table = (long *)utstring_malloc(sizeof(long) * (P_NeedleLen + 1));
         if (V_KMP_Table != NULL)
         {
             _utstring_BuildTableR(P_Needle, P_NeedleLen, V_KMP_Table);
@@ -399,7 +409,7 @@ _UNUSED_ static long utstring_findR(
                                              P_NeedleLen, 
                                              V_KMP_Table);
 
-            free(V_KMP_Table);
+            utstring_release(V_KMP_Table);
         }
     }
 
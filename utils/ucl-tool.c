@@ -32,7 +32,7 @@ void usage(const char *name, FILE *out) {
           "(default: standard output)\n");
   fprintf(out, "  --schema - specify schema file for validation\n");
   fprintf(out, "  --format - output format. Options: ucl (default), "
-          "json, compact_json, yaml, msgpack\n");
+          "json, compact_json, canonical_json, ndjson, yaml, msgpack\n");
 }
 
 int main(int argc, char **argv) {
@@ -89,6 +89,10 @@ int main(int argc, char **argv) {
           emitter = UCL_EMIT_YAML;
         } else if (strcmp(val, "compact_json") == 0) {
           emitter = UCL_EMIT_JSON_COMPACT;
+        } else if (strcmp(val, "canonical_json") == 0) {
+          emitter = UCL_EMIT_JSON_CANONICAL;
+        } else if (strcmp(val, "ndjson") == 0) {
+          emitter = UCL_EMIT_NDJSON;
         } else if (strcmp(val, "msgpack") == 0) {
           emitter = UCL_EMIT_MSGPACK;
         } else {